@@ -65,10 +65,13 @@ class LinearDiskCache
 {
 public:
 	// return number of read entries
-	u32 OpenAndRead(const char *filename, LinearDiskCacheReader<K, V> &reader)
+	// A file written with a different version is thrown away.
+	u32 OpenAndRead(const char *filename, LinearDiskCacheReader<K, V> &reader, u32 version = LINEAR_DISKCACHE_VER)
 	{
 		using std::ios_base;
 
+		m_header.ver = version;
+
 		// close any currently opened file
 		Close();
 		m_num_entries = 0;
@@ -192,7 +195,8 @@ private:
 			, value_t_size(sizeof(V))
 		{}
 
-		const u32 id, ver;
+		const u32 id;
+		u32 ver;
 		const u16 key_t_size, value_t_size;
 
 	} m_header;
@@ -0,0 +1,111 @@
+// Copyright (c) 2012- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#include "ThreadPool.h"
+#include "CPUDetect.h"
+
+// More than this rarely helps, the loops are mostly memory bound.
+#define MAX_POOL_THREADS 7
+
+ThreadPool::ThreadPool(int numThreads)
+	: quit_(false), generation_(0), loop_(0), userdata_(0),
+		lower_(0), upper_(0), numRanges_(0), nextRange_(0), rangesDone_(0) {
+	if (numThreads <= 0) {
+#if defined(_M_IX86) || defined(_M_X64)
+		numThreads = cpu_info.num_cores - 1;
+#else
+		numThreads = 1;
+#endif
+	}
+	if (numThreads > MAX_POOL_THREADS)
+		numThreads = MAX_POOL_THREADS;
+
+	for (int i = 0; i < numThreads; i++)
+		threads_.push_back(new std::thread(&ThreadPool::WorkerMain, this));
+}
+
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> guard(mutex_);
+		quit_ = true;
+		workCond_.notify_all();
+	}
+	for (size_t i = 0; i < threads_.size(); i++) {
+		threads_[i]->join();
+		delete threads_[i];
+	}
+	threads_.clear();
+}
+
+void ThreadPool::WorkerMain(ThreadPool *pool) {
+	int seenGeneration = 0;
+	std::unique_lock<std::mutex> lock(pool->mutex_);
+	while (true) {
+		while (!pool->quit_ && pool->generation_ == seenGeneration)
+			pool->workCond_.wait(lock);
+		if (pool->quit_)
+			break;
+		seenGeneration = pool->generation_;
+		pool->RunRanges(lock);
+	}
+}
+
+// Called with the lock held. Claims ranges until there are none left.
+void ThreadPool::RunRanges(std::unique_lock<std::mutex> &lock) {
+	while (nextRange_ < numRanges_) {
+		int range = nextRange_++;
+		int count = upper_ - lower_;
+		int start = lower_ + (int)((s64)count * range / numRanges_);
+		int end = lower_ + (int)((s64)count * (range + 1) / numRanges_);
+
+		lock.unlock();
+		loop_(userdata_, start, end);
+		lock.lock();
+
+		if (++rangesDone_ == numRanges_)
+			doneCond_.notify_all();
+	}
+}
+
+void ThreadPool::ParallelLoop(LoopFunc loop, void *userdata, int lower, int upper, int minRange) {
+	int numRanges = (int)threads_.size() + 1;
+	if (minRange < 1)
+		minRange = 1;
+	if (numRanges > (upper - lower) / minRange)
+		numRanges = (upper - lower) / minRange;
+
+	if (numRanges <= 1) {
+		if (upper > lower)
+			loop(userdata, lower, upper);
+		return;
+	}
+
+	std::unique_lock<std::mutex> lock(mutex_);
+	loop_ = loop;
+	userdata_ = userdata;
+	lower_ = lower;
+	upper_ = upper;
+	numRanges_ = numRanges;
+	nextRange_ = 0;
+	rangesDone_ = 0;
+	generation_++;
+	workCond_.notify_all();
+
+	RunRanges(lock);
+	while (rangesDone_ < numRanges_)
+		doneCond_.wait(lock);
+}
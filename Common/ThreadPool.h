@@ -0,0 +1,57 @@
+// Copyright (c) 2012- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#pragma once
+
+#include <vector>
+
+#include "Thread.h"
+
+// Runs the ranges of a loop on a fixed set of worker threads. The calling
+// thread takes a range too, and ParallelLoop returns once all are done.
+// Only one thread may call ParallelLoop at a time.
+class ThreadPool {
+public:
+	typedef void (*LoopFunc)(void *userdata, int lower, int upper);
+
+	// 0 threads picks one less than the number of cores.
+	ThreadPool(int numThreads = 0);
+	~ThreadPool();
+
+	void ParallelLoop(LoopFunc loop, void *userdata, int lower, int upper, int minRange = 1);
+	int NumThreads() const { return (int)threads_.size(); }
+
+private:
+	static void WorkerMain(ThreadPool *pool);
+	void RunRanges(std::unique_lock<std::mutex> &lock);
+
+	std::vector<std::thread *> threads_;
+	std::mutex mutex_;
+	std::condition_variable workCond_;
+	std::condition_variable doneCond_;
+	bool quit_;
+	int generation_;
+
+	// The loop in progress.
+	LoopFunc loop_;
+	void *userdata_;
+	int lower_;
+	int upper_;
+	int numRanges_;
+	int nextRange_;
+	int rangesDone_;
+};
@@ -17,7 +17,7 @@
 
 #include "x64Analyzer.h"
 
-bool DisassembleMov(const unsigned char *codePtr, InstructionInfo &info, int accessType)
+static bool DisassembleMovInternal(const unsigned char *codePtr, InstructionInfo &info, int accessType, bool alertOnUnknown)
 {
 	unsigned const char *startCodePtr = codePtr;
 	u8 rex = 0;
@@ -173,11 +173,16 @@ bool DisassembleMov(const unsigned char *codePtr, InstructionInfo &info, int acc
 				}
 			}
 			break;
+		case MOVE_8BIT_REG_TO_MEM: //move 8-bit reg to memory
+			info.operandSize = 1;
+			break;
+
 		case MOVE_REG_TO_MEM: //move reg to memory
 			break;
 
 		default:
-			PanicAlert("Unhandled disasm case in write handler!\n\nPlease implement or avoid.");
+			if (alertOnUnknown)
+				PanicAlert("Unhandled disasm case in write handler!\n\nPlease implement or avoid.");
 			return false;
 		}
 	}
@@ -228,3 +233,13 @@ bool DisassembleMov(const unsigned char *codePtr, InstructionInfo &info, int acc
 	info.instructionSize = (int)(codePtr - startCodePtr);
 	return true;
 }
+
+bool DisassembleMov(const unsigned char *codePtr, InstructionInfo &info, int accessType)
+{
+	return DisassembleMovInternal(codePtr, info, accessType, true);
+}
+
+bool DisassembleMovNoAlert(const unsigned char *codePtr, InstructionInfo &info, int accessType)
+{
+	return DisassembleMovInternal(codePtr, info, accessType, false);
+}
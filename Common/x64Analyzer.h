@@ -53,6 +53,7 @@ enum{
 	MOVSX_SHORT     = 0xBF, //movsx on short
 	MOVE_8BIT	    = 0xC6, //move 8-bit immediate
 	MOVE_16_32BIT   = 0xC7, //move 16 or 32-bit immediate
+	MOVE_8BIT_REG_TO_MEM = 0x88, //move 8-bit reg to memory
 	MOVE_REG_TO_MEM = 0x89, //move reg to memory
 };
 
@@ -62,5 +63,7 @@ enum AccessType{
 };
 
 bool DisassembleMov(const unsigned char *codePtr, InstructionInfo &info, int accessType);
+// Same, but just returns false on instructions it doesn't know. For use from fault handlers.
+bool DisassembleMovNoAlert(const unsigned char *codePtr, InstructionInfo &info, int accessType);
 
 #endif // _X64ANALYZER_H_
@@ -64,6 +64,10 @@ void CConfig::Load(const char *iniFileName)
 	graphics->Get("BufferedRendering", &bBufferedRendering, true);
 	graphics->Get("HardwareTransform", &bHardwareTransform, true);
 	graphics->Get("LinearFiltering", &bLinearFiltering, false);
+	graphics->Get("VertexDecoderJit", &bVertexDecoderJit, true);
+	graphics->Get("VertexCache", &bVertexCache, true);
+	graphics->Get("PatchQuality", &iPatchQuality, 1);
+	graphics->Get("SeparateGPUThread", &bSeparateGPUThread, false);
 
 	IniFile::Section *sound = iniFile.GetOrCreateSection("Sound");
 	sound->Get("Enable", &bEnableSound, true);
@@ -103,6 +107,10 @@ void CConfig::Save()
 		graphics->Set("BufferedRendering", bBufferedRendering);
 		graphics->Set("HardwareTransform", bHardwareTransform);
 		graphics->Set("LinearFiltering", bLinearFiltering);
+		graphics->Set("VertexDecoderJit", bVertexDecoderJit);
+		graphics->Set("VertexCache", bVertexCache);
+		graphics->Set("PatchQuality", iPatchQuality);
+		graphics->Set("SeparateGPUThread", bSeparateGPUThread);
 
 		IniFile::Section *sound = iniFile.GetOrCreateSection("Sound");
 		sound->Set("Enable", bEnableSound);
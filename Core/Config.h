@@ -53,6 +53,10 @@ public:
 	bool bBufferedRendering;
 	bool bDrawWireframe;
 	bool bLinearFiltering;
+	bool bVertexDecoderJit;
+	bool bVertexCache;
+	int iPatchQuality;  // 0 = half the game's patch divisions, 1 = as set by the game, 2 = double.
+	bool bSeparateGPUThread;  // Only used by the GPU backends that don't need a graphics context.
 	int iWindowZoom;  // for Windows
 
 	// Sound
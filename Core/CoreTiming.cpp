@@ -17,6 +17,8 @@
 
 
 #include <vector>
+#include <map>
+#include <algorithm>
 #include <cstdio>
 
 #include "MsgHandler.h"
@@ -48,24 +50,42 @@ struct EventType
 
 std::vector<EventType> event_types;
 
+// This is what gets saved, keep the layout.
 struct BaseEvent
 {
 	s64 time;
 	u64 userdata;
 	int type;
-//	Event *next;
 };
 
+// Only used for the threadsafe queue, which is drained into the main queue by MoveEvents.
 typedef LinkedListItem<BaseEvent> Event;
 
-Event *first;
+typedef std::multimap<std::pair<int, u64>, int> EventLookup;
+
+// Pending events live in slots, ordered by a binary min-heap of slot indices.
+// Each slot tracks its heap position so unscheduling doesn't have to search.
+struct QueuedEvent
+{
+	BaseEvent ev;
+	// Breaks ties so events for the same cycle run in the order they were scheduled.
+	u64 order;
+	int heapIndex;
+	EventLookup::iterator lookup;
+};
+
+std::vector<QueuedEvent> eventSlots;
+std::vector<int> freeEventSlots;
+std::vector<int> eventHeap;
+// Finds slots by (type, userdata), for UnscheduleEvent / RemoveEvent / IsScheduled.
+EventLookup eventLookup;
+u64 nextEventOrder = 0;
+
 Event *tsFirst;
 Event *tsLast;
 
-// event pools
-Event *eventPool = 0;
+// event pool
 Event *eventTsPool = 0;
-int allocatedTsEvents = 0;
 
 int downcount, slicelength;
 
@@ -89,39 +109,114 @@ int GetClockFrequencyMHz()
 }
 
 
-Event* GetNewEvent()
+Event* GetNewTsEvent()
 {
-	if(!eventPool)
+	if(!eventTsPool)
 		return new Event;
 
-	Event* ev = eventPool;
-	eventPool = ev->next;
+	Event* ev = eventTsPool;
+	eventTsPool = ev->next;
 	return ev;
 }
 
-Event* GetNewTsEvent()
+void FreeTsEvent(Event* ev)
 {
-	allocatedTsEvents++;
+	ev->next = eventTsPool;
+	eventTsPool = ev;
+}
 
-	if(!eventTsPool)
-		return new Event;
+inline bool EventBefore(int slotA, int slotB)
+{
+	const QueuedEvent &a = eventSlots[slotA];
+	const QueuedEvent &b = eventSlots[slotB];
+	return a.ev.time < b.ev.time || (a.ev.time == b.ev.time && a.order < b.order);
+}
 
-	Event* ev = eventTsPool;
-	eventTsPool = ev->next;
-	return ev;
+inline void SetHeapEntry(int pos, int slot)
+{
+	eventHeap[pos] = slot;
+	eventSlots[slot].heapIndex = pos;
 }
 
-void FreeEvent(Event* ev)
+void SiftUp(int pos)
 {
-	ev->next = eventPool;
-	eventPool = ev;
+	int slot = eventHeap[pos];
+	while (pos > 0)
+	{
+		int parent = (pos - 1) / 2;
+		if (!EventBefore(slot, eventHeap[parent]))
+			break;
+		SetHeapEntry(pos, eventHeap[parent]);
+		pos = parent;
+	}
+	SetHeapEntry(pos, slot);
 }
 
-void FreeTsEvent(Event* ev)
+void SiftDown(int pos)
 {
-	ev->next = eventTsPool;
-	eventTsPool = ev;
-	allocatedTsEvents--;
+	int size = (int)eventHeap.size();
+	int slot = eventHeap[pos];
+	while (true)
+	{
+		int child = pos * 2 + 1;
+		if (child >= size)
+			break;
+		if (child + 1 < size && EventBefore(eventHeap[child + 1], eventHeap[child]))
+			child++;
+		if (!EventBefore(eventHeap[child], slot))
+			break;
+		SetHeapEntry(pos, eventHeap[child]);
+		pos = child;
+	}
+	SetHeapEntry(pos, slot);
+}
+
+// Returns NULL if nothing is scheduled.  Don't hold on to it across scheduling.
+inline const BaseEvent *FirstEvent()
+{
+	if (eventHeap.empty())
+		return NULL;
+	return &eventSlots[eventHeap[0]].ev;
+}
+
+void AddEventToQueue(const BaseEvent &ev)
+{
+	int slot;
+	if (freeEventSlots.empty())
+	{
+		slot = (int)eventSlots.size();
+		eventSlots.push_back(QueuedEvent());
+	}
+	else
+	{
+		slot = freeEventSlots.back();
+		freeEventSlots.pop_back();
+	}
+
+	QueuedEvent &qe = eventSlots[slot];
+	qe.ev = ev;
+	qe.order = nextEventOrder++;
+	qe.lookup = eventLookup.insert(std::make_pair(std::make_pair(ev.type, ev.userdata), slot));
+
+	eventHeap.push_back(slot);
+	SiftUp((int)eventHeap.size() - 1);
+}
+
+void RemoveEventFromQueue(int slot)
+{
+	QueuedEvent &qe = eventSlots[slot];
+	int pos = qe.heapIndex;
+	eventLookup.erase(qe.lookup);
+	freeEventSlots.push_back(slot);
+
+	int last = eventHeap.back();
+	eventHeap.pop_back();
+	if (pos < (int)eventHeap.size())
+	{
+		SetHeapEntry(pos, last);
+		SiftDown(pos);
+		SiftUp(eventSlots[last].heapIndex);
+	}
 }
 
 int RegisterEvent(const char *name, TimedCallback callback)
@@ -146,7 +241,7 @@ void RestoreRegisterEvent(int event_type, const char *name, TimedCallback callba
 
 void UnregisterAllEvents()
 {
-	if (first)
+	if (!eventHeap.empty())
 		PanicAlert("Cannot unregister events with events pending");
 	event_types.clear();
 }
@@ -165,13 +260,6 @@ void Shutdown()
 	ClearPendingEvents();
 	UnregisterAllEvents();
 
-	while(eventPool)
-	{
-		Event *ev = eventPool;
-		eventPool = ev->next;
-		delete ev;
-	}
-
 	std::lock_guard<std::recursive_mutex> lk(externalEventSection);
 	while(eventTsPool)
 	{
@@ -224,30 +312,11 @@ void ScheduleEvent_Threadsafe_Immediate(int event_type, u64 userdata)
 
 void ClearPendingEvents()
 {
-	while (first)
-	{
-		Event *e = first->next;
-		FreeEvent(first);
-		first = e;
-	}
-}
-
-void AddEventToQueue(Event* ne)
-{
-	Event* prev = NULL;
-	Event** pNext = &first;
-	for(;;)
-	{
-		Event*& next = *pNext;
-		if(!next || ne->time < next->time)
-		{
-			ne->next = next;
-			next = ne;
-			break;
-		}
-		prev = next;
-		pNext = &prev->next;
-	}
+	eventSlots.clear();
+	freeEventSlots.clear();
+	eventHeap.clear();
+	eventLookup.clear();
+	nextEventOrder = 0;
 }
 
 // This must be run ONLY from within the cpu thread
@@ -255,10 +324,10 @@ void AddEventToQueue(Event* ne)
 // than Advance 
 void ScheduleEvent(s64 cyclesIntoFuture, int event_type, u64 userdata)
 {
-	Event *ne = GetNewEvent();
-	ne->userdata = userdata;
-	ne->type = event_type;
-	ne->time = GetTicks() + cyclesIntoFuture;
+	BaseEvent ne;
+	ne.userdata = userdata;
+	ne.type = event_type;
+	ne.time = GetTicks() + cyclesIntoFuture;
 	AddEventToQueue(ne);
 }
 
@@ -266,42 +335,13 @@ void ScheduleEvent(s64 cyclesIntoFuture, int event_type, u64 userdata)
 u64 UnscheduleEvent(int event_type, u64 userdata)
 {
 	u64 result = 0;
-	if (!first)
-		return result;
-	while(first)
+	EventLookup::iterator iter = eventLookup.find(std::make_pair(event_type, userdata));
+	while (iter != eventLookup.end() && iter->first.first == event_type && iter->first.second == userdata)
 	{
-		if (first->type == event_type && first->userdata == userdata)
-		{
-			result = first->time - globalTimer;
-
-			Event *next = first->next;
-			FreeEvent(first);
-			first = next;
-		}
-		else
-		{
-			break;
-		}
-	}
-	if (!first)
-		return result;
-	Event *prev = first;
-	Event *ptr = prev->next;
-	while (ptr)
-	{
-		if (ptr->type == event_type && ptr->userdata == userdata)
-		{
-			result = ptr->time - globalTimer;
-
-			prev->next = ptr->next;
-			FreeEvent(ptr);
-			ptr = prev->next;
-		}
-		else
-		{
-			prev = ptr;
-			ptr = ptr->next;
-		}
+		int slot = iter->second;
+		++iter;
+		result = eventSlots[slot].ev.time - globalTimer;
+		RemoveEventFromQueue(slot);
 	}
 
 	return result;
@@ -315,51 +355,18 @@ void RegisterAdvanceCallback(void (*callback)(int cyclesExecuted))
 
 bool IsScheduled(int event_type) 
 {
-	if (!first)
-		return false;
-	Event *e = first;
-	while (e) {
-		if (e->type == event_type)
-			return true;
-		e = e->next;
-	}
-	return false;
+	EventLookup::iterator iter = eventLookup.lower_bound(std::make_pair(event_type, (u64)0));
+	return iter != eventLookup.end() && iter->first.first == event_type;
 }
 
 void RemoveEvent(int event_type)
 {
-	if (!first)
-		return;
-	while(first)
-	{
-		if (first->type == event_type)
-		{
-			Event *next = first->next;
-			FreeEvent(first);
-			first = next;
-		}
-		else
-		{
-			break;
-		}
-	}
-	if (!first)
-		return;
-	Event *prev = first;
-	Event *ptr = prev->next;
-	while (ptr)
+	EventLookup::iterator iter = eventLookup.lower_bound(std::make_pair(event_type, (u64)0));
+	while (iter != eventLookup.end() && iter->first.first == event_type)
 	{
-		if (ptr->type == event_type)
-		{
-			prev->next = ptr->next;
-			FreeEvent(ptr);
-			ptr = prev->next;
-		}
-		else
-		{
-			prev = ptr;
-			ptr = ptr->next;
-		}
+		int slot = iter->second;
+		++iter;
+		RemoveEventFromQueue(slot);
 	}
 }
 
@@ -416,19 +423,15 @@ void ProcessFifoWaitEvents()
 {
 	MoveEvents();
 
-	if (!first)
-		return;
-
-	while (first)
+	while (!eventHeap.empty())
 	{
-		if (first->time <= globalTimer)
+		int slot = eventHeap[0];
+		if (eventSlots[slot].ev.time <= globalTimer)
 		{
-//			LOG(CPU, "[Scheduler] %s		 (%lld, %lld) ", 
-//				first->name ? first->name : "?", (u64)globalTimer, (u64)first->time);
-			Event* evt = first;
-			first = first->next;
-			event_types[evt->type].callback(evt->userdata, (int)(globalTimer - evt->time));
-			FreeEvent(evt);
+			// Copy it out, the callback may schedule more events and move the slots.
+			BaseEvent evt = eventSlots[slot].ev;
+			RemoveEventFromQueue(slot);
+			event_types[evt.type].callback(evt.userdata, (int)(globalTimer - evt.time));
 		}
 		else
 		{
@@ -440,24 +443,15 @@ void ProcessFifoWaitEvents()
 void MoveEvents()
 {
 	std::lock_guard<std::recursive_mutex> lk(externalEventSection);
-		// Move events from async queue into main queue
+	// Move events from async queue into main queue
 	while (tsFirst)
 	{
 		Event *next = tsFirst->next;
-		AddEventToQueue(tsFirst);
+		AddEventToQueue(*tsFirst);
+		FreeTsEvent(tsFirst);
 		tsFirst = next;
 	}
 	tsLast = NULL;
-
-	// Move free events to threadsafe pool
-	while(allocatedTsEvents > 0 && eventPool)
-	{
-		Event *ev = eventPool;
-		eventPool = ev->next;
-		ev->next = eventTsPool;
-		eventTsPool = ev;
-		allocatedTsEvents--;
-	}
 }
 
 void Advance()
@@ -468,6 +462,7 @@ void Advance()
 
 	ProcessFifoWaitEvents();
 
+	const BaseEvent *first = FirstEvent();
 	if (!first)
 	{
 		// WARN_LOG(CPU, "WARNING - no events in queue. Setting downcount to 10000");
@@ -484,13 +479,25 @@ void Advance()
 		advanceCallback(cyclesExecuted);
 }
 
+// Pending events in the order they will fire.
+void GetSortedEvents(std::vector<BaseEvent> &events)
+{
+	std::vector<int> slots = eventHeap;
+	std::sort(slots.begin(), slots.end(), EventBefore);
+
+	events.clear();
+	events.reserve(slots.size());
+	for (size_t i = 0; i < slots.size(); ++i)
+		events.push_back(eventSlots[slots[i]].ev);
+}
+
 void LogPendingEvents()
 {
-	Event *ptr = first;
-	while (ptr)
+	std::vector<BaseEvent> events;
+	GetSortedEvents(events);
+	for (size_t i = 0; i < events.size(); ++i)
 	{
-		//INFO_LOG(CPU, "PENDING: Now: %lld Pending: %lld Type: %d", globalTimer, ptr->time, ptr->type);
-		ptr = ptr->next;
+		//INFO_LOG(CPU, "PENDING: Now: %lld Pending: %lld Type: %d", globalTimer, events[i].time, events[i].type);
 	}
 }
 
@@ -500,6 +507,7 @@ void Idle(int maxIdle)
 	if (maxIdle != 0 && cyclesDown > maxIdle)
 		cyclesDown = maxIdle;
 
+	const BaseEvent *first = FirstEvent();
 	if (first && cyclesDown > 0)
 	{
 		int cyclesExecuted = slicelength - downcount;
@@ -524,11 +532,14 @@ void Idle(int maxIdle)
 
 std::string GetScheduledEventsSummary()
 {
-	Event *ptr = first;
+	std::vector<BaseEvent> events;
+	GetSortedEvents(events);
+
 	std::string text = "Scheduled events\n";
 	text.reserve(1000);
-	while (ptr)
+	for (size_t i = 0; i < events.size(); ++i)
 	{
+		const BaseEvent *ptr = &events[i];
 		unsigned int t = ptr->type;
 		if (t >= event_types.size())
 			PanicAlert("Invalid event type"); // %i", t);
@@ -538,7 +549,6 @@ std::string GetScheduledEventsSummary()
 		char temp[512];
 		sprintf(temp, "%s : %i %08x%08x\n", name, (int)ptr->time, (u32)(ptr->userdata >> 32), (u32)(ptr->userdata));
 		text += temp;
-		ptr = ptr->next;
 	}
 	return text;
 }
@@ -548,6 +558,39 @@ void Event_DoState(PointerWrap &p, BaseEvent *ev)
 	p.Do(*ev);
 }
 
+// Same format as DoLinkedList, which was used when the queue was a list.
+void DoEventQueue(PointerWrap &p)
+{
+	if (p.mode == p.MODE_READ)
+	{
+		ClearPendingEvents();
+		while (true)
+		{
+			u8 shouldExist = 0;
+			p.Do(shouldExist);
+			if (shouldExist != 1)
+				break;
+
+			BaseEvent ev;
+			Event_DoState(p, &ev);
+			AddEventToQueue(ev);
+		}
+	}
+	else
+	{
+		std::vector<BaseEvent> events;
+		GetSortedEvents(events);
+		for (size_t i = 0; i < events.size(); ++i)
+		{
+			u8 shouldExist = 1;
+			p.Do(shouldExist);
+			Event_DoState(p, &events[i]);
+		}
+		u8 shouldExist = 0;
+		p.Do(shouldExist);
+	}
+}
+
 void DoState(PointerWrap &p)
 {
 	std::lock_guard<std::recursive_mutex> lk(externalEventSection);
@@ -557,7 +600,7 @@ void DoState(PointerWrap &p)
 	// These (should) be filled in later by the modules.
 	event_types.resize(n, EventType(AntiCrashCallback, "INVALID EVENT"));
 
-	p.DoLinkedList<BaseEvent, GetNewEvent, FreeEvent, Event_DoState>(first, (Event **) NULL);
+	DoEventQueue(p);
 	p.DoLinkedList<BaseEvent, GetNewTsEvent, FreeTsEvent, Event_DoState>(tsFirst, &tsLast);
 
 	p.Do(CPU_HZ);
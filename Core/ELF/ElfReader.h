@@ -42,6 +42,7 @@ class ElfReader
 	bool bRelocate;
 	u32 entryPoint;
 	u32 vaddr;
+	u32 totalSize;
 	u32 segmentVAddr[32];
 public:
 	ElfReader(void *ptr)
@@ -52,6 +53,7 @@ public:
 		header = (Elf32_Ehdr*)ptr;
 		segments = (Elf32_Phdr *)(base + header->e_phoff);
 		sections = (Elf32_Shdr *)(base + header->e_shoff);
+		totalSize = 0;
 	}
 
 	~ElfReader()
@@ -119,6 +121,11 @@ public:
 		return vaddr;
 	}
 
+	u32 GetTotalSize()
+	{
+		return totalSize;
+	}
+
 	// More indepth stuff:)
 	bool LoadInto(u32 vaddr);
 	bool LoadSymbols();
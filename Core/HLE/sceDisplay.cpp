@@ -132,6 +132,7 @@ void __DisplayDoState(PointerWrap &p) {
 	p.Do(leaveVblankEvent);
 	CoreTiming::RestoreRegisterEvent(leaveVblankEvent, "LeaveVBlank", &hleLeaveVblank);
 
+	gpu->SyncThread();
 	p.Do(gstate);
 	p.Do(gstate_c);
 	p.Do(gpuStats);
@@ -184,6 +185,8 @@ void hleEnterVblank(u64 userdata, int cyclesLate) {
 
 	// Trigger VBlank interrupt handlers.
 	__TriggerInterrupt(PSP_INTR_IMMEDIATE | PSP_INTR_ONLY_IF_ENABLED, PSP_VBLANK_INTR);
+	// Don't leave list interrupts from a GPU thread waiting for the next sceGe call.
+	gpu->ProcessEvents(PSP_INTR_IMMEDIATE);
 
 	CoreTiming::ScheduleEvent(msToCycles(vblankMs) - cyclesLate, leaveVblankEvent, vbCount+1);
 
@@ -206,12 +209,17 @@ void hleEnterVblank(u64 userdata, int cyclesLate) {
 
 	// Now we can subvert the Ge engine in order to draw custom overlays like stat counters etc.
 	// Here we will be drawing to the non buffered front surface.
+	if (g_Config.bShowDebugStats) {
+		// The GPU thread does the counting, so let it finish before reading the counters.
+		gpu->SyncThread();
+	}
 	if (g_Config.bShowDebugStats && gpuStats.numDrawCalls) {
 		gpu->UpdateStats();
-		char stats[512];
+		char stats[768];
 		sprintf(stats,
 			"Frames: %i\n"
 			"Draw calls: %i\n"
+			"Draw joins: %i\n"
 			"Draw flushes: %i\n"
 			"Vertices Transformed: %i\n"
 			"Textures active: %i\n"
@@ -219,9 +227,12 @@ void hleEnterVblank(u64 userdata, int cyclesLate) {
 			"Texture invalidations: %i\n"
 			"Vertex shaders loaded: %i\n"
 			"Fragment shaders loaded: %i\n"
-			"Combined shaders loaded: %i\n",
+			"Combined shaders loaded: %i\n"
+			"Vertex decoders: %i (%i hits, %i misses)\n"
+			"Patches tessellated: %i\n",
 			gpuStats.numFrames,
 			gpuStats.numDrawCalls,
+			gpuStats.numJoins,
 			gpuStats.numFlushes,
 			gpuStats.numVertsTransformed,
 			gpuStats.numTextures,
@@ -229,15 +240,19 @@ void hleEnterVblank(u64 userdata, int cyclesLate) {
 			gpuStats.numTextureInvalidations,
 			gpuStats.numVertexShaders,
 			gpuStats.numFragmentShaders,
-			gpuStats.numShaders
+			gpuStats.numShaders,
+			gpuStats.numVertexDecoders,
+			gpuStats.numVertexDecoderHits,
+			gpuStats.numVertexDecoderMisses,
+			gpuStats.numPatchesTessellated
 			);
+		// Before PPGe gives the GPU thread something to count again.
+		gpuStats.resetFrame();
 
 		float zoom = 0.5f; /// g_Config.iWindowZoom;
 		PPGeBegin();
 		PPGeDrawText(stats, 0, 0, 0, zoom, 0xFFc0c0c0);
 		PPGeEnd();
-
-		gpuStats.resetFrame();
 	}
 
 	host->EndFrame();
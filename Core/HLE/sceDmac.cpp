@@ -17,12 +17,17 @@
 
 #include "Globals.h"
 #include "HLE.h"
+#include "../../GPU/GPUInterface.h"
+#include "../../GPU/GPUState.h"
 
 u32 sceDmacMemcpy(u32 dst, u32 src, u32 size)
 {
 	DEBUG_LOG(HLE, "sceDmacMemcpy(dest=%08x, src=%08x, size=%i)", dst, src, size);
 	// TODO: check the addresses.
 	Memory::Memcpy(dst, Memory::GetPointer(src), size);
+	// DMA doesn't go through the dcache, so games won't write it back before drawing from it.
+	if (size != 0)
+		gpu->InvalidateCache(dst, size);
 	return 0;
 }
 
@@ -46,8 +46,8 @@ void __GeShutdown()
 
 }
 
-// The GE is implemented wrong - it should be parallel to the CPU execution instead of
-// synchronous.
+// The GE only runs in parallel to the CPU with SeparateGPUThread on, and then it's only
+// caught up with at the syncs below. Otherwise lists run synchronously when enqueued.
 
 u32 sceGeEdramGetAddr()
 {
@@ -94,6 +94,7 @@ u32 sceGeListEnQueue(u32 listAddress, u32 stallAddress, int callbackId,
 	//if (!stallAddress)
 	//	stallAddress = listAddress;
 	u32 listID = gpu->EnqueueList(listAddress, stallAddress, __GeSubIntrBase(callbackId), false);
+	gpu->ProcessEvents(PSP_INTR_HLE);
 
 	DEBUG_LOG(HLE, "List %i enqueued.", listID);
 	//return display list ID
@@ -109,6 +110,7 @@ u32 sceGeListEnQueueHead(u32 listAddress, u32 stallAddress, int callbackId,
 	//if (!stallAddress)
 	//	stallAddress = listAddress;
 	u32 listID = gpu->EnqueueList(listAddress, stallAddress, __GeSubIntrBase(callbackId), true);
+	gpu->ProcessEvents(PSP_INTR_HLE);
 
 	DEBUG_LOG(HLE, "List %i enqueued.", listID);
 	//return display list ID
@@ -127,12 +129,15 @@ int sceGeListUpdateStallAddr(u32 displayListID, u32 stallAddress)
 			displayListID, stallAddress);
 
 	gpu->UpdateStall(displayListID, stallAddress);
+	gpu->ProcessEvents(PSP_INTR_HLE);
 	return 0;
 }
 
 int sceGeListSync(u32 displayListID, u32 mode) //0 : wait for completion		1:check and return
 {
 	DEBUG_LOG(HLE, "sceGeListSync(dlid=%08x, mode=%08x)", displayListID, mode);
+	gpu->SyncThread();
+	gpu->ProcessEvents(PSP_INTR_HLE);
 	if(mode == 1) {
 		return gpu->listStatus(displayListID);
 	}
@@ -144,6 +149,8 @@ u32 sceGeDrawSync(u32 mode)
 	//wait/check entire drawing state
 	DEBUG_LOG(HLE, "FAKE sceGeDrawSync(mode=%d)  (0=wait for completion)",
 			mode);
+	gpu->SyncThread();
+	gpu->ProcessEvents(PSP_INTR_HLE);
 	gpu->DrawSync(mode);
 	return 0;
 }
@@ -231,6 +238,7 @@ int sceGeUnsetCallback(u32 cbID)
 u32 sceGeSaveContext(u32 ctxAddr)
 {
 	DEBUG_LOG(HLE, "sceGeSaveContext(%08x)", ctxAddr);
+	gpu->SyncThread();
 	gpu->Flush();
 	if (sizeof(gstate) > 512 * 4)
 	{
@@ -252,6 +260,7 @@ u32 sceGeSaveContext(u32 ctxAddr)
 u32 sceGeRestoreContext(u32 ctxAddr)
 {
 	DEBUG_LOG(HLE, "sceGeRestoreContext(%08x)", ctxAddr);
+	gpu->SyncThread();
 	gpu->Flush();
 
 	if (sizeof(gstate) > 512 * 4)
@@ -277,6 +286,7 @@ int sceGeGetMtx(int type, u32 matrixPtr)
 	}
 
 	INFO_LOG(HLE, "sceGeGetMtx(%d, %08x)", type, matrixPtr);
+	gpu->SyncThread();
 	switch (type) {
 	case GE_MTX_BONE0:
 	case GE_MTX_BONE1:
@@ -310,6 +320,7 @@ int sceGeGetMtx(int type, u32 matrixPtr)
 u32 sceGeGetCmd(int cmd)
 {
 	INFO_LOG(HLE, "sceGeGetCmd(%i)", cmd);
+	gpu->SyncThread();
 	return gstate.cmdmem[cmd];  // Does not mask away the high bits.
 }
 
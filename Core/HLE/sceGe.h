@@ -46,3 +46,8 @@ u32 sceGeRestoreContext(u32 ctxAddr);
 u32 sceGeSaveContext(u32 ctxAddr);
 
 u32 sceGeListEnQueue(u32 listAddress, u32 stallAddress, int callbackId, u32 optParamAddr);
+
+// And for the unit tests.
+int sceGeListUpdateStallAddr(u32 displayListID, u32 stallAddress);
+int sceGeListSync(u32 displayListID, u32 mode);
+u32 sceGeDrawSync(u32 mode);
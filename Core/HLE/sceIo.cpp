@@ -26,6 +26,8 @@
 #include "HLE.h"
 #include "../MIPS/MIPS.h"
 #include "../HW/MemoryStick.h"
+#include "../../GPU/GPUInterface.h"
+#include "../../GPU/GPUState.h"
 
 #include "../FileSystems/FileSystem.h"
 #include "../FileSystems/MetaFileSystem.h"
@@ -304,6 +306,10 @@ u32 sceIoRead(int id, u32 data_addr, int size) {
 			u8 *data = (u8*) Memory::GetPointer(data_addr);
 			f->asyncResult = (u32) pspFileSystem.ReadFile(f->handle, data,
 					size);
+			// Like DMA, this never passes through the dcache, so textures loaded
+			// this way get no writeback to invalidate them.
+			if ((s32) f->asyncResult > 0)
+				gpu->InvalidateCache(data_addr, (int) f->asyncResult);
 			DEBUG_LOG(HLE, "%i=sceIoRead(%d, %08x , %i)", f->asyncResult, id,
 					data_addr, size);
 			return f->asyncResult;
@@ -257,8 +257,11 @@ int sceKernelDcacheInvalidateRange(u32 addr, int size)
 		if ((addr % 64) != 0 || (size % 64) != 0)
 			return SCE_KERNEL_ERROR_CACHE_ALIGNMENT;
 
-		if (addr != 0)
+		if (addr != 0) {
+			// The CPU is about to read this, so whatever the GPU thread is drawing has to land first.
+			gpu->SyncThread();
 			gpu->InvalidateCache(addr, size);
+		}
 	}
 	return 0;
 }
@@ -285,12 +288,14 @@ int sceKernelDcacheWritebackInvalidateRange(u32 addr, int size)
 		return SCE_KERNEL_ERROR_INVALID_SIZE;
 
 	if (size > 0 && addr != 0) {
+		gpu->SyncThread();
 		gpu->InvalidateCache(addr, size);
 	}
 	return 0;
 }
 int sceKernelDcacheWritebackInvalidateAll()
 {
+	gpu->SyncThread();
 	gpu->InvalidateCacheHint(0, -1);
 	return 0;
 }
@@ -460,16 +465,26 @@ KernelObject *KernelObjectPool::CreateByIDType(int type)
 	}
 }
 
+int sceKernelIcacheInvalidateRange(u32 addr, int size)
+{
+	DEBUG_LOG(CPU, "sceKernelIcacheInvalidateRange(%08x, %i)", addr, size);
+	if (size > 0 && addr != 0)
+		currentMIPS->InvalidateICache(addr, size);
+	return 0;
+}
+
 void sceKernelIcacheInvalidateAll()
 {
-	DEBUG_LOG(CPU, "Icache invalidated - should clear JIT someday");
+	DEBUG_LOG(CPU, "Icache invalidated");
+	currentMIPS->InvalidateICache(PSP_GetKernelMemoryBase(), Memory::RAM_SIZE);
 	RETURN(0);
 }
 
 
 void sceKernelIcacheClearAll()
 {
-	DEBUG_LOG(CPU, "Icache cleared - should clear JIT someday");
+	DEBUG_LOG(CPU, "Icache cleared");
+	currentMIPS->InvalidateICache(PSP_GetKernelMemoryBase(), Memory::RAM_SIZE);
 	RETURN(0);
 }
 
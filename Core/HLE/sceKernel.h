@@ -301,6 +301,7 @@ int sceKernelDcacheWritebackRange(u32 addr, int size);
 int sceKernelDcacheWritebackInvalidateRange(u32 addr, int size);
 int sceKernelDcacheWritebackInvalidateAll();
 void sceKernelGetThreadStackFreeSize();
+int sceKernelIcacheInvalidateRange(u32 addr, int size);
 void sceKernelIcacheInvalidateAll();
 void sceKernelIcacheClearAll();
 
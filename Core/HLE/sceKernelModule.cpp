@@ -307,6 +307,8 @@ Module *__KernelLoadELFFromPtr(const u8 *ptr, u32 loadAddress, std::string *erro
 		return 0;
 	}
 	module->memoryBlockAddr = reader.GetVaddr();
+	// Whatever was compiled from this memory before is stale now.
+	currentMIPS->InvalidateICache(module->memoryBlockAddr, reader.GetTotalSize());
 
 	struct libent
 	{
@@ -18,6 +18,10 @@
 #include <set>
 #include <map>
 #include <queue>
+#include <deque>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
 
 #include "HLE.h"
 #include "HLETables.h"
@@ -462,11 +466,119 @@ public:
 	u32 stackBlock;
 };
 
+// Ready threads bucketed by priority.  A bitmap of non-empty buckets makes
+// finding the best ready thread O(1), regardless of how many threads exist.
+struct ThreadQueueList
+{
+	enum {
+		NUM_QUEUES = 128,
+		NUM_BITMAP_WORDS = NUM_QUEUES / 32,
+	};
+
+	ThreadQueueList()
+	{
+		clear();
+	}
+
+	static int queueIndex(int priority)
+	{
+		// Games may set bogus priorities, the lowest queue catches them all.
+		if (priority < 0)
+			return 0;
+		if (priority >= NUM_QUEUES)
+			return NUM_QUEUES - 1;
+		return priority;
+	}
+
+	void push_back(int priority, SceUID threadID)
+	{
+		int q = queueIndex(priority);
+		queues[q].push_back(threadID);
+		bitmap[q >> 5] |= 1 << (q & 31);
+	}
+
+	void remove(int priority, SceUID threadID)
+	{
+		int q = queueIndex(priority);
+		std::deque<SceUID> &queue = queues[q];
+		for (std::deque<SceUID>::iterator iter = queue.begin(), end = queue.end(); iter != end; ++iter)
+		{
+			if (*iter == threadID)
+			{
+				queue.erase(iter);
+				break;
+			}
+		}
+		if (queue.empty())
+			bitmap[q >> 5] &= ~(1 << (q & 31));
+	}
+
+	// Slow path for when the priority isn't known.
+	void remove(SceUID threadID)
+	{
+		for (int q = 0; q < NUM_QUEUES; ++q)
+		{
+			if (!queues[q].empty())
+				remove(q, threadID);
+		}
+	}
+
+	// Returns the first thread of the best priority, and moves it to the back of its queue
+	// so threads of equal priority take turns.  Returns 0 if nothing is ready.
+	// The current thread only gets picked again if nothing else of its priority is ready.
+	SceUID pop_rotate(SceUID current)
+	{
+		for (int i = 0; i < NUM_BITMAP_WORDS; ++i)
+		{
+			if (bitmap[i] == 0)
+				continue;
+
+			std::deque<SceUID> &queue = queues[i * 32 + lowestBit(bitmap[i])];
+			if (queue.front() == current && queue.size() > 1)
+			{
+				queue.pop_front();
+				queue.push_back(current);
+			}
+			SceUID threadID = queue.front();
+			if (queue.size() > 1)
+			{
+				queue.pop_front();
+				queue.push_back(threadID);
+			}
+			return threadID;
+		}
+		return 0;
+	}
+
+	void clear()
+	{
+		for (int i = 0; i < NUM_QUEUES; ++i)
+			queues[i].clear();
+		memset(bitmap, 0, sizeof(bitmap));
+	}
+
+	static int lowestBit(u32 mask)
+	{
+#ifdef _MSC_VER
+		unsigned long index;
+		_BitScanForward(&index, mask);
+		return (int)index;
+#else
+		return __builtin_ctz(mask);
+#endif
+	}
+
+	std::deque<SceUID> queues[NUM_QUEUES];
+	u32 bitmap[NUM_BITMAP_WORDS];
+};
+
 void __KernelExecuteMipsCallOnCurrentThread(int callId, bool reschedAfter);
 
 
 Thread *__KernelCreateThread(SceUID &id, SceUID moduleID, const char *name, u32 entryPoint, u32 priority, int stacksize, u32 attr);
 void __KernelResetThread(Thread *t);
+void __KernelSetThreadStatus(Thread *t, u32 status);
+void __KernelRebuildReadyQueue();
 void __KernelCancelWakeup(SceUID threadID);
 void __KernelCancelThreadEndTimeout(SceUID threadID);
 bool __KernelCheckThreadCallbacks(Thread *thread, bool force);
@@ -481,6 +593,8 @@ u32 threadReturnHackAddr;
 u32 cbReturnHackAddr;
 u32 intReturnHackAddr;
 std::vector<SceUID> threadqueue;
+// Not saved, rebuilt from thread statuses on load.
+ThreadQueueList threadReadyQueue;
 std::vector<ThreadCallback> threadEndListeners;
 
 SceUID threadIdleID[2];
@@ -628,6 +742,8 @@ void __KernelThreadingDoState(PointerWrap &p)
 	p.Do(currentThread);
 	SceUID dv = 0;
 	p.Do(threadqueue, dv);
+	if (p.mode == p.MODE_READ)
+		__KernelRebuildReadyQueue();
 	p.DoArray(threadIdleID, ARRAY_SIZE(threadIdleID));
 	p.Do(dispatchEnabled);
 	p.Do(curModule);
@@ -685,7 +801,7 @@ void __KernelStartIdleThreads()
 		t->nt.gpreg = __KernelGetModuleGP(curModule);
 		t->context.r[MIPS_REG_GP] = t->nt.gpreg;
 		//t->context.pc += 4;	// ADJUSTPC
-		t->nt.status = THREADSTATUS_READY;
+		__KernelSetThreadStatus(t, THREADSTATUS_READY);
 	}
 }
 
@@ -730,6 +846,7 @@ void __KernelThreadingShutdown()
 {
 	kernelMemory.Free(threadReturnHackAddr);
 	threadqueue.clear();
+	threadReadyQueue.clear();
 	threadEndListeners.clear();
 	mipsCalls.clear();
 	threadReturnHackAddr = 0;
@@ -1101,32 +1218,30 @@ void __KernelCancelThreadEndTimeout(SceUID threadID)
 	CoreTiming::UnscheduleEvent(eventThreadEndTimeout, threadID);
 }
 
-void __KernelRemoveFromThreadQueue(Thread *t)
+void __KernelSetThreadStatus(Thread *t, u32 status)
 {
-	for (size_t i = 0; i < threadqueue.size(); i++)
+	bool wasReady = t->isReady();
+	t->nt.status = status;
+	if (wasReady != t->isReady())
 	{
-		if (threadqueue[i] == t->GetUID())
-		{
-			DEBUG_LOG(HLE, "Deleted thread %p (%i) from thread queue", t, t->GetUID());
-			threadqueue.erase(threadqueue.begin() + i);
-			return;
-		}
+		if (wasReady)
+			threadReadyQueue.remove(t->nt.currentPriority, t->GetUID());
+		else
+			threadReadyQueue.push_back(t->nt.currentPriority, t->GetUID());
 	}
 }
 
-Thread *__KernelNextThread() {
-	// round-robin scheduler
-	// seems to work ?
-	// not accurate!
-	int bestthread = -1;
-	int prio = 0xffffff;
+void __KernelRebuildReadyQueue()
+{
+	threadReadyQueue.clear();
 
-	int next = 0;
+	// Start after the current thread so it's the last of its priority to run again.
+	size_t start = 0;
 	for (size_t i = 0; i < threadqueue.size(); i++)
 	{
-		if (currentThread == threadqueue[i])
+		if (threadqueue[i] == currentThread)
 		{
-			next = (int)i;
+			start = i + 1;
 			break;
 		}
 	}
@@ -1134,23 +1249,44 @@ Thread *__KernelNextThread() {
 	u32 error;
 	for (size_t i = 0; i < threadqueue.size(); i++)
 	{
-		next = (next + 1) % threadqueue.size();
+		SceUID threadID = threadqueue[(start + i) % threadqueue.size()];
+		Thread *t = kernelObjects.Get<Thread>(threadID, error);
+		if (t && t->isReady())
+			threadReadyQueue.push_back(t->nt.currentPriority, threadID);
+	}
+}
 
-		Thread *t = kernelObjects.Get<Thread>(threadqueue[next], error);
-		if (t && t->nt.currentPriority < prio)
+void __KernelRemoveFromThreadQueue(Thread *t)
+{
+	if (t->isReady())
+		threadReadyQueue.remove(t->nt.currentPriority, t->GetUID());
+
+	for (size_t i = 0; i < threadqueue.size(); i++)
+	{
+		if (threadqueue[i] == t->GetUID())
 		{
-			if (t->nt.status & THREADSTATUS_READY)
-			{
-				bestthread = next;
-				prio = t->nt.currentPriority;
-			}
+			DEBUG_LOG(HLE, "Deleted thread %p (%i) from thread queue", t, t->GetUID());
+			threadqueue.erase(threadqueue.begin() + i);
+			return;
 		}
 	}
+}
 
-	if (bestthread != -1)
-		return kernelObjects.Get<Thread>(threadqueue[bestthread], error);
-	else
-		return 0;
+Thread *__KernelNextThread() {
+	// Round-robin within the best ready priority.
+	u32 error;
+	SceUID bestThread;
+	while ((bestThread = threadReadyQueue.pop_rotate(currentThread)) != 0)
+	{
+		Thread *t = kernelObjects.Get<Thread>(bestThread, error);
+		if (t)
+			return t;
+
+		// Deleted without going through the thread functions, drop it.
+		ERROR_LOG(HLE, "Ready queue contained deleted thread %i", bestThread);
+		threadReadyQueue.remove(bestThread);
+	}
+	return 0;
 }
 
 void __KernelReSchedule(const char *reason)
@@ -1331,7 +1467,7 @@ void __KernelSetupRootThread(SceUID moduleID, int args, const char *argp, int pr
 	__KernelResetThread(thread);
 
 	currentThread = id;
-	thread->nt.status = THREADSTATUS_READY; // do not schedule
+	__KernelSetThreadStatus(thread, THREADSTATUS_READY); // do not schedule
 
 	strcpy(thread->nt.name, "root");
 
@@ -1402,7 +1538,7 @@ int sceKernelStartThread(SceUID threadToStartID, u32 argSize, u32 argBlockPtr)
 
 		__KernelResetThread(startThread);
 
-		startThread->nt.status = THREADSTATUS_READY;
+		__KernelSetThreadStatus(startThread, THREADSTATUS_READY);
 		u32 sp = startThread->context.r[MIPS_REG_SP];
 		if (argBlockPtr && argSize > 0)
 		{
@@ -1480,7 +1616,7 @@ void __KernelReturnFromThread()
 	}
 
 	thread->nt.exitStatus = currentMIPS->r[2];
-	thread->nt.status = THREADSTATUS_DORMANT;
+	__KernelSetThreadStatus(thread, THREADSTATUS_DORMANT);
 	__KernelFireThreadEnd(thread);
 
 	// TODO: Need to remove the thread from any ready queues.
@@ -1497,7 +1633,7 @@ void sceKernelExitThread()
 	_dbg_assert_msg_(HLE, thread != NULL, "Exited from a NULL thread.");
 
 	ERROR_LOG(HLE,"sceKernelExitThread FAKED");
-	thread->nt.status = THREADSTATUS_DORMANT;
+	__KernelSetThreadStatus(thread, THREADSTATUS_DORMANT);
 	thread->nt.exitStatus = PARAM(0);
 	__KernelFireThreadEnd(thread);
 
@@ -1513,7 +1649,7 @@ void _sceKernelExitThread()
 	_dbg_assert_msg_(HLE, thread != NULL, "_Exited from a NULL thread.");
 
 	ERROR_LOG(HLE,"_sceKernelExitThread FAKED");
-	thread->nt.status = THREADSTATUS_DORMANT;
+	__KernelSetThreadStatus(thread, THREADSTATUS_DORMANT);
 	thread->nt.exitStatus = PARAM(0);
 	__KernelFireThreadEnd(thread);
 
@@ -1531,7 +1667,7 @@ void sceKernelExitDeleteThread()
 	if (t)
 	{
 		INFO_LOG(HLE,"sceKernelExitDeleteThread()");
-		t->nt.status = THREADSTATUS_DORMANT;
+		__KernelSetThreadStatus(t, THREADSTATUS_DORMANT);
 		t->nt.exitStatus = PARAM(0);
 		__KernelFireThreadEnd(t);
 		// TODO: Why not?
@@ -1637,7 +1773,7 @@ int sceKernelTerminateThread(u32 threadID)
 		if (t)
 		{
 			t->nt.exitStatus = SCE_KERNEL_ERROR_THREAD_TERMINATED;
-			t->nt.status = THREADSTATUS_DORMANT;
+			__KernelSetThreadStatus(t, THREADSTATUS_DORMANT);
 			__KernelFireThreadEnd(t);
 			// TODO: Should this really reschedule?
 			__KernelTriggerWait(WAITTYPE_THREADEND, threadID, t->nt.exitStatus, true);
@@ -1703,7 +1839,14 @@ void sceKernelChangeThreadPriority()
 	if (thread)
 	{
 		DEBUG_LOG(HLE,"sceKernelChangeThreadPriority(%i, %i)", id, PARAM(1));
-		thread->nt.currentPriority = PARAM(1);
+		if (thread->isReady())
+		{
+			threadReadyQueue.remove(thread->nt.currentPriority, id);
+			thread->nt.currentPriority = PARAM(1);
+			threadReadyQueue.push_back(thread->nt.currentPriority, id);
+		}
+		else
+			thread->nt.currentPriority = PARAM(1);
 		RETURN(0);
 	}
 	else
@@ -2066,7 +2209,7 @@ void ActionAfterMipsCall::run(MipsCall &call) {
 	u32 error;
 	Thread *thread = kernelObjects.Get<Thread>(threadID, error);
 	if (thread) {
-		thread->nt.status = status;
+		__KernelSetThreadStatus(thread, status);
 		thread->nt.waitType = waitType;
 		thread->nt.waitID = waitID;
 		thread->waitInfo = waitInfo;
@@ -2135,10 +2278,11 @@ void Thread::resumeFromWait()
 	}
 	else
 	{
-		this->nt.status &= ~THREADSTATUS_WAIT;
+		u32 newStatus = this->nt.status & ~THREADSTATUS_WAIT;
 		// TODO: What if DORMANT or DEAD?
-		if (!(this->nt.status & THREADSTATUS_WAITSUSPEND))
-			this->nt.status = THREADSTATUS_READY;
+		if (!(newStatus & THREADSTATUS_WAITSUSPEND))
+			newStatus = THREADSTATUS_READY;
+		__KernelSetThreadStatus(this, newStatus);
 
 		// Non-waiting threads do not process callbacks.
 		this->isProcessingCallbacks = false;
@@ -2230,7 +2374,7 @@ void __KernelChangeThreadState(Thread *thread, ThreadStatus newStatus) {
 	// TODO: JPSCP has many conditions here, like removing wait timeout actions etc.
 	// if (thread->nt.status == THREADSTATUS_WAIT && newStatus != THREADSTATUS_WAITSUSPEND) {
 
-	thread->nt.status = newStatus;
+	__KernelSetThreadStatus(thread, newStatus);
 
 	if (newStatus == THREADSTATUS_WAIT) {
 		if (thread->nt.waitType == WAITTYPE_NONE) {
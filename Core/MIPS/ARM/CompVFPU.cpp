@@ -15,7 +15,44 @@
 #define _SIZE ((op>>11 ) & 0x1F)
 
 
+#define DISABLE Comp_Generic(op); return;
+
 namespace MIPSComp
 {
 
+void Jit::Comp_VPFX(u32 op)
+{
+	DISABLE;
+}
+
+void Jit::Comp_VecDo3(u32 op)
+{
+	DISABLE;
+}
+
+void Jit::Comp_VDot(u32 op)
+{
+	DISABLE;
+}
+
+void Jit::Comp_VScl(u32 op)
+{
+	DISABLE;
+}
+
+void Jit::Comp_Vmmul(u32 op)
+{
+	DISABLE;
+}
+
+void Jit::Comp_Vtfm(u32 op)
+{
+	DISABLE;
+}
+
+void Jit::Comp_VCrossQuat(u32 op)
+{
+	DISABLE;
+}
+
 }
\ No newline at end of file
@@ -78,6 +78,11 @@ void Jit::FlushAll()
 	fpr.Flush(FLUSH_ALL);
 }
 
+void Jit::InvalidateCacheAt(u32 em_address, int length)
+{
+	blocks.InvalidateICache(em_address, length);
+}
+
 void Jit::ClearCache()
 {
 	blocks.Clear();
@@ -92,10 +92,19 @@ public:
 	void Comp_FPU2op(u32 op);
 	void Comp_mxc1(u32 op);
 
+	void Comp_VPFX(u32 op);
+	void Comp_VecDo3(u32 op);
+	void Comp_VDot(u32 op);
+	void Comp_VScl(u32 op);
+	void Comp_Vmmul(u32 op);
+	void Comp_Vtfm(u32 op);
+	void Comp_VCrossQuat(u32 op);
+
 	JitBlockCache *GetBlockCache() { return &blocks; }
 	AsmRoutineManager &Asm() { return asm_; }
 
 	void ClearCache();
+	void InvalidateCacheAt(u32 em_address, int length = 4);
 
 private:
 	void FlushAll();
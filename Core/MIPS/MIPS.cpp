@@ -18,6 +18,7 @@
 #include "Common.h"
 #include "MIPS.h"
 #include "MIPSTables.h"
+#include "MIPSIntCache.h"
 #include "MIPSDebugInterface.h"
 #include "MIPSVFPUUtils.h"
 #include "../System.h"
@@ -60,6 +61,7 @@ void MIPSState::Reset()
 
 	if (PSP_CoreParameter().cpuCore == CPU_JIT)
 		MIPSComp::jit = new MIPSComp::Jit(this);
+	MIPSIntCache_Clear();
 
 	memset(r, 0, sizeof(r));
 	memset(f, 0, sizeof(f));
@@ -158,6 +160,13 @@ int MIPSState::RunLoopUntil(u64 globalTicks)
 	return 1;
 }
 
+void MIPSState::InvalidateICache(u32 address, int length)
+{
+	if (MIPSComp::jit)
+		MIPSComp::jit->InvalidateCacheAt(address, length);
+	MIPSIntCache_Invalidate(address, length);
+}
+
 void MIPSState::WriteFCR(int reg, int value)
 {
 	if (reg == 31)
@@ -153,6 +153,8 @@ public:
 
 	void SingleStep();
 	int RunLoopUntil(u64 globalTicks);
+	// Drops whatever the JIT or the fast interpreter made of [address, address + length).
+	void InvalidateICache(u32 address, int length = 4);
 };
 
 
@@ -29,9 +29,9 @@ using namespace std;
 
 namespace MIPSAnalyst
 {
-	RegisterAnalysisResults regAnal[32];
-	RegisterAnalysisResults total[32];
-	int numAnalysisDone=0;
+	// Blocks longer than this are cut off. The JIT itself has no such limit, but
+	// everything that uses the results has to cope with incomplete info anyway.
+	static const int MAX_ANALYZE = 512;
 
 	int GetOutReg(u32 op)
 	{
@@ -85,65 +85,106 @@ namespace MIPSAnalyst
 		}
 	}
 
-	void Analyze(u32 address)
+	// movz/movn only write rd if the condition holds, so rd is effectively an input too.
+	static bool IsConditionalMove(u32 op)
 	{
-		//set everything to -1 (FF)
-		memset(regAnal, 255, sizeof(AnalysisResults)*32); 
-		for (int i=0; i<32; i++)
+		return (op & 0xFC00003E) == 0x0000000A;
+	}
+
+	// Instructions whose register usage isn't fully described by the flags in MIPSTables.
+	static bool IsOpaque(u32 info)
+	{
+		return info == 0 || (info & (IS_VFPU | IS_JUMP | IS_CONDBRANCH | BAD_INSTRUCTION)) != 0;
+	}
+
+	static void ResetRegister(RegisterAnalysisResults &reg)
+	{
+		reg.used = false;
+		reg.firstRead = -1;
+		reg.lastRead = -1;
+		reg.firstWrite = -1;
+		reg.lastWrite = -1;
+		reg.firstReadAsAddr = -1;
+		reg.lastReadAsAddr = -1;
+		reg.readCount = 0;
+		reg.writeCount = 0;
+		reg.readAsAddrCount = 0;
+		reg.usesVFPU = false;
+	}
+
+	static void NoteRead(RegisterAnalysisResults &reg, u32 addr)
+	{
+		if (reg.firstRead == -1)
+			reg.firstRead = addr;
+		reg.lastRead = addr;
+		reg.readCount++;
+		reg.used = true;
+	}
+
+	static void NoteReadAsAddr(RegisterAnalysisResults &reg, u32 addr)
+	{
+		if (reg.firstReadAsAddr == -1)
+			reg.firstReadAsAddr = addr;
+		reg.lastReadAsAddr = addr;
+		reg.readAsAddrCount++;
+		reg.used = true;
+	}
+
+	static void NoteWrite(RegisterAnalysisResults &reg, u32 addr)
+	{
+		if (reg.firstWrite == -1)
+			reg.firstWrite = addr;
+		reg.lastWrite = addr;
+		reg.writeCount++;
+		reg.used = true;
+	}
+
+	AnalysisResults Analyze(u32 address)
+	{
+		AnalysisResults results;
+		for (int i = 0; i < 32; i++)
 		{
-			regAnal[i].used=false;
-			regAnal[i].readCount=0;
-			regAnal[i].writeCount=0;
-			regAnal[i].readAsAddrCount=0;
+			ResetRegister(results.r[i]);
+			ResetRegister(results.f[i]);
 		}
 
 		u32 addr = address;
 		bool exitFlag = false;
-		while (true)
+		for (int count = 0; count < MAX_ANALYZE; count++)
 		{
 			u32 op = Memory::Read_Instruction(addr);
 			u32 info = MIPSGetInfo(op);
 
-			for (int reg=0; reg < 32; reg++)
-			{
-				int rs = MIPS_GET_RS(op);
-				int rt = MIPS_GET_RT(op);
-				int rd = MIPS_GET_RD(op);
-
-				if (
-					((info & IN_RS) && (rs == reg)) ||
-					((info & IN_RS_SHIFT) && (rs == reg)) ||
-					((info & IN_RT) && (rt == reg)))
-				{
-					if (regAnal[reg].firstRead == -1)
-						regAnal[reg].firstRead = addr;
-					regAnal[reg].lastRead = addr;
-					regAnal[reg].readCount++;
-					regAnal[reg].used=true;
-				}
-				if (
-					((info & IN_RS_ADDR) && (rs == reg))
-					)
-				{
-					if (regAnal[reg].firstReadAsAddr == -1)
-						regAnal[reg].firstReadAsAddr = addr;
-					regAnal[reg].lastReadAsAddr = addr;
-					regAnal[reg].readAsAddrCount++;
-					regAnal[reg].used=true;
-				}
-				if (
-					((info & OUT_RT) && (rt == reg)) ||
-					((info & OUT_RD) && (rd == reg)) ||
-					((info & OUT_RA) && (reg == MIPS_REG_RA))
-					)
-				{
-					if (regAnal[reg].firstWrite == -1)
-						regAnal[reg].firstWrite = addr;
-					regAnal[reg].lastWrite = addr;
-					regAnal[reg].writeCount++;
-					regAnal[reg].used=true;
-				}
-			}
+			int rs = MIPS_GET_RS(op);
+			int rt = MIPS_GET_RT(op);
+			int rd = MIPS_GET_RD(op);
+
+			if (info & (IN_RS | IN_RS_SHIFT))
+				NoteRead(results.r[rs], addr);
+			if (info & IN_RS_ADDR)
+				NoteReadAsAddr(results.r[rs], addr);
+			if (info & IN_RT)
+				NoteRead(results.r[rt], addr);
+			if (IsConditionalMove(op))
+				NoteRead(results.r[rd], addr);
+
+			if (info & OUT_RT)
+				NoteWrite(results.r[rt], addr);
+			if (info & OUT_RD)
+				NoteWrite(results.r[rd], addr);
+			if (info & OUT_RA)
+				NoteWrite(results.r[MIPS_REG_RA], addr);
+
+			if (info & IN_FS)
+				NoteRead(results.f[MIPS_GET_FS(op)], addr);
+			if (info & IN_FT)
+				NoteRead(results.f[MIPS_GET_FT(op)], addr);
+			if (info & OUT_FS)
+				NoteWrite(results.f[MIPS_GET_FS(op)], addr);
+			if (info & OUT_FT)
+				NoteWrite(results.f[MIPS_GET_FT(op)], addr);
+			if (info & OUT_FD)
+				NoteWrite(results.f[MIPS_GET_FD(op)], addr);
 
 			if (exitFlag) //delay slot done, let's quit!
 				break;
@@ -152,23 +193,71 @@ namespace MIPSAnalyst
 			{
 				exitFlag = true; // now do the delay slot
 			}
+			// The JIT ends the block on a syscall too.
+			else if (info == 0 && (op & 0xFC00003F) == 0x0000000C)
+				break;
 
 			addr += 4;
 		}
 
-		int numUsedRegs=0;
-		static int totalUsedRegs=0;
-		static int numAnalyzings=0;
-		for (int i=0; i<32; i++)
+		results.blockStart = address;
+		results.blockEnd = addr;
+		return results;
+	}
+
+	static bool IsLiveAt(u32 reg, u32 addr, bool fpr)
+	{
+		for (int count = 0; count < MAX_ANALYZE; count++, addr += 4)
 		{
-			if (regAnal[i].used) 
-				numUsedRegs++;
+			u32 op = Memory::Read_Instruction(addr);
+			u32 info = MIPSGetInfo(op);
+			if (IsOpaque(info))
+				return true;
+
+			if (fpr)
+			{
+				if ((info & IN_FS) && MIPS_GET_FS(op) == reg)
+					return true;
+				if ((info & IN_FT) && MIPS_GET_FT(op) == reg)
+					return true;
+				if ((info & OUT_FS) && MIPS_GET_FS(op) == reg)
+					return false;
+				if ((info & OUT_FT) && MIPS_GET_FT(op) == reg)
+					return false;
+				if ((info & OUT_FD) && MIPS_GET_FD(op) == reg)
+					return false;
+			}
+			else
+			{
+				if ((info & (IN_RS | IN_RS_SHIFT | IN_RS_ADDR)) && MIPS_GET_RS(op) == reg)
+					return true;
+				if ((info & IN_RT) && MIPS_GET_RT(op) == reg)
+					return true;
+				if (IsConditionalMove(op) && MIPS_GET_RD(op) == reg)
+					return true;
+				if ((info & OUT_RT) && MIPS_GET_RT(op) == reg)
+					return false;
+				if ((info & OUT_RD) && MIPS_GET_RD(op) == reg)
+					return false;
+				if ((info & OUT_RA) && reg == MIPS_REG_RA)
+					return false;
+			}
 		}
-		totalUsedRegs+=numUsedRegs;
-		numAnalyzings++;
-		DEBUG_LOG(CPU,"[ %08x ] Used regs: %i	 Average: %f",address,numUsedRegs,(float)totalUsedRegs/(float)numAnalyzings);
+		return true;
 	}
 
+	bool IsGPRLiveAt(int reg, u32 addr)
+	{
+		// Writes to zero are discarded, so it's always "read" from its home.
+		if (reg == MIPS_REG_ZERO)
+			return true;
+		return IsLiveAt(reg, addr, false);
+	}
+
+	bool IsFPRLiveAt(int reg, u32 addr)
+	{
+		return IsLiveAt(reg, addr, true);
+	}
 
 	struct Function
 	{
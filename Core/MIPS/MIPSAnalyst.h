@@ -21,7 +21,6 @@
 
 namespace MIPSAnalyst
 {
-	void Analyze(u32 address);
 	struct RegisterAnalysisResults
 	{
 		bool used;
@@ -37,17 +36,37 @@ namespace MIPSAnalyst
 		int readAsAddrCount;
 		bool usesVFPU;
 
-		int TotalReadCount() {return readCount + readAsAddrCount;}
-		int FirstRead() {return firstReadAsAddr < firstRead ? firstReadAsAddr : firstRead;}
-		int LastRead() {return lastReadAsAddr > lastRead ? lastReadAsAddr : lastRead;}
+		// Positions are addresses, -1 means never. Compare unsigned so kernel addresses work.
+		static int Earlier(int a, int b) {return (u32)a < (u32)b ? a : b;}
+		static int Later(int a, int b) {return a == -1 ? b : (b == -1 ? a : ((u32)a > (u32)b ? a : b));}
+
+		int TotalReadCount() const {return readCount + readAsAddrCount;}
+		int FirstRead() const {return Earlier(firstReadAsAddr, firstRead);}
+		int LastRead() const {return Later(lastReadAsAddr, lastRead);}
+		int LastUse() const {return Later(LastRead(), lastWrite);}
 	};
 
 	struct AnalysisResults
 	{
-		int x;
+		// First and last instruction covered, the last one is normally the delay slot.
+		u32 blockStart;
+		u32 blockEnd;
+
+		RegisterAnalysisResults r[32];
+		RegisterAnalysisResults f[32];
+
+		// True if reg is not touched again at or after addr (within the analyzed block).
+		bool IsGPRUnusedAfter(int reg, u32 addr) const {return !r[reg].used || (u32)r[reg].LastUse() < addr;}
+		bool IsFPRUnusedAfter(int reg, u32 addr) const {return !f[reg].used || (u32)f[reg].LastUse() < addr;}
 	};
 
+	AnalysisResults Analyze(u32 address);
+
 	bool IsRegisterUsed(u32 reg, u32 addr);
+	// Conservative liveness: false only if reg is certainly overwritten at or after addr
+	// before anything reads it. Gives up (returns true) on branches and opaque instructions.
+	bool IsGPRLiveAt(int reg, u32 addr);
+	bool IsFPRLiveAt(int reg, u32 addr);
 	void ScanForFunctions(u32 startAddr, u32 endAddr);
 	void CompileLeafs();
 
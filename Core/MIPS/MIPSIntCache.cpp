@@ -0,0 +1,403 @@
+// Copyright (c) 2012- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+
+#include <map>
+#include <vector>
+
+#include "MemoryUtil.h"
+
+#include "MIPS.h"
+#include "MIPSTables.h"
+#include "MIPSIntCache.h"
+#include "../MemMap.h"
+#include "../Core.h"
+#include "../CoreTiming.h"
+
+struct PredecodedOp;
+typedef void (*PredecodedFunc)(MIPSState *mips, const PredecodedOp &p);
+
+struct PredecodedOp
+{
+	PredecodedFunc func;
+	// Only used by the generic handler.
+	MIPSInterpretFunc interpret;
+	u32 op;
+	// Extended immediate, or the branch target for branches and jumps.
+	u32 imm;
+	u8 rs, rt, rd, sa;
+};
+
+struct PredecodedBlock
+{
+	u32 startAddr;
+	// Compared on entry, so code that was overwritten without an icache invalidate is redecoded.
+	u32 firstOp;
+	int firstIndex;
+	int numOps;
+	bool invalid;
+};
+
+// A block ends after the delay slot of its first branch or jump, or after this many ops.
+#define MAX_PREDECODED_BLOCK_OPS 64
+// Everything is thrown away once this many ops have been decoded.
+#define MAX_PREDECODED_OPS 0x40000
+
+// Blocks in RAM are found through a flat table, anything else through a map.
+#define INTCACHE_RAM_BASE 0x08000000
+#define INTCACHE_RAM_ENTRIES (Memory::RAM_SIZE >> 2)
+
+static std::vector<PredecodedOp> ops;
+static std::vector<PredecodedBlock> blocks;
+// Block index + 1, zero if none.
+static u32 *blockLookup = 0;
+static std::map<u32, int> otherBlocks;
+// Bumped on every clear, so a running block can tell that its ops are gone.
+static u32 clearCount = 0;
+
+#define _RS ((op>>21) & 0x1F)
+#define _RT ((op>>16) & 0x1F)
+#define _RD ((op>>11) & 0x1F)
+#define _SA ((op>>6 ) & 0x1F)
+#define R(i) (mips->r[i])
+
+static inline void DelayBranchTo(MIPSState *mips, u32 where)
+{
+	mips->pc += 4;
+	mips->nextPC = where;
+	mips->inDelaySlot = true;
+}
+
+static void Pre_Generic(MIPSState *mips, const PredecodedOp &p) { p.interpret(p.op); }
+static void Pre_Unknown(MIPSState *mips, const PredecodedOp &p) { MIPSInterpret(p.op); }
+static void Pre_Nop(MIPSState *mips, const PredecodedOp &p) { mips->pc += 4; }
+
+static void Pre_Addiu(MIPSState *mips, const PredecodedOp &p) { R(p.rt) = R(p.rs) + p.imm; mips->pc += 4; }
+static void Pre_Slti(MIPSState *mips, const PredecodedOp &p)  { R(p.rt) = (s32)R(p.rs) < (s32)p.imm; mips->pc += 4; }
+static void Pre_Sltiu(MIPSState *mips, const PredecodedOp &p) { R(p.rt) = R(p.rs) < p.imm; mips->pc += 4; }
+static void Pre_Andi(MIPSState *mips, const PredecodedOp &p)  { R(p.rt) = R(p.rs) & p.imm; mips->pc += 4; }
+static void Pre_Ori(MIPSState *mips, const PredecodedOp &p)   { R(p.rt) = R(p.rs) | p.imm; mips->pc += 4; }
+static void Pre_Xori(MIPSState *mips, const PredecodedOp &p)  { R(p.rt) = R(p.rs) ^ p.imm; mips->pc += 4; }
+static void Pre_Lui(MIPSState *mips, const PredecodedOp &p)   { R(p.rt) = p.imm; mips->pc += 4; }
+
+static void Pre_Addu(MIPSState *mips, const PredecodedOp &p) { R(p.rd) = R(p.rs) + R(p.rt); mips->pc += 4; }
+static void Pre_Subu(MIPSState *mips, const PredecodedOp &p) { R(p.rd) = R(p.rs) - R(p.rt); mips->pc += 4; }
+static void Pre_And(MIPSState *mips, const PredecodedOp &p)  { R(p.rd) = R(p.rs) & R(p.rt); mips->pc += 4; }
+static void Pre_Or(MIPSState *mips, const PredecodedOp &p)   { R(p.rd) = R(p.rs) | R(p.rt); mips->pc += 4; }
+static void Pre_Xor(MIPSState *mips, const PredecodedOp &p)  { R(p.rd) = R(p.rs) ^ R(p.rt); mips->pc += 4; }
+static void Pre_Nor(MIPSState *mips, const PredecodedOp &p)  { R(p.rd) = ~(R(p.rs) | R(p.rt)); mips->pc += 4; }
+static void Pre_Slt(MIPSState *mips, const PredecodedOp &p)  { R(p.rd) = (s32)R(p.rs) < (s32)R(p.rt); mips->pc += 4; }
+static void Pre_Sltu(MIPSState *mips, const PredecodedOp &p) { R(p.rd) = R(p.rs) < R(p.rt); mips->pc += 4; }
+
+static void Pre_Sll(MIPSState *mips, const PredecodedOp &p) { R(p.rd) = R(p.rt) << p.sa; mips->pc += 4; }
+static void Pre_Srl(MIPSState *mips, const PredecodedOp &p) { R(p.rd) = R(p.rt) >> p.sa; mips->pc += 4; }
+static void Pre_Sra(MIPSState *mips, const PredecodedOp &p) { R(p.rd) = (u32)((s32)R(p.rt) >> p.sa); mips->pc += 4; }
+
+// Same unchecked accesses as the old switch based fast interpreter.
+static void Pre_Lb(MIPSState *mips, const PredecodedOp &p)  { R(p.rt) = (u32)(s32)(s8)Memory::ReadUnchecked_U8(R(p.rs) + p.imm); mips->pc += 4; }
+static void Pre_Lh(MIPSState *mips, const PredecodedOp &p)  { R(p.rt) = (u32)(s32)(s16)Memory::ReadUnchecked_U16(R(p.rs) + p.imm); mips->pc += 4; }
+static void Pre_Lw(MIPSState *mips, const PredecodedOp &p)  { R(p.rt) = Memory::ReadUnchecked_U32(R(p.rs) + p.imm); mips->pc += 4; }
+static void Pre_Lbu(MIPSState *mips, const PredecodedOp &p) { R(p.rt) = Memory::ReadUnchecked_U8(R(p.rs) + p.imm); mips->pc += 4; }
+static void Pre_Lhu(MIPSState *mips, const PredecodedOp &p) { R(p.rt) = Memory::ReadUnchecked_U16(R(p.rs) + p.imm); mips->pc += 4; }
+static void Pre_Sb(MIPSState *mips, const PredecodedOp &p)  { Memory::WriteUnchecked_U8(R(p.rt), R(p.rs) + p.imm); mips->pc += 4; }
+static void Pre_Sh(MIPSState *mips, const PredecodedOp &p)  { Memory::WriteUnchecked_U16(R(p.rt), R(p.rs) + p.imm); mips->pc += 4; }
+static void Pre_Sw(MIPSState *mips, const PredecodedOp &p)  { Memory::WriteUnchecked_U32(R(p.rt), R(p.rs) + p.imm); mips->pc += 4; }
+
+static void Pre_Beq(MIPSState *mips, const PredecodedOp &p)  { if (R(p.rt) == R(p.rs)) DelayBranchTo(mips, p.imm); else mips->pc += 4; }
+static void Pre_Bne(MIPSState *mips, const PredecodedOp &p)  { if (R(p.rt) != R(p.rs)) DelayBranchTo(mips, p.imm); else mips->pc += 4; }
+static void Pre_Blez(MIPSState *mips, const PredecodedOp &p) { if ((s32)R(p.rs) <= 0) DelayBranchTo(mips, p.imm); else mips->pc += 4; }
+static void Pre_Bgtz(MIPSState *mips, const PredecodedOp &p) { if ((s32)R(p.rs) > 0) DelayBranchTo(mips, p.imm); else mips->pc += 4; }
+static void Pre_J(MIPSState *mips, const PredecodedOp &p)    { DelayBranchTo(mips, p.imm); }
+static void Pre_Jal(MIPSState *mips, const PredecodedOp &p)  { R(31) = mips->pc + 8; DelayBranchTo(mips, p.imm); }
+
+static void Pre_Jr(MIPSState *mips, const PredecodedOp &p)
+{
+	// Int_JumpRegType knows what to do with jumps in delay slots.
+	if (mips->inDelaySlot)
+		p.interpret(p.op);
+	else
+		DelayBranchTo(mips, R(p.rs));
+}
+
+static void Predecode(u32 op, u32 addr, PredecodedOp &p)
+{
+	p.op = op;
+	p.interpret = MIPSGetInterpretFunc(op);
+	p.func = p.interpret ? &Pre_Generic : &Pre_Unknown;
+	p.rs = _RS;
+	p.rt = _RT;
+	p.rd = _RD;
+	p.sa = _SA;
+	p.imm = 0;
+
+	if (op == 0)
+	{
+		p.func = &Pre_Nop;
+		return;
+	}
+
+	s32 simm = (s32)(s16)(op & 0xFFFF);
+	u32 uimm = (u32)(u16)(op & 0xFFFF);
+
+	switch (op >> 26)
+	{
+	case 0:
+		// Writes to $zero are left to the interpreter.
+		if ((op & 63) != 8 && p.rd == 0)
+			break;
+		switch (op & 63)
+		{
+		case 0: p.func = &Pre_Sll; break;
+		case 2: if (p.rs == 0) p.func = &Pre_Srl; break;
+		case 3: p.func = &Pre_Sra; break;
+		case 8: p.func = &Pre_Jr; break;
+		case 33: p.func = &Pre_Addu; break;
+		case 35: p.func = &Pre_Subu; break;
+		case 36: p.func = &Pre_And; break;
+		case 37: p.func = &Pre_Or; break;
+		case 38: p.func = &Pre_Xor; break;
+		case 39: p.func = &Pre_Nor; break;
+		case 42: p.func = &Pre_Slt; break;
+		case 43: p.func = &Pre_Sltu; break;
+		}
+		break;
+
+	case 2:
+	case 3:
+		p.imm = (addr & 0xF0000000) | ((op & 0x3FFFFFF) << 2);
+		p.func = (op >> 26) == 2 ? &Pre_J : &Pre_Jal;
+		break;
+
+	case 4:
+	case 5:
+	case 6:
+	case 7:
+		{
+			static const PredecodedFunc branches[4] = {&Pre_Beq, &Pre_Bne, &Pre_Blez, &Pre_Bgtz};
+			p.imm = addr + 4 + (simm << 2);
+			p.func = branches[(op >> 26) - 4];
+		}
+		break;
+
+	case 8:
+	case 9:
+	case 10:
+	case 11:
+	case 12:
+	case 13:
+	case 14:
+	case 15:
+		{
+			if (p.rt == 0)
+				break;
+			static const PredecodedFunc itypes[8] = {&Pre_Addiu, &Pre_Addiu, &Pre_Slti, &Pre_Sltiu, &Pre_Andi, &Pre_Ori, &Pre_Xori, &Pre_Lui};
+			static const bool signExtend[8] = {true, true, true, true, false, false, false, false};
+			p.imm = signExtend[(op >> 26) - 8] ? (u32)simm : uimm;
+			if ((op >> 26) == 15)
+				p.imm = uimm << 16;
+			p.func = itypes[(op >> 26) - 8];
+		}
+		break;
+
+	case 32:
+	case 33:
+	case 35:
+	case 36:
+	case 37:
+		if (p.rt == 0)
+			break;
+		p.imm = (u32)simm;
+		switch (op >> 26)
+		{
+		case 32: p.func = &Pre_Lb; break;
+		case 33: p.func = &Pre_Lh; break;
+		case 35: p.func = &Pre_Lw; break;
+		case 36: p.func = &Pre_Lbu; break;
+		case 37: p.func = &Pre_Lhu; break;
+		}
+		break;
+
+	case 40: p.imm = (u32)simm; p.func = &Pre_Sb; break;
+	case 41: p.imm = (u32)simm; p.func = &Pre_Sh; break;
+	case 43: p.imm = (u32)simm; p.func = &Pre_Sw; break;
+	}
+}
+
+static int GetBlockIndex(u32 addr)
+{
+	u32 offset = addr - INTCACHE_RAM_BASE;
+	if (offset < Memory::RAM_SIZE)
+		return (int)blockLookup[offset >> 2] - 1;
+
+	std::map<u32, int>::const_iterator iter = otherBlocks.find(addr);
+	return iter == otherBlocks.end() ? -1 : iter->second;
+}
+
+static void SetBlockIndex(u32 addr, int index)
+{
+	u32 offset = addr - INTCACHE_RAM_BASE;
+	if (offset < Memory::RAM_SIZE)
+		blockLookup[offset >> 2] = (u32)(index + 1);
+	else if (index >= 0)
+		otherBlocks[addr] = index;
+	else
+		otherBlocks.erase(addr);
+}
+
+static int CompileBlock(u32 addr)
+{
+	if (ops.size() + MAX_PREDECODED_BLOCK_OPS + 1 > MAX_PREDECODED_OPS)
+		MIPSIntCache_Clear();
+
+	PredecodedBlock b;
+	b.startAddr = addr;
+	b.firstOp = Memory::ReadUnchecked_U32(addr);
+	b.firstIndex = (int)ops.size();
+	b.invalid = false;
+
+	bool endAfterNext = false;
+	u32 pc = addr;
+	for (int i = 0; ; i++, pc += 4)
+	{
+		u32 op = Memory::Read_Instruction(pc);
+		PredecodedOp p;
+		Predecode(op, pc, p);
+		ops.push_back(p);
+
+		if (endAfterNext)
+			break;
+		if (MIPSGetInfo(op) & DELAYSLOT)
+			endAfterNext = true;
+		else if (i + 1 >= MAX_PREDECODED_BLOCK_OPS)
+			break;
+	}
+	b.numOps = (int)ops.size() - b.firstIndex;
+
+	blocks.push_back(b);
+	int index = (int)blocks.size() - 1;
+	SetBlockIndex(addr, index);
+	return index;
+}
+
+static int GetBlock(u32 addr)
+{
+	if (!blockLookup)
+		blockLookup = (u32 *)AllocateMemoryPages(INTCACHE_RAM_ENTRIES * sizeof(u32));
+
+	int index = GetBlockIndex(addr);
+	if (index >= 0 && blocks[index].firstOp == Memory::ReadUnchecked_U32(addr))
+		return index;
+	return CompileBlock(addr);
+}
+
+void MIPSIntCache_Invalidate(u32 address, int length)
+{
+	const u32 end = address + length;
+	for (size_t i = 0; i < blocks.size(); i++)
+	{
+		PredecodedBlock &b = blocks[i];
+		if (b.invalid || b.startAddr >= end || b.startAddr + b.numOps * 4 <= address)
+			continue;
+
+		b.invalid = true;
+		if (GetBlockIndex(b.startAddr) == (int)i)
+			SetBlockIndex(b.startAddr, -1);
+	}
+}
+
+void MIPSIntCache_Clear()
+{
+	if (blockLookup)
+	{
+		for (size_t i = 0; i < blocks.size(); i++)
+		{
+			u32 offset = blocks[i].startAddr - INTCACHE_RAM_BASE;
+			if (offset < Memory::RAM_SIZE)
+				blockLookup[offset >> 2] = 0;
+		}
+	}
+	otherBlocks.clear();
+	blocks.clear();
+	ops.clear();
+	clearCount++;
+}
+
+void MIPSIntCache_Shutdown()
+{
+	MIPSIntCache_Clear();
+	if (blockLookup)
+	{
+		FreeMemoryPages(blockLookup, INTCACHE_RAM_ENTRIES * sizeof(u32));
+		blockLookup = 0;
+	}
+}
+
+// Syscalls and anything else not predecoded may invalidate or clear the cache (icache
+// invalidates, module loads, a reset), so the rest of the block can't be trusted after them.
+static inline bool BlockStillValid(const PredecodedOp *p, int index, u32 startClearCount)
+{
+	if (p->func != &Pre_Generic && p->func != &Pre_Unknown)
+		return true;
+	return clearCount == startClearCount && !blocks[index].invalid;
+}
+
+// For slow platforms without JITs.
+int MIPSInterpret_RunFastUntil(u64 globalTicks)
+{
+	MIPSState *curMips = currentMIPS;
+	while (coreState == CORE_RUNNING)
+	{
+		while (CoreTiming::downcount >= 0 && coreState == CORE_RUNNING)
+		{
+			do
+			{
+				const int index = GetBlock(curMips->pc);
+				const u32 startClearCount = clearCount;
+				const PredecodedOp *p = &ops[blocks[index].firstIndex];
+				const PredecodedOp *end = p + blocks[index].numOps;
+
+				// Stop early if something (syscalls, likely branches, exceptions) went elsewhere.
+				for (u32 expectedPC = blocks[index].startAddr; p != end && curMips->pc == expectedPC; ++p, expectedPC += 4)
+				{
+					bool wasInDelaySlot = curMips->inDelaySlot;
+					p->func(curMips, *p);
+
+					if (curMips->inDelaySlot)
+					{
+						// The reason we have to check this is the delay slot hack in Int_Syscall.
+						if (wasInDelaySlot)
+						{
+							curMips->pc = curMips->nextPC;
+							curMips->inDelaySlot = false;
+						}
+						CoreTiming::downcount -= 1;
+					}
+					else if (CoreTiming::downcount < 0 || coreState != CORE_RUNNING)
+						break;
+
+					// Look the block up again (and redecode it if needed) at the current pc.
+					if (!BlockStillValid(p, index, startClearCount))
+						break;
+				}
+				// NEVER stop in a delay slot!
+			} while (curMips->inDelaySlot);
+		}
+
+		CoreTiming::Advance();
+	}
+	return 1;
+}
@@ -0,0 +1,31 @@
+// Copyright (c) 2012- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+
+#pragma once
+
+#include "../../Globals.h"
+
+// Predecoded interpreter, used as CPU_FASTINTERPRETER (see MIPSInterpret_RunFastUntil).
+// Basic blocks are decoded once into arrays of handlers with their operands already
+// extracted, and cached by start address.
+
+// Drops blocks overlapping [address, address + length). Call wherever the JIT is invalidated.
+void MIPSIntCache_Invalidate(u32 address, int length);
+void MIPSIntCache_Clear();
+// Also frees the lookup table.
+void MIPSIntCache_Shutdown();
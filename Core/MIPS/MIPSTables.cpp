@@ -129,11 +129,11 @@ const MIPSInstruction tableImmediate[64] =  //xxxxxx .....
 	//32
 	INSTR("lb",  &Jit::Comp_ITypeMem, Dis_ITypeMem, Int_ITypeMem, IN_MEM|IN_IMM16|IN_RS_ADDR|OUT_RT),
 	INSTR("lh",  &Jit::Comp_ITypeMem, Dis_ITypeMem, Int_ITypeMem, IN_MEM|IN_IMM16|IN_RS_ADDR|OUT_RT),
-	INSTR("lwl", &Jit::Comp_ITypeMem, Dis_ITypeMem, Int_ITypeMem, IN_MEM|IN_IMM16|IN_RS_ADDR|OUT_RT),
+	INSTR("lwl", &Jit::Comp_ITypeMem, Dis_ITypeMem, Int_ITypeMem, IN_MEM|IN_IMM16|IN_RS_ADDR|IN_RT|OUT_RT),
 	INSTR("lw",  &Jit::Comp_ITypeMem, Dis_ITypeMem, Int_ITypeMem, IN_MEM|IN_IMM16|IN_RS_ADDR|OUT_RT),
 	INSTR("lbu", &Jit::Comp_ITypeMem, Dis_ITypeMem, Int_ITypeMem, IN_MEM|IN_IMM16|IN_RS_ADDR|OUT_RT),
 	INSTR("lhu", &Jit::Comp_ITypeMem, Dis_ITypeMem, Int_ITypeMem, IN_MEM|IN_IMM16|IN_RS_ADDR|OUT_RT),
-	INSTR("lwr", &Jit::Comp_ITypeMem, Dis_ITypeMem, Int_ITypeMem, IN_MEM|IN_IMM16|IN_RS_ADDR|OUT_RT),
+	INSTR("lwr", &Jit::Comp_ITypeMem, Dis_ITypeMem, Int_ITypeMem, IN_MEM|IN_IMM16|IN_RS_ADDR|IN_RT|OUT_RT),
 	{-2},
 	//40
 	INSTR("sb",  &Jit::Comp_ITypeMem, Dis_ITypeMem, Int_ITypeMem, IN_IMM16|IN_RS_ADDR|IN_RT|OUT_MEM),
@@ -146,7 +146,7 @@ const MIPSInstruction tableImmediate[64] =  //xxxxxx .....
 	INSTR("cache", &Jit::Comp_Generic, Dis_Generic, Int_Cache, 0),
 	//48
 	INSTR("ll", &Jit::Comp_Generic, Dis_Generic, Int_StoreSync, 0),
-	INSTR("lwc1", &Jit::Comp_FPULS, Dis_FPULS, Int_FPULS, IN_RT|IN_RS_ADDR),
+	INSTR("lwc1", &Jit::Comp_FPULS, Dis_FPULS, Int_FPULS, IN_MEM|IN_IMM16|IN_RS_ADDR|OUT_FT),
 	INSTR("lv.s", &Jit::Comp_Generic, Dis_SV, Int_SV, IS_VFPU),
 	{-2}, // HIT THIS IN WIPEOUT
 	{VFPU4Jump},
@@ -155,7 +155,7 @@ const MIPSInstruction tableImmediate[64] =  //xxxxxx .....
 	{VFPU5},
 	//56
 	INSTR("sc", &Jit::Comp_Generic, Dis_Generic, Int_StoreSync, 0),
-	INSTR("swc1", &Jit::Comp_FPULS, Dis_FPULS, Int_FPULS, 0), //copU
+	INSTR("swc1", &Jit::Comp_FPULS, Dis_FPULS, Int_FPULS, IN_IMM16|IN_RS_ADDR|IN_FT|OUT_MEM), //copU
 	INSTR("sv.s", &Jit::Comp_Generic, Dis_SV, Int_SV,IS_VFPU),
 	{-2}, 
 	//60
@@ -178,8 +178,8 @@ const MIPSInstruction tableSpecial[64] = /// 000000 ...... ...... .......... xxx
 	INSTR("srav",  &Jit::Comp_ShiftType, Dis_VarShiftType, Int_ShiftType, OUT_RD|IN_RT|IN_RS_SHIFT),
 
 	//8
-	INSTR("jr",    &Jit::Comp_JumpReg, Dis_JumpRegType, Int_JumpRegType,0),
-	INSTR("jalr",  &Jit::Comp_JumpReg, Dis_JumpRegType, Int_JumpRegType,0),
+	INSTR("jr",    &Jit::Comp_JumpReg, Dis_JumpRegType, Int_JumpRegType, IS_JUMP|IN_RS|DELAYSLOT),
+	INSTR("jalr",  &Jit::Comp_JumpReg, Dis_JumpRegType, Int_JumpRegType, IS_JUMP|IN_RS|OUT_RD|DELAYSLOT),
 	INSTR("movz",  &Jit::Comp_RType3, Dis_RType3, Int_RType3, OUT_RD|IN_RS|IN_RT),
 	INSTR("movn",  &Jit::Comp_RType3, Dis_RType3, Int_RType3, OUT_RD|IN_RS|IN_RT),
 	INSTR("syscall", &Jit::Comp_Syscall, Dis_Syscall, Int_Syscall,0),
@@ -247,51 +247,51 @@ const MIPSInstruction tableSpecial[64] = /// 000000 ...... ...... .......... xxx
 
 const MIPSInstruction tableSpecial2[64] = 
 {
-	INSTR("add.s",  &Jit::Comp_FPU3op, Dis_FPU3op, Int_FPU3op, 0),
-	INSTR("sub.s",  &Jit::Comp_FPU3op, Dis_FPU3op, Int_FPU3op, 0),
-	INSTR("mul.s",  &Jit::Comp_FPU3op, Dis_FPU3op, Int_FPU3op, 0),
-	INSTR("div.s",  &Jit::Comp_FPU3op, Dis_FPU3op, Int_FPU3op, 0),
-	INSTR("sqrt.s", &Jit::Comp_FPU2op, Dis_FPU2op, Int_FPU2op, 0),
-	INSTR("abs.s",  &Jit::Comp_FPU2op, Dis_FPU2op, Int_FPU2op, 0),
-	INSTR("mov.s",  &Jit::Comp_FPU2op, Dis_FPU2op, Int_FPU2op, 0),
-	INSTR("neg.s",  &Jit::Comp_FPU2op, Dis_FPU2op, Int_FPU2op, 0),
+	INSTR("add.s",  &Jit::Comp_FPU3op, Dis_FPU3op, Int_FPU3op, IN_FS|IN_FT|OUT_FD),
+	INSTR("sub.s",  &Jit::Comp_FPU3op, Dis_FPU3op, Int_FPU3op, IN_FS|IN_FT|OUT_FD),
+	INSTR("mul.s",  &Jit::Comp_FPU3op, Dis_FPU3op, Int_FPU3op, IN_FS|IN_FT|OUT_FD),
+	INSTR("div.s",  &Jit::Comp_FPU3op, Dis_FPU3op, Int_FPU3op, IN_FS|IN_FT|OUT_FD),
+	INSTR("sqrt.s", &Jit::Comp_FPU2op, Dis_FPU2op, Int_FPU2op, IN_FS|OUT_FD),
+	INSTR("abs.s",  &Jit::Comp_FPU2op, Dis_FPU2op, Int_FPU2op, IN_FS|OUT_FD),
+	INSTR("mov.s",  &Jit::Comp_FPU2op, Dis_FPU2op, Int_FPU2op, IN_FS|OUT_FD),
+	INSTR("neg.s",  &Jit::Comp_FPU2op, Dis_FPU2op, Int_FPU2op, IN_FS|OUT_FD),
 //8
 	{-2}, {-2}, {-2}, {-2},
-	INSTR("round.w.s",  &Jit::Comp_FPU2op, Dis_FPU2op, Int_FPU2op, 0),
-	INSTR("trunc.w.s",  &Jit::Comp_FPU2op, Dis_FPU2op, Int_FPU2op, 0),
-	INSTR("ceil.w.s",   &Jit::Comp_FPU2op, Dis_FPU2op, Int_FPU2op, 0),
-	INSTR("floor.w.s",  &Jit::Comp_FPU2op, Dis_FPU2op, Int_FPU2op, 0),
+	INSTR("round.w.s",  &Jit::Comp_FPU2op, Dis_FPU2op, Int_FPU2op, IN_FS|OUT_FD),
+	INSTR("trunc.w.s",  &Jit::Comp_FPU2op, Dis_FPU2op, Int_FPU2op, IN_FS|OUT_FD),
+	INSTR("ceil.w.s",   &Jit::Comp_FPU2op, Dis_FPU2op, Int_FPU2op, IN_FS|OUT_FD),
+	INSTR("floor.w.s",  &Jit::Comp_FPU2op, Dis_FPU2op, Int_FPU2op, IN_FS|OUT_FD),
 //16	
 	{-2}, {-2}, {-2}, {-2}, {-2}, {-2}, {-2}, {-2},
 //24
 	{-2}, {-2}, {-2}, {-2}, {-2}, {-2}, {-2}, {-2},
 //32
-	INSTR("cvt.s.w", &Jit::Comp_Generic, Dis_FPU2op, Int_FPU2op, 0),
+	INSTR("cvt.s.w", &Jit::Comp_Generic, Dis_FPU2op, Int_FPU2op, IN_FS|OUT_FD),
 	{-2}, {-2}, {-2}, 
 //36
-	INSTR("cvt.w.s", &Jit::Comp_Generic, Dis_FPU2op, Int_FPU2op, 0),
+	INSTR("cvt.w.s", &Jit::Comp_Generic, Dis_FPU2op, Int_FPU2op, IN_FS|OUT_FD),
 	{-2}, 
 	INSTR("dis.int", &Jit::Comp_Generic, Dis_Generic, Int_Interrupt, 0), 
 	{-2}, 
 //40
 	{-2}, {-2}, {-2}, {-2}, {-2}, {-2}, {-2}, {-2},
 //48
-	INSTR("c.f",   &Jit::Comp_Generic, Dis_FPUComp, Int_FPUComp, OUT_FPUFLAG),
-	INSTR("c.un",  &Jit::Comp_Generic, Dis_FPUComp, Int_FPUComp, OUT_FPUFLAG),
-	INSTR("c.eq",  &Jit::Comp_Generic, Dis_FPUComp, Int_FPUComp, OUT_FPUFLAG),
-	INSTR("c.ueq", &Jit::Comp_Generic, Dis_FPUComp, Int_FPUComp, OUT_FPUFLAG),
-  INSTR("c.olt", &Jit::Comp_Generic, Dis_FPUComp, Int_FPUComp, OUT_FPUFLAG),
-  INSTR("c.ult", &Jit::Comp_Generic, Dis_FPUComp, Int_FPUComp, OUT_FPUFLAG),
-  INSTR("c.ole", &Jit::Comp_Generic, Dis_FPUComp, Int_FPUComp, OUT_FPUFLAG),
-  INSTR("c.ule", &Jit::Comp_Generic, Dis_FPUComp, Int_FPUComp, OUT_FPUFLAG),
-  INSTR("c.sf",  &Jit::Comp_Generic, Dis_FPUComp, Int_FPUComp, OUT_FPUFLAG),
-  INSTR("c.ngle",&Jit::Comp_Generic, Dis_FPUComp, Int_FPUComp, OUT_FPUFLAG),
-  INSTR("c.seq", &Jit::Comp_Generic, Dis_FPUComp, Int_FPUComp, OUT_FPUFLAG),
-  INSTR("c.ngl", &Jit::Comp_Generic, Dis_FPUComp, Int_FPUComp, OUT_FPUFLAG),
-  INSTR("c.lt",  &Jit::Comp_Generic, Dis_FPUComp, Int_FPUComp, OUT_FPUFLAG),
-  INSTR("c.nge", &Jit::Comp_Generic, Dis_FPUComp, Int_FPUComp, OUT_FPUFLAG),
-  INSTR("c.le",  &Jit::Comp_Generic, Dis_FPUComp, Int_FPUComp, OUT_FPUFLAG),
-  INSTR("c.ngt", &Jit::Comp_Generic, Dis_FPUComp, Int_FPUComp, OUT_FPUFLAG),
+	INSTR("c.f",   &Jit::Comp_Generic, Dis_FPUComp, Int_FPUComp, IN_FS|IN_FT|OUT_FPUFLAG),
+	INSTR("c.un",  &Jit::Comp_Generic, Dis_FPUComp, Int_FPUComp, IN_FS|IN_FT|OUT_FPUFLAG),
+	INSTR("c.eq",  &Jit::Comp_Generic, Dis_FPUComp, Int_FPUComp, IN_FS|IN_FT|OUT_FPUFLAG),
+	INSTR("c.ueq", &Jit::Comp_Generic, Dis_FPUComp, Int_FPUComp, IN_FS|IN_FT|OUT_FPUFLAG),
+  INSTR("c.olt", &Jit::Comp_Generic, Dis_FPUComp, Int_FPUComp, IN_FS|IN_FT|OUT_FPUFLAG),
+  INSTR("c.ult", &Jit::Comp_Generic, Dis_FPUComp, Int_FPUComp, IN_FS|IN_FT|OUT_FPUFLAG),
+  INSTR("c.ole", &Jit::Comp_Generic, Dis_FPUComp, Int_FPUComp, IN_FS|IN_FT|OUT_FPUFLAG),
+  INSTR("c.ule", &Jit::Comp_Generic, Dis_FPUComp, Int_FPUComp, IN_FS|IN_FT|OUT_FPUFLAG),
+  INSTR("c.sf",  &Jit::Comp_Generic, Dis_FPUComp, Int_FPUComp, IN_FS|IN_FT|OUT_FPUFLAG),
+  INSTR("c.ngle",&Jit::Comp_Generic, Dis_FPUComp, Int_FPUComp, IN_FS|IN_FT|OUT_FPUFLAG),
+  INSTR("c.seq", &Jit::Comp_Generic, Dis_FPUComp, Int_FPUComp, IN_FS|IN_FT|OUT_FPUFLAG),
+  INSTR("c.ngl", &Jit::Comp_Generic, Dis_FPUComp, Int_FPUComp, IN_FS|IN_FT|OUT_FPUFLAG),
+  INSTR("c.lt",  &Jit::Comp_Generic, Dis_FPUComp, Int_FPUComp, IN_FS|IN_FT|OUT_FPUFLAG),
+  INSTR("c.nge", &Jit::Comp_Generic, Dis_FPUComp, Int_FPUComp, IN_FS|IN_FT|OUT_FPUFLAG),
+  INSTR("c.le",  &Jit::Comp_Generic, Dis_FPUComp, Int_FPUComp, IN_FS|IN_FT|OUT_FPUFLAG),
+  INSTR("c.ngt", &Jit::Comp_Generic, Dis_FPUComp, Int_FPUComp, IN_FS|IN_FT|OUT_FPUFLAG),
 };
 
 
@@ -301,7 +301,7 @@ const MIPSInstruction tableSpecial3[64] =
 	{-2},
 	{-2},
 	{-2},
-	INSTR("ins", &Jit::Comp_Generic, Dis_Special3, Int_Special3, IN_RS|OUT_RT),
+	INSTR("ins", &Jit::Comp_Generic, Dis_Special3, Int_Special3, IN_RS|IN_RT|OUT_RT),
 	{-2},
 	{-2},
 	{-2},
@@ -448,11 +448,11 @@ MIPSInstruction tableCop0CO[64] =
 
 MIPSInstruction tableCop1[32] = 
 {
-	INSTR("mfc1",&Jit::Comp_mxc1, Dis_mxc1,Int_mxc1, OUT_RT),
+	INSTR("mfc1",&Jit::Comp_mxc1, Dis_mxc1,Int_mxc1, IN_FS|OUT_RT),
 	{-2},
 	INSTR("cfc1",&Jit::Comp_mxc1, Dis_mxc1,Int_mxc1, 0),
 	{-2},
-	INSTR("mtc1",&Jit::Comp_mxc1, Dis_mxc1,Int_mxc1, IN_RT),
+	INSTR("mtc1",&Jit::Comp_mxc1, Dis_mxc1,Int_mxc1, IN_RT|OUT_FS),
 	{-2},
 	INSTR("ctc1",&Jit::Comp_mxc1, Dis_mxc1,Int_mxc1, 0),
 	{-2},
@@ -479,19 +479,19 @@ MIPSInstruction tableCop1BC[32] =
 
 MIPSInstruction tableVFPU0[8] = 
 {
-	INSTR("vadd",&Jit::Comp_Generic, Dis_VectorSet3, Int_VecDo3, IS_VFPU),
-	INSTR("vsub",&Jit::Comp_Generic, Dis_VectorSet3, Int_VecDo3, IS_VFPU), 
+	INSTR("vadd",&Jit::Comp_VecDo3, Dis_VectorSet3, Int_VecDo3, IS_VFPU),
+	INSTR("vsub",&Jit::Comp_VecDo3, Dis_VectorSet3, Int_VecDo3, IS_VFPU), 
 	INSTR("vsbn",&Jit::Comp_Generic, Dis_VectorSet3, 0, IS_VFPU), 
 	{-2}, {-2}, {-2}, {-2}, 
 	
-	INSTR("vdiv",&Jit::Comp_Generic, Dis_VectorSet3, Int_VecDo3, IS_VFPU),
+	INSTR("vdiv",&Jit::Comp_VecDo3, Dis_VectorSet3, Int_VecDo3, IS_VFPU),
 };
 
 MIPSInstruction tableVFPU1[8] = 
 {
-	INSTR("vmul",&Jit::Comp_Generic, Dis_VectorSet3, Int_VecDo3, IS_VFPU),
-	INSTR("vdot",&Jit::Comp_Generic, Dis_VectorDot, Int_VDot, IS_VFPU), 
-	INSTR("vscl",&Jit::Comp_Generic, Dis_VScl, Int_VScl, IS_VFPU),
+	INSTR("vmul",&Jit::Comp_VecDo3, Dis_VectorSet3, Int_VecDo3, IS_VFPU),
+	INSTR("vdot",&Jit::Comp_VDot, Dis_VectorDot, Int_VDot, IS_VFPU), 
+	INSTR("vscl",&Jit::Comp_VScl, Dis_VScl, Int_VScl, IS_VFPU),
 	{-2},
 	INSTR("vhdp",&Jit::Comp_Generic, Dis_Generic, Int_VHdp, IS_VFPU), 
 	INSTR("vcrs",&Jit::Comp_Generic, Dis_Vcrs, Int_Vcrs, IS_VFPU), 
@@ -613,12 +613,12 @@ MIPSInstruction tableVFPU4[32] =  //110100 00000 xxxxx
 
 MIPSInstruction tableVFPU5[8] =  //110111 xxx
 {
-	INSTR("vpfxs",&Jit::Comp_Generic, Dis_VPFXST, Int_VPFX, IS_VFPU),
-	INSTR("vpfxs",&Jit::Comp_Generic, Dis_VPFXST, Int_VPFX, IS_VFPU),
-	INSTR("vpfxt",&Jit::Comp_Generic, Dis_VPFXST, Int_VPFX, IS_VFPU),
-	INSTR("vpfxt",&Jit::Comp_Generic, Dis_VPFXST, Int_VPFX, IS_VFPU),
-	INSTR("vpfxd", &Jit::Comp_Generic, Dis_VPFXD, Int_VPFX, IS_VFPU),
-	INSTR("vpfxd", &Jit::Comp_Generic, Dis_VPFXD, Int_VPFX, IS_VFPU),
+	INSTR("vpfxs",&Jit::Comp_VPFX, Dis_VPFXST, Int_VPFX, IS_VFPU),
+	INSTR("vpfxs",&Jit::Comp_VPFX, Dis_VPFXST, Int_VPFX, IS_VFPU),
+	INSTR("vpfxt",&Jit::Comp_VPFX, Dis_VPFXST, Int_VPFX, IS_VFPU),
+	INSTR("vpfxt",&Jit::Comp_VPFX, Dis_VPFXST, Int_VPFX, IS_VFPU),
+	INSTR("vpfxd", &Jit::Comp_VPFX, Dis_VPFXD, Int_VPFX, IS_VFPU),
+	INSTR("vpfxd", &Jit::Comp_VPFX, Dis_VPFXD, Int_VPFX, IS_VFPU),
 	INSTR("viim.s",&Jit::Comp_Generic, Dis_Viim,Int_Viim, IS_VFPU),
 	INSTR("vfim.s",&Jit::Comp_Generic, Dis_Viim,Int_Viim, IS_VFPU),
 };
@@ -626,35 +626,35 @@ MIPSInstruction tableVFPU5[8] =  //110111 xxx
 MIPSInstruction tableVFPU6[32] =  //111100 xxx
 {
 //0
-	INSTR("vmmul",&Jit::Comp_Generic, Dis_MatrixMult, Int_Vmmul, IS_VFPU),
-	INSTR("vmmul",&Jit::Comp_Generic, Dis_MatrixMult, Int_Vmmul, IS_VFPU),
-	INSTR("vmmul",&Jit::Comp_Generic, Dis_MatrixMult, Int_Vmmul, IS_VFPU),
-	INSTR("vmmul",&Jit::Comp_Generic, Dis_MatrixMult, Int_Vmmul, IS_VFPU),
-
-	INSTR("v(h)tfm2",&Jit::Comp_Generic, Dis_Vtfm, Int_Vtfm, IS_VFPU),
-	INSTR("v(h)tfm2",&Jit::Comp_Generic, Dis_Vtfm, Int_Vtfm, IS_VFPU),
-	INSTR("v(h)tfm2",&Jit::Comp_Generic, Dis_Vtfm, Int_Vtfm, IS_VFPU),
-	INSTR("v(h)tfm2",&Jit::Comp_Generic, Dis_Vtfm, Int_Vtfm, IS_VFPU),
+	INSTR("vmmul",&Jit::Comp_Vmmul, Dis_MatrixMult, Int_Vmmul, IS_VFPU),
+	INSTR("vmmul",&Jit::Comp_Vmmul, Dis_MatrixMult, Int_Vmmul, IS_VFPU),
+	INSTR("vmmul",&Jit::Comp_Vmmul, Dis_MatrixMult, Int_Vmmul, IS_VFPU),
+	INSTR("vmmul",&Jit::Comp_Vmmul, Dis_MatrixMult, Int_Vmmul, IS_VFPU),
+
+	INSTR("v(h)tfm2",&Jit::Comp_Vtfm, Dis_Vtfm, Int_Vtfm, IS_VFPU),
+	INSTR("v(h)tfm2",&Jit::Comp_Vtfm, Dis_Vtfm, Int_Vtfm, IS_VFPU),
+	INSTR("v(h)tfm2",&Jit::Comp_Vtfm, Dis_Vtfm, Int_Vtfm, IS_VFPU),
+	INSTR("v(h)tfm2",&Jit::Comp_Vtfm, Dis_Vtfm, Int_Vtfm, IS_VFPU),
 //8
-	INSTR("v(h)tfm3",&Jit::Comp_Generic, Dis_Vtfm, Int_Vtfm, IS_VFPU),
-	INSTR("v(h)tfm3",&Jit::Comp_Generic, Dis_Vtfm, Int_Vtfm, IS_VFPU),
-	INSTR("v(h)tfm3",&Jit::Comp_Generic, Dis_Vtfm, Int_Vtfm, IS_VFPU),
-	INSTR("v(h)tfm3",&Jit::Comp_Generic, Dis_Vtfm, Int_Vtfm, IS_VFPU),
-
-	INSTR("v(h)tfm4",&Jit::Comp_Generic, Dis_Vtfm, Int_Vtfm, IS_VFPU),
-	INSTR("v(h)tfm4",&Jit::Comp_Generic, Dis_Vtfm, Int_Vtfm, IS_VFPU),
-	INSTR("v(h)tfm4",&Jit::Comp_Generic, Dis_Vtfm, Int_Vtfm, IS_VFPU),
-	INSTR("v(h)tfm4",&Jit::Comp_Generic, Dis_Vtfm, Int_Vtfm, IS_VFPU),
+	INSTR("v(h)tfm3",&Jit::Comp_Vtfm, Dis_Vtfm, Int_Vtfm, IS_VFPU),
+	INSTR("v(h)tfm3",&Jit::Comp_Vtfm, Dis_Vtfm, Int_Vtfm, IS_VFPU),
+	INSTR("v(h)tfm3",&Jit::Comp_Vtfm, Dis_Vtfm, Int_Vtfm, IS_VFPU),
+	INSTR("v(h)tfm3",&Jit::Comp_Vtfm, Dis_Vtfm, Int_Vtfm, IS_VFPU),
+
+	INSTR("v(h)tfm4",&Jit::Comp_Vtfm, Dis_Vtfm, Int_Vtfm, IS_VFPU),
+	INSTR("v(h)tfm4",&Jit::Comp_Vtfm, Dis_Vtfm, Int_Vtfm, IS_VFPU),
+	INSTR("v(h)tfm4",&Jit::Comp_Vtfm, Dis_Vtfm, Int_Vtfm, IS_VFPU),
+	INSTR("v(h)tfm4",&Jit::Comp_Vtfm, Dis_Vtfm, Int_Vtfm, IS_VFPU),
 	//16
 	INSTR("vmscl",&Jit::Comp_Generic, Dis_Generic, Int_Vmscl, IS_VFPU),
 	INSTR("vmscl",&Jit::Comp_Generic, Dis_Generic, Int_Vmscl, IS_VFPU),
 	INSTR("vmscl",&Jit::Comp_Generic, Dis_Generic, Int_Vmscl, IS_VFPU),
 	INSTR("vmscl",&Jit::Comp_Generic, Dis_Generic, Int_Vmscl, IS_VFPU),
 
-	INSTR("vcrsp.t/vqmul.q",&Jit::Comp_Generic, Dis_CrossQuat, Int_CrossQuat, IS_VFPU),
-	INSTR("vcrsp.t/vqmul.q",&Jit::Comp_Generic, Dis_CrossQuat, Int_CrossQuat, IS_VFPU),
-	INSTR("vcrsp.t/vqmul.q",&Jit::Comp_Generic, Dis_CrossQuat, Int_CrossQuat, IS_VFPU),
-	INSTR("vcrsp.t/vqmul.q",&Jit::Comp_Generic, Dis_CrossQuat, Int_CrossQuat, IS_VFPU),
+	INSTR("vcrsp.t/vqmul.q",&Jit::Comp_VCrossQuat, Dis_CrossQuat, Int_CrossQuat, IS_VFPU),
+	INSTR("vcrsp.t/vqmul.q",&Jit::Comp_VCrossQuat, Dis_CrossQuat, Int_CrossQuat, IS_VFPU),
+	INSTR("vcrsp.t/vqmul.q",&Jit::Comp_VCrossQuat, Dis_CrossQuat, Int_CrossQuat, IS_VFPU),
+	INSTR("vcrsp.t/vqmul.q",&Jit::Comp_VCrossQuat, Dis_CrossQuat, Int_CrossQuat, IS_VFPU),
 //24
 	{-2},
 	{-2},
@@ -930,12 +930,6 @@ void MIPSInterpret(u32 op) //only for those rare ones
   }
 }
 
-#define _RS   ((op>>21) & 0x1F)
-#define _RT   ((op>>16) & 0x1F)
-#define _RD   ((op>>11) & 0x1F)
-#define R(i)   (curMips->r[i])
-
-
 int MIPSInterpret_RunUntil(u64 globalTicks)
 {
 	MIPSState *curMips = currentMIPS;
@@ -1002,131 +996,6 @@ int MIPSInterpret_RunUntil(u64 globalTicks)
 	return 1;
 }
 
-static inline void DelayBranchTo(MIPSState *curMips, u32 where)
-{
-	curMips->pc += 4;
-	curMips->nextPC = where;
-	curMips->inDelaySlot = true;
-}
-
-// Optimized interpreter loop that shortcuts the most common instructions.
-// For slow platforms without JITs.
-#define SIMM16 (s32)(s16)(op & 0xFFFF)
-#define UIMM16 (u32)(u16)(op & 0xFFFF)
-#define SUIMM16 (u32)(s32)(s16)(op & 0xFFFF)
-int MIPSInterpret_RunFastUntil(u64 globalTicks)
-{
-	MIPSState *curMips = currentMIPS;
-	while (coreState == CORE_RUNNING) 
-	{
-		while (CoreTiming::downcount >= 0 && coreState == CORE_RUNNING)   // TODO: Try to get rid of the latter check
-		{
-			again:
-			bool wasInDelaySlot = curMips->inDelaySlot;
-			u32 op = Memory::ReadUnchecked_U32(curMips->pc);
-			switch (op >> 29)
-			{
-			case 0x0:
-				{
-					int imm = (s16)(op&0xFFFF) << 2;
-					int rs = _RS;
-					int rt = _RT;
-					u32 addr = curMips->pc + imm + 4;
-					switch (op >> 26) 
-					{
-					case 4:	if (R(rt) == R(rs))	DelayBranchTo(curMips, addr); else curMips->pc += 4; break; //beq
-					case 5:	if (R(rt) != R(rs))	DelayBranchTo(curMips, addr); else curMips->pc += 4; break; //bne
-					case 6:	if ((s32)R(rs) <= 0) DelayBranchTo(curMips, addr); else curMips->pc += 4; break; //blez
-					case 7:	 if ((s32)R(rs) >	0) DelayBranchTo(curMips, addr); else curMips->pc += 4; break; //bgtz
-					default:
-						goto interpret;
-					}
-				}
-				break;
-
-			case 0x1:
-				{
-					int rt = _RT;
-					int rs = _RS;
-					switch (op >> 26) 
-					{
-					case 8:  R(rt) = R(rs) + SIMM16; break;      //addi
-					case 9:  R(rt) = R(rs) + SIMM16; break;      //addiu
-					case 10: R(rt) = (s32)R(rs) < SIMM16; break; //slti
-					case 11: R(rt) = R(rs) < SUIMM16; break;     //sltiu
-					case 12: R(rt) = R(rs) & UIMM16; break;      //andi
-					case 13: R(rt) = R(rs) | UIMM16; break;      //ori
-					case 14: R(rt) = R(rs) ^ UIMM16; break;      //xori
-					case 15: R(rt) = UIMM16 << 16;   break;      //lui
-					default:
-						goto interpret;
-					}
-					currentMIPS->pc += 4;
-				}
-				break;
-				
-			case 0x4:
-				{
-					int rt = _RT;
-					int rs = _RS;
-					int imm = (s16)(op & 0xFFFF);
-					u32 addr = R(rs) + imm;
-					switch (op >> 26) 
-					{
-					case 32: R(rt) = (u32)(s32)(s8) Memory::ReadUnchecked_U8(addr); break; //lb
-					case 33: R(rt) = (u32)(s32)(s16)Memory::ReadUnchecked_U16(addr); break; //lh
-					case 35: R(rt) = Memory::ReadUnchecked_U32(addr); break; //lw
-					case 36: R(rt) = Memory::ReadUnchecked_U8(addr); break; //lbu
-					case 37: R(rt) = Memory::ReadUnchecked_U16(addr); break; //lhu
-					default:
-						goto interpret;
-					}
-					currentMIPS->pc += 4;
-				}
-			  break;
-
-			case 0x5:
-				{
-					int rt = _RT;
-					int rs = _RS;
-					int imm = (s16)(op & 0xFFFF);
-					u32 addr = R(rs) + imm;
-					switch (op >> 26)
-					{
-					case 40: Memory::WriteUnchecked_U8(R(rt), addr); break; //sb
-					case 41: Memory::WriteUnchecked_U16(R(rt), addr); break; //sh
-					case 43: Memory::WriteUnchecked_U32(R(rt), addr); break; //sw
-					default:
-						goto interpret;
-					}
-					currentMIPS->pc += 4;
-				}
-				break;
-				
-			default:
-				interpret:
-				MIPSInterpret(op);
-			}
-
-			if (curMips->inDelaySlot)
-			{
-				// The reason we have to check this is the delay slot hack in Int_Syscall.
-				if (wasInDelaySlot)
-				{
-					curMips->pc = curMips->nextPC;
-					curMips->inDelaySlot = false;
-				}
-				CoreTiming::downcount -= 1;
-				goto again;
-			}
-		}
-
-		CoreTiming::Advance();
-	}
-	return 1;
-}
-
-
 const char *MIPSGetName(u32 op)
 {
 	static const char *noname = "unk";
@@ -1150,7 +1019,7 @@ u32 MIPSGetInfo(u32 op)
 MIPSInterpretFunc MIPSGetInterpretFunc(u32 op)
 {
 	const MIPSInstruction *instr = MIPSGetInstruction(op);
-	if (instr->interpret)
+	if (instr && instr->interpret)
 		return instr->interpret;
 	else
 		return 0;
@@ -1160,7 +1029,9 @@ MIPSInterpretFunc MIPSGetInterpretFunc(u32 op)
 int MIPSGetInstructionCycleEstimate(u32 op)
 {
   u32 info = MIPSGetInfo(op);
-  if (info & DELAYSLOT)
+  // jr/jalr are flagged DELAYSLOT for block analysis, but keep the timing they always had.
+  bool jumpReg = (op & 0xFC00003E) == 0x00000008;
+  if ((info & DELAYSLOT) && !jumpReg)
     return 2;
   else
     return 1;
@@ -44,6 +44,12 @@
 #define OUT_OTHER 0x1000000
 #define OUT_FPUFLAG 0x2000000
 
+#define IN_FS   0x4000000
+#define IN_FT   0x8000000
+#define OUT_FS  0x10000000
+#define OUT_FT  0x20000000
+#define OUT_FD  0x40000000
+
 #ifndef CDECL
 #define CDECL
 #endif
@@ -82,6 +82,62 @@ void WriteVector(const float *rd, VectorSize size, int reg)
   }
 }
 
+void GetVectorRegs(u8 regs[4], VectorSize N, int vectorReg)
+{
+	int mtx = (vectorReg >> 2) & 7;
+	int col = vectorReg & 3;
+	int row = 0;
+	int length = 0;
+	int transpose = (vectorReg >> 5) & 1;
+
+	switch (N)
+	{
+	case V_Single: transpose = 0; row = (vectorReg >> 5) & 3; length = 1; break;
+	case V_Pair:   row = (vectorReg >> 5) & 2; length = 2; break;
+	case V_Triple: row = (vectorReg >> 6) & 1; length = 3; break;
+	case V_Quad:   row = (vectorReg >> 5) & 2; length = 4; break;
+	}
+
+	for (int i = 0; i < length; i++)
+	{
+		int index = mtx * 4;
+		if (transpose)
+			index += ((row + i) & 3) + col * 32;
+		else
+			index += col + ((row + i) & 3) * 32;
+		regs[i] = index;
+	}
+}
+
+void GetMatrixRegs(u8 regs[16], MatrixSize N, int matrixReg)
+{
+	int mtx = (matrixReg >> 2) & 7;
+	int col = matrixReg & 3;
+	int row = 0;
+	int side = 0;
+	int transpose = (matrixReg >> 5) & 1;
+
+	switch (N)
+	{
+	case M_2x2: row = (matrixReg >> 5) & 2; side = 2; break;
+	case M_3x3: row = (matrixReg >> 6) & 1; side = 3; break;
+	case M_4x4: row = (matrixReg >> 5) & 2; side = 4; break;
+	}
+
+	for (int i = 0; i < side; i++)
+	{
+		for (int j = 0; j < side; j++)
+		{
+			int index = mtx * 4;
+			if (transpose)
+				index += ((row + i) & 3) + ((col + j) & 3) * 32;
+			else
+				index += ((col + j) & 3) + ((row + i) & 3) * 32;
+			regs[j * 4 + i] = index;
+		}
+	}
+}
+
 void ReadMatrix(float *rd, MatrixSize size, int reg)
 {
 	int mtx = (reg >> 2) & 7;
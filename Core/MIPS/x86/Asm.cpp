@@ -56,6 +56,11 @@ void Jit()
 	MIPSComp::jit->Compile(currentMIPS->pc);
 }
 
+void JitHotBlock()
+{
+	MIPSComp::jit->CompileSuperblock(currentMIPS->pc);
+}
+
 // IDEA, NOT IMPLEMENTED: no more block numbers - hack opcodes just contain offset within
 // dynarec buffer, gets rid of lookup into block buffer
 // At this offset - 4, there is an int specifying the block number if needed.
@@ -135,6 +140,17 @@ void AsmRoutineManager::Generate(MIPSState *mips, MIPSComp::Jit *jit)
 #endif
 			JMP(dispatcherNoCheck); // Let's just dispatch again, we'll enter the block since we know it's there.
 
+			// Blocks jump here (with pc set) when their run count hits the superblock threshold.
+			recompileHotBlock = GetCodePtr();
+#ifdef _M_IX86
+			ABI_AlignStack(0);
+			CALL(reinterpret_cast<void *>(&JitHotBlock));
+			ABI_RestoreStack(0);
+#elif _M_X64
+			CALL((void *)&JitHotBlock);
+#endif
+			JMP(dispatcherNoCheck, true);
+
 		SetJumpTarget(bail);
 
 		CMP(32, M((void*)&coreState), Imm32(0));
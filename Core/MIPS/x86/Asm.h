@@ -67,6 +67,7 @@ public:
 	const u8 *dispatcher;
 	const u8 *dispatcherCheckCoreState;
 	const u8 *dispatcherNoCheck;
+	const u8 *recompileHotBlock;
 
 	const u8 *fpException;
 
@@ -38,11 +38,70 @@ using namespace MIPSAnalyst;
 
 namespace MIPSComp
 {
-	void Jit::CompImmLogic(u32 op, void (XEmitter::*arith)(int, const OpArg &, const OpArg &))
+	static u32 RType3_ImmAdd(const u32 a, const u32 b)
+	{
+		return a + b;
+	}
+
+	static u32 RType3_ImmSub(const u32 a, const u32 b)
+	{
+		return a - b;
+	}
+
+	static u32 RType3_ImmAnd(const u32 a, const u32 b)
+	{
+		return a & b;
+	}
+
+	static u32 RType3_ImmOr(const u32 a, const u32 b)
+	{
+		return a | b;
+	}
+
+	static u32 RType3_ImmXor(const u32 a, const u32 b)
+	{
+		return a ^ b;
+	}
+
+	static u32 RType3_ImmNor(const u32 a, const u32 b)
+	{
+		return ~(a | b);
+	}
+
+	static u32 ShiftType_ImmLogicalLeft(const u32 a, const u32 b)
+	{
+		return a << (b & 0x1f);
+	}
+
+	static u32 ShiftType_ImmLogicalRight(const u32 a, const u32 b)
+	{
+		return a >> (b & 0x1f);
+	}
+
+	static u32 ShiftType_ImmArithRight(const u32 a, const u32 b)
+	{
+		return ((s32) a) >> (b & 0x1f);
+	}
+
+	static u32 ShiftType_ImmRotateRight(const u32 a, const u32 b)
+	{
+		const s8 sa = b & 0x1f;
+		if (sa == 0)
+			return a;
+		return (a >> sa) | (a << (32 - sa));
+	}
+
+	void Jit::CompImmLogic(u32 op, void (XEmitter::*arith)(int, const OpArg &, const OpArg &), u32 (*doImm)(const u32, const u32))
 	{
 		u32 uimm = (u16)(op & 0xFFFF);
 		int rt = _RT;
 		int rs = _RS;
+		if (gpr.IsImmediate(rs))
+		{
+			gpr.SetImmediate32(rt, doImm(gpr.GetImmediate32(rs), uimm));
+			return;
+		}
+
 		gpr.Lock(rt, rs);
 		gpr.BindToRegister(rt, rt == rs, true);
 		if (rt != rs)
@@ -60,36 +119,38 @@ namespace MIPSComp
 		int rt = _RT;
 		int rs = _RS;
 
+		// Writes to $zero are nops, and must not make it look like a nonzero constant.
+		if (rt == 0)
+			return;
+
 		switch (op >> 26) 
 		{
 		case 8:	// same as addiu?
 		case 9:	//R(rt) = R(rs) + simm; break;	//addiu
 			{
-				if (gpr.R(rs).IsImm())
+				if (gpr.IsImmediate(rs))
 				{
-					gpr.SetImmediate32(rt, gpr.R(rs).GetImmValue() + simm);
+					gpr.SetImmediate32(rt, gpr.GetImmediate32(rs) + simm);
 					break;
 				}
 
 				gpr.Lock(rt, rs);
-				if (rs != 0)
-				{
-					gpr.BindToRegister(rt, rt == rs, true);
-					if (rt != rs)
-						MOV(32, gpr.R(rt), gpr.R(rs));
-					if (simm != 0)
-						ADD(32, gpr.R(rt), Imm32((u32)(s32)simm));
-					// TODO: Can also do LEA if both operands happen to be in registers.
-				}
-				else
-				{
-					gpr.SetImmediate32(rt, simm);
-				}
+				gpr.BindToRegister(rt, rt == rs, true);
+				if (rt != rs)
+					MOV(32, gpr.R(rt), gpr.R(rs));
+				if (simm != 0)
+					ADD(32, gpr.R(rt), Imm32((u32)(s32)simm));
+				// TODO: Can also do LEA if both operands happen to be in registers.
 				gpr.UnlockAll();
 			}
 			break;
 
 		case 10: // R(rt) = (s32)R(rs) < simm; break; //slti
+			if (gpr.IsImmediate(rs))
+			{
+				gpr.SetImmediate32(rt, (s32)gpr.GetImmediate32(rs) < simm);
+				break;
+			}
 			gpr.Lock(rt, rs);
 			gpr.BindToRegister(rs, true, false);
 			gpr.BindToRegister(rt, rt == rs, true);
@@ -101,6 +162,11 @@ namespace MIPSComp
 			break;
 
 		case 11: // R(rt) = R(rs) < uimm; break; //sltiu
+			if (gpr.IsImmediate(rs))
+			{
+				gpr.SetImmediate32(rt, gpr.GetImmediate32(rs) < (u32)simm);
+				break;
+			}
 			gpr.Lock(rt, rs);
 			gpr.BindToRegister(rs, true, false);
 			gpr.BindToRegister(rt, rt == rs, true);
@@ -111,9 +177,9 @@ namespace MIPSComp
 			gpr.UnlockAll();
 			break;
 
-		case 12: CompImmLogic(op, &XEmitter::AND); break;
-		case 13: CompImmLogic(op, &XEmitter::OR); break;
-		case 14: CompImmLogic(op, &XEmitter::XOR); break;
+		case 12: CompImmLogic(op, &XEmitter::AND, &RType3_ImmAnd); break;
+		case 13: CompImmLogic(op, &XEmitter::OR, &RType3_ImmOr); break;
+		case 14: CompImmLogic(op, &XEmitter::XOR, &RType3_ImmXor); break;
 
 		case 15: //R(rt) = uimm << 16;	 break; //lui
 			gpr.SetImmediate32(rt, uimm << 16);
@@ -126,12 +192,18 @@ namespace MIPSComp
 	}
 
 	//rd = rs X rt
-	void Jit::CompTriArith(u32 op, void (XEmitter::*arith)(int, const OpArg &, const OpArg &))
+	void Jit::CompTriArith(u32 op, void (XEmitter::*arith)(int, const OpArg &, const OpArg &), u32 (*doImm)(const u32, const u32))
 	{
 		int rt = _RT;
 		int rs = _RS;
 		int rd = _RD;
 
+		if (gpr.IsImmediate(rs) && gpr.IsImmediate(rt))
+		{
+			gpr.SetImmediate32(rd, doImm(gpr.GetImmediate32(rs), gpr.GetImmediate32(rt)));
+			return;
+		}
+
 		gpr.FlushLockX(EDX);
 		gpr.Lock(rt, rs, rd);
 		MOV(32, R(EAX), gpr.R(rs));
@@ -152,6 +224,9 @@ namespace MIPSComp
 		int rs = _RS;
 		int rd = _RD;
 
+		if (rd == 0)
+			return;
+
 		switch (op & 63)
 		{
 		//case 10: if (!R(rt)) R(rd) = R(rs); break; //movz
@@ -159,28 +234,38 @@ namespace MIPSComp
 
 		// case 32: //R(rd) = R(rs) + R(rt);		break; //add
 		case 33: //R(rd) = R(rs) + R(rt);		break; //addu
-			CompTriArith(op, &XEmitter::ADD);
+			CompTriArith(op, &XEmitter::ADD, &RType3_ImmAdd);
 			break;
 		case 34: //R(rd) = R(rs) - R(rt);		break; //sub
 		case 35:
-			CompTriArith(op, &XEmitter::SUB);
+			CompTriArith(op, &XEmitter::SUB, &RType3_ImmSub);
 			break;
 		case 36: //R(rd) = R(rs) & R(rt);		break; //and
-			CompTriArith(op, &XEmitter::AND);
+			CompTriArith(op, &XEmitter::AND, &RType3_ImmAnd);
 			break;
 		case 37: //R(rd) = R(rs) | R(rt);		break; //or
-			CompTriArith(op, &XEmitter::OR);
+			CompTriArith(op, &XEmitter::OR, &RType3_ImmOr);
 			break;
 		case 38: //R(rd) = R(rs) ^ R(rt);		break; //xor
-			CompTriArith(op, &XEmitter::XOR);
+			CompTriArith(op, &XEmitter::XOR, &RType3_ImmXor);
 			break;
 
 		case 39: // R(rd) = ~(R(rs) | R(rt)); //nor
-			CompTriArith(op, &XEmitter::OR);
+			if (gpr.IsImmediate(rs) && gpr.IsImmediate(rt))
+			{
+				gpr.SetImmediate32(rd, RType3_ImmNor(gpr.GetImmediate32(rs), gpr.GetImmediate32(rt)));
+				break;
+			}
+			CompTriArith(op, &XEmitter::OR, &RType3_ImmOr);
 			NOT(32, gpr.R(rd));
 			break;
 
 		case 42: //R(rd) = (int)R(rs) < (int)R(rt); break; //slt
+			if (gpr.IsImmediate(rs) && gpr.IsImmediate(rt))
+			{
+				gpr.SetImmediate32(rd, (s32)gpr.GetImmediate32(rs) < (s32)gpr.GetImmediate32(rt));
+				break;
+			}
 			gpr.Lock(rt, rs, rd);
 			gpr.BindToRegister(rs, true, true);
 			gpr.BindToRegister(rd, true, true);
@@ -192,6 +277,11 @@ namespace MIPSComp
 			break;
 
 		case 43: //R(rd) = R(rs) < R(rt);		break; //sltu
+			if (gpr.IsImmediate(rs) && gpr.IsImmediate(rt))
+			{
+				gpr.SetImmediate32(rd, gpr.GetImmediate32(rs) < gpr.GetImmediate32(rt));
+				break;
+			}
 			gpr.Lock(rd, rs, rt);
 			gpr.BindToRegister(rs, true, true);
 			gpr.BindToRegister(rd, true, true);
@@ -214,12 +304,18 @@ namespace MIPSComp
 	}
 
 
-	void Jit::CompShiftImm(u32 op, void (XEmitter::*shift)(int, OpArg, OpArg))
+	void Jit::CompShiftImm(u32 op, void (XEmitter::*shift)(int, OpArg, OpArg), u32 (*doImm)(const u32, const u32))
 	{
 		int rd = _RD;
 		int rt = _RT;
-		gpr.Lock(rd, rt);
 		int sa = _SA;
+		if (gpr.IsImmediate(rt))
+		{
+			gpr.SetImmediate32(rd, doImm(gpr.GetImmediate32(rt), sa));
+			return;
+		}
+
+		gpr.Lock(rd, rt);
 		gpr.BindToRegister(rd, rd == rt, true);
 		if (rd != rt)
 			MOV(32, gpr.R(rd), gpr.R(rt));
@@ -251,12 +347,15 @@ namespace MIPSComp
 		CONDITIONAL_DISABLE
 		int rs = _RS;
 		int fd = _FD;
+		if (_RD == 0)
+			return;
+
 		// WARNIGN : ROTR
 		switch (op & 0x3f)
 		{
-		case 0: CompShiftImm(op, &XEmitter::SHL); break;
-		case 2: CompShiftImm(op, rs == 1 ? &XEmitter::ROR : &XEmitter::SHR); break;	// srl, rotr
-		case 3: CompShiftImm(op, &XEmitter::SAR); break;	// sra
+		case 0: CompShiftImm(op, &XEmitter::SHL, &ShiftType_ImmLogicalLeft); break;
+		case 2: CompShiftImm(op, rs == 1 ? &XEmitter::ROR : &XEmitter::SHR, rs == 1 ? &ShiftType_ImmRotateRight : &ShiftType_ImmLogicalRight); break;	// srl, rotr
+		case 3: CompShiftImm(op, &XEmitter::SAR, &ShiftType_ImmArithRight); break;	// sra
 
 		case 4: CompShiftVar(op, &XEmitter::SHL); break; //sllv
 		case 6: CompShiftVar(op, fd == 1 ? &XEmitter::ROR : &XEmitter::SHR); break;	//srlv
@@ -274,9 +373,17 @@ namespace MIPSComp
 		CONDITIONAL_DISABLE
 		int rt = _RT;
 		int rd = _RD;
+		if (rd == 0)
+			return;
+
 		switch ((op >> 6) & 31)
 		{
 		case 16: // seb  // R(rd) = (u32)(s32)(s8)(u8)R(rt);
+			if (gpr.IsImmediate(rt))
+			{
+				gpr.SetImmediate32(rd, (u32)(s32)(s8)(u8)gpr.GetImmediate32(rt));
+				break;
+			}
 			gpr.Lock(rd, rt);
 			gpr.BindToRegister(rd, true, true);
 			MOV(32, R(EAX), gpr.R(rt));  // work around the byte-register addressing problem
@@ -285,6 +392,11 @@ namespace MIPSComp
 			break;
 
 		case 24: // seh
+			if (gpr.IsImmediate(rt))
+			{
+				gpr.SetImmediate32(rd, (u32)(s32)(s16)(u16)gpr.GetImmediate32(rt));
+				break;
+			}
 			gpr.Lock(rd, rt);
 			// MOVSX doesn't like immediate arguments, for example, so let's force it to a register.
 			gpr.BindToRegister(rt, true, false);
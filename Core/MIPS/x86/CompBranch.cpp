@@ -59,36 +59,47 @@ static u64 saved_flags;
 
 #endif
 
-void Jit::BranchRSRTComp(u32 op, Gen::CCFlags cc, bool likely)
+// Emits the delay slot and exits of a conditional branch, once the flags are set up.
+// cc is the condition for the branch NOT being taken.
+void Jit::CompBranchExits(Gen::CCFlags cc, bool likely, bool delaySlotIsNice, u32 targetAddr)
 {
-	if (js.inDelaySlot) {
-		ERROR_LOG(JIT, "Branch in delay slot at %08x", js.compilerPC);
-		return;
-	}
-	int offset = (signed short)(op&0xFFFF)<<2;
-	int rt = _RT;
-	int rs = _RS;
-	u32 targetAddr = js.compilerPC + offset + 4;
-
-	u32 delaySlotOp = Memory::ReadUnchecked_U32(js.compilerPC+4);
+	u32 notTakenAddr = js.compilerPC + 8;
+	bool followTaken = PredictBranchTaken(targetAddr, notTakenAddr);
+	u32 nextPC = followTaken ? targetAddr : notTakenAddr;
 
-	//Compile the delay slot
-	bool delaySlotIsNice = GetOutReg(delaySlotOp) != rt && GetOutReg(delaySlotOp) != rs;// IsDelaySlotNice(op, delaySlotOp);
-	if (!delaySlotIsNice)
+	if (CanExtendSuperblock(nextPC))
 	{
-		//ERROR_LOG(CPU, "Not nice delay slot in BranchRSRTComp :( %08x", js.compilerPC);
-	}
-	delaySlotIsNice = false;	// Until we have time to fully fix this
+		// Keep going on the likely side, registers stay cached. The other side gets a side exit.
+		Gen::CCFlags onTraceCC = followTaken ? (Gen::CCFlags)(cc ^ 1) : cc;
+		u32 offTraceAddr = followTaken ? notTakenAddr : targetAddr;
 
-	if (rs == 0)
-	{
-		CMP(32, gpr.R(rt), Imm32(0));
-	}
-	else
-	{
-		gpr.BindToRegister(rs, true, false);
-		CMP(32, gpr.R(rs), rt == 0 ? Imm32(0) : gpr.R(rt));
+		js.inDelaySlot = true;
+		if (!likely)
+		{
+			if (!delaySlotIsNice)
+				SAVE_FLAGS; // preserve flag around the delay slot!
+			CompileAt(js.compilerPC + 4);
+			if (!delaySlotIsNice)
+				LOAD_FLAGS; // restore flag!
+			Gen::FixupBranch onTrace = J_CC(onTraceCC, true);
+			WriteSideExit(offTraceAddr, 0);
+			SetJumpTarget(onTrace);
+		}
+		else
+		{
+			// Likely: the delay slot only runs if the branch is taken.
+			Gen::FixupBranch onTrace = J_CC(onTraceCC, true);
+			WriteSideExit(offTraceAddr, followTaken ? 0 : js.compilerPC + 4);
+			SetJumpTarget(onTrace);
+			if (followTaken)
+				CompileAt(js.compilerPC + 4);
+		}
+		js.inDelaySlot = false;
+
+		ContinueSuperblockAt(nextPC);
+		return;
 	}
+
 	FlushAll();
 
 	js.inDelaySlot = true;
@@ -112,65 +123,73 @@ void Jit::BranchRSRTComp(u32 op, Gen::CCFlags cc, bool likely)
 	js.inDelaySlot = false;
 
 	// Take the branch
-	WriteExit(targetAddr, 0);
+	WriteExit(targetAddr, js.nextExit++);
 
 	SetJumpTarget(ptr);
 	// Not taken
-	WriteExit(js.compilerPC+8, 1);
+	WriteExit(notTakenAddr, js.nextExit++);
 
 	js.compiling = false;
 }
 
-void Jit::BranchRSZeroComp(u32 op, Gen::CCFlags cc, bool likely)
+void Jit::BranchRSRTComp(u32 op, Gen::CCFlags cc, bool likely)
 {
 	if (js.inDelaySlot) {
 		ERROR_LOG(JIT, "Branch in delay slot at %08x", js.compilerPC);
 		return;
 	}
 	int offset = (signed short)(op&0xFFFF)<<2;
+	int rt = _RT;
 	int rs = _RS;
 	u32 targetAddr = js.compilerPC + offset + 4;
 
-	u32 delaySlotOp = Memory::ReadUnchecked_U32(js.compilerPC + 4);
+	u32 delaySlotOp = Memory::ReadUnchecked_U32(js.compilerPC+4);
 
-	bool delaySlotIsNice = GetOutReg(delaySlotOp) != rs; //IsDelaySlotNice(op, delaySlotOp);
+	//Compile the delay slot
+	bool delaySlotIsNice = GetOutReg(delaySlotOp) != rt && GetOutReg(delaySlotOp) != rs;// IsDelaySlotNice(op, delaySlotOp);
 	if (!delaySlotIsNice)
 	{
-		//ERROR_LOG(CPU, "Not nice delay slot in BranchRSZeroComp :( %08x", js.compilerPC);
+		//ERROR_LOG(CPU, "Not nice delay slot in BranchRSRTComp :( %08x", js.compilerPC);
 	}
 	delaySlotIsNice = false;	// Until we have time to fully fix this
-	
-	gpr.BindToRegister(rs, true, false);
-	CMP(32, gpr.R(rs), Imm32(0));
-	FlushAll();
 
-	Gen::FixupBranch ptr;
-	js.inDelaySlot = true;
-	if (!likely)
+	if (rs == 0)
 	{
-		if (!delaySlotIsNice)
-			SAVE_FLAGS; // preserve flag around the delay slot! Better hope the delay slot instruction doesn't need to fall back to interpreter...
-		CompileAt(js.compilerPC + 4);
-		FlushAll();
-		if (!delaySlotIsNice)
-			LOAD_FLAGS; // restore flag!
-		ptr = J_CC(cc, true);
+		gpr.BindToRegister(rt, true, false);
+		CMP(32, gpr.R(rt), Imm32(0));
 	}
 	else
 	{
-		ptr = J_CC(cc, true);
-		CompileAt(js.compilerPC + 4);
-		FlushAll();
+		gpr.BindToRegister(rs, true, false);
+		CMP(32, gpr.R(rs), rt == 0 ? Imm32(0) : gpr.R(rt));
 	}
-	js.inDelaySlot = false;
 
-	// Take the branch
-	WriteExit(targetAddr, 0);
+	CompBranchExits(cc, likely, delaySlotIsNice, targetAddr);
+}
 
-	SetJumpTarget(ptr);
-	// Not taken
-	WriteExit(js.compilerPC + 8, 1);
-	js.compiling = false;
+void Jit::BranchRSZeroComp(u32 op, Gen::CCFlags cc, bool likely)
+{
+	if (js.inDelaySlot) {
+		ERROR_LOG(JIT, "Branch in delay slot at %08x", js.compilerPC);
+		return;
+	}
+	int offset = (signed short)(op&0xFFFF)<<2;
+	int rs = _RS;
+	u32 targetAddr = js.compilerPC + offset + 4;
+
+	u32 delaySlotOp = Memory::ReadUnchecked_U32(js.compilerPC + 4);
+
+	bool delaySlotIsNice = GetOutReg(delaySlotOp) != rs; //IsDelaySlotNice(op, delaySlotOp);
+	if (!delaySlotIsNice)
+	{
+		//ERROR_LOG(CPU, "Not nice delay slot in BranchRSZeroComp :( %08x", js.compilerPC);
+	}
+	delaySlotIsNice = false;	// Until we have time to fully fix this
+	
+	gpr.BindToRegister(rs, true, false);
+	CMP(32, gpr.R(rs), Imm32(0));
+
+	CompBranchExits(cc, likely, delaySlotIsNice, targetAddr);
 }
 
 
@@ -192,9 +211,9 @@ void Jit::Comp_RelBranch(u32 op)
 
 	default:
 		_dbg_assert_msg_(CPU,0,"Trying to compile instruction that can't be compiled");
+		js.compiling = false;
 		break;
 	}
-	js.compiling = false;
 }
 
 void Jit::Comp_RelBranchRI(u32 op)
@@ -207,9 +226,9 @@ void Jit::Comp_RelBranchRI(u32 op)
 	case 3: BranchRSZeroComp(op, CC_L, true);	 break; //if ((s32)R(rs) >= 0) DelayBranchTo(addr); else PC += 8; break;//bgezl
 	default:
 		_dbg_assert_msg_(CPU,0,"Trying to compile instruction that can't be compiled");
+		js.compiling = false;
 		break;
 	}
-	js.compiling = false;
 }
 
 
@@ -233,37 +252,9 @@ void Jit::BranchFPFlag(u32 op, Gen::CCFlags cc, bool likely)
 
 	delaySlotIsNice = false;	// Until we have time to fully fix this
 
-	FlushAll();
-
 	TEST(32, M((void *)&(mips_->fpcond)), Imm32(1));
-	Gen::FixupBranch ptr;
-	js.inDelaySlot = true;
-	if (!likely)
-	{
-		if (!delaySlotIsNice)
-			SAVE_FLAGS; // preserve flag around the delay slot!
-		CompileAt(js.compilerPC + 4);
-		FlushAll();
-		if (!delaySlotIsNice)
-			LOAD_FLAGS; // restore flag!
-		ptr = J_CC(cc, true);
-	}
-	else
-	{
-		ptr = J_CC(cc, true);
-		CompileAt(js.compilerPC + 4);
-		FlushAll();
-	}
-	js.inDelaySlot = false;
 
-	// Take the branch
-	WriteExit(targetAddr, 0);
-
-	SetJumpTarget(ptr);
-	// Not taken
-	WriteExit(js.compilerPC + 8, 1);
-
-	js.compiling = false;
+	CompBranchExits(cc, likely, delaySlotIsNice, targetAddr);
 }
 
 
@@ -277,9 +268,9 @@ void Jit::Comp_FPUBranch(u32 op)
 	case 3: BranchFPFlag(op, CC_Z,	true);	break; //bc1tl
 	default:
 		_dbg_assert_msg_(CPU,0,"Trying to interpret instruction that can't be interpreted");
+		js.compiling = false;
 		break;
 	}
-	js.compiling = false;
 }
 
 // If likely is set, discard the branch slot if NOT taken.
@@ -302,41 +293,13 @@ void Jit::BranchVFPUFlag(u32 op, Gen::CCFlags cc, bool likely)
 
 	delaySlotIsNice = false;	// Until we have time to fully fix this
 
-	FlushAll();
-
 	// THE CONDITION
 	int imm3 = (op >> 18) & 7;
 
 	//int val = (mips_->vfpuCtrl[VFPU_CTRL_CC] >> imm3) & 1;
 	TEST(32, M((void *)&(mips_->vfpuCtrl[VFPU_CTRL_CC])), Imm32(1 << imm3));
-	Gen::FixupBranch ptr;
-	js.inDelaySlot = true;
-	if (!likely)
-	{
-		if (!delaySlotIsNice)
-			SAVE_FLAGS; // preserve flag around the delay slot!
-		CompileAt(js.compilerPC + 4);
-		FlushAll();
-		if (!delaySlotIsNice)
-			LOAD_FLAGS; // restore flag!
-		ptr = J_CC(cc, true);
-	}
-	else
-	{
-		ptr = J_CC(cc, true);
-		CompileAt(js.compilerPC + 4);
-		FlushAll();
-	}
-	js.inDelaySlot = false;
-
-	// Take the branch
-	WriteExit(targetAddr, 0);
-
-	SetJumpTarget(ptr);
-	// Not taken
-	WriteExit(js.compilerPC + 8, 1);
 
-	js.compiling = false;
+	CompBranchExits(cc, likely, delaySlotIsNice, targetAddr);
 }
 
 
@@ -355,9 +318,9 @@ void Jit::Comp_VBranch(u32 op)
 	case 3: BranchVFPUFlag(op, CC_Z,	true);	break; //bvtl
 	default:
 		_dbg_assert_msg_(CPU,0,"Comp_VBranch: Invalid instruction");
+		js.compiling = false;
 		break;
 	}
-	js.compiling = false;
 }
 
 void Jit::Comp_Jump(u32 op)
@@ -369,18 +332,30 @@ void Jit::Comp_Jump(u32 op)
 	u32 off = ((op & 0x3FFFFFF) << 2);
 	u32 targetAddr = (js.compilerPC & 0xF0000000) | off;
 	//Delay slot
+	js.inDelaySlot = true;
 	CompileAt(js.compilerPC + 4);
+	js.inDelaySlot = false;
+
+	// In a superblock, just carry on at the target.
+	if (CanExtendSuperblock(targetAddr))
+	{
+		if ((op >> 26) == 3) //jal
+			gpr.SetImmediate32(MIPS_REG_RA, js.compilerPC + 8);
+		ContinueSuperblockAt(targetAddr);
+		return;
+	}
+
 	FlushAll();
 
 	switch (op >> 26) 
 	{
 	case 2: //j
-		WriteExit(targetAddr, 0);
+		WriteExit(targetAddr, js.nextExit++);
 		break; 
 
 	case 3: //jal
 		MOV(32, M(&mips_->r[MIPS_REG_RA]), Imm32(js.compilerPC + 8));	// Save return address
-		WriteExit(targetAddr, 0);
+		WriteExit(targetAddr, js.nextExit++);
 		break;
 
 	default:
@@ -417,7 +392,9 @@ void Jit::Comp_JumpReg(u32 op)
 		gpr.BindToRegister(rs, true, false);
 		MOV(32, M(&currentMIPS->pc), gpr.R(rs));	// for syscalls in delay slot - could be avoided
 		MOV(32, M(&savedPC), gpr.R(rs));
+		js.inDelaySlot = true;
 		CompileAt(js.compilerPC + 4);
+		js.inDelaySlot = false;
 		FlushAll();
 
 		if (!js.compiling)
@@ -103,14 +103,10 @@ void Jit::Comp_FPULS(u32 op)
 		gpr.Lock(rs);
 		fpr.Lock(ft);
 		fpr.BindToRegister(ft, false, true);
-#ifdef _M_IX86
-		MOV(32, R(EAX), gpr.R(rs));
-		AND(32, R(EAX), Imm32(Memory::MEMVIEW32_MASK));
-		MOVSS(fpr.RX(ft), MDisp(EAX, (u32)Memory::base + offset));
-#else
-		MOV(32, R(EAX), gpr.R(rs));
-		MOVSS(fpr.RX(ft), MComplex(RBX, RAX, SCALE_1, offset));
-#endif
+		{
+			bool direct;
+			MOVSS(fpr.RX(ft), PrepareMemoryOpArg(rs, offset, 4, direct));
+		}
 		gpr.UnlockAll();
 		fpr.UnlockAll();
 		break;
@@ -118,14 +114,10 @@ void Jit::Comp_FPULS(u32 op)
 		gpr.Lock(rs);
 		fpr.Lock(ft);
 		fpr.BindToRegister(ft, true, false);
-#ifdef _M_IX86
-		MOV(32, R(EAX), gpr.R(rs));
-		AND(32, R(EAX), Imm32(Memory::MEMVIEW32_MASK));
-		MOVSS(MDisp(EAX, (u32)Memory::base + offset), fpr.RX(ft));
-#else
-		MOV(32, R(EAX), gpr.R(rs));
-		MOVSS(MComplex(RBX, RAX, SCALE_1, offset), fpr.RX(ft));
-#endif
+		{
+			bool direct;
+			MOVSS(PrepareMemoryOpArg(rs, offset, 4, direct), fpr.RX(ft));
+		}
 		gpr.UnlockAll();
 		fpr.UnlockAll();
 		break;
@@ -41,6 +41,108 @@
 
 namespace MIPSComp
 {
+	// Whether addr..addr+size is inside one of the views mapped in the arena, so a direct access can't fault.
+	static bool IsMappedAddress(u32 addr, int size)
+	{
+		// x64 addresses these as a signed disp32 off RBX, so keep below 2GB.
+		if (addr >= 0x80000000 || addr + size > 0x80000000)
+			return false;
+		// Bit 30 selects the uncached mirrors.
+		u32 masked = addr & 0x3FFFFFFF;
+		if (masked >= 0x00010000 && masked + size <= 0x00010000 + Memory::SCRATCHPAD_SIZE)
+			return true;
+		if (masked >= PSP_GetVidMemBase() && masked + size <= PSP_GetVidMemBase() + Memory::VRAM_SIZE)
+			return true;
+		return masked >= PSP_GetKernelMemoryBase() && masked + size <= PSP_GetUserMemoryEnd();
+	}
+
+	// Sets direct if the address is a known constant that can't fault. Otherwise the
+	// access must be padded with PadFastmemAccess.
+	OpArg Jit::PrepareMemoryOpArg(int rs, int offset, int size, bool &direct)
+	{
+		direct = false;
+		if (gpr.IsImmediate(rs))
+		{
+			u32 addr = gpr.GetImmediate32(rs) + offset;
+			if (IsMappedAddress(addr, size))
+			{
+				direct = true;
+#ifdef _M_IX86
+				return M(Memory::base + (addr & Memory::MEMVIEW32_MASK));
+#else
+				return MDisp(RBX, addr);
+#endif
+			}
+		}
+
+		MOV(32, R(EAX), gpr.R(rs));
+#ifdef _M_IX86
+		AND(32, R(EAX), Imm32(Memory::MEMVIEW32_MASK));
+		return MDisp(EAX, (u32)Memory::base + offset);
+#else
+		return MComplex(RBX, EAX, SCALE_1, offset);
+#endif
+	}
+
+	// Makes sure BackPatch has room for its CALL if this access faults.
+	void Jit::PadFastmemAccess(const u8 *start)
+	{
+#ifdef _M_X64
+		int size = (int)(GetCodePtr() - start);
+		if (size < FASTMEM_PATCH_SIZE)
+			NOP(FASTMEM_PATCH_SIZE - size);
+#endif
+	}
+
+	void Jit::CompITypeMemRead(u32 op, u32 bits, void (XEmitter::*mov)(int, int, X64Reg, OpArg))
+	{
+		int offset = (signed short)(op&0xFFFF);
+		int rt = _RT;
+		int rs = _RS;
+
+		gpr.Lock(rt, rs);
+		// The address is taken before rt is bound, so rs == rt needs no load.
+		bool direct;
+		OpArg src = PrepareMemoryOpArg(rs, offset, bits / 8, direct);
+		gpr.BindToRegister(rt, false, true);
+		const u8 *start = GetCodePtr();
+		(this->*mov)(32, bits, gpr.RX(rt), src);
+		if (!direct)
+			PadFastmemAccess(start);
+		gpr.UnlockAll();
+	}
+
+	void Jit::CompITypeMemWrite(u32 op, u32 bits)
+	{
+		int offset = (signed short)(op&0xFFFF);
+		int rt = _RT;
+		int rs = _RS;
+
+		gpr.Lock(rt, rs);
+		bool direct;
+		OpArg dest = PrepareMemoryOpArg(rs, offset, bits / 8, direct);
+		if (direct && gpr.IsImmediate(rt))
+		{
+			// The backpatcher can't handle immediate stores, but these never fault.
+			u32 value = gpr.GetImmediate32(rt);
+			if (bits == 8)
+				MOV(8, dest, Imm8((u8)value));
+			else if (bits == 16)
+				MOV(16, dest, Imm16((u16)value));
+			else
+				MOV(32, dest, Imm32(value));
+		}
+		else
+		{
+			gpr.BindToRegister(rt, true, false);
+			const u8 *start = GetCodePtr();
+			MOV(bits, dest, gpr.R(rt));
+			if (!direct)
+				PadFastmemAccess(start);
+		}
+		gpr.UnlockAll();
+	}
+
 	void Jit::Comp_ITypeMem(u32 op)
 	{
 		if (!g_Config.bFastMemory)
@@ -48,9 +150,7 @@ namespace MIPSComp
 			DISABLE;
 		}
 
-		int offset = (signed short)(op&0xFFFF);
 		int rt = _RT;
-		int rs = _RS;
 		int o = op>>26;
 		if (((op >> 29) & 1) == 0 && rt == 0) {
 			// Don't load anything into $zr
@@ -60,88 +160,49 @@ namespace MIPSComp
 		switch (o)
 		{
 		case 37: //R(rt) = ReadMem16(addr); break; //lhu
+			CompITypeMemRead(op, 16, &XEmitter::MOVZX);
+			break;
+
 		case 36: //R(rt) = ReadMem8 (addr); break; //lbu
-			Comp_Generic(op);
-			return;
+			CompITypeMemRead(op, 8, &XEmitter::MOVZX);
+			break;
 
 		case 35: //R(rt) = ReadMem32(addr); break; //lw
-			gpr.Lock(rt, rs);
-			gpr.BindToRegister(rt, rt == rs, true);
-#ifdef _M_IX86
-			MOV(32, R(EAX), gpr.R(rs));
-			AND(32, R(EAX), Imm32(Memory::MEMVIEW32_MASK));
-			MOV(32, gpr.R(rt), MDisp(EAX, (u32)Memory::base + offset));
-#else
-			MOV(32, R(EAX), gpr.R(rs));
-			MOV(32, gpr.R(rt), MComplex(RBX, EAX, SCALE_1, offset));
-#endif
-			gpr.UnlockAll();
+			CompITypeMemRead(op, 32, &XEmitter::MOVZX);
 			break;
 
-		case 132: //R(rt) = (u32)(s32)(s8) ReadMem8 (addr); break; //lb
-		case 133: //R(rt) = (u32)(s32)(s16)ReadMem16(addr); break; //lh
-		case 136: //R(rt) = ReadMem8 (addr); break; //lbu
-		case 140: //WriteMem8 (addr, R(rt)); break; //sb
-			
-		case 40:
-		case 41: //WriteMem16(addr, R(rt)); break; //sh
-			Comp_Generic(op);
-			return;
+		case 32: //R(rt) = (u32)(s32)(s8) ReadMem8 (addr); break; //lb
+			CompITypeMemRead(op, 8, &XEmitter::MOVSX);
+			break;
 
-		case 43: //WriteMem32(addr, R(rt)); break; //sw
-			{
-				gpr.Lock(rt, rs);
-				gpr.BindToRegister(rt, true, false);
+		case 33: //R(rt) = (u32)(s32)(s16)ReadMem16(addr); break; //lh
+			CompITypeMemRead(op, 16, &XEmitter::MOVSX);
+			break;
+
+		case 40: //WriteMem8 (addr, R(rt)); break; //sb
 #ifdef _M_IX86
-				MOV(32, R(EAX), gpr.R(rs));
-				AND(32, R(EAX), Imm32(Memory::MEMVIEW32_MASK));
-				MOV(32, MDisp(EAX, (u32)Memory::base + offset), gpr.R(rt));
-#else
-				MOV(32, R(EAX), gpr.R(rs));
-				MOV(32, MComplex(RBX, EAX, SCALE_1, offset), gpr.R(rt));
+			// ESI/EDI/EBP have no 8-bit form and EAX holds the address.
+			DISABLE;
 #endif
-				gpr.UnlockAll();
-			}
+			CompITypeMemWrite(op, 8);
 			break;
 
-		case 134: //lwl
-			{
-				Crash();
-				//u32 shift = (addr & 3) << 3;
-				//u32 mem = ReadMem32(addr & 0xfffffffc);
-				//R(rt) = ( u32(R(rt)) & (0x00ffffff >> shift) ) | ( mem << (24 - shift) );
-			}
+		case 41: //WriteMem16(addr, R(rt)); break; //sh
+			CompITypeMemWrite(op, 16);
 			break;
 
-		case 138: //lwr
-			{
-				Crash();
-				//u32 shift = (addr & 3) << 3;
-				//u32 mem = ReadMem32(addr & 0xfffffffc);
-
-				//R(rt) = ( u32(rt) & (0xffffff00 << (24 - shift)) ) | ( mem	>> shift );
-			}
+		case 43: //WriteMem32(addr, R(rt)); break; //sw
+			CompITypeMemWrite(op, 32);
 			break;
 
-		case 142: //swl
-			{
-				Crash();
-				//u32 shift = (addr & 3) << 3;
-				//u32 mem = ReadMem32(addr & 0xfffffffc);
-				//WriteMem32((addr & 0xfffffffc),	( ( u32(R(rt)) >>	(24 - shift) ) ) |
-				//	(	mem & (0xffffff00 << shift) ));
-			}
-			break;
-		case 146: //swr
-			{
-				Crash();
-				//	u32 shift = (addr & 3) << 3;
-			//	u32 mem = ReadMem32(addr & 0xfffffffc);
-//
-//				WriteMem32((addr & 0xfffffffc), ( ( u32(R(rt)) << shift ) |
-//					(mem	& (0x00ffffff >> (24 - shift)) ) ) );
-			}
-			break;
+		case 34: //lwl
+		case 38: //lwr
+		case 42: //swl
+		case 46: //swr
+			// These merge with rt / memory, the interpreter handles them for now.
+			Comp_Generic(op);
+			return;
+
 		default:
 			Comp_Generic(op);
 			return ;
@@ -17,6 +17,7 @@
 
 #include "../../MemMap.h"
 #include "../MIPSAnalyst.h"
+#include "../MIPSVFPUUtils.h"
 
 #include "Jit.h"
 #include "RegCache.h"
@@ -42,4 +43,464 @@
 namespace MIPSComp
 {
 
-}
\ No newline at end of file
+static const float vfpuConstants[8] = {0.f, 1.f, 2.f, 0.5f, 3.f, 1.f/3.f, 0.25f, 1.f/6.f};
+static const float zero = 0.0f;
+static const float one = 1.0f;
+static const float minusOne = -1.0f;
+static const u32 GC_ALIGNED16(noSignMask[4]) = {0x7FFFFFFF, 0x7FFFFFFF, 0x7FFFFFFF, 0x7FFFFFFF};
+static const u32 GC_ALIGNED16(signBitAll[4]) = {0x80000000, 0x80000000, 0x80000000, 0x80000000};
+
+// Results are parked here when writing them directly would clobber a source.
+static float GC_ALIGNED16(vfpuTemp[16]);
+
+static void GetVectorRegsF(u8 regs[4], VectorSize sz, int vectorReg)
+{
+	GetVectorRegs(regs, sz, vectorReg);
+	for (int i = 0; i < GetNumVectorElements(sz); i++)
+		regs[i] = FPURegCache::V(regs[i]);
+}
+
+static void GetMatrixRegsF(u8 regs[16], MatrixSize sz, int matrixReg)
+{
+	GetMatrixRegs(regs, sz, matrixReg);
+	int n = GetMatrixSide(sz);
+	for (int i = 0; i < n; i++)
+		for (int j = 0; j < n; j++)
+			regs[j * 4 + i] = FPURegCache::V(regs[j * 4 + i]);
+}
+
+// Which source lane an S/T prefix makes lane i read, or -1 for a constant.
+static int PrefixLaneSource(u32 prefix, int i)
+{
+	if ((prefix >> (12 + i)) & 1)
+		return -1;
+	return (prefix >> (i * 2)) & 3;
+}
+
+// The interpreter reads garbage for lanes swizzled in from beyond the vector size.
+static bool IsPrefixWithinSize(u32 prefix, int n)
+{
+	for (int i = 0; i < n; i++)
+	{
+		if (PrefixLaneSource(prefix, i) >= n)
+			return false;
+	}
+	return true;
+}
+
+static bool IsLaneMasked(u32 prefixD, int lane)
+{
+	return ((prefixD >> (8 + lane)) & 1) != 0;
+}
+
+// Would writing dregs[i] as we go clobber something a later lane of s/t still reads?
+static bool LaterLanesRead(const u8 *dregs, int n, const u8 *sregs, u32 prefixS, const u8 *tregs, u32 prefixT)
+{
+	for (int i = 0; i < n; i++)
+	{
+		for (int j = i + 1; j < n; j++)
+		{
+			int s = PrefixLaneSource(prefixS, j);
+			int t = PrefixLaneSource(prefixT, j);
+			if ((s >= 0 && sregs[s] == dregs[i]) || (tregs && t >= 0 && tregs[t] == dregs[i]))
+				return true;
+		}
+	}
+	return false;
+}
+
+static bool RegsOverlap(const u8 *a, int an, const u8 *b, int bn)
+{
+	for (int i = 0; i < an; i++)
+		for (int j = 0; j < bn; j++)
+			if (a[i] == b[j])
+				return true;
+	return false;
+}
+
+// Only the n x n corner of GetMatrixRegs' output is filled in.
+static bool MatricesOverlap(const u8 *a, const u8 *b, int n)
+{
+	for (int i = 0; i < n; i++)
+		for (int j = 0; j < n; j++)
+			if (RegsOverlap(&a[i * 4], n, &b[j * 4], n))
+				return true;
+	return false;
+}
+
+void Jit::LoadPrefixedLane(X64Reg dest, const u8 *vregs, u32 prefix, int lane)
+{
+	int regnum = (prefix >> (lane * 2)) & 3;
+	int abs = (prefix >> (8 + lane)) & 1;
+	int negate = (prefix >> (16 + lane)) & 1;
+	int constants = (prefix >> (12 + lane)) & 1;
+
+	if (constants)
+		MOVSS(dest, M((void *)&vfpuConstants[regnum + (abs << 2)]));
+	else
+	{
+		MOVSS(dest, fpr.R(vregs[regnum]));
+		if (abs)
+			ANDPS(dest, M((void *)noSignMask));
+	}
+	if (negate)
+		XORPS(dest, M((void *)signBitAll));
+}
+
+// Saturation from the D prefix. Written so NaNs pass through, like the interpreter. Uses XMM1.
+void Jit::ApplyPrefixDLane(X64Reg reg, int lane)
+{
+	int sat = (js.prefixD >> (lane * 2)) & 3;
+	if (sat == 1 || sat == 3)
+	{
+		MOVSS(XMM1, M((void *)(sat == 1 ? &zero : &minusOne)));
+		MAXSS(XMM1, R(reg));
+		MOVSS(reg, M((void *)&one));
+		MINSS(reg, R(XMM1));
+	}
+}
+
+void Jit::StoreVectorLane(int freg, X64Reg src)
+{
+	fpr.BindToRegister(freg, false, true);
+	MOVSS(fpr.RX(freg), R(src));
+}
+
+void Jit::Comp_VPFX(u32 op)
+{
+	CONDITIONAL_DISABLE;
+
+	// Just remember it, ops compiled natively use it directly. Stored on flush.
+	u32 data = op & 0xFFFFF;
+	switch ((op >> 24) & 3)
+	{
+	case 0:
+		js.prefixS = data;
+		js.prefixSFlag = JitState::PREFIX_KNOWN_DIRTY;
+		break;
+	case 1:
+		js.prefixT = data;
+		js.prefixTFlag = JitState::PREFIX_KNOWN_DIRTY;
+		break;
+	case 2:
+		js.prefixD = data;
+		js.prefixDFlag = JitState::PREFIX_KNOWN_DIRTY;
+		break;
+	default:
+		DISABLE;
+	}
+}
+
+void Jit::Comp_VecDo3(u32 op)
+{
+	CONDITIONAL_DISABLE;
+
+	if (js.HasUnknownPrefix())
+	{
+		DISABLE;
+	}
+
+	void (XEmitter::*xmmop)(X64Reg, OpArg) = NULL;
+	switch (op >> 26)
+	{
+	case 24: //VFPU0
+		switch ((op >> 23) & 7)
+		{
+		case 0: xmmop = &XEmitter::ADDSS; break; //vadd
+		case 1: xmmop = &XEmitter::SUBSS; break; //vsub
+		case 7: xmmop = &XEmitter::DIVSS; break; //vdiv
+		}
+		break;
+	case 25: //VFPU1
+		if (((op >> 23) & 7) == 0)
+			xmmop = &XEmitter::MULSS; //vmul
+		break;
+	}
+
+	VectorSize sz = GetVecSize(op);
+	int n = GetNumVectorElements(sz);
+	if (!xmmop || !IsPrefixWithinSize(js.prefixS, n) || !IsPrefixWithinSize(js.prefixT, n))
+	{
+		DISABLE;
+	}
+
+	u8 sregs[4], tregs[4], dregs[4];
+	GetVectorRegsF(sregs, sz, _VS);
+	GetVectorRegsF(tregs, sz, _VT);
+	GetVectorRegsF(dregs, sz, _VD);
+	bool useTemp = LaterLanesRead(dregs, n, sregs, js.prefixS, tregs, js.prefixT);
+
+	for (int i = 0; i < n; i++)
+	{
+		if (IsLaneMasked(js.prefixD, i))
+			continue;
+		LoadPrefixedLane(XMM0, sregs, js.prefixS, i);
+		LoadPrefixedLane(XMM1, tregs, js.prefixT, i);
+		(this->*xmmop)(XMM0, R(XMM1));
+		ApplyPrefixDLane(XMM0, i);
+		if (useTemp)
+			MOVSS(M((void *)&vfpuTemp[i]), XMM0);
+		else
+			StoreVectorLane(dregs[i], XMM0);
+	}
+
+	if (useTemp)
+	{
+		for (int i = 0; i < n; i++)
+		{
+			if (IsLaneMasked(js.prefixD, i))
+				continue;
+			MOVSS(XMM0, M((void *)&vfpuTemp[i]));
+			StoreVectorLane(dregs[i], XMM0);
+		}
+	}
+
+	js.EatPrefix();
+}
+
+void Jit::Comp_VDot(u32 op)
+{
+	CONDITIONAL_DISABLE;
+
+	if (js.HasUnknownPrefix())
+	{
+		DISABLE;
+	}
+
+	VectorSize sz = GetVecSize(op);
+	int n = GetNumVectorElements(sz);
+	if (!IsPrefixWithinSize(js.prefixS, n) || !IsPrefixWithinSize(js.prefixT, n))
+	{
+		DISABLE;
+	}
+
+	u8 sregs[4], tregs[4];
+	GetVectorRegsF(sregs, sz, _VS);
+	GetVectorRegsF(tregs, sz, _VT);
+
+	// Sums from 0.0f like the interpreter, which matters for -0.0.
+	X64Reg tempxreg = fpr.GetFreeXReg();
+	fpr.LockX(tempxreg);
+	XORPS(XMM0, R(XMM0));
+	for (int i = 0; i < n; i++)
+	{
+		LoadPrefixedLane(XMM1, sregs, js.prefixS, i);
+		LoadPrefixedLane(tempxreg, tregs, js.prefixT, i);
+		MULSS(XMM1, R(tempxreg));
+		ADDSS(XMM0, R(XMM1));
+	}
+	fpr.UnlockAllX();
+
+	// The write mask doesn't apply, the interpreter writes the single lane directly.
+	ApplyPrefixDLane(XMM0, 0);
+	StoreVectorLane(FPURegCache::V(_VD), XMM0);
+
+	js.EatPrefix();
+}
+
+void Jit::Comp_VScl(u32 op)
+{
+	CONDITIONAL_DISABLE;
+
+	if (js.HasUnknownPrefix())
+	{
+		DISABLE;
+	}
+
+	VectorSize sz = GetVecSize(op);
+	int n = GetNumVectorElements(sz);
+	if (!IsPrefixWithinSize(js.prefixS, n))
+	{
+		DISABLE;
+	}
+
+	// Only S is prefixed, the scale is read as is.
+	u8 sregs[4], dregs[4];
+	GetVectorRegsF(sregs, sz, _VS);
+	GetVectorRegsF(dregs, sz, _VD);
+	u8 treg = FPURegCache::V(_VT);
+	bool useTemp = LaterLanesRead(dregs, n, sregs, js.prefixS, NULL, 0) || RegsOverlap(dregs, n - 1, &treg, 1);
+
+	for (int i = 0; i < n; i++)
+	{
+		if (IsLaneMasked(js.prefixD, i))
+			continue;
+		LoadPrefixedLane(XMM0, sregs, js.prefixS, i);
+		MULSS(XMM0, fpr.R(treg));
+		ApplyPrefixDLane(XMM0, i);
+		if (useTemp)
+			MOVSS(M((void *)&vfpuTemp[i]), XMM0);
+		else
+			StoreVectorLane(dregs[i], XMM0);
+	}
+
+	if (useTemp)
+	{
+		for (int i = 0; i < n; i++)
+		{
+			if (IsLaneMasked(js.prefixD, i))
+				continue;
+			MOVSS(XMM0, M((void *)&vfpuTemp[i]));
+			StoreVectorLane(dregs[i], XMM0);
+		}
+	}
+
+	js.EatPrefix();
+}
+
+// Prefixes don't apply to vmmul, vtfm and vcrsp, they're just eaten.
+void Jit::Comp_Vmmul(u32 op)
+{
+	CONDITIONAL_DISABLE;
+
+	MatrixSize sz = GetMtxSize(op);
+	int n = GetMatrixSide(sz);
+
+	u8 sregs[16], tregs[16], dregs[16];
+	GetMatrixRegsF(sregs, sz, _VS);
+	GetMatrixRegsF(tregs, sz, _VT);
+	GetMatrixRegsF(dregs, sz, _VD);
+	bool useTemp = MatricesOverlap(dregs, sregs, n) || MatricesOverlap(dregs, tregs, n);
+
+	for (int a = 0; a < n; a++)
+	{
+		for (int b = 0; b < n; b++)
+		{
+			XORPS(XMM0, R(XMM0));
+			for (int c = 0; c < n; c++)
+			{
+				MOVSS(XMM1, fpr.R(sregs[b * 4 + c]));
+				MULSS(XMM1, fpr.R(tregs[a * 4 + c]));
+				ADDSS(XMM0, R(XMM1));
+			}
+			if (useTemp)
+				MOVSS(M((void *)&vfpuTemp[a * 4 + b]), XMM0);
+			else
+				StoreVectorLane(dregs[a * 4 + b], XMM0);
+		}
+	}
+
+	if (useTemp)
+	{
+		for (int a = 0; a < n; a++)
+		{
+			for (int b = 0; b < n; b++)
+			{
+				MOVSS(XMM0, M((void *)&vfpuTemp[a * 4 + b]));
+				StoreVectorLane(dregs[a * 4 + b], XMM0);
+			}
+		}
+	}
+
+	js.EatPrefix();
+}
+
+void Jit::Comp_Vtfm(u32 op)
+{
+	CONDITIONAL_DISABLE;
+
+	int ins = (op >> 23) & 7;
+	VectorSize sz = GetVecSize(op);
+	MatrixSize msz = GetMtxSize(op);
+	int n = GetNumVectorElements(sz);
+
+	// vhtfm: the last column is added as is, as if t had a 1 there.
+	bool homogenous = false;
+	if (n == ins)
+	{
+		n++;
+		sz = (VectorSize)((int)sz + 1);
+		msz = (MatrixSize)((int)msz + 1);
+		homogenous = true;
+	}
+	if (n != ins + 1 || sz > V_Quad || msz > M_4x4 || GetMatrixSide(msz) != n)
+	{
+		DISABLE;
+	}
+
+	u8 sregs[16], tregs[4], dregs[4];
+	GetMatrixRegsF(sregs, msz, _VS);
+	GetVectorRegsF(tregs, sz, _VT);
+	GetVectorRegsF(dregs, sz, _VD);
+
+	bool useTemp = RegsOverlap(dregs, n, tregs, n);
+	for (int i = 0; i < n && !useTemp; i++)
+		useTemp = RegsOverlap(dregs, n, &sregs[i * 4], n);
+
+	for (int i = 0; i < n; i++)
+	{
+		XORPS(XMM0, R(XMM0));
+		for (int k = 0; k < n; k++)
+		{
+			if (homogenous && k == n - 1)
+				ADDSS(XMM0, fpr.R(sregs[i * 4 + k]));
+			else
+			{
+				MOVSS(XMM1, fpr.R(sregs[i * 4 + k]));
+				MULSS(XMM1, fpr.R(tregs[k]));
+				ADDSS(XMM0, R(XMM1));
+			}
+		}
+		if (useTemp)
+			MOVSS(M((void *)&vfpuTemp[i]), XMM0);
+		else
+			StoreVectorLane(dregs[i], XMM0);
+	}
+
+	if (useTemp)
+	{
+		for (int i = 0; i < n; i++)
+		{
+			MOVSS(XMM0, M((void *)&vfpuTemp[i]));
+			StoreVectorLane(dregs[i], XMM0);
+		}
+	}
+
+	js.EatPrefix();
+}
+
+void Jit::Comp_VCrossQuat(u32 op)
+{
+	CONDITIONAL_DISABLE;
+
+	// vqmul.q is left to the interpreter.
+	VectorSize sz = GetVecSize(op);
+	if (sz != V_Triple)
+	{
+		DISABLE;
+	}
+
+	u8 sregs[4], tregs[4], dregs[4];
+	GetVectorRegsF(sregs, sz, _VS);
+	GetVectorRegsF(tregs, sz, _VT);
+	GetVectorRegsF(dregs, sz, _VD);
+	bool useTemp = RegsOverlap(dregs, 3, sregs, 3) || RegsOverlap(dregs, 3, tregs, 3);
+
+	// d[i] = s[i+1]*t[i+2] - s[i+2]*t[i+1]
+	for (int i = 0; i < 3; i++)
+	{
+		int a = (i + 1) % 3, b = (i + 2) % 3;
+		MOVSS(XMM0, fpr.R(sregs[a]));
+		MULSS(XMM0, fpr.R(tregs[b]));
+		MOVSS(XMM1, fpr.R(sregs[b]));
+		MULSS(XMM1, fpr.R(tregs[a]));
+		SUBSS(XMM0, R(XMM1));
+		if (useTemp)
+			MOVSS(M((void *)&vfpuTemp[i]), XMM0);
+		else
+			StoreVectorLane(dregs[i], XMM0);
+	}
+
+	if (useTemp)
+	{
+		for (int i = 0; i < 3; i++)
+		{
+			MOVSS(XMM0, M((void *)&vfpuTemp[i]));
+			StoreVectorLane(dregs[i], XMM0);
+		}
+	}
+
+	js.EatPrefix();
+}
+
+}
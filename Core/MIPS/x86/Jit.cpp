@@ -20,6 +20,7 @@
 #include "../MIPS.h"
 #include "../MIPSCodeUtils.h"
 #include "../MIPSInt.h"
+#include "../MIPSIntVFPU.h"
 #include "../MIPSTables.h"
 
 #include "RegCache.h"
@@ -31,25 +32,85 @@ extern u32 *pspmainram;
 namespace MIPSComp
 {
 
-Jit::Jit(MIPSState *mips) : blocks(mips), mips_(mips)
+Jit::Jit(MIPSState *mips) : blocks(mips), mips_(mips), codeRegion_(0),
+	backPatchCount_(0), lastBackPatchResult_(BACKPATCH_NONE), lastBackPatchAddress_(0)
 {
 	blocks.Init();
 	asm_.Init(mips, this);
 	gpr.SetEmitter(this);
 	fpr.SetEmitter(this);
 	AllocCodeSpace(1024 * 1024 * 16);
+	trampolines_.Init();
+	InstallFastmemFaultHandler();
 }
 
 void Jit::FlushAll()
 {
 	gpr.Flush(FLUSH_ALL);
 	fpr.Flush(FLUSH_ALL);
+	FlushPrefixV();
+}
+
+void Jit::FlushPrefixV()
+{
+	if ((js.prefixSFlag & JitState::PREFIX_DIRTY) != 0)
+	{
+		MOV(32, M(&mips_->vfpuCtrl[VFPU_CTRL_SPREFIX]), Imm32(js.prefixS));
+		js.prefixSFlag &= ~JitState::PREFIX_DIRTY;
+	}
+	if ((js.prefixTFlag & JitState::PREFIX_DIRTY) != 0)
+	{
+		MOV(32, M(&mips_->vfpuCtrl[VFPU_CTRL_TPREFIX]), Imm32(js.prefixT));
+		js.prefixTFlag &= ~JitState::PREFIX_DIRTY;
+	}
+	if ((js.prefixDFlag & JitState::PREFIX_DIRTY) != 0)
+	{
+		MOV(32, M(&mips_->vfpuCtrl[VFPU_CTRL_DPREFIX]), Imm32(js.prefixD));
+		js.prefixDFlag &= ~JitState::PREFIX_DIRTY;
+	}
 }
 
 void Jit::ClearCache()
 {
 	blocks.Clear();
 	ClearCodeSpace();
+#ifdef _M_X64
+	trampolines_.ClearCodeSpace();
+#endif
+	codeRegion_ = 0;
+}
+
+void Jit::InvalidateCacheAt(u32 em_address, int length)
+{
+	// This only unlinks and redirects, the code itself stays until its region is reused.
+	blocks.InvalidateICache(em_address, length);
+}
+
+// Must only be called from outside of block code (dispatcher, recompileHotBlock),
+// since the region that gets reused may hold the block we came from.
+void Jit::PrepareCodeSpace()
+{
+	bool trampolinesFull = false;
+#ifdef _M_X64
+	// Trampolines can't be freed with the blocks that use them.
+	trampolinesFull = trampolines_.GetSpaceLeft() < JIT_MIN_TRAMPOLINE_SPACE;
+#endif
+	if (blocks.IsFull() || trampolinesFull)
+	{
+		// Block numbers aren't recycled, so this still takes everything.
+		ClearCache();
+		return;
+	}
+
+	const size_t regionSize = region_size / JIT_CODE_REGIONS;
+	if (GetCodePtr() + JIT_MIN_BLOCK_SPACE <= region + (codeRegion_ + 1) * regionSize)
+		return;
+
+	codeRegion_ = (codeRegion_ + 1) % JIT_CODE_REGIONS;
+	u8 *start = region + codeRegion_ * regionSize;
+	blocks.DestroyBlocksInCodeRange(start, start + regionSize);
+	memset(start, 0xCC, regionSize);
+	SetCodePtr(start);
 }
 
 u8 *codeCache;
@@ -57,25 +118,46 @@ u8 *codeCache;
 void Jit::CompileAt(u32 addr)
 {
 	u32 op = Memory::Read_Instruction(addr);
+	gpr.SetCompilerPC(addr);
+	fpr.SetCompilerPC(addr);
 	MIPSCompileOp(op);
 }
 
 void Jit::Compile(u32 em_address)
 {
-	if (GetSpaceLeft() < 0x10000 || blocks.IsFull())
-	{
-		ClearCache();
-	}
+	PrepareCodeSpace();
 
 	int block_num = blocks.AllocateBlock(em_address);
 	JitBlock *b = blocks.GetBlock(block_num);
+	js.superblock = false;
 	blocks.FinalizeBlock(block_num, jo.enableBlocklink, DoJit(em_address, b));
 }
 
+void Jit::CompileSuperblock(u32 em_address)
+{
+	// The old block is still around (we came from it), take it out first.
+	int old_block = blocks.GetBlockNumberFromStartAddress(em_address);
+	if (old_block >= 0)
+		blocks.DestroyBlock(old_block, true);
+
+	PrepareCodeSpace();
+
+	int block_num = blocks.AllocateBlock(em_address);
+	JitBlock *b = blocks.GetBlock(block_num);
+	js.superblock = true;
+	const u8 *code = DoJit(em_address, b);
+	js.superblock = false;
+
+	blocks.FinalizeBlock(block_num, jo.enableBlocklink, code);
+	for (int i = 1; i < js.numSegments; i++)
+		blocks.AddBlockRange(block_num, js.segmentStart[i], js.segmentEnd[i] - js.segmentStart[i]);
+}
+
 void Jit::RunLoopUntil(u64 globalticks)
 {
 	// TODO: copy globalticks somewhere
 	((void (*)())asm_.enterCode)();
+	LogBackPatches();
 	// NOTICE_LOG(HLE, "Exited jitted code at %i, corestate=%i, dc=%i", CoreTiming::GetTicks() / 1000, (int)coreState, CoreTiming::downcount);
 }
 
@@ -87,6 +169,14 @@ const u8 *Jit::DoJit(u32 em_address, JitBlock *b)
 	js.curBlock = b;
 	js.compiling = true;
 	js.inDelaySlot = false;
+	js.nextExit = 0;
+	js.numInstructions = 0;
+	js.numSegments = 1;
+	js.segmentStart[0] = js.blockStart;
+	// We can't know what the code before us left in the prefixes.
+	js.prefixSFlag = JitState::PREFIX_UNKNOWN;
+	js.prefixTFlag = JitState::PREFIX_UNKNOWN;
+	js.prefixDFlag = JitState::PREFIX_UNKNOWN;
 
 	// We add a check before the block, used when entering from a linked block.
 	b->checkedEntry = GetCodePtr();
@@ -98,31 +188,100 @@ const u8 *Jit::DoJit(u32 em_address, JitBlock *b)
 
 	b->normalEntry = GetCodePtr();
 
-	// TODO: this needs work
-	MIPSAnalyst::AnalysisResults analysis; // = MIPSAnalyst::Analyze(em_address);
+	// Count entries, hot blocks get recompiled as superblocks. EAX is free on block entry.
+	if (jo.enableSuperblocks && !js.superblock)
+	{
+#ifdef _M_X64
+		MOV(64, R(RAX), ImmPtr(&b->runCount));
+		ADD(32, MatR(RAX), Imm8(1));
+		CMP(32, MatR(RAX), Imm32(jo.superblockThreshold));
+#else
+		ADD(32, M(&b->runCount), Imm8(1));
+		CMP(32, M(&b->runCount), Imm32(jo.superblockThreshold));
+#endif
+		FixupBranch notHot = J_CC(CC_NE);
+		MOV(32, M(&mips_->pc), Imm32(js.blockStart));
+		JMP(asm_.recompileHotBlock, true);
+		SetJumpTarget(notHot);
+	}
+
+	MIPSAnalyst::AnalysisResults analysis = MIPSAnalyst::Analyze(em_address);
 
 	gpr.Start(mips_, analysis);
 	fpr.Start(mips_, analysis);
 
-	int numInstructions = 0;
 	while (js.compiling)
 	{
 		u32 inst = Memory::Read_Instruction(js.compilerPC);
 		js.downcountAmount += MIPSGetInstructionCycleEstimate(inst);
 
+		gpr.SetCompilerPC(js.compilerPC);
+		fpr.SetCompilerPC(js.compilerPC);
 		MIPSCompileOp(inst);
 
 		js.compilerPC += 4;
-		numInstructions++;
+		js.numInstructions++;
 	}
 
 	b->codeSize = (u32)(GetCodePtr() - b->normalEntry);
 	NOP();
 	AlignCode4();
-	b->originalSize = numInstructions;
+	if (js.superblock)
+	{
+		// The last segment ends after the delay slot of the final branch.
+		js.segmentEnd[js.numSegments - 1] = js.compilerPC + 4;
+		b->flags |= BLOCK_SUPERBLOCK;
+		b->originalSize = (js.segmentEnd[0] - js.segmentStart[0]) / 4;
+	}
+	else
+		b->originalSize = js.numInstructions;
 	return b->normalEntry;
 }
 
+bool Jit::PredictBranchTaken(u32 targetAddr, u32 notTakenAddr)
+{
+	// Backwards branches are mostly loops.
+	if (targetAddr <= js.compilerPC)
+		return true;
+
+	// Otherwise, go with whichever side has been entered more often so far.
+	int takenBlock = blocks.GetBlockNumberFromStartAddress(targetAddr);
+	int notTakenBlock = blocks.GetBlockNumberFromStartAddress(notTakenAddr);
+	int takenCount = takenBlock >= 0 ? blocks.GetBlock(takenBlock)->runCount : 0;
+	int notTakenCount = notTakenBlock >= 0 ? blocks.GetBlock(notTakenBlock)->runCount : 0;
+	return takenCount > notTakenCount;
+}
+
+bool Jit::CanExtendSuperblock(u32 destination)
+{
+	if (!js.superblock || js.inDelaySlot)
+		return false;
+	if (js.numSegments >= JIT_MAX_SUPERBLOCK_SEGMENTS || js.numInstructions >= JIT_MAX_SUPERBLOCK_LENGTH)
+		return false;
+	if (!Memory::IsValidAddress(destination))
+		return false;
+
+	// Don't unroll loops, jumping back into the superblock is an exit.
+	for (int i = 0; i < js.numSegments; i++)
+	{
+		u32 end = i == js.numSegments - 1 ? js.compilerPC + 8 : js.segmentEnd[i];
+		if (destination >= js.segmentStart[i] && destination < end)
+			return false;
+	}
+	return true;
+}
+
+void Jit::ContinueSuperblockAt(u32 nextPC)
+{
+	// The current segment ends after the branch's delay slot.
+	js.segmentEnd[js.numSegments - 1] = js.compilerPC + 8;
+	js.segmentStart[js.numSegments] = nextPC;
+	js.numSegments++;
+
+	// DoJit will step to nextPC.
+	js.compilerPC = nextPC - 4;
+}
+
 void Jit::Comp_RunBlock(u32 op)
 {
 	// This shouldn't be necessary, the dispatcher should catch us before we get here.
@@ -131,6 +290,14 @@ void Jit::Comp_RunBlock(u32 op)
 
 void Jit::Comp_Generic(u32 op)
 {
+	// The interpreter only sees what's in memory, but values that get overwritten
+	// before they're read again don't need to go there. Not safe in a delay slot,
+	// since the next instruction depends on the branch.
+	if (!js.inDelaySlot)
+	{
+		gpr.DiscardDeadRegs();
+		fpr.DiscardDeadRegs();
+	}
 	FlushAll();
 	MIPSInterpretFunc func = MIPSGetInterpretFunc(op);
 	if (func)
@@ -138,6 +305,28 @@ void Jit::Comp_Generic(u32 op)
 		MOV(32, M(&mips_->pc), Imm32(js.compilerPC));
 		ABI_CallFunctionC((void *)func, op);
 	}
+
+	if ((MIPSGetInfo(op) & IS_VFPU) != 0)
+	{
+		// The prefixes were flushed above, so these match memory afterwards.
+		if (func == &MIPSInt::Int_Vmtvc || func == &MIPSInt::Int_VPFX)
+		{
+			js.prefixSFlag = JitState::PREFIX_UNKNOWN;
+			js.prefixTFlag = JitState::PREFIX_UNKNOWN;
+			js.prefixDFlag = JitState::PREFIX_UNKNOWN;
+		}
+		else if (func != &MIPSInt::Int_SV && func != &MIPSInt::Int_SVQ &&
+			func != &MIPSInt::Int_Mftv && func != &MIPSInt::Int_Vmfvc && func != &MIPSInt::Int_Vflush &&
+			func != &MIPSInt::Int_Vrnds)
+		{
+			js.prefixS = 0xE4;
+			js.prefixT = 0xE4;
+			js.prefixD = 0;
+			js.prefixSFlag = JitState::PREFIX_KNOWN;
+			js.prefixTFlag = JitState::PREFIX_KNOWN;
+			js.prefixDFlag = JitState::PREFIX_KNOWN;
+		}
+	}
 }
 
 void Jit::WriteExit(u32 destination, int exit_num)
@@ -149,21 +338,51 @@ void Jit::WriteExit(u32 destination, int exit_num)
 	b->exitAddress[exit_num] = destination;
 	b->exitPtrs[exit_num] = GetWritableCodePtr();
 
-	// Link opportunity!
-	int block = blocks.GetBlockNumberFromStartAddress(destination);
-	if (jo.enableBlocklink)
-	{
-		if (block >= 0 && jo.enableBlocklink)
-		{
-			// It exists! Joy of joy!
-			JMP(blocks.GetBlock(block)->checkedEntry, true);
-			b->linkStatus[exit_num] = true;
-			return;
-		}
-	}
-	// No blocklinking.
+	// Always write the unlinked exit first, links are patched over it so they can be undone.
 	MOV(32, M(&mips_->pc), Imm32(destination));
 	JMP(asm_.dispatcher, true);
+
+	// Looping back to ourselves is always safe, since DestroyBlock redirects checkedEntry
+	// to the dispatcher. Keeps tight loops out of the dispatcher even without blocklinking.
+	const u8 *target = 0;
+	if (destination == js.blockStart)
+		target = b->checkedEntry;
+	else if (jo.enableBlocklink)
+	{
+		// Link opportunity!
+		int block = blocks.GetBlockNumberFromStartAddress(destination);
+		if (block >= 0)
+			target = blocks.GetBlock(block)->checkedEntry;
+	}
+
+	if (target)
+	{
+		XEmitter emit(b->exitPtrs[exit_num]);
+		emit.JMP(target, true);
+		b->linkStatus[exit_num] = true;
+	}
+}
+
+// Leaves a superblock in the middle. The code that follows on the trace still expects
+// the current register cache state, so it's restored after flushing for the exit.
+void Jit::WriteSideExit(u32 destination, u32 delaySlotAddr)
+{
+	gpr.SaveState();
+	fpr.SaveState();
+	// Same for the VFPU prefixes, which the delay slot and the flush may change.
+	JitState savedState = js;
+	if (delaySlotAddr != 0)
+		CompileAt(delaySlotAddr);
+	FlushAll();
+	WriteExit(destination, js.nextExit++);
+	gpr.LoadState();
+	fpr.LoadState();
+	js.prefixS = savedState.prefixS;
+	js.prefixT = savedState.prefixT;
+	js.prefixD = savedState.prefixD;
+	js.prefixSFlag = savedState.prefixSFlag;
+	js.prefixTFlag = savedState.prefixTFlag;
+	js.prefixDFlag = savedState.prefixDFlag;
 }
 
 void Jit::WriteExitDestInEAX()
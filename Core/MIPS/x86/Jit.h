@@ -26,19 +26,36 @@
 
 #include "x64Emitter.h"
 #include "JitCache.h"
+#include "JitBackpatch.h"
 #include "RegCache.h"
 
 namespace MIPSComp
 {
 
+// A superblock follows at most this many original blocks, and stops
+// taking new ones once it's this long.
+#define JIT_MAX_SUPERBLOCK_SEGMENTS 4
+#define JIT_MAX_SUPERBLOCK_LENGTH 256
+
+// The code space is used as a ring of this many regions. When it fills up,
+// only the blocks in the oldest region are thrown away.
+#define JIT_CODE_REGIONS 8
+// Never start a block with less than this left in the region.
+#define JIT_MIN_BLOCK_SPACE 0x10000
+
 struct JitOptions
 {
 	JitOptions()
 	{
 		enableBlocklink = false;
+		enableSuperblocks = true;
+		superblockThreshold = 256;
 	}
 
 	bool enableBlocklink;
+	// Blocks entered superblockThreshold times get recompiled as superblocks.
+	bool enableSuperblocks;
+	int superblockThreshold;
 };
 
 struct JitState
@@ -50,6 +67,52 @@ struct JitState
 	int downcountAmount;
 	bool compiling;	// TODO: get rid of this in favor of using analysis results to determine end of block
 	JitBlock *curBlock;
+	int nextExit;
+	int numInstructions;
+
+	// Superblock state. Each segment is a straight run of original code.
+	bool superblock;
+	int numSegments;
+	u32 segmentStart[JIT_MAX_SUPERBLOCK_SEGMENTS];
+	u32 segmentEnd[JIT_MAX_SUPERBLOCK_SEGMENTS];
+
+	enum PrefixState
+	{
+		PREFIX_UNKNOWN = 0x00,
+		PREFIX_KNOWN = 0x01,
+		// Not written to vfpuCtrl yet.
+		PREFIX_DIRTY = 0x10,
+		PREFIX_KNOWN_DIRTY = 0x11,
+	};
+
+	// VFPU prefixes as seen by the compiler, see Comp_VPFX.
+	u32 prefixS;
+	u32 prefixT;
+	u32 prefixD;
+	int prefixSFlag;
+	int prefixTFlag;
+	int prefixDFlag;
+
+	bool HasUnknownPrefix() const
+	{
+		return (prefixSFlag & prefixTFlag & prefixDFlag & PREFIX_KNOWN) == 0;
+	}
+
+	// Most VFPU ops reset the prefixes once they're done.
+	void EatPrefix()
+	{
+		EatPrefix(prefixS, prefixSFlag, 0xE4);
+		EatPrefix(prefixT, prefixTFlag, 0xE4);
+		EatPrefix(prefixD, prefixDFlag, 0);
+	}
+
+private:
+	static void EatPrefix(u32 &prefix, int &flag, u32 passthru)
+	{
+		if (flag != PREFIX_KNOWN || prefix != passthru)
+			flag = PREFIX_KNOWN_DIRTY;
+		prefix = passthru;
+	}
 };
 
 class Jit : public Gen::XCodeBlock
@@ -65,6 +128,7 @@ public:
 	void RunLoopUntil(u64 globalticks);
 
 	void Compile(u32 em_address);	// Compiles a block at current MIPS PC
+	void CompileSuperblock(u32 em_address);	// Replaces the (hot) block at em_address
 	const u8 *DoJit(u32 em_address, JitBlock *b);
 
 	void CompileAt(u32 addr);
@@ -91,15 +155,49 @@ public:
 	void Comp_FPU2op(u32 op);
 	void Comp_mxc1(u32 op);
 
+	void Comp_VPFX(u32 op);
+	void Comp_VecDo3(u32 op);
+	void Comp_VDot(u32 op);
+	void Comp_VScl(u32 op);
+	void Comp_Vmmul(u32 op);
+	void Comp_Vtfm(u32 op);
+	void Comp_VCrossQuat(u32 op);
+
 	JitBlockCache *GetBlockCache() { return &blocks; }
 	AsmRoutineManager &Asm() { return asm_; }
 
 	void ClearCache();
+	// Drops blocks compiled from [em_address, em_address + length). Safe to call from HLE.
+	void InvalidateCacheAt(u32 em_address, int length = 4);
+	// Redirects the fastmem access at codePtr, which faulted on emAddress, to a slow path.
+	// Called from the fault handler. Returns false if codePtr isn't a fastmem access.
+	bool BackPatch(u8 *codePtr, u32 emAddress, int accessType);
+	// Logs what BackPatch did since last time. Call from outside the fault handler.
+	void LogBackPatches();
+
 private:
+	enum BackPatchResult
+	{
+		BACKPATCH_NONE,
+		BACKPATCH_PATCHED,
+		BACKPATCH_UNKNOWN_INSTRUCTION,
+		BACKPATCH_UNEXPECTED_ACCESS,
+		BACKPATCH_OUT_OF_SPACE,
+	};
+	void NoteBackPatch(BackPatchResult result, u32 emAddress);
+
 	void FlushAll();
+	void FlushPrefixV();
+	void PrepareCodeSpace();
 
 	void WriteExit(u32 destination, int exit_num);
 	void WriteExitDestInEAX();
+	void WriteSideExit(u32 destination, u32 delaySlotAddr);
+
+	// Superblock support. Returns true if compilation should continue at nextPC.
+	bool CanExtendSuperblock(u32 destination);
+	bool PredictBranchTaken(u32 targetAddr, u32 notTakenAddr);
+	void ContinueSuperblockAt(u32 nextPC);
 //	void WriteRfiExitDestInEAX();
 	void WriteSyscallExit();
 
@@ -108,15 +206,27 @@ private:
 	void BranchVFPUFlag(u32 op, Gen::CCFlags cc, bool likely);
 	void BranchRSZeroComp(u32 op, Gen::CCFlags cc, bool likely);
 	void BranchRSRTComp(u32 op, Gen::CCFlags cc, bool likely);
+	void CompBranchExits(Gen::CCFlags cc, bool likely, bool delaySlotIsNice, u32 targetAddr);
 
 	// Utilities to reduce duplicated code
-	void CompImmLogic(u32 op, void (XEmitter::*arith)(int, const OpArg &, const OpArg &));
-	void CompTriArith(u32 op, void (XEmitter::*arith)(int, const OpArg &, const OpArg &));
-	void CompShiftImm(u32 op, void (XEmitter::*shift)(int, OpArg, OpArg));
+	void CompImmLogic(u32 op, void (XEmitter::*arith)(int, const OpArg &, const OpArg &), u32 (*doImm)(const u32, const u32));
+	void CompTriArith(u32 op, void (XEmitter::*arith)(int, const OpArg &, const OpArg &), u32 (*doImm)(const u32, const u32));
+	void CompShiftImm(u32 op, void (XEmitter::*shift)(int, OpArg, OpArg), u32 (*doImm)(const u32, const u32));
 	void CompShiftVar(u32 op, void (XEmitter::*shift)(int, OpArg, OpArg));
 
 	void CompFPTriArith(u32 op, void (XEmitter::*arith)(X64Reg reg, OpArg), bool orderMatters);
 
+	// Fastmem. Leaves the address in EAX, which the backpatcher relies on.
+	OpArg PrepareMemoryOpArg(int rs, int offset, int size, bool &direct);
+	void PadFastmemAccess(const u8 *start);
+	void CompITypeMemRead(u32 op, u32 bits, void (XEmitter::*mov)(int, int, X64Reg, OpArg));
+	void CompITypeMemWrite(u32 op, u32 bits);
+
+	// VFPU lanes, regs are FPURegCache indices.
+	void LoadPrefixedLane(X64Reg dest, const u8 *vregs, u32 prefix, int lane);
+	void ApplyPrefixDLane(X64Reg reg, int lane);
+	void StoreVectorLane(int freg, X64Reg src);
+
 	JitBlockCache blocks;
 	JitOptions jo;
 	JitState js;
@@ -125,8 +235,15 @@ private:
 	FPURegCache fpr;
 
 	AsmRoutineManager asm_;
+	TrampolineCache trampolines_;
 
 	MIPSState *mips_;
+	int codeRegion_;
+
+	// Written by BackPatch inside the fault handler, read by LogBackPatches.
+	volatile int backPatchCount_;
+	volatile int lastBackPatchResult_;
+	volatile u32 lastBackPatchAddress_;
 };
 
 typedef void (Jit::*MIPSCompileFunc)(u32 opcode);
@@ -0,0 +1,370 @@
+// Copyright (c) 2012- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+
+// Fastmem: loads and stores are emitted as plain MOVs into the memory arena at
+// Memory::base. Addresses that aren't mapped there (hardware registers, bad
+// pointers) fault. The handler below then rewrites the faulting MOV into a
+// CALL to a trampoline that does the access through Memory::Read_U32 etc.,
+// so each such site only faults once.
+
+#include <algorithm>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <signal.h>
+#include <string.h>
+#ifdef __APPLE__
+#include <sys/ucontext.h>
+#elif defined(__linux__)
+#include <ucontext.h>
+#endif
+#endif
+
+#include "Common.h"
+#include "ABI.h"
+#include "x64Emitter.h"
+#include "x64Analyzer.h"
+
+#include "../../MemMap.h"
+#include "../JitCommon/JitCommon.h"
+
+#include "Jit.h"
+#include "JitBackpatch.h"
+
+using namespace Gen;
+
+namespace MIPSComp
+{
+
+#ifdef _M_X64
+
+// The trampolines have to keep everything the JIT may have in registers.
+// RAX isn't saved: it only ever holds the address, and the fast path clobbers it too.
+static const X64Reg callerSavedRegs[] =
+{
+#ifdef _WIN32
+	RCX, RDX, R8, R9, R10, R11,
+#else
+	RCX, RDX, RSI, RDI, R8, R9, R10, R11,
+#endif
+};
+
+#ifdef _WIN32
+static const int callerSavedXmms = 6;
+static const int shadowSpace = 0x20;
+#else
+static const int callerSavedXmms = 16;
+static const int shadowSpace = 0;
+#endif
+
+// Generous upper bound on a single trampoline.
+static const size_t maxTrampolineSize = 256;
+
+void TrampolineCache::Init()
+{
+	AllocCodeSpace(1024 * 1024);
+}
+
+int TrampolineCache::SaveCallerSaved(X64Reg skip)
+{
+	const int count = sizeof(callerSavedRegs) / sizeof(callerSavedRegs[0]);
+	int pushed = 0;
+	for (int i = 0; i < count; i++)
+	{
+		if (callerSavedRegs[i] == skip)
+			continue;
+		PUSH(callerSavedRegs[i]);
+		pushed++;
+	}
+
+	// Block code keeps RSP 16-byte aligned, so the CALL to us left it 8 off.
+	int frame = shadowSpace + callerSavedXmms * 16;
+	if (((pushed + 1) * 8 + frame) & 15)
+		frame += 8;
+	SUB(64, R(RSP), Imm32(frame));
+	for (int i = 0; i < callerSavedXmms; i++)
+		MOVAPS(MDisp(RSP, shadowSpace + i * 16), (X64Reg)(XMM0 + i));
+	return frame;
+}
+
+void TrampolineCache::RestoreCallerSaved(X64Reg skip, int frame)
+{
+	for (int i = 0; i < callerSavedXmms; i++)
+		MOVAPS((X64Reg)(XMM0 + i), MDisp(RSP, shadowSpace + i * 16));
+	ADD(64, R(RSP), Imm32(frame));
+
+	const int count = sizeof(callerSavedRegs) / sizeof(callerSavedRegs[0]);
+	for (int i = count - 1; i >= 0; i--)
+	{
+		if (callerSavedRegs[i] != skip)
+			POP(callerSavedRegs[i]);
+	}
+}
+
+const u8 *TrampolineCache::GetReadTrampoline(const InstructionInfo &info)
+{
+	if (GetSpaceLeft() < maxTrampolineSize)
+		return 0;
+
+	const u8 *trampoline = GetCodePtr();
+	X64Reg addrReg = (X64Reg)info.scaledReg;
+	X64Reg dataReg = (X64Reg)info.regOperandReg;
+
+	int frame = SaveCallerSaved(dataReg);
+	MOV(32, R(ABI_PARAM1), R(addrReg));
+	if (info.displacement != 0)
+		ADD(32, R(ABI_PARAM1), Imm32(info.displacement));
+	switch (info.operandSize)
+	{
+	case 4: CALL((void *)&Memory::Read_U32); break;
+	case 2: CALL((void *)&Memory::Read_U16); break;
+	case 1: CALL((void *)&Memory::Read_U8); break;
+	}
+	RestoreCallerSaved(dataReg, frame);
+
+	if (info.signExtend)
+		MOVSX(32, info.operandSize * 8, dataReg, R(EAX));
+	else if (info.operandSize != 4)
+		MOVZX(32, info.operandSize * 8, dataReg, R(EAX));
+	else
+		MOV(32, R(dataReg), R(EAX));
+	RET();
+	return trampoline;
+}
+
+const u8 *TrampolineCache::GetWriteTrampoline(const InstructionInfo &info)
+{
+	if (GetSpaceLeft() < maxTrampolineSize)
+		return 0;
+
+	const u8 *trampoline = GetCodePtr();
+	X64Reg addrReg = (X64Reg)info.scaledReg;
+	X64Reg dataReg = (X64Reg)info.regOperandReg;
+
+	int frame = SaveCallerSaved(INVALID_REG);
+	// BackPatch only takes addresses in RAX, so setting ABI_PARAM1 first can't clobber it.
+	MOV(32, R(ABI_PARAM1), R(dataReg));
+	MOV(32, R(ABI_PARAM2), R(addrReg));
+	if (info.displacement != 0)
+		ADD(32, R(ABI_PARAM2), Imm32(info.displacement));
+	switch (info.operandSize)
+	{
+	case 4: CALL((void *)&Memory::Write_U32); break;
+	case 2: CALL((void *)&Memory::Write_U16); break;
+	case 1: CALL((void *)&Memory::Write_U8); break;
+	}
+	RestoreCallerSaved(INVALID_REG, frame);
+	RET();
+	return trampoline;
+}
+
+bool Jit::BackPatch(u8 *codePtr, u32 emAddress, int accessType)
+{
+	if (!IsInCodeSpace(codePtr))
+		return false;
+
+	// This runs in the fault handler: no alerts, no logging. LogBackPatches reports later.
+	InstructionInfo info;
+	if (!DisassembleMovNoAlert(codePtr, info, accessType))
+	{
+		NoteBackPatch(BACKPATCH_UNKNOWN_INSTRUCTION, emAddress);
+		return false;
+	}
+	// Only take the accesses Comp_ITypeMem emits, [RBX + RAX + disp].
+	if (info.hasImmediate || info.otherReg != RBX || info.scaledReg != RAX
+		|| (info.operandSize != 1 && info.operandSize != 2 && info.operandSize != 4))
+	{
+		NoteBackPatch(BACKPATCH_UNEXPECTED_ACCESS, emAddress);
+		return false;
+	}
+
+	const u8 *trampoline;
+	if (accessType == OP_ACCESS_WRITE)
+		trampoline = trampolines_.GetWriteTrampoline(info);
+	else
+		trampoline = trampolines_.GetReadTrampoline(info);
+	if (!trampoline)
+	{
+		NoteBackPatch(BACKPATCH_OUT_OF_SPACE, emAddress);
+		return false;
+	}
+
+	XEmitter emitter(codePtr);
+	emitter.CALL((const void *)trampoline);
+	emitter.NOP(std::max(info.instructionSize, FASTMEM_PATCH_SIZE) - FASTMEM_PATCH_SIZE);
+	NoteBackPatch(BACKPATCH_PATCHED, emAddress);
+	return true;
+}
+
+void Jit::NoteBackPatch(BackPatchResult result, u32 emAddress)
+{
+	if (result == BACKPATCH_PATCHED)
+		backPatchCount_++;
+	lastBackPatchResult_ = result;
+	lastBackPatchAddress_ = emAddress;
+}
+
+void Jit::LogBackPatches()
+{
+	BackPatchResult result = (BackPatchResult)lastBackPatchResult_;
+	if (result == BACKPATCH_NONE)
+		return;
+
+	u32 emAddress = lastBackPatchAddress_;
+	switch (result)
+	{
+	case BACKPATCH_PATCHED:
+		DEBUG_LOG(JIT, "Backpatched %d fastmem accesses, last to %08x", backPatchCount_, emAddress);
+		break;
+	case BACKPATCH_UNKNOWN_INSTRUCTION:
+		ERROR_LOG(JIT, "Fastmem access to %08x faulted on an instruction the backpatcher doesn't know", emAddress);
+		break;
+	case BACKPATCH_UNEXPECTED_ACCESS:
+		ERROR_LOG(JIT, "Fastmem access to %08x faulted on an access the backpatcher can't redirect", emAddress);
+		break;
+	case BACKPATCH_OUT_OF_SPACE:
+		ERROR_LOG(JIT, "Out of trampoline space, can't backpatch access to %08x", emAddress);
+		break;
+	default:
+		break;
+	}
+	backPatchCount_ = 0;
+	lastBackPatchResult_ = BACKPATCH_NONE;
+}
+
+// Returns true if the faulting access was ours and has been patched, so it can be retried.
+static bool HandleFastmemFault(uintptr_t hostAddress, u8 *codePtr, int accessType)
+{
+	if (!jit || !Memory::base)
+		return false;
+
+	// Offsets are signed 16-bit, so accesses may land a little outside the 4GB.
+	const uintptr_t base = (uintptr_t)Memory::base;
+	if (hostAddress < base - 0x8000 || hostAddress >= base + 0x100000000ULL + 0x8000)
+		return false;
+
+	return jit->BackPatch(codePtr, (u32)(hostAddress - base), accessType);
+}
+
+#ifdef _WIN32
+
+static LONG NTAPI FastmemExceptionHandler(PEXCEPTION_POINTERS pPtrs)
+{
+	const EXCEPTION_RECORD *record = pPtrs->ExceptionRecord;
+	if (record->ExceptionCode != EXCEPTION_ACCESS_VIOLATION)
+		return EXCEPTION_CONTINUE_SEARCH;
+
+	// ExceptionInformation[0] is 1 for writes, [1] the address.
+	int accessType = record->ExceptionInformation[0] == 1 ? OP_ACCESS_WRITE : OP_ACCESS_READ;
+	uintptr_t hostAddress = (uintptr_t)record->ExceptionInformation[1];
+	if (HandleFastmemFault(hostAddress, (u8 *)pPtrs->ContextRecord->Rip, accessType))
+		return EXCEPTION_CONTINUE_EXECUTION;
+	return EXCEPTION_CONTINUE_SEARCH;
+}
+
+void InstallFastmemFaultHandler()
+{
+	static bool installed = false;
+	if (installed)
+		return;
+	AddVectoredExceptionHandler(TRUE, FastmemExceptionHandler);
+	installed = true;
+}
+
+#else
+
+#ifdef __APPLE__
+static const int faultSignal = SIGBUS;
+#else
+static const int faultSignal = SIGSEGV;
+#endif
+
+static struct sigaction oldFaultAction;
+
+static void FastmemSignalHandler(int sig, siginfo_t *info, void *raw)
+{
+	ucontext_t *context = (ucontext_t *)raw;
+	// Bit 1 of the page fault error code is set for writes.
+#ifdef __APPLE__
+	u8 *codePtr = (u8 *)context->uc_mcontext->__ss.__rip;
+	u64 err = context->uc_mcontext->__es.__err;
+#elif defined(__FreeBSD__)
+	u8 *codePtr = (u8 *)context->uc_mcontext.mc_rip;
+	u64 err = context->uc_mcontext.mc_err;
+#else
+	u8 *codePtr = (u8 *)context->uc_mcontext.gregs[REG_RIP];
+	u64 err = context->uc_mcontext.gregs[REG_ERR];
+#endif
+	int accessType = (err & 2) ? OP_ACCESS_WRITE : OP_ACCESS_READ;
+	if (HandleFastmemFault((uintptr_t)info->si_addr, codePtr, accessType))
+		return;
+
+	// Not ours. Hand it on, or crash as if we were never here.
+	if (oldFaultAction.sa_flags & SA_SIGINFO)
+		oldFaultAction.sa_sigaction(sig, info, raw);
+	else if (oldFaultAction.sa_handler != SIG_DFL && oldFaultAction.sa_handler != SIG_IGN)
+		oldFaultAction.sa_handler(sig);
+	else
+		sigaction(sig, &oldFaultAction, NULL);
+}
+
+void InstallFastmemFaultHandler()
+{
+	static bool installed = false;
+	if (installed)
+		return;
+
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_sigaction = &FastmemSignalHandler;
+	sa.sa_flags = SA_SIGINFO;
+	sigemptyset(&sa.sa_mask);
+	sigaction(faultSignal, &sa, &oldFaultAction);
+	installed = true;
+}
+
+#endif
+
+#else
+
+void TrampolineCache::Init()
+{
+}
+
+bool Jit::BackPatch(u8 *codePtr, u32 emAddress, int accessType)
+{
+	// 32-bit masks addresses into the arena instead, see Comp_ITypeMem.
+	return false;
+}
+
+void Jit::NoteBackPatch(BackPatchResult result, u32 emAddress)
+{
+}
+
+void Jit::LogBackPatches()
+{
+}
+
+void InstallFastmemFaultHandler()
+{
+}
+
+#endif
+
+}	// namespace MIPSComp
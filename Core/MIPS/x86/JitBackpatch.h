@@ -0,0 +1,51 @@
+// Copyright (c) 2012- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+
+#pragma once
+
+#include "Common.h"
+#include "x64Emitter.h"
+#include "x64Analyzer.h"
+
+namespace MIPSComp
+{
+
+// Fastmem accesses are padded with NOPs up to this size, so a CALL fits over them.
+#define FASTMEM_PATCH_SIZE 5
+// Fully clear the JIT once less than this is left for trampolines.
+#define JIT_MIN_TRAMPOLINE_SPACE 0x4000
+
+// Slow path thunks for fastmem accesses that faulted. Backpatched sites CALL into these.
+// They are never freed one by one, so this is only reset together with the whole JIT cache.
+class TrampolineCache : public Gen::XCodeBlock
+{
+public:
+	void Init();
+
+	const u8 *GetReadTrampoline(const InstructionInfo &info);
+	const u8 *GetWriteTrampoline(const InstructionInfo &info);
+
+private:
+	int SaveCallerSaved(Gen::X64Reg skip);
+	void RestoreCallerSaved(Gen::X64Reg skip, int frame);
+};
+
+// Routes faults on the memory arena from JIT code to Jit::BackPatch. Only does anything on x64.
+void InstallFastmemFaultHandler();
+
+}	// namespace MIPSComp
@@ -23,6 +23,7 @@
 // locating performance issues.
 
 #include "Common.h"
+#include "MemoryUtil.h"
 
 #ifdef _WIN32
 #include <windows.h>
@@ -80,6 +81,11 @@ void JitBlockCache::Init()
 #endif
 	blocks = new JitBlock[MAX_NUM_BLOCKS];
 	blockCodePointers = new const u8*[MAX_NUM_BLOCKS];
+	// Fresh pages are zero and only the touched ones get backed.
+	block_lookup = (u32 *)AllocateMemoryPages(JIT_ICACHE_ENTRIES * sizeof(u32));
+	links_to = (u32 *)AllocateMemoryPages(JIT_ICACHE_ENTRIES * sizeof(u32));
+	block_ranges = new std::vector<BlockRange>[JIT_NUM_RANGE_BUCKETS + 1];
+	bucket_listed.assign(JIT_NUM_RANGE_BUCKETS + 1, false);
 	Clear();
 }
 
@@ -87,8 +93,18 @@ void JitBlockCache::Shutdown()
 {
 	delete[] blocks;
 	delete[] blockCodePointers;
+	delete[] block_ranges;
+	if (block_lookup)
+		FreeMemoryPages(block_lookup, JIT_ICACHE_ENTRIES * sizeof(u32));
+	if (links_to)
+		FreeMemoryPages(links_to, JIT_ICACHE_ENTRIES * sizeof(u32));
 	blocks = 0;
 	blockCodePointers = 0;
+	block_ranges = 0;
+	block_lookup = 0;
+	links_to = 0;
+	used_buckets.clear();
+	bucket_listed.clear();
 	num_blocks = 0;
 #if defined USE_OPROFILE && USE_OPROFILE
 	op_close_agent(agent);
@@ -108,12 +124,25 @@ JitBlockCache::~JitBlockCache()
 // is full and when saving and loading states.
 void JitBlockCache::Clear()
 {
+	// Empty the link lists first, so DestroyBlock doesn't pick them apart one by one.
+	// Only reset what was touched, the tables are big.
 	for (int i = 0; i < num_blocks; i++)
 	{
+		const JitBlock &b = blocks[i];
+		for (int e = 0; e < MAX_JIT_BLOCK_EXITS; e++)
+		{
+			if (b.exitAddress[e] != INVALID_EXIT && IsLookupAddress(b.exitAddress[e]))
+				links_to[LookupIndex(b.exitAddress[e])] = 0;
+		}
+	}
+	for (int i = 0; i < num_blocks; i++)
 		DestroyBlock(i, false);
+	for (size_t i = 0; i < used_buckets.size(); i++)
+	{
+		block_ranges[used_buckets[i]].clear();
+		bucket_listed[used_buckets[i]] = false;
 	}
-	links_to.clear();
-	block_map.clear();
+	used_buckets.clear();
 	num_blocks = 0;
 	memset(blockCodePointers, 0, sizeof(u8*)*MAX_NUM_BLOCKS);
 }
@@ -157,17 +186,31 @@ bool JitBlockCache::RangeIntersect(int s1, int e1, int s2, int e2) const
 		return false;
 }
 
+bool JitBlockCache::IsLookupAddress(u32 em_address)
+{
+	u32 pAddr = em_address & 0x1FFFFFFF;
+	return pAddr >= JIT_ICACHE_BASE && pAddr < JIT_ICACHE_BASE + JIT_ICACHE_SIZE;
+}
+
+u32 JitBlockCache::LookupIndex(u32 em_address)
+{
+	return (em_address & JIT_ICACHE_MASK) >> 2;
+}
+
 int JitBlockCache::AllocateBlock(u32 em_address)
 {
 	JitBlock &b = blocks[num_blocks];
 	b.invalid = false;
 	b.originalAddress = em_address;
-	b.exitAddress[0] = INVALID_EXIT;
-	b.exitAddress[1] = INVALID_EXIT;
-	b.exitPtrs[0] = 0;
-	b.exitPtrs[1] = 0;
-	b.linkStatus[0] = false;
-	b.linkStatus[1] = false;
+	for (int i = 0; i < MAX_JIT_BLOCK_EXITS; i++)
+	{
+		b.exitAddress[i] = INVALID_EXIT;
+		b.exitPtrs[i] = 0;
+		b.linkStatus[i] = false;
+		b.nextLinkTo[i] = 0;
+	}
+	b.runCount = 0;
+	b.flags = 0;
 	b.blockNum = num_blocks;
 	num_blocks++; //commit the current block
 	return num_blocks - 1;
@@ -182,17 +225,20 @@ void JitBlockCache::FinalizeBlock(int block_num, bool block_link, const u8 *code
 	u32 opcode = MIPS_MAKE_EMUHACK(0, block_num);
 	Memory::Write_Opcode_JIT(b.originalAddress, opcode);
 	
-	// Convert the logical address to a physical address for the block map
-	// Yeah, this'll work fine for PSP too I think.
-	u32 pAddr = b.originalAddress & 0x1FFFFFFF;
-
-	block_map[std::make_pair(pAddr + 4 * b.originalSize - 1, pAddr)] = block_num;
+	if (IsLookupAddress(b.originalAddress))
+		block_lookup[LookupIndex(b.originalAddress)] = block_num + 1;
+	AddBlockRange(block_num, b.originalAddress, 4 * b.originalSize);
 	if (block_link)
 	{
-		for (int i = 0; i < 2; i++)
+		for (int i = 0; i < MAX_JIT_BLOCK_EXITS; i++)
 		{
-			if (b.exitAddress[i] != INVALID_EXIT) 
-				links_to.insert(std::pair<u32, int>(b.exitAddress[i], block_num));
+			// Exits leaving RAM still get linked here, just never from the other end.
+			if (b.exitAddress[i] != INVALID_EXIT && IsLookupAddress(b.exitAddress[i]))
+			{
+				u32 &head = links_to[LookupIndex(b.exitAddress[i])];
+				b.nextLinkTo[i] = head;
+				head = block_num * MAX_JIT_BLOCK_EXITS + i + 1;
+			}
 		}
 			
 		LinkBlock(block_num);
@@ -222,6 +268,33 @@ void JitBlockCache::FinalizeBlock(int block_num, bool block_link, const u8 *code
 #endif
 }
 
+void JitBlockCache::AddBlockRange(int block_num, u32 em_address, u32 size)
+{
+	if (size == 0)
+		return;
+
+	BlockRange range;
+	range.start = em_address & 0x1FFFFFFF;
+	range.end = range.start + size - 1;
+	range.blockNum = block_num;
+
+	int first = JIT_NUM_RANGE_BUCKETS, last = JIT_NUM_RANGE_BUCKETS;
+	if (IsLookupAddress(range.start) && IsLookupAddress(range.end))
+	{
+		first = (range.start & JIT_ICACHE_MASK) >> JIT_RANGE_BUCKET_SHIFT;
+		last = (range.end & JIT_ICACHE_MASK) >> JIT_RANGE_BUCKET_SHIFT;
+	}
+	for (int i = first; i <= last; i++)
+	{
+		if (!bucket_listed[i])
+		{
+			bucket_listed[i] = true;
+			used_buckets.push_back(i);
+		}
+		block_ranges[i].push_back(range);
+	}
+}
+
 const u8 **JitBlockCache::GetCodePointers()
 {
 	return blockCodePointers;
@@ -230,7 +303,21 @@ const u8 **JitBlockCache::GetCodePointers()
 int JitBlockCache::GetBlockNumberFromStartAddress(u32 addr)
 {
 	if (!blocks)
-		return -1;		
+		return -1;
+	if (IsLookupAddress(addr))
+	{
+		u32 entry = block_lookup[LookupIndex(addr)];
+		if (entry == 0)
+			return -1;
+		int bl = entry - 1;
+		if (bl >= num_blocks || blocks[bl].invalid || blocks[bl].originalAddress != addr)
+			return -1;
+		// The game may have overwritten the code without telling us.
+		if (Memory::ReadUnchecked_U32(addr) != (MIPS_EMUHACK_OPCODE | (u32)bl))
+			return -1;
+		return bl;
+	}
+
 	u32 inst = Memory::Read_U32(addr);
 	if (!MIPS_IS_EMUHACK(inst)) // definitely not a JIT block
 		return -1;
@@ -280,7 +367,7 @@ void JitBlockCache::LinkBlockExits(int i)
 		// This block is dead. Don't relink it.
 		return;
 	}
-	for (int e = 0; e < 2; e++)
+	for (int e = 0; e < MAX_JIT_BLOCK_EXITS; e++)
 	{
 		if (b.exitAddress[e] != INVALID_EXIT && !b.linkStatus[e])
 		{
@@ -295,40 +382,62 @@ void JitBlockCache::LinkBlockExits(int i)
 	}
 }
 
-using namespace std;
-
 void JitBlockCache::LinkBlock(int i)
 {
 	LinkBlockExits(i);
 	JitBlock &b = blocks[i];
-	std::map<u32, int>::iterator iter;
-	pair<multimap<u32, int>::iterator, multimap<u32, int>::iterator> ppp;
-	// equal_range(b) returns pair<iterator,iterator> representing the range
-	// of element with key b
-	ppp = links_to.equal_range(b.originalAddress);
-	if (ppp.first == ppp.second)
+	if (!IsLookupAddress(b.originalAddress))
 		return;
-	for (multimap<u32, int>::iterator iter2 = ppp.first; iter2 != ppp.second; ++iter2) {
-		// PanicAlert("Linking block %i to block %i", iter2->second, i);
-		LinkBlockExits(iter2->second);
+	for (u32 link = links_to[LookupIndex(b.originalAddress)]; link != 0; )
+	{
+		int source = (link - 1) / MAX_JIT_BLOCK_EXITS;
+		// PanicAlert("Linking block %i to block %i", source, i);
+		LinkBlockExits(source);
+		link = blocks[source].nextLinkTo[(link - 1) % MAX_JIT_BLOCK_EXITS];
 	}
 }
 
 void JitBlockCache::UnlinkBlock(int i)
 {
 	JitBlock &b = blocks[i];
-	std::map<u32, int>::iterator iter;
-	pair<multimap<u32, int>::iterator, multimap<u32, int>::iterator> ppp;
-	ppp = links_to.equal_range(b.originalAddress);
-	if (ppp.first == ppp.second)
+	if (!IsLookupAddress(b.originalAddress))
 		return;
-	for (multimap<u32, int>::iterator iter2 = ppp.first; iter2 != ppp.second; ++iter2) {
-		JitBlock &sourceBlock = blocks[iter2->second];
-		for (int e = 0; e < 2; e++)
-		{
-			if (sourceBlock.exitAddress[e] == b.originalAddress)
-				sourceBlock.linkStatus[e] = false;
-		}
+	for (u32 link = links_to[LookupIndex(b.originalAddress)]; link != 0; )
+	{
+		JitBlock &sourceBlock = blocks[(link - 1) / MAX_JIT_BLOCK_EXITS];
+		int e = (link - 1) % MAX_JIT_BLOCK_EXITS;
+		// Dead blocks' code may already be reused, don't touch it.
+		if (sourceBlock.linkStatus[e] && !sourceBlock.invalid)
+			UnlinkExit(sourceBlock, e);
+		sourceBlock.linkStatus[e] = false;
+		link = sourceBlock.nextLinkTo[e];
+	}
+}
+
+// Puts back the exit Jit::WriteExit wrote before it was linked.
+void JitBlockCache::UnlinkExit(JitBlock &b, int e)
+{
+	XEmitter emit(b.exitPtrs[e]);
+	emit.MOV(32, M(&mips->pc), Imm32(b.exitAddress[e]));
+	emit.JMP(MIPSComp::jit->Asm().dispatcher, true);
+	b.linkStatus[e] = false;
+}
+
+// Takes the block's exits off the links_to lists of the addresses they jump to.
+void JitBlockCache::RemoveExitLinks(int i)
+{
+	const JitBlock &b = blocks[i];
+	for (int e = 0; e < MAX_JIT_BLOCK_EXITS; e++)
+	{
+		if (b.exitAddress[e] == INVALID_EXIT || !IsLookupAddress(b.exitAddress[e]))
+			continue;
+		const u32 self = i * MAX_JIT_BLOCK_EXITS + e + 1;
+		u32 *link = &links_to[LookupIndex(b.exitAddress[e])];
+		while (*link != 0 && *link != self)
+			link = &blocks[(*link - 1) / MAX_JIT_BLOCK_EXITS].nextLinkTo[(*link - 1) % MAX_JIT_BLOCK_EXITS];
+		// Not there if the block was never linked.
+		if (*link == self)
+			*link = b.nextLinkTo[e];
 	}
 }
 
@@ -349,8 +458,11 @@ void JitBlockCache::DestroyBlock(int block_num, bool invalidate)
 	b.invalid = true;
 	if ((int)Memory::ReadUnchecked_U32(b.originalAddress) == (MIPS_EMUHACK_OPCODE | block_num))
 		Memory::WriteUnchecked_U32(b.originalFirstOpcode, b.originalAddress);
+	if (IsLookupAddress(b.originalAddress) && block_lookup[LookupIndex(b.originalAddress)] == (u32)block_num + 1)
+		block_lookup[LookupIndex(b.originalAddress)] = 0;
 
 	UnlinkBlock(block_num);
+	RemoveExitLinks(block_num);
 
 	// Send anyone who tries to run this block back to the dispatcher.
 	// Not entirely ideal, but .. pretty good.
@@ -367,21 +479,62 @@ void JitBlockCache::DestroyBlock(int block_num, bool invalidate)
 	*/
 }
 
+void JitBlockCache::DestroyBlocksInCodeRange(const u8 *start, const u8 *end)
+{
+	for (int i = 0; i < num_blocks; i++)
+	{
+		if (!blocks[i].invalid && blocks[i].checkedEntry >= start && blocks[i].checkedEntry < end)
+			DestroyBlock(i, false);
+	}
+}
+
 void JitBlockCache::InvalidateICache(u32 address, const u32 length)
 {
+	if (length == 0)
+		return;
+
 	// Convert the logical address to a physical address for the block map
 	u32 pAddr = address & 0x1FFFFFFF;
+	u32 pEnd = pAddr + length - 1;
 
-	// destroy JIT blocks
-	// !! this works correctly under assumption that any two overlapping blocks end at the same address
-	std::map<pair<u32,u32>, u32>::iterator it1 = block_map.lower_bound(std::make_pair(pAddr, 0)), it2 = it1, it;
-	while (it2 != block_map.end() && it2->first.second < pAddr + length)
+	if (IsLookupAddress(pAddr) && IsLookupAddress(pEnd))
+	{
+		int first = (pAddr & JIT_ICACHE_MASK) >> JIT_RANGE_BUCKET_SHIFT;
+		int last = (pEnd & JIT_ICACHE_MASK) >> JIT_RANGE_BUCKET_SHIFT;
+		for (int i = first; i <= last; i++)
+			InvalidateBucket(i, pAddr, pEnd);
+	}
+	else
 	{
-		DestroyBlock(it2->second, true);
-		it2++;
+		// Rare, just look everywhere.
+		for (size_t i = 0; i < used_buckets.size(); i++)
+			InvalidateBucket(used_buckets[i], pAddr, pEnd);
 	}
-	if (it1 != it2)
+}
+
+void JitBlockCache::InvalidateBucket(int bucket, u32 pAddr, u32 pEnd)
+{
+	std::vector<BlockRange> &ranges = block_ranges[bucket];
+	bool destroyed = false;
+	for (size_t i = 0; i < ranges.size(); i++)
+	{
+		const BlockRange &range = ranges[i];
+		// Superblocks and replaced blocks can show up more than once.
+		if (range.start <= pEnd && range.end >= pAddr && !blocks[range.blockNum].invalid)
+		{
+			DestroyBlock(range.blockNum, true);
+			destroyed = true;
+		}
+	}
+	// Most invalidations hit nothing, only compact when there's something new to drop.
+	// That also takes out ranges of blocks destroyed some other way.
+	if (!destroyed)
+		return;
+	size_t kept = 0;
+	for (size_t i = 0; i < ranges.size(); i++)
 	{
-		block_map.erase(it1, it2);
+		if (!blocks[ranges[i].blockNum].invalid)
+			ranges[kept++] = ranges[i];
 	}
+	ranges.resize(kept);
 }
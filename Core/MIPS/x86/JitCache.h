@@ -17,7 +17,6 @@
 
 #pragma once
 
-#include <map>
 #include <vector>
 #include <string>
 
@@ -27,39 +26,48 @@
 // Add the VTune include/lib directories to the project directories to get this to build.
 // #define USE_VTUNE
 
-// emulate CPU with unlimited instruction cache
-// the only way to invalidate a region is the "icbi" instruction
-
+// Direct-mapped lookup over main RAM (by physical address), one entry per instruction.
+// Blocks outside RAM aren't in the tables and take the slow path.
+#define JIT_ICACHE_BASE 0x08000000
 #define JIT_ICACHE_SIZE 0x2000000
 #define JIT_ICACHE_MASK 0x1ffffff
-#define JIT_ICACHEEX_SIZE 0x4000000
-#define JIT_ICACHEEX_MASK 0x3ffffff
-#define JIT_ICACHE_EXRAM_BIT 0x10000000
-#define JIT_ICACHE_VMEM_BIT 0x20000000
-// this corresponds to opcode 5 which is invalid in PowerPC
-#define JIT_ICACHE_INVALID_BYTE 0x14
-#define JIT_ICACHE_INVALID_WORD 0x14141414
+#define JIT_ICACHE_ENTRIES (JIT_ICACHE_SIZE / 4)
+
+// Block ranges are indexed by the buckets of RAM they touch, for range invalidation.
+#define JIT_RANGE_BUCKET_SHIFT 9
+#define JIT_NUM_RANGE_BUCKETS (JIT_ICACHE_SIZE >> JIT_RANGE_BUCKET_SHIFT)
 
 #define JIT_OPCODE 0xFFCCCCCC	// yeah this ain't gonna work
 
+// Superblocks have a side exit per followed branch on top of the usual two.
+#define MAX_JIT_BLOCK_EXITS 8
+
+enum BlockFlag
+{
+	// Recompiled from a hot block, may span several original blocks.
+	BLOCK_SUPERBLOCK = 1,
+};
+
 struct JitBlock
 {
 	const u8 *checkedEntry;
 	const u8 *normalEntry;
 
-	u8 *exitPtrs[2];		 // to be able to rewrite the exit jum
-	u32 exitAddress[2];	// 0xFFFFFFFF == unknown
+	u8 *exitPtrs[MAX_JIT_BLOCK_EXITS];		 // to be able to rewrite the exit jum
+	u32 exitAddress[MAX_JIT_BLOCK_EXITS];	// 0xFFFFFFFF == unknown
 
 	u32 originalAddress;
 	u32 originalFirstOpcode; //to be able to restore
 	u32 codeSize; 
 	u32 originalSize;
-	int runCount;	// for profiling.
+	int runCount;	// Bumped on every entry by non-superblocks, see JitOptions::superblockThreshold.
 	int blockNum;
 	int flags;
 
 	bool invalid;
-	bool linkStatus[2];
+	bool linkStatus[MAX_JIT_BLOCK_EXITS];
+	// Next (block * MAX_JIT_BLOCK_EXITS + exit) + 1 exiting to the same address, 0 == end.
+	u32 nextLinkTo[MAX_JIT_BLOCK_EXITS];
 	bool ContainsAddress(u32 em_address);
 
 #ifdef _WIN32
@@ -83,24 +91,48 @@ class JitBlockCache
 	const u8 **blockCodePointers;
 	JitBlock *blocks;
 	int num_blocks;
-	std::multimap<u32, int> links_to;
-	std::map<std::pair<u32,u32>, u32> block_map; // (end_addr, start_addr) -> number
+
+	struct BlockRange
+	{
+		u32 start;
+		u32 end;
+		int blockNum;
+	};
+
+	// Indexed by (pAddr & JIT_ICACHE_MASK) / 4, 0 == nothing.
+	// block_lookup holds block number + 1 of the block starting there.
+	// links_to holds the first exit (see JitBlock::nextLinkTo) jumping there.
+	u32 *block_lookup;
+	u32 *links_to;
+	// Ranges overlapping each bucket of RAM. The last one is for anything outside RAM.
+	std::vector<BlockRange> *block_ranges;
+	// The buckets that got a range since the last Clear(), each listed once.
+	std::vector<int> used_buckets;
+	std::vector<bool> bucket_listed;
 
 	int MAX_NUM_BLOCKS;
 
 	bool RangeIntersect(int s1, int e1, int s2, int e2) const;
+	static bool IsLookupAddress(u32 em_address);
+	static u32 LookupIndex(u32 em_address);
+	void InvalidateBucket(int bucket, u32 pAddr, u32 pEnd);
 	void LinkBlockExits(int i);
 	void LinkBlock(int i);
 	void UnlinkBlock(int i);
+	void UnlinkExit(JitBlock &b, int e);
+	void RemoveExitLinks(int i);
 
 public:
 	JitBlockCache(MIPSState *mips_) :
 		mips(mips_), blockCodePointers(0), blocks(0), num_blocks(0),
-		MAX_NUM_BLOCKS(0) { }
+		block_lookup(0), links_to(0), block_ranges(0), MAX_NUM_BLOCKS(0) { }
 	~JitBlockCache();
 
 	int AllocateBlock(u32 em_address);
 	void FinalizeBlock(int block_num, bool block_link, const u8 *code_ptr);
+	// Superblocks cover more than [originalAddress, originalAddress + originalSize * 4).
+	// Register the other pieces so invalidation catches them.
+	void AddBlockRange(int block_num, u32 em_address, u32 size);
 
 	void Clear();
 	void Init();
@@ -129,6 +161,8 @@ public:
 	// DOES NOT WORK CORRECTLY WITH INLINING
 	void InvalidateICache(u32 address, const u32 length);
 	void DestroyBlock(int block_num, bool invalidate);
+	// Before reusing code space. Anything linking into the range is unlinked first.
+	void DestroyBlocksInCodeRange(const u8 *start, const u8 *end);
 
 	// Not currently used
 	//void DestroyBlocksWithFlag(BlockFlag death_flag);
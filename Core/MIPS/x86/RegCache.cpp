@@ -38,7 +38,7 @@ static const int allocationOrder[] =
 #endif
 };
 
-RegCache::RegCache() : emit(0), mips(0) {
+RegCache::RegCache(int numRegs) : emit(0), numRegs(numRegs), regAnal(0), analysisEnd(0), compilerPC(0), mips(0) {
 	memset(locks, 0, sizeof(locks));
 	memset(xlocks, 0, sizeof(xlocks));
 	memset(saved_locks, 0, sizeof(saved_locks));
@@ -52,13 +52,15 @@ RegCache::RegCache() : emit(0), mips(0) {
 void RegCache::Start(MIPSState *mips, MIPSAnalyst::AnalysisResults &stats)
 {
   this->mips = mips;
+	analysisEnd = stats.blockEnd;
+	compilerPC = stats.blockStart;
 	for (int i = 0; i < NUMXREGS; i++)
 	{
 		xregs[i].free = true;
 		xregs[i].dirty = false;
 		xlocks[i] = false;
 	}
-	for (int i = 0; i < 32; i++)
+	for (int i = 0; i < numRegs; i++)
 	{
 		regs[i].location = GetDefaultLocation(i);
 		regs[i].away = false;
@@ -109,7 +111,7 @@ bool RegCache::IsFreeX(int xreg) const
 
 void RegCache::UnlockAll()
 {
-	for (int i = 0; i < 32; i++)
+	for (int i = 0; i < numRegs; i++)
 		locks[i] = false;
 }
 
@@ -133,19 +135,29 @@ X64Reg RegCache::GetFreeXReg()
 	}
 	//Okay, not found :( Force grab one
 
-	//TODO - add a pass to grab xregs whose ppcreg is not used in the next 3 instructions
+	// Prefer regs the rest of the block doesn't use, then ones that don't need a store.
+	int best = -1;
+	int bestScore = 4;
 	for (int i = 0; i < aCount; i++)
 	{
 		X64Reg xr = (X64Reg)aOrder[i];
 		if (xlocks[xr]) 
 			continue;
 		int preg = xregs[xr].mipsReg;
-		if (!locks[preg])
+		if (locks[preg])
+			continue;
+		int score = (IsUnusedLater(preg) ? 0 : 2) + (xregs[xr].dirty ? 1 : 0);
+		if (score < bestScore)
 		{
-			StoreFromRegister(preg);
-			return xr;
+			best = xr;
+			bestScore = score;
 		}
 	}
+	if (best != -1)
+	{
+		StoreFromRegister(xregs[best].mipsReg);
+		return (X64Reg)best;
+	}
 	//Still no dice? Die!
 	_assert_msg_(DYNA_REC, 0, "Regcache ran out of regs");
 	return (X64Reg) -1;
@@ -179,7 +191,7 @@ void RegCache::FlushR(X64Reg reg)
 
 int RegCache::SanityCheck() const
 {
-	for (int i = 0; i < 32; i++) {
+	for (int i = 0; i < numRegs; i++) {
 		if (regs[i].away) {
 			if (regs[i].location.IsSimpleReg()) {
 				Gen::X64Reg simple = regs[i].location.GetSimpleReg();
@@ -195,6 +207,33 @@ int RegCache::SanityCheck() const
 	return 0;
 }
 
+bool RegCache::IsUnusedLater(int preg) const
+{
+	// Past the end of what was analyzed, we know nothing. VFPU regs aren't analyzed at all.
+	if (regAnal == 0 || preg >= 32 || compilerPC > analysisEnd)
+		return false;
+	return !regAnal[preg].used || (u32)regAnal[preg].LastUse() < compilerPC;
+}
+
+void RegCache::DiscardDeadRegs()
+{
+	for (int i = 0; i < numRegs; i++)
+	{
+		if (!regs[i].away || locks[i])
+			continue;
+		if (IsLive(i))
+			continue;
+
+		if (regs[i].location.IsSimpleReg())
+			DiscardRegContentsIfCached(i);
+		else if (regs[i].location.IsImm())
+		{
+			regs[i].away = false;
+			regs[i].location = GetDefaultLocation(i);
+		}
+	}
+}
+
 void RegCache::DiscardRegContentsIfCached(int preg)
 {
 	if (regs[preg].away && regs[preg].location.IsSimpleReg())
@@ -216,14 +255,43 @@ void GPRRegCache::SetImmediate32(int preg, u32 immValue)
 	regs[preg].location = Imm32(immValue);
 }
 
+bool GPRRegCache::IsImmediate(int preg) const
+{
+	if (preg == 0)
+		return true;
+	return regs[preg].away && regs[preg].location.IsImm();
+}
+
+u32 GPRRegCache::GetImmediate32(int preg) const
+{
+	_dbg_assert_msg_(DYNA_REC, IsImmediate(preg), "Reg %i not immediate", preg);
+	if (preg == 0)
+		return 0;
+	return regs[preg].location.GetImmValue();
+}
+
 void GPRRegCache::Start(MIPSState *mips, MIPSAnalyst::AnalysisResults &stats)
 {
 	RegCache::Start(mips, stats);
+	regAnal = stats.r;
 }
 
 void FPURegCache::Start(MIPSState *mips, MIPSAnalyst::AnalysisResults &stats)
 {
 	RegCache::Start(mips, stats);
+	regAnal = stats.f;
+}
+
+bool GPRRegCache::IsLive(int preg) const
+{
+	return MIPSAnalyst::IsGPRLiveAt(preg, compilerPC);
+}
+
+bool FPURegCache::IsLive(int preg) const
+{
+	if (preg >= 32)
+		return true;
+	return MIPSAnalyst::IsFPRLiveAt(preg, compilerPC);
 }
 
 const int *GPRRegCache::GetAllocationOrder(int &count)
@@ -253,7 +321,9 @@ OpArg GPRRegCache::GetDefaultLocation(int reg) const
 
 OpArg FPURegCache::GetDefaultLocation(int reg) const
 {
-	return M(&mips->f[reg]);
+	if (reg < 32)
+		return M(&mips->f[reg]);
+	return M(&mips->v[reg - 32]);
 }
 
 void RegCache::KillImmediate(int preg, bool doLoad, bool makeDirty)
@@ -366,11 +436,13 @@ void FPURegCache::StoreFromRegister(int i)
 	{
 		X64Reg xr = regs[i].location.GetSimpleReg();
 		_assert_msg_(DYNA_REC, xr < NUMXREGS, "WTF - store - invalid reg");
+		bool doStore = xregs[xr].dirty;
 		xregs[xr].free = true;
 		xregs[xr].dirty = false;
 		xregs[xr].mipsReg = -1;
 		OpArg newLoc = GetDefaultLocation(i);
-		emit->MOVSS(newLoc, xr);
+		if (doStore)
+			emit->MOVSS(newLoc, xr);
 		regs[i].location = newLoc;
 		regs[i].away = false;
 	}
@@ -386,7 +458,7 @@ void RegCache::Flush(FlushMode mode)
 		if (xlocks[i])
 			PanicAlert("Someone forgot to unlock X64 reg %i.", i);
 	}
-	for (int i = 0; i < 32; i++)
+	for (int i = 0; i < numRegs; i++)
 	{
 		if (locks[i])
 		{
@@ -48,6 +48,10 @@ struct X64CachedReg
 typedef int XReg;
 typedef int PReg;
 
+#define NUM_MIPS_GPRS 32
+// The FPU cache also holds the VFPU registers, as 32 + index into MIPSState::v.
+#define NUM_MIPS_FPRS (32 + 128)
+
 #ifdef _M_X64
 #define NUMXREGS 16
 #elif _M_IX86
@@ -57,31 +61,44 @@ typedef int PReg;
 class RegCache
 {
 private:
-	bool locks[32];
-	bool saved_locks[32];
+	bool locks[NUM_MIPS_FPRS];
+	bool saved_locks[NUM_MIPS_FPRS];
 	bool saved_xlocks[NUMXREGS];
 
 protected:
 	bool xlocks[NUMXREGS];
-	MIPSCachedReg regs[32];
+	MIPSCachedReg regs[NUM_MIPS_FPRS];
 	X64CachedReg xregs[NUMXREGS];
 
-	MIPSCachedReg saved_regs[32];
+	MIPSCachedReg saved_regs[NUM_MIPS_FPRS];
 	X64CachedReg saved_xregs[NUMXREGS];
 
 	virtual const int *GetAllocationOrder(int &count) = 0;
-	
+	// Liveness of preg right before the instruction at compilerPC executes.
+	virtual bool IsLive(int preg) const = 0;
+	bool IsUnusedLater(int preg) const;
+
 	XEmitter *emit;
+	int numRegs;
+
+	// Analysis of the block being compiled, owned by the Jit. Only valid during DoJit.
+	const MIPSAnalyst::RegisterAnalysisResults *regAnal;
+	u32 analysisEnd;
+	u32 compilerPC;
 
 public:
   MIPSState *mips;
-	RegCache();
+	RegCache(int numRegs);
 
 	virtual ~RegCache() {}
 	virtual void Start(MIPSState *mips, MIPSAnalyst::AnalysisResults &stats) = 0;
 
 	void DiscardRegContentsIfCached(int preg);
+	// Drops cached values that will be overwritten before anything reads them, so a
+	// following Flush doesn't store them.
+	void DiscardDeadRegs();
 	void SetEmitter(XEmitter *emitter) {emit = emitter;}
+	void SetCompilerPC(u32 pc) {compilerPC = pc;}
 
 	void FlushR(X64Reg reg); 
 	void FlushR(X64Reg reg, X64Reg reg2) {FlushR(reg); FlushR(reg2);}
@@ -130,21 +147,36 @@ public:
 class GPRRegCache : public RegCache
 {
 public:
+	GPRRegCache() : RegCache(NUM_MIPS_GPRS) {}
 	void Start(MIPSState *mips, MIPSAnalyst::AnalysisResults &stats);
 	void BindToRegister(int preg, bool doLoad = true, bool makeDirty = true);
 	void StoreFromRegister(int preg);
 	OpArg GetDefaultLocation(int reg) const;
 	const int *GetAllocationOrder(int &count);
 	void SetImmediate32(int preg, u32 immValue);
+	// Known-constant values, folded at compile time until something needs them in a register.
+	// $zero always counts as one.
+	bool IsImmediate(int preg) const;
+	u32 GetImmediate32(int preg) const;
+
+protected:
+	bool IsLive(int preg) const;
 };
 
 
 class FPURegCache : public RegCache
 {
 public:
+	FPURegCache() : RegCache(NUM_MIPS_FPRS) {}
 	void Start(MIPSState *mips, MIPSAnalyst::AnalysisResults &stats);
 	void BindToRegister(int preg, bool doLoad = true, bool makeDirty = true);
 	void StoreFromRegister(int preg);
 	const int *GetAllocationOrder(int &count);
 	OpArg GetDefaultLocation(int reg) const;
+
+	// Cache index of a VFPU register, by its index into MIPSState::v.
+	static int V(int vreg) {return 32 + vreg;}
+
+protected:
+	bool IsLive(int preg) const;
 };
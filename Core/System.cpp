@@ -20,6 +20,7 @@
 #include "MIPS/MIPS.h"
 
 #include "MIPS/JitCommon/JitCommon.h"
+#include "MIPS/MIPSIntCache.h"
 
 #include "System.h"
 // Bad dependency
@@ -70,6 +71,7 @@ bool PSP_Init(const CoreParameter &coreParam, std::string *error_string)
 		__KernelShutdown();
 		HLEShutdown();
 		host->ShutdownSound();
+		MIPSIntCache_Shutdown();
 		Memory::Shutdown();
 		coreParameter.fileToStart = "";
 		return false;
@@ -103,6 +105,7 @@ void PSP_Shutdown()
 	}
 	__KernelShutdown();
 	HLEShutdown();
+	MIPSIntCache_Shutdown();
 	Memory::Shutdown() ;
 	currentCPU = 0;
 }
@@ -229,6 +229,8 @@ void PPGeEnd()
 		DEBUG_LOG(HLE, "PPGe enqueued display list %i", list);
 		// TODO: Might need to call some internal trickery function when this is actually synchronous.
 		// sceGeListSync(u32 displayListID, 1); //0 : wait for completion		1:check and return
+		// With a GPU thread, the list has to be done before interrupts are back on.
+		gpu->SyncThread();
 		gpu->EnableInterrupts(true);
 		sceGeRestoreContext(savedContextPtr);
 	}
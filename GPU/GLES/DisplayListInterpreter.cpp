@@ -15,10 +15,14 @@
 // Official git repository and contact information can be found at
 // https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
 
+#include <algorithm>
+
+#include "../../Common/FileUtil.h"
 #include "../../Core/MemMap.h"
 #include "../../Core/Host.h"
 #include "../../Core/Config.h"
 #include "../../Core/System.h"
+#include "../../Core/ELF/ParamSFO.h"
 #include "../../native/gfx_es2/gl_state.h"
 
 #include "../GPUState.h"
@@ -37,110 +41,238 @@
 extern u32 curTextureWidth;
 extern u32 curTextureHeight;
 
-const int flushOnChangedBeforeCommandList[] = {
-	GE_CMD_VERTEXTYPE,
-	GE_CMD_BLENDMODE,
-	GE_CMD_BLENDFIXEDA,
-	GE_CMD_BLENDFIXEDB,
+struct CommandTableEntry {
+	u8 cmd;
+	u8 flags;
+	// Uniforms that read this register, dirtied when the value changes.
+	u32 dirtyUniform;
 };
 
-const int flushBeforeCommandList[] = {
-	GE_CMD_BEZIER,
-	GE_CMD_SPLINE,
-	GE_CMD_SIGNAL,
-	GE_CMD_FINISH,
-	GE_CMD_BJUMP,
-	GE_CMD_OFFSETADDR,
-	GE_CMD_REGION1,GE_CMD_REGION2,
-	GE_CMD_CULLFACEENABLE,
-	GE_CMD_TEXTUREMAPENABLE,
-	GE_CMD_LIGHTINGENABLE,
-	GE_CMD_FOGENABLE,
-	GE_CMD_TEXSCALEU,GE_CMD_TEXSCALEV,
-	GE_CMD_TEXOFFSETU,GE_CMD_TEXOFFSETV,
-	GE_CMD_MINZ,GE_CMD_MAXZ,
-	GE_CMD_FRAMEBUFPTR,
-	GE_CMD_FRAMEBUFWIDTH,
-	GE_CMD_FRAMEBUFPIXFORMAT,
-	GE_CMD_TEXADDR0,
-	GE_CMD_CLUTADDR,
-	GE_CMD_LOADCLUT,
-	GE_CMD_TEXMAPMODE,
-	GE_CMD_TEXSHADELS,
-	GE_CMD_CLUTFORMAT,
-	GE_CMD_TRANSFERSTART,
-	GE_CMD_TEXBUFWIDTH0,
-	GE_CMD_TEXSIZE0,GE_CMD_TEXSIZE1,GE_CMD_TEXSIZE2,GE_CMD_TEXSIZE3,
-	GE_CMD_TEXSIZE4,GE_CMD_TEXSIZE5,GE_CMD_TEXSIZE6,GE_CMD_TEXSIZE7,
-	GE_CMD_ZBUFPTR,
-	GE_CMD_ZBUFWIDTH,
-	GE_CMD_AMBIENTCOLOR,
-	GE_CMD_AMBIENTALPHA,
-	GE_CMD_MATERIALAMBIENT,
-	GE_CMD_MATERIALDIFFUSE,
-	GE_CMD_MATERIALEMISSIVE,
-	GE_CMD_MATERIALSPECULAR,
-	GE_CMD_MATERIALALPHA,
-	GE_CMD_MATERIALSPECULARCOEF,
-	GE_CMD_COLORMODEL,
-	GE_CMD_LIGHTTYPE0, GE_CMD_LIGHTTYPE1, GE_CMD_LIGHTTYPE2, GE_CMD_LIGHTTYPE3,
-	GE_CMD_LX0,GE_CMD_LY0,GE_CMD_LZ0,
-	GE_CMD_LX1,GE_CMD_LY1,GE_CMD_LZ1,
-	GE_CMD_LX2,GE_CMD_LY2,GE_CMD_LZ2,
-	GE_CMD_LX3,GE_CMD_LY3,GE_CMD_LZ3,
-	GE_CMD_LDX0,GE_CMD_LDY0,GE_CMD_LDZ0,
-	GE_CMD_LDX1,GE_CMD_LDY1,GE_CMD_LDZ1,
-	GE_CMD_LDX2,GE_CMD_LDY2,GE_CMD_LDZ2,
-	GE_CMD_LDX3,GE_CMD_LDY3,GE_CMD_LDZ3,
-	GE_CMD_LKA0,GE_CMD_LKB0,GE_CMD_LKC0,
-	GE_CMD_LKA1,GE_CMD_LKB1,GE_CMD_LKC1,
-	GE_CMD_LKA2,GE_CMD_LKB2,GE_CMD_LKC2,
-	GE_CMD_LKA3,GE_CMD_LKB3,GE_CMD_LKC3,
-	GE_CMD_LKS0,GE_CMD_LKS1,GE_CMD_LKS2,GE_CMD_LKS3,
-	GE_CMD_LKO0,GE_CMD_LKO1,GE_CMD_LKO2,GE_CMD_LKO3,
-	GE_CMD_LAC0,GE_CMD_LDC0,GE_CMD_LSC0,
-	GE_CMD_LAC1,GE_CMD_LDC1,GE_CMD_LSC1,
-	GE_CMD_LAC2,GE_CMD_LDC2,GE_CMD_LSC2,
-	GE_CMD_LAC3,GE_CMD_LDC3,GE_CMD_LSC3,
-	GE_CMD_VIEWPORTX1,GE_CMD_VIEWPORTY1,
-	GE_CMD_VIEWPORTX2,GE_CMD_VIEWPORTY2,
-	GE_CMD_VIEWPORTZ1,GE_CMD_VIEWPORTZ2,
-	GE_CMD_LIGHTENABLE0,GE_CMD_LIGHTENABLE1,GE_CMD_LIGHTENABLE2,GE_CMD_LIGHTENABLE3,
-	GE_CMD_CULL,
-	GE_CMD_LMODE,
-	GE_CMD_REVERSENORMAL,
-	GE_CMD_PATCHDIVISION,
-	GE_CMD_MATERIALUPDATE,
-	GE_CMD_CLEARMODE,
-	GE_CMD_ALPHABLENDENABLE,
-	GE_CMD_ALPHATESTENABLE,
-	GE_CMD_ALPHATEST,
-	GE_CMD_TEXFUNC,
-	GE_CMD_TEXFILTER,
-	GE_CMD_TEXENVCOLOR,
-	GE_CMD_TEXMODE,
-	GE_CMD_TEXFORMAT,
-	GE_CMD_TEXFLUSH,
-	GE_CMD_TEXWRAP,
-	GE_CMD_ZTESTENABLE,
-	GE_CMD_STENCILTESTENABLE,
-	GE_CMD_STENCILOP,
-	GE_CMD_ZTEST,
-	GE_CMD_FOG1,
-	GE_CMD_FOG2,
-	GE_CMD_FOGCOLOR,
-	GE_CMD_MORPHWEIGHT0,GE_CMD_MORPHWEIGHT1,GE_CMD_MORPHWEIGHT2,GE_CMD_MORPHWEIGHT3,
-	GE_CMD_MORPHWEIGHT4,GE_CMD_MORPHWEIGHT5,GE_CMD_MORPHWEIGHT6,GE_CMD_MORPHWEIGHT7,
-	GE_CMD_WORLDMATRIXNUMBER,
-	GE_CMD_VIEWMATRIXNUMBER,
-	GE_CMD_PROJMATRIXNUMBER,
-	GE_CMD_PROJMATRIXDATA,
-	GE_CMD_TGENMATRIXNUMBER,
-	GE_CMD_BONEMATRIXNUMBER,
+// Commands not listed here are plain registers that nothing reads until a draw
+// is decoded, so they're skipped entirely when rewritten with the same value.
+static const CommandTableEntry commandTable[] = {
+	// Control and drawing. These have side effects beyond their register value.
+	{GE_CMD_VADDR, FLAG_EXECUTE},
+	{GE_CMD_IADDR, FLAG_EXECUTE},
+	{GE_CMD_PRIM, FLAG_EXECUTE},
+	{GE_CMD_BEZIER, FLAG_FLUSHBEFORE | FLAG_EXECUTE},
+	{GE_CMD_SPLINE, FLAG_FLUSHBEFORE | FLAG_EXECUTE},
+	{GE_CMD_JUMP, FLAG_EXECUTE},
+	{GE_CMD_CALL, FLAG_EXECUTE},
+	{GE_CMD_RET, FLAG_EXECUTE},
+	{GE_CMD_SIGNAL, FLAG_FLUSHBEFORE | FLAG_EXECUTE},
+	{GE_CMD_FINISH, FLAG_FLUSHBEFORE | FLAG_EXECUTE},
+	{GE_CMD_END, FLAG_EXECUTE},
+	{GE_CMD_BJUMP, FLAG_FLUSHBEFORE | FLAG_EXECUTE},
+	{GE_CMD_ORIGIN, FLAG_EXECUTE},
+	{GE_CMD_LOADCLUT, FLAG_FLUSHBEFORE | FLAG_EXECUTE | FLAG_DIRTYTEXTURE},
+	{GE_CMD_TEXFLUSH, FLAG_FLUSHBEFORE | FLAG_EXECUTE},
+	{GE_CMD_TRANSFERSTART, FLAG_FLUSHBEFORE | FLAG_EXECUTE},
+	// Sets GL state directly, which the draws don't restore.
+	{GE_CMD_CLEARMODE, FLAG_FLUSHBEFOREONCHANGE | FLAG_EXECUTE},
+
+	// The matrix commands move the matrix number along.
+	{GE_CMD_WORLDMATRIXNUMBER, FLAG_EXECUTE},
+	{GE_CMD_VIEWMATRIXNUMBER, FLAG_EXECUTE},
+	{GE_CMD_PROJMATRIXNUMBER, FLAG_EXECUTE},
+	{GE_CMD_TGENMATRIXNUMBER, FLAG_EXECUTE},
+	{GE_CMD_BONEMATRIXNUMBER, FLAG_EXECUTE},
+	{GE_CMD_WORLDMATRIXDATA, FLAG_FLUSHBEFOREONMATRIXCHANGE | FLAG_EXECUTE},
+	{GE_CMD_VIEWMATRIXDATA, FLAG_FLUSHBEFOREONMATRIXCHANGE | FLAG_EXECUTE},
+	{GE_CMD_PROJMATRIXDATA, FLAG_FLUSHBEFOREONMATRIXCHANGE | FLAG_EXECUTE},
+	{GE_CMD_TGENMATRIXDATA, FLAG_FLUSHBEFOREONMATRIXCHANGE | FLAG_EXECUTE},
+	{GE_CMD_BONEMATRIXDATA, FLAG_FLUSHBEFOREONMATRIXCHANGE | FLAG_EXECUTE},
+
+	// State read when the collected draws are decoded or drawn.
+	{GE_CMD_VERTEXTYPE, FLAG_FLUSHBEFOREONCHANGE},
+	{GE_CMD_OFFSETADDR, FLAG_FLUSHBEFOREONCHANGE},
+	{GE_CMD_REGION1, FLAG_FLUSHBEFOREONCHANGE},
+	{GE_CMD_REGION2, FLAG_FLUSHBEFOREONCHANGE},
+	{GE_CMD_CLIPENABLE, FLAG_FLUSHBEFOREONCHANGE},
+	{GE_CMD_CULLFACEENABLE, FLAG_FLUSHBEFOREONCHANGE},
+	{GE_CMD_TEXTUREMAPENABLE, FLAG_FLUSHBEFOREONCHANGE | FLAG_DIRTYTEXTURE},
+	{GE_CMD_LIGHTINGENABLE, FLAG_FLUSHBEFOREONCHANGE},
+	{GE_CMD_FOGENABLE, FLAG_FLUSHBEFOREONCHANGE},
+	{GE_CMD_DITHERENABLE, FLAG_FLUSHBEFOREONCHANGE},
+	{GE_CMD_ANTIALIASENABLE, FLAG_FLUSHBEFOREONCHANGE},
+	{GE_CMD_COLORTESTENABLE, FLAG_FLUSHBEFOREONCHANGE},
+	{GE_CMD_LOGICOPENABLE, FLAG_FLUSHBEFOREONCHANGE},
+	{GE_CMD_OFFSETX, FLAG_FLUSHBEFOREONCHANGE},
+	{GE_CMD_OFFSETY, FLAG_FLUSHBEFOREONCHANGE},
+	{GE_CMD_TEXSCALEU, FLAG_FLUSHBEFOREONCHANGE, DIRTY_UVSCALEOFFSET},
+	{GE_CMD_TEXSCALEV, FLAG_FLUSHBEFOREONCHANGE, DIRTY_UVSCALEOFFSET},
+	{GE_CMD_TEXOFFSETU, FLAG_FLUSHBEFOREONCHANGE, DIRTY_UVSCALEOFFSET},
+	{GE_CMD_TEXOFFSETV, FLAG_FLUSHBEFOREONCHANGE, DIRTY_UVSCALEOFFSET},
+	{GE_CMD_SCISSOR1, FLAG_FLUSHBEFOREONCHANGE},
+	{GE_CMD_SCISSOR2, FLAG_FLUSHBEFOREONCHANGE},
+	{GE_CMD_MINZ, FLAG_FLUSHBEFOREONCHANGE},
+	{GE_CMD_MAXZ, FLAG_FLUSHBEFOREONCHANGE},
+	{GE_CMD_FRAMEBUFPTR, FLAG_FLUSHBEFOREONCHANGE},
+	{GE_CMD_FRAMEBUFWIDTH, FLAG_FLUSHBEFOREONCHANGE},
+	{GE_CMD_FRAMEBUFPIXFORMAT, FLAG_FLUSHBEFOREONCHANGE},
+	{GE_CMD_ZBUFPTR, FLAG_FLUSHBEFOREONCHANGE},
+	{GE_CMD_ZBUFWIDTH, FLAG_FLUSHBEFOREONCHANGE},
+
+	{GE_CMD_TEXADDR0, FLAG_FLUSHBEFOREONCHANGE | FLAG_DIRTYTEXTURE},
+	{GE_CMD_TEXADDR1, FLAG_FLUSHBEFOREONCHANGE | FLAG_DIRTYTEXTURE},
+	{GE_CMD_TEXADDR2, FLAG_FLUSHBEFOREONCHANGE | FLAG_DIRTYTEXTURE},
+	{GE_CMD_TEXADDR3, FLAG_FLUSHBEFOREONCHANGE | FLAG_DIRTYTEXTURE},
+	{GE_CMD_TEXADDR4, FLAG_FLUSHBEFOREONCHANGE | FLAG_DIRTYTEXTURE},
+	{GE_CMD_TEXADDR5, FLAG_FLUSHBEFOREONCHANGE | FLAG_DIRTYTEXTURE},
+	{GE_CMD_TEXADDR6, FLAG_FLUSHBEFOREONCHANGE | FLAG_DIRTYTEXTURE},
+	{GE_CMD_TEXADDR7, FLAG_FLUSHBEFOREONCHANGE | FLAG_DIRTYTEXTURE},
+	{GE_CMD_TEXBUFWIDTH0, FLAG_FLUSHBEFOREONCHANGE | FLAG_DIRTYTEXTURE},
+	{GE_CMD_TEXBUFWIDTH1, FLAG_FLUSHBEFOREONCHANGE | FLAG_DIRTYTEXTURE},
+	{GE_CMD_TEXBUFWIDTH2, FLAG_FLUSHBEFOREONCHANGE | FLAG_DIRTYTEXTURE},
+	{GE_CMD_TEXBUFWIDTH3, FLAG_FLUSHBEFOREONCHANGE | FLAG_DIRTYTEXTURE},
+	{GE_CMD_TEXBUFWIDTH4, FLAG_FLUSHBEFOREONCHANGE | FLAG_DIRTYTEXTURE},
+	{GE_CMD_TEXBUFWIDTH5, FLAG_FLUSHBEFOREONCHANGE | FLAG_DIRTYTEXTURE},
+	{GE_CMD_TEXBUFWIDTH6, FLAG_FLUSHBEFOREONCHANGE | FLAG_DIRTYTEXTURE},
+	{GE_CMD_TEXBUFWIDTH7, FLAG_FLUSHBEFOREONCHANGE | FLAG_DIRTYTEXTURE},
+	{GE_CMD_TEXSIZE0, FLAG_FLUSHBEFOREONCHANGE | FLAG_DIRTYTEXTURE},
+	{GE_CMD_TEXSIZE1, FLAG_FLUSHBEFOREONCHANGE | FLAG_DIRTYTEXTURE},
+	{GE_CMD_TEXSIZE2, FLAG_FLUSHBEFOREONCHANGE | FLAG_DIRTYTEXTURE},
+	{GE_CMD_TEXSIZE3, FLAG_FLUSHBEFOREONCHANGE | FLAG_DIRTYTEXTURE},
+	{GE_CMD_TEXSIZE4, FLAG_FLUSHBEFOREONCHANGE | FLAG_DIRTYTEXTURE},
+	{GE_CMD_TEXSIZE5, FLAG_FLUSHBEFOREONCHANGE | FLAG_DIRTYTEXTURE},
+	{GE_CMD_TEXSIZE6, FLAG_FLUSHBEFOREONCHANGE | FLAG_DIRTYTEXTURE},
+	{GE_CMD_TEXSIZE7, FLAG_FLUSHBEFOREONCHANGE | FLAG_DIRTYTEXTURE},
+	{GE_CMD_CLUTADDR, FLAG_FLUSHBEFOREONCHANGE | FLAG_DIRTYTEXTURE},
+	{GE_CMD_CLUTADDRUPPER, FLAG_FLUSHBEFOREONCHANGE | FLAG_DIRTYTEXTURE},
+	{GE_CMD_CLUTFORMAT, FLAG_FLUSHBEFOREONCHANGE | FLAG_DIRTYTEXTURE},
+	{GE_CMD_TEXMODE, FLAG_FLUSHBEFOREONCHANGE | FLAG_DIRTYTEXTURE},
+	{GE_CMD_TEXFORMAT, FLAG_FLUSHBEFOREONCHANGE | FLAG_DIRTYTEXTURE},
+	{GE_CMD_TEXMAPMODE, FLAG_FLUSHBEFOREONCHANGE},
+	{GE_CMD_TEXSHADELS, FLAG_FLUSHBEFOREONCHANGE},
+	{GE_CMD_TEXFUNC, FLAG_FLUSHBEFOREONCHANGE},
+	{GE_CMD_TEXFILTER, FLAG_FLUSHBEFOREONCHANGE},
+	{GE_CMD_TEXENVCOLOR, FLAG_FLUSHBEFOREONCHANGE, DIRTY_TEXENV},
+	{GE_CMD_TEXWRAP, FLAG_FLUSHBEFOREONCHANGE},
+	{GE_CMD_TEXLODSLOPE, FLAG_FLUSHBEFOREONCHANGE},
+
+	{GE_CMD_AMBIENTCOLOR, FLAG_FLUSHBEFOREONCHANGE, DIRTY_AMBIENT},
+	{GE_CMD_AMBIENTALPHA, FLAG_FLUSHBEFOREONCHANGE, DIRTY_AMBIENT},
+	{GE_CMD_MATERIALAMBIENT, FLAG_FLUSHBEFOREONCHANGE, DIRTY_MATAMBIENTALPHA},
+	{GE_CMD_MATERIALDIFFUSE, FLAG_FLUSHBEFOREONCHANGE, DIRTY_MATDIFFUSE},
+	{GE_CMD_MATERIALEMISSIVE, FLAG_FLUSHBEFOREONCHANGE, DIRTY_MATEMISSIVE},
+	{GE_CMD_MATERIALSPECULAR, FLAG_FLUSHBEFOREONCHANGE, DIRTY_MATSPECULAR},
+	{GE_CMD_MATERIALALPHA, FLAG_FLUSHBEFOREONCHANGE, DIRTY_MATAMBIENTALPHA},
+	{GE_CMD_MATERIALSPECULARCOEF, FLAG_FLUSHBEFOREONCHANGE, DIRTY_MATSPECULAR},
+	{GE_CMD_MATERIALUPDATE, FLAG_FLUSHBEFOREONCHANGE},
+	{GE_CMD_COLORMODEL, FLAG_FLUSHBEFOREONCHANGE},
+	{GE_CMD_LIGHTTYPE0, FLAG_FLUSHBEFOREONCHANGE},
+	{GE_CMD_LIGHTTYPE1, FLAG_FLUSHBEFOREONCHANGE},
+	{GE_CMD_LIGHTTYPE2, FLAG_FLUSHBEFOREONCHANGE},
+	{GE_CMD_LIGHTTYPE3, FLAG_FLUSHBEFOREONCHANGE},
+	{GE_CMD_LX0, FLAG_FLUSHBEFOREONCHANGE, DIRTY_LIGHT0},
+	{GE_CMD_LY0, FLAG_FLUSHBEFOREONCHANGE, DIRTY_LIGHT0},
+	{GE_CMD_LZ0, FLAG_FLUSHBEFOREONCHANGE, DIRTY_LIGHT0},
+	{GE_CMD_LX1, FLAG_FLUSHBEFOREONCHANGE, DIRTY_LIGHT1},
+	{GE_CMD_LY1, FLAG_FLUSHBEFOREONCHANGE, DIRTY_LIGHT1},
+	{GE_CMD_LZ1, FLAG_FLUSHBEFOREONCHANGE, DIRTY_LIGHT1},
+	{GE_CMD_LX2, FLAG_FLUSHBEFOREONCHANGE, DIRTY_LIGHT2},
+	{GE_CMD_LY2, FLAG_FLUSHBEFOREONCHANGE, DIRTY_LIGHT2},
+	{GE_CMD_LZ2, FLAG_FLUSHBEFOREONCHANGE, DIRTY_LIGHT2},
+	{GE_CMD_LX3, FLAG_FLUSHBEFOREONCHANGE, DIRTY_LIGHT3},
+	{GE_CMD_LY3, FLAG_FLUSHBEFOREONCHANGE, DIRTY_LIGHT3},
+	{GE_CMD_LZ3, FLAG_FLUSHBEFOREONCHANGE, DIRTY_LIGHT3},
+	{GE_CMD_LDX0, FLAG_FLUSHBEFOREONCHANGE, DIRTY_LIGHT0},
+	{GE_CMD_LDY0, FLAG_FLUSHBEFOREONCHANGE, DIRTY_LIGHT0},
+	{GE_CMD_LDZ0, FLAG_FLUSHBEFOREONCHANGE, DIRTY_LIGHT0},
+	{GE_CMD_LDX1, FLAG_FLUSHBEFOREONCHANGE, DIRTY_LIGHT1},
+	{GE_CMD_LDY1, FLAG_FLUSHBEFOREONCHANGE, DIRTY_LIGHT1},
+	{GE_CMD_LDZ1, FLAG_FLUSHBEFOREONCHANGE, DIRTY_LIGHT1},
+	{GE_CMD_LDX2, FLAG_FLUSHBEFOREONCHANGE, DIRTY_LIGHT2},
+	{GE_CMD_LDY2, FLAG_FLUSHBEFOREONCHANGE, DIRTY_LIGHT2},
+	{GE_CMD_LDZ2, FLAG_FLUSHBEFOREONCHANGE, DIRTY_LIGHT2},
+	{GE_CMD_LDX3, FLAG_FLUSHBEFOREONCHANGE, DIRTY_LIGHT3},
+	{GE_CMD_LDY3, FLAG_FLUSHBEFOREONCHANGE, DIRTY_LIGHT3},
+	{GE_CMD_LDZ3, FLAG_FLUSHBEFOREONCHANGE, DIRTY_LIGHT3},
+	{GE_CMD_LKA0, FLAG_FLUSHBEFOREONCHANGE, DIRTY_LIGHT0},
+	{GE_CMD_LKB0, FLAG_FLUSHBEFOREONCHANGE, DIRTY_LIGHT0},
+	{GE_CMD_LKC0, FLAG_FLUSHBEFOREONCHANGE, DIRTY_LIGHT0},
+	{GE_CMD_LKA1, FLAG_FLUSHBEFOREONCHANGE, DIRTY_LIGHT1},
+	{GE_CMD_LKB1, FLAG_FLUSHBEFOREONCHANGE, DIRTY_LIGHT1},
+	{GE_CMD_LKC1, FLAG_FLUSHBEFOREONCHANGE, DIRTY_LIGHT1},
+	{GE_CMD_LKA2, FLAG_FLUSHBEFOREONCHANGE, DIRTY_LIGHT2},
+	{GE_CMD_LKB2, FLAG_FLUSHBEFOREONCHANGE, DIRTY_LIGHT2},
+	{GE_CMD_LKC2, FLAG_FLUSHBEFOREONCHANGE, DIRTY_LIGHT2},
+	{GE_CMD_LKA3, FLAG_FLUSHBEFOREONCHANGE, DIRTY_LIGHT3},
+	{GE_CMD_LKB3, FLAG_FLUSHBEFOREONCHANGE, DIRTY_LIGHT3},
+	{GE_CMD_LKC3, FLAG_FLUSHBEFOREONCHANGE, DIRTY_LIGHT3},
+	{GE_CMD_LKS0, FLAG_FLUSHBEFOREONCHANGE, DIRTY_LIGHT0},
+	{GE_CMD_LKS1, FLAG_FLUSHBEFOREONCHANGE, DIRTY_LIGHT1},
+	{GE_CMD_LKS2, FLAG_FLUSHBEFOREONCHANGE, DIRTY_LIGHT2},
+	{GE_CMD_LKS3, FLAG_FLUSHBEFOREONCHANGE, DIRTY_LIGHT3},
+	{GE_CMD_LKO0, FLAG_FLUSHBEFOREONCHANGE, DIRTY_LIGHT0},
+	{GE_CMD_LKO1, FLAG_FLUSHBEFOREONCHANGE, DIRTY_LIGHT1},
+	{GE_CMD_LKO2, FLAG_FLUSHBEFOREONCHANGE, DIRTY_LIGHT2},
+	{GE_CMD_LKO3, FLAG_FLUSHBEFOREONCHANGE, DIRTY_LIGHT3},
+	{GE_CMD_LAC0, FLAG_FLUSHBEFOREONCHANGE, DIRTY_LIGHT0},
+	{GE_CMD_LDC0, FLAG_FLUSHBEFOREONCHANGE, DIRTY_LIGHT0},
+	{GE_CMD_LSC0, FLAG_FLUSHBEFOREONCHANGE, DIRTY_LIGHT0},
+	{GE_CMD_LAC1, FLAG_FLUSHBEFOREONCHANGE, DIRTY_LIGHT1},
+	{GE_CMD_LDC1, FLAG_FLUSHBEFOREONCHANGE, DIRTY_LIGHT1},
+	{GE_CMD_LSC1, FLAG_FLUSHBEFOREONCHANGE, DIRTY_LIGHT1},
+	{GE_CMD_LAC2, FLAG_FLUSHBEFOREONCHANGE, DIRTY_LIGHT2},
+	{GE_CMD_LDC2, FLAG_FLUSHBEFOREONCHANGE, DIRTY_LIGHT2},
+	{GE_CMD_LSC2, FLAG_FLUSHBEFOREONCHANGE, DIRTY_LIGHT2},
+	{GE_CMD_LAC3, FLAG_FLUSHBEFOREONCHANGE, DIRTY_LIGHT3},
+	{GE_CMD_LDC3, FLAG_FLUSHBEFOREONCHANGE, DIRTY_LIGHT3},
+	{GE_CMD_LSC3, FLAG_FLUSHBEFOREONCHANGE, DIRTY_LIGHT3},
+	{GE_CMD_LIGHTENABLE0, FLAG_FLUSHBEFOREONCHANGE},
+	{GE_CMD_LIGHTENABLE1, FLAG_FLUSHBEFOREONCHANGE},
+	{GE_CMD_LIGHTENABLE2, FLAG_FLUSHBEFOREONCHANGE},
+	{GE_CMD_LIGHTENABLE3, FLAG_FLUSHBEFOREONCHANGE},
+	{GE_CMD_LMODE, FLAG_FLUSHBEFOREONCHANGE},
+	{GE_CMD_REVERSENORMAL, FLAG_FLUSHBEFOREONCHANGE},
+
+	{GE_CMD_VIEWPORTX1, FLAG_FLUSHBEFOREONCHANGE},
+	{GE_CMD_VIEWPORTY1, FLAG_FLUSHBEFOREONCHANGE},
+	{GE_CMD_VIEWPORTX2, FLAG_FLUSHBEFOREONCHANGE},
+	{GE_CMD_VIEWPORTY2, FLAG_FLUSHBEFOREONCHANGE},
+	{GE_CMD_VIEWPORTZ1, FLAG_FLUSHBEFOREONCHANGE},
+	{GE_CMD_VIEWPORTZ2, FLAG_FLUSHBEFOREONCHANGE},
+	{GE_CMD_CULL, FLAG_FLUSHBEFOREONCHANGE},
+	{GE_CMD_PATCHDIVISION, FLAG_FLUSHBEFOREONCHANGE},
+	{GE_CMD_PATCHPRIMITIVE, FLAG_FLUSHBEFOREONCHANGE},
+	{GE_CMD_PATCHFACING, FLAG_FLUSHBEFOREONCHANGE},
+
+	{GE_CMD_ALPHABLENDENABLE, FLAG_FLUSHBEFOREONCHANGE},
+	{GE_CMD_BLENDMODE, FLAG_FLUSHBEFOREONCHANGE},
+	{GE_CMD_BLENDFIXEDA, FLAG_FLUSHBEFOREONCHANGE},
+	{GE_CMD_BLENDFIXEDB, FLAG_FLUSHBEFOREONCHANGE},
+	{GE_CMD_ALPHATESTENABLE, FLAG_FLUSHBEFOREONCHANGE},
+	{GE_CMD_ALPHATEST, FLAG_FLUSHBEFOREONCHANGE, DIRTY_ALPHACOLORREF},
+	{GE_CMD_ZTESTENABLE, FLAG_FLUSHBEFOREONCHANGE},
+	{GE_CMD_STENCILTESTENABLE, FLAG_FLUSHBEFOREONCHANGE},
+	{GE_CMD_STENCILTEST, FLAG_FLUSHBEFOREONCHANGE},
+	{GE_CMD_STENCILOP, FLAG_FLUSHBEFOREONCHANGE},
+	{GE_CMD_ZTEST, FLAG_FLUSHBEFOREONCHANGE},
+	{GE_CMD_ZWRITEDISABLE, FLAG_FLUSHBEFOREONCHANGE},
+	{GE_CMD_MASKRGB, FLAG_FLUSHBEFOREONCHANGE},
+	{GE_CMD_MASKALPHA, FLAG_FLUSHBEFOREONCHANGE},
+	{GE_CMD_LOGICOP, FLAG_FLUSHBEFOREONCHANGE},
+	{GE_CMD_DITH0, FLAG_FLUSHBEFOREONCHANGE},
+	{GE_CMD_DITH1, FLAG_FLUSHBEFOREONCHANGE},
+	{GE_CMD_DITH2, FLAG_FLUSHBEFOREONCHANGE},
+	{GE_CMD_DITH3, FLAG_FLUSHBEFOREONCHANGE},
+	{GE_CMD_FOG1, FLAG_FLUSHBEFOREONCHANGE, DIRTY_FOGCOEF},
+	{GE_CMD_FOG2, FLAG_FLUSHBEFOREONCHANGE, DIRTY_FOGCOEF},
+	{GE_CMD_FOGCOLOR, FLAG_FLUSHBEFOREONCHANGE, DIRTY_FOGCOLOR},
+	{GE_CMD_MORPHWEIGHT0, FLAG_FLUSHBEFOREONCHANGE},
+	{GE_CMD_MORPHWEIGHT1, FLAG_FLUSHBEFOREONCHANGE},
+	{GE_CMD_MORPHWEIGHT2, FLAG_FLUSHBEFOREONCHANGE},
+	{GE_CMD_MORPHWEIGHT3, FLAG_FLUSHBEFOREONCHANGE},
+	{GE_CMD_MORPHWEIGHT4, FLAG_FLUSHBEFOREONCHANGE},
+	{GE_CMD_MORPHWEIGHT5, FLAG_FLUSHBEFOREONCHANGE},
+	{GE_CMD_MORPHWEIGHT6, FLAG_FLUSHBEFOREONCHANGE},
+	{GE_CMD_MORPHWEIGHT7, FLAG_FLUSHBEFOREONCHANGE},
 };
 
 GLES_GPU::GLES_GPU(int renderWidth, int renderHeight)
-:		interruptsEnabled_(true),
+:		shaderCacheLoaded_(false),
+		interruptsEnabled_(true),
 		displayFramebufPtr_(0),
 		renderWidth_(renderWidth),
 		renderHeight_(renderHeight)
@@ -155,15 +287,16 @@ GLES_GPU::GLES_GPU(int renderWidth, int renderHeight)
 		ERROR_LOG(G3D, "gstate has drifted out of sync!");
 	}
 
-	flushBeforeCommand_ = new u8[256];
-	memset(flushBeforeCommand_, 0, 256 * sizeof(bool));
-	for (size_t i = 0; i < ARRAY_SIZE(flushOnChangedBeforeCommandList); i++) {
-		flushBeforeCommand_[flushOnChangedBeforeCommandList[i]] = 2;
-	}
-	for (size_t i = 0; i < ARRAY_SIZE(flushBeforeCommandList); i++) {
-		flushBeforeCommand_[flushBeforeCommandList[i]] = 1;
+	memset(commandFlags_, 0, sizeof(commandFlags_));
+	memset(dirtyUniformOnChange_, 0, sizeof(dirtyUniformOnChange_));
+	for (size_t i = 0; i < ARRAY_SIZE(commandTable); i++) {
+		const u8 cmd = commandTable[i].cmd;
+		if (commandFlags_[cmd] != 0) {
+			ERROR_LOG(G3D, "Command %02x listed twice in the command table", cmd);
+		}
+		commandFlags_[cmd] = commandTable[i].flags;
+		dirtyUniformOnChange_[cmd] = commandTable[i].dirtyUniform;
 	}
-	flushBeforeCommand_[1] = 0;
 }
 
 GLES_GPU::~GLES_GPU() {
@@ -175,7 +308,6 @@ GLES_GPU::~GLES_GPU() {
 	vfbs_.clear();
 	shaderManager_->ClearCache(true);
 	delete shaderManager_;
-	delete [] flushBeforeCommand_;
 }
 
 void GLES_GPU::DeviceLost() {
@@ -183,6 +315,7 @@ void GLES_GPU::DeviceLost() {
 	// FBO:s appear to survive? Or no?
 	shaderManager_->ClearCache(false);
 	TextureCache_Clear(false);
+	transformDraw_.ClearVertexCache(false);
 }
 
 void GLES_GPU::InitClear() {
@@ -200,6 +333,10 @@ void GLES_GPU::DumpNextFrame() {
 
 void GLES_GPU::BeginFrame() {
 	TextureCache_Decimate();
+	transformDraw_.DecimateVertexCache();
+	// Redundant texture register writes are skipped, so this is what gets textures
+	// that changed behind our back (without a dcache call or TEXFLUSH) rechecked.
+	gstate_c.textureChanged = true;
 
 	if (dumpNextFrame_) {
 		NOTICE_LOG(G3D, "DUMPING THIS FRAME");
@@ -208,6 +345,18 @@ void GLES_GPU::BeginFrame() {
 	} else if (dumpThisFrame_) {
 		dumpThisFrame_ = false;
 	}
+
+	// The game isn't loaded yet when we're created, so wait for the first frame.
+	if (!shaderCacheLoaded_) {
+		shaderCacheLoaded_ = true;
+		std::string discID = g_paramSFO.GetValueString("DISC_ID");
+		if (!discID.empty()) {
+			std::string cacheDir = g_Config.memCardDirectory + "PSP/SYSTEM/CACHE/";
+			File::CreateFullPath(cacheDir);
+			shaderManager_->LoadShaderCache(cacheDir + discID + ".glshadercache");
+		}
+	}
+	shaderManager_->PrecompileCachedShaders();
 	shaderManager_->DirtyShader();
 
 	// Not sure if this is really needed.
@@ -414,17 +563,57 @@ static void LeaveClearMode() {
 	// dirtyshader?
 }
 
+// Whether a matrix data command would actually change the matrix entry it writes.
+static bool MatrixDataChanged(u32 cmd, u32 data) {
+	const float value = getFloat24(data);
+	int num;
+	switch (cmd) {
+	case GE_CMD_WORLDMATRIXDATA:
+		num = gstate.worldmtxnum & 0xF;
+		return num < 12 && gstate.worldMatrix[num] != value;
+	case GE_CMD_VIEWMATRIXDATA:
+		num = gstate.viewmtxnum & 0xF;
+		return num < 12 && gstate.viewMatrix[num] != value;
+	case GE_CMD_PROJMATRIXDATA:
+		num = gstate.projmtxnum & 0xF;
+		return gstate.projMatrix[num] != value;
+	case GE_CMD_TGENMATRIXDATA:
+		num = gstate.texmtxnum & 0xF;
+		return num < 12 && gstate.tgenMatrix[num] != value;
+	case GE_CMD_BONEMATRIXDATA:
+		num = gstate.boneMatrixNumber & 0x7F;
+		return num < 96 && gstate.boneMatrix[num] != value;
+	default:
+		return true;
+	}
+}
+
 void GLES_GPU::PreExecuteOp(u32 op, u32 diff) {
 	u32 cmd = op >> 24;
 
-	if (flushBeforeCommand_[cmd] == 1 || (diff && flushBeforeCommand_[cmd] == 2))
+	const u8 flags = commandFlags_[cmd];
+	if (flags & FLAG_FLUSHBEFORE) {
 		transformDraw_.Flush();
+	} else if (flags & FLAG_FLUSHBEFOREONCHANGE) {
+		if (diff)
+			transformDraw_.Flush();
+	} else if (flags & FLAG_FLUSHBEFOREONMATRIXCHANGE) {
+		if (MatrixDataChanged(cmd, op & 0xFFFFFF))
+			transformDraw_.Flush();
+	}
 }
 
 void GLES_GPU::ExecuteOp(u32 op, u32 diff) {
 	u32 cmd = op >> 24;
 	u32 data = op & 0xFFFFFF;
 
+	if (diff) {
+		if (commandFlags_[cmd] & FLAG_DIRTYTEXTURE)
+			gstate_c.textureChanged = true;
+		if (dirtyUniformOnChange_[cmd])
+			shaderManager_->DirtyUniform(dirtyUniformOnChange_[cmd]);
+	}
+
 	// Handle control and drawing commands here directly. The others we delegate.
 	switch (cmd) {
 	case GE_CMD_BASE:
@@ -453,8 +642,7 @@ void GLES_GPU::ExecuteOp(u32 op, u32 diff) {
 				break;
 			}
 
-			// TODO: Split this so that we can collect sequences of primitives, can greatly speed things up
-			// on platforms where draw calls are expensive like mobile and D3D
+			// Compatible primitives are collected by transformDraw_ until a state change flushes them.
 			void *verts = Memory::GetPointer(gstate_c.vertexAddr);
 			void *inds = 0;
 			if ((gstate.vertType & GE_VTYPE_IDX_MASK) != GE_VTYPE_IDX_NONE) {
@@ -540,7 +728,7 @@ void GLES_GPU::ExecuteOp(u32 op, u32 diff) {
 	case GE_CMD_FINISH:
 		// TODO: Should this run while interrupts are suspended?
 		if (interruptsEnabled_)
-			__TriggerInterruptWithArg(PSP_INTR_HLE, PSP_GE_INTR, currentList->subIntrBase | PSP_GE_SUBINTR_FINISH, 0);
+			TriggerListInterrupt(currentList->subIntrBase | PSP_GE_SUBINTR_FINISH, 0);
 		break;
 
 	case GE_CMD_END:
@@ -578,7 +766,7 @@ void GLES_GPU::ExecuteOp(u32 op, u32 diff) {
 				}
 				// TODO: Should this run while interrupts are suspended?
 				if (interruptsEnabled_)
-					__TriggerInterruptWithArg(PSP_INTR_HLE, PSP_GE_INTR, currentList->subIntrBase | PSP_GE_SUBINTR_SIGNAL, signal);
+					TriggerListInterrupt(currentList->subIntrBase | PSP_GE_SUBINTR_SIGNAL, signal);
 			}
 			break;
 		case GE_CMD_FINISH:
@@ -638,7 +826,6 @@ void GLES_GPU::ExecuteOp(u32 op, u32 diff) {
 		break;
 
 	case GE_CMD_TEXTUREMAPENABLE:
-		gstate_c.textureChanged = true;
 		break;
 
 	case GE_CMD_LIGHTINGENABLE:
@@ -658,22 +845,18 @@ void GLES_GPU::ExecuteOp(u32 op, u32 diff) {
 
 	case GE_CMD_TEXSCALEU:
 		gstate_c.uScale = getFloat24(data);
-		shaderManager_->DirtyUniform(DIRTY_UVSCALEOFFSET);
 		break;
 
 	case GE_CMD_TEXSCALEV:
 		gstate_c.vScale = getFloat24(data);
-		shaderManager_->DirtyUniform(DIRTY_UVSCALEOFFSET);
 		break;
 
 	case GE_CMD_TEXOFFSETU:
 		gstate_c.uOff = getFloat24(data);
-		shaderManager_->DirtyUniform(DIRTY_UVSCALEOFFSET);
 		break;
 
 	case GE_CMD_TEXOFFSETV:
 		gstate_c.vOff = getFloat24(data);
-		shaderManager_->DirtyUniform(DIRTY_UVSCALEOFFSET);
 		break;
 
 	case GE_CMD_SCISSOR1:
@@ -705,7 +888,6 @@ void GLES_GPU::ExecuteOp(u32 op, u32 diff) {
 	case GE_CMD_TEXADDR5:
 	case GE_CMD_TEXADDR6:
 	case GE_CMD_TEXADDR7:
-		gstate_c.textureChanged = true;
 		break;
 
 	case GE_CMD_TEXBUFWIDTH0:
@@ -716,15 +898,8 @@ void GLES_GPU::ExecuteOp(u32 op, u32 diff) {
 	case GE_CMD_TEXBUFWIDTH5:
 	case GE_CMD_TEXBUFWIDTH6:
 	case GE_CMD_TEXBUFWIDTH7:
-		gstate_c.textureChanged = true;
-		break;
-
 	case GE_CMD_CLUTADDR:
-		gstate_c.textureChanged = true;
-		break;
-
 	case GE_CMD_CLUTADDRUPPER:
-		gstate_c.textureChanged = true;
 		break;
 
 	case GE_CMD_LOADCLUT:
@@ -739,7 +914,6 @@ void GLES_GPU::ExecuteOp(u32 op, u32 diff) {
 		break;
 
 	case GE_CMD_CLUTFORMAT:
-		gstate_c.textureChanged = true;
 		break;
 
 	case GE_CMD_TRANSFERSRC:
@@ -764,7 +938,7 @@ void GLES_GPU::ExecuteOp(u32 op, u32 diff) {
 	case GE_CMD_TEXSIZE0:
 		gstate_c.curTextureWidth = 1 << (gstate.texsize[0] & 0xf);
 		gstate_c.curTextureHeight = 1 << ((gstate.texsize[0]>>8) & 0xf);
-		//fall thru - ignoring the mipmap sizes for now
+		//fall thru
 	case GE_CMD_TEXSIZE1:
 	case GE_CMD_TEXSIZE2:
 	case GE_CMD_TEXSIZE3:
@@ -772,7 +946,6 @@ void GLES_GPU::ExecuteOp(u32 op, u32 diff) {
 	case GE_CMD_TEXSIZE5:
 	case GE_CMD_TEXSIZE6:
 	case GE_CMD_TEXSIZE7:
-		gstate_c.textureChanged = true;
 		break;
 
 	case GE_CMD_ZBUFPTR:
@@ -784,33 +957,21 @@ void GLES_GPU::ExecuteOp(u32 op, u32 diff) {
 		break;
 
 	case GE_CMD_MATERIALAMBIENT:
-		if (diff)
-			shaderManager_->DirtyUniform(DIRTY_MATAMBIENTALPHA);
 		break;
 
 	case GE_CMD_MATERIALDIFFUSE:
-		if (diff)
-			shaderManager_->DirtyUniform(DIRTY_MATDIFFUSE);
 		break;
 
 	case GE_CMD_MATERIALEMISSIVE:
-		if (diff)
-			shaderManager_->DirtyUniform(DIRTY_MATEMISSIVE);
 		break;
 
 	case GE_CMD_MATERIALSPECULAR:
-		if (diff)
-			shaderManager_->DirtyUniform(DIRTY_MATSPECULAR);
 		break;
 
 	case GE_CMD_MATERIALALPHA:
-		if (diff)
-			shaderManager_->DirtyUniform(DIRTY_MATAMBIENTALPHA);
 		break;
 
 	case GE_CMD_MATERIALSPECULARCOEF:
-		if (diff)
-			shaderManager_->DirtyUniform(DIRTY_MATSPECULAR);
 		break;
 
 	case GE_CMD_LIGHTTYPE0:
@@ -828,8 +989,6 @@ void GLES_GPU::ExecuteOp(u32 op, u32 diff) {
 			int l = n / 3;
 			int c = n % 3;
 			gstate_c.lightpos[l][c] = getFloat24(data);
-			if (diff)
-				shaderManager_->DirtyUniform(DIRTY_LIGHT0 << l);
 		}
 		break;
 
@@ -842,8 +1001,6 @@ void GLES_GPU::ExecuteOp(u32 op, u32 diff) {
 			int l = n / 3;
 			int c = n % 3;
 			gstate_c.lightdir[l][c] = getFloat24(data);
-			if (diff)
-				shaderManager_->DirtyUniform(DIRTY_LIGHT0 << l);
 		}
 		break;
 
@@ -856,8 +1013,6 @@ void GLES_GPU::ExecuteOp(u32 op, u32 diff) {
 			int l = n / 3;
 			int c = n % 3;
 			gstate_c.lightatt[l][c] = getFloat24(data);
-			if (diff)
-				shaderManager_->DirtyUniform(DIRTY_LIGHT0 << l);
 		}
 		break;
 
@@ -875,8 +1030,6 @@ void GLES_GPU::ExecuteOp(u32 op, u32 diff) {
 			gstate_c.lightColor[t][l][0] = r;
 			gstate_c.lightColor[t][l][1] = g;
 			gstate_c.lightColor[t][l][2] = b;
-			if (diff)
-				shaderManager_->DirtyUniform(DIRTY_LIGHT0 << l);
 		}
 		break;
 
@@ -941,22 +1094,19 @@ void GLES_GPU::ExecuteOp(u32 op, u32 diff) {
 		break;
 
 	case GE_CMD_ALPHATEST:
-		shaderManager_->DirtyUniform(DIRTY_ALPHACOLORREF);
-		break;
-
 	case GE_CMD_TEXENVCOLOR:
-		if (diff)
-			shaderManager_->DirtyUniform(DIRTY_TEXENV);
-		break;
-
 	case GE_CMD_TEXFUNC:
 	case GE_CMD_TEXFILTER:
 	case GE_CMD_TEXMODE:
 	case GE_CMD_TEXFORMAT:
-	case GE_CMD_TEXFLUSH:
 	case GE_CMD_TEXWRAP:
 		break;
 
+	case GE_CMD_TEXFLUSH:
+		// The texture data may have changed even if none of the registers did.
+		gstate_c.textureChanged = true;
+		break;
+
 	//////////////////////////////////////////////////////////////////
 	//	Z/STENCIL TESTING
 	//////////////////////////////////////////////////////////////////
@@ -1064,18 +1214,118 @@ void GLES_GPU::UpdateStats() {
 	gpuStats.numFragmentShaders = shaderManager_->NumFragmentShaders();
 	gpuStats.numShaders = shaderManager_->NumPrograms();
 	gpuStats.numTextures = TextureCache_NumLoadedTextures();
+	gpuStats.numVertexDecoders = transformDraw_.NumVertexDecoders();
 }
 
-void GLES_GPU::DoBlockTransfer() {
-	// TODO: This is used a lot to copy data around between render targets and textures,
-	// and also to quickly load textures from RAM to VRAM. So we should do checks like the following:
-	//  * Does dstBasePtr point to an existing texture? If so maybe reload it immediately.
-	//
-	//  * Does srcBasePtr point to a render target, and dstBasePtr to a texture? If so
-	//    either copy between rt and texture or reassign the texture to point to the render target
-	//
-	// etc....
+// Copies a block between two memory rects, skipping rows that already hold the same bytes.
+// firstRow and lastRow get the range of rows that changed, first > last if none did.
+static void CopyTransferRows(u8 *dst, u32 dstPitch, const u8 *src, u32 srcPitch, u32 rowSize, int rows, int *firstRow, int *lastRow) {
+	*firstRow = rows;
+	*lastRow = -1;
+	if (srcPitch == rowSize && dstPitch == rowSize) {
+		if (memcmp(dst, src, rows * rowSize) != 0) {
+			memmove(dst, src, rows * rowSize);
+			*firstRow = 0;
+			*lastRow = rows - 1;
+		}
+		return;
+	}
+
+	// Bottom up if the destination is further along, so overlapping rows aren't overwritten before they're read.
+	const bool backwards = dst > src;
+	for (int i = 0; i < rows; i++) {
+		int y = backwards ? rows - 1 - i : i;
+		u8 *dstRow = dst + y * dstPitch;
+		const u8 *srcRow = src + y * srcPitch;
+		if (memcmp(dstRow, srcRow, rowSize) != 0) {
+			memmove(dstRow, srcRow, rowSize);
+			*firstRow = std::min(*firstRow, y);
+			*lastRow = std::max(*lastRow, y);
+		}
+	}
+}
+
+// Finds the render target whose memory overlaps the rows of a transfer rect starting at x, y, and
+// where in the render target the rect starts. That can be above the render target (a negative
+// vfbY), so callers have to clip. The rect has to have the same stride and pixel size to line up.
+GLES_GPU::VirtualFramebuffer *GLES_GPU::GetTransferVFB(u32 basePtr, int stride, int bpp, int x, int y, int height, int *vfbX, int *vfbY) {
+	const u32 addr = (basePtr + (y * stride + x) * bpp) & 0x3FFFFFF;
+	const u32 end = addr + height * stride * bpp;
+	for (auto iter = vfbs_.begin(); iter != vfbs_.end(); ++iter) {
+		VirtualFramebuffer *vfb = *iter;
+		const int vfbBpp = vfb->format == GE_FORMAT_8888 ? 4 : 2;
+		const u32 start = vfb->fb_address & 0x3FFFFFF;
+		const int pitch = vfb->fb_stride * vfbBpp;
+		if (pitch == 0 || end <= start || addr >= start + pitch * vfb->height)
+			continue;
+		if (stride != vfb->fb_stride || bpp != vfbBpp) {
+			WARN_LOG(G3D, "Block transfer into render target %08x with a different layout, ignoring the render target", vfb->fb_address);
+			continue;
+		}
+		const int offset = (int)(addr - start);
+		// Round down, also for rects that start above.
+		*vfbY = offset >= 0 ? offset / pitch : -((pitch - 1 - offset) / pitch);
+		*vfbX = (offset - *vfbY * pitch) / bpp;
+		return vfb;
+	}
+	return 0;
+}
+
+// Brings the FBO of a render target up to date with a block transfer into its memory. The
+// block comes straight from the source render target when there is one, otherwise from memory.
+void GLES_GPU::CopyToRenderTarget(VirtualFramebuffer *dstVfb, int dstX, int dstY, VirtualFramebuffer *srcVfb, int srcX, int srcY, const u8 *pixels, int stride, int width, int height) {
+	// Skip the rows above either render target, and clip the rest to both of them.
+	int skipRows = std::max(-dstY, srcVfb ? -srcY : 0);
+	if (skipRows > 0) {
+		const int bpp = dstVfb->format == GE_FORMAT_8888 ? 4 : 2;
+		pixels += skipRows * stride * bpp;
+		dstY += skipRows;
+		srcY += skipRows;
+		height -= skipRows;
+	}
+	width = std::min(width, dstVfb->width - dstX);
+	height = std::min(height, dstVfb->height - dstY);
+	if (srcVfb) {
+		width = std::min(width, srcVfb->width - srcX);
+		height = std::min(height, srcVfb->height - srcY);
+	}
+	if (width <= 0 || height <= 0)
+		return;
+	if (srcVfb == dstVfb) {
+		WARN_LOG(G3D, "Block transfer within render target %08x, not copied on the GPU", dstVfb->fb_address);
+		return;
+	}
+
+	fbo_bind_as_render_target(dstVfb->fbo);
+	glstate.viewport.set(0, 0, renderWidth_, renderHeight_);
+	glstate.blend.disable();
+	glstate.cullFace.disable();
+	glstate.depthTest.disable();
+	glstate.scissorTest.disable();
+
+	if (srcVfb) {
+		// FBOs are upside down.
+		fbo_bind_color_as_texture(srcVfb->fbo, 0);
+		float u1 = (float)srcX / srcVfb->width;
+		float u2 = (float)(srcX + width) / srcVfb->width;
+		float v1 = (float)(srcVfb->height - srcY) / srcVfb->height;
+		float v2 = (float)(srcVfb->height - srcY - height) / srcVfb->height;
+		framebufferManager.DrawActiveTextureRect((float)dstX, (float)dstY, (float)width, (float)height, u1, v1, u2, v2);
+	} else {
+		framebufferManager.DrawPixelsRect(pixels, dstVfb->format, stride, dstX, dstY, width, height);
+	}
+
+	// The next draw binds its render target again.
+	currentRenderVfb_ = 0;
+	shaderManager_->DirtyShader();
+	shaderManager_->DirtyUniform(DIRTY_ALL);
+	gstate_c.textureChanged = true;
+}
 
+// Block transfers load textures from RAM into VRAM, and copy between textures and render targets.
+// The memory copy always happens. In buffered rendering, a render target being written also gets
+// the block drawn into its FBO, so what's displayed or drawn on later includes it.
+void GLES_GPU::DoBlockTransfer() {
 	u32 srcBasePtr = (gstate.transfersrc & 0xFFFFFF) | ((gstate.transfersrcw & 0xFF0000) << 8);
 	u32 srcStride = gstate.transfersrcw & 0x3FF;
 
@@ -1095,19 +1345,43 @@ void GLES_GPU::DoBlockTransfer() {
 
 	DEBUG_LOG(G3D, "Block transfer: %08x to %08x, %i x %i , ...", srcBasePtr, dstBasePtr, width, height);
 
-	// Do the copy!
-	for (int y = 0; y < height; y++) {
-		const u8 *src = Memory::GetPointer(srcBasePtr + ((y + srcY) * srcStride + srcX) * bpp);
-		u8 *dst = Memory::GetPointer(dstBasePtr + ((y + dstY) * srcStride + dstX) * bpp);
-		memcpy(dst, src, width * bpp);
+	const u32 srcAddr = srcBasePtr + (srcY * srcStride + srcX) * bpp;
+	const u32 dstAddr = dstBasePtr + (dstY * dstStride + dstX) * bpp;
+	const u32 srcPitch = srcStride * bpp;
+	const u32 dstPitch = dstStride * bpp;
+	const u32 rowSize = width * bpp;
+	const u32 srcEnd = srcAddr + (height - 1) * srcPitch + rowSize - 1;
+	const u32 dstEnd = dstAddr + (height - 1) * dstPitch + rowSize - 1;
+	if (!Memory::IsValidAddress(srcAddr) || !Memory::IsValidAddress(srcEnd) || !Memory::IsValidAddress(dstAddr) || !Memory::IsValidAddress(dstEnd)) {
+		ERROR_LOG(G3D, "Block transfer out of memory: %08x to %08x, %i x %i", srcAddr, dstAddr, width, height);
+		return;
 	}
 
-	// TODO: Notify all overlapping FBOs that they need to reload.
+	int firstRow, lastRow;
+	CopyTransferRows(Memory::GetPointer(dstAddr), dstPitch, Memory::GetPointer(srcAddr), srcPitch, rowSize, height, &firstRow, &lastRow);
+
+	if (g_Config.bBufferedRendering) {
+		int srcVfbX = 0, srcVfbY = 0, dstVfbX = 0, dstVfbY = 0;
+		VirtualFramebuffer *srcVfb = GetTransferVFB(srcBasePtr, srcStride, bpp, srcX, srcY, height, &srcVfbX, &srcVfbY);
+		VirtualFramebuffer *dstVfb = GetTransferVFB(dstBasePtr, dstStride, bpp, dstX, dstY, height, &dstVfbX, &dstVfbY);
+		// Even when VRAM already had these bytes, the FBO may not, since it isn't written back.
+		if (dstVfb) {
+			CopyToRenderTarget(dstVfb, dstVfbX, dstVfbY, srcVfb, srcVfbX, srcVfbY, Memory::GetPointer(dstAddr), dstStride, width, height);
+		} else if (srcVfb && !dstVfb) {
+			// FBOs aren't read back, so this only has what was last in VRAM.
+			WARN_LOG(G3D, "Block transfer from render target %08x to memory, contents may be stale", srcVfb->fb_address);
+		}
+	}
 
-	TextureCache_Invalidate(dstBasePtr + dstY * dstStride + dstX, height * dstStride + width * bpp, true);
+	// Textures only need a recheck where the memory really changed.
+	if (firstRow <= lastRow) {
+		TextureCache_InvalidateRect(dstAddr + firstRow * dstPitch, dstPitch, rowSize, lastRow - firstRow + 1, true);
+	}
 }
 
 void GLES_GPU::InvalidateCache(u32 addr, int size) {
+	gstate_c.textureChanged = true;
+	transformDraw_.NotifyMemoryInvalidated();
 	if (size > 0)
 		TextureCache_Invalidate(addr, size, true);
 	else
@@ -1115,6 +1389,8 @@ void GLES_GPU::InvalidateCache(u32 addr, int size) {
 }
 
 void GLES_GPU::InvalidateCacheHint(u32 addr, int size) {
+	gstate_c.textureChanged = true;
+	transformDraw_.NotifyMemoryInvalidated();
 	if (size > 0)
 		TextureCache_Invalidate(addr, size, false);
 	else
@@ -1129,6 +1405,7 @@ void GLES_GPU::DoState(PointerWrap &p) {
 	GPUCommon::DoState(p);
 
 	TextureCache_Clear(true);
+	transformDraw_.ClearVertexCache(true);
 	gstate_c.textureChanged = true;
 	for (auto iter = vfbs_.begin(); iter != vfbs_.end(); ++iter) {
 		fbo_destroy((*iter)->fbo);
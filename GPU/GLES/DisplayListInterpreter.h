@@ -66,7 +66,9 @@ private:
 	FramebufferManager framebufferManager;
 	TransformDrawEngine transformDraw_;
 	ShaderManager *shaderManager_;
-	u8 *flushBeforeCommand_;
+	bool shaderCacheLoaded_;
+	// Indexed by command, the commandTable flags live in commandFlags_.
+	u32 dirtyUniformOnChange_[256];
 	bool interruptsEnabled_;
 
 	u32 displayFramebufPtr_;
@@ -102,6 +104,8 @@ private:
 	void SetRenderFrameBuffer();  // Uses parameters computed from gstate
 	// TODO: Break out into some form of FBO manager
 	VirtualFramebuffer *GetDisplayFBO();
+	VirtualFramebuffer *GetTransferVFB(u32 basePtr, int stride, int bpp, int x, int y, int height, int *vfbX, int *vfbY);
+	void CopyToRenderTarget(VirtualFramebuffer *dstVfb, int dstX, int dstY, VirtualFramebuffer *srcVfb, int srcX, int srcY, const u8 *pixels, int stride, int width, int height);
 
 	std::list<VirtualFramebuffer *> vfbs_;
 
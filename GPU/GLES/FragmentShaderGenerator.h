@@ -46,6 +46,8 @@ struct FragmentShaderID
 	}
 };
 
+// Bump this whenever GenerateFragmentShader changes, so cached shaders from older builds get dropped.
+#define FRAGMENT_SHADER_GEN_VERSION 1
 
 void ComputeFragmentShaderID(FragmentShaderID *id);
 
@@ -83,70 +83,64 @@ FramebufferManager::~FramebufferManager() {
 	delete [] convBuf;
 }
 
-void FramebufferManager::DrawPixels(const u8 *framebuf, int pixelFormat, int linesize) {
-	// TODO: We can trivially do these in the shader, and there's no need to
-	// upconvert to 8888 for the 16-bit formats.
-	for (int y = 0; y < 272; y++) {
-		switch (pixelFormat) {
-		case PSP_DISPLAY_PIXEL_FORMAT_565:
+// Converts a row of PSP pixels to RGBA8888.
+static void ConvertPixelsToRGBA(u8 *dst, const u8 *src, int pixelFormat, int count) {
+	switch (pixelFormat) {
+	case PSP_DISPLAY_PIXEL_FORMAT_565:
+		{
+			const u16 *src16 = (const u16 *)src;
+			for (int x = 0; x < count; x++)
 			{
-				const u16 *src = (const u16 *)framebuf + linesize * y;
-				u8 *dst = convBuf + 4 * 480 * y;
-				for (int x = 0; x < 480; x++)
-				{
-					u16 col = src[x];
-					dst[x * 4] = ((col) & 0x1f) << 3;
-					dst[x * 4 + 1] = ((col >> 5) & 0x3f) << 2;
-					dst[x * 4 + 2] = ((col >> 11) & 0x1f) << 3;
-					dst[x * 4 + 3] = 255;
-				}
+				u16 col = src16[x];
+				dst[x * 4] = ((col) & 0x1f) << 3;
+				dst[x * 4 + 1] = ((col >> 5) & 0x3f) << 2;
+				dst[x * 4 + 2] = ((col >> 11) & 0x1f) << 3;
+				dst[x * 4 + 3] = 255;
 			}
-			break;
+		}
+		break;
 
-		case PSP_DISPLAY_PIXEL_FORMAT_5551:
+	case PSP_DISPLAY_PIXEL_FORMAT_5551:
+		{
+			const u16 *src16 = (const u16 *)src;
+			for (int x = 0; x < count; x++)
 			{
-				const u16 *src = (const u16 *)framebuf + linesize * y;
-				u8 *dst = convBuf + 4 * 480 * y;
-				for (int x = 0; x < 480; x++)
-				{
-					u16 col = src[x];
-					dst[x * 4] = ((col) & 0x1f) << 3;
-					dst[x * 4 + 1] = ((col >> 5) & 0x1f) << 3;
-					dst[x * 4 + 2] = ((col >> 10) & 0x1f) << 3;
-					dst[x * 4 + 3] = (col >> 15) ? 255 : 0;
-				}
+				u16 col = src16[x];
+				dst[x * 4] = ((col) & 0x1f) << 3;
+				dst[x * 4 + 1] = ((col >> 5) & 0x1f) << 3;
+				dst[x * 4 + 2] = ((col >> 10) & 0x1f) << 3;
+				dst[x * 4 + 3] = (col >> 15) ? 255 : 0;
 			}
-			break;
+		}
+		break;
 
-		case PSP_DISPLAY_PIXEL_FORMAT_8888:
-			{
-				const u8 *src = framebuf + linesize * 4 * y;
-				u8 *dst = convBuf + 4 * 480 * y;
-				for (int x = 0; x < 480; x++)
-				{
-					dst[x * 4] = src[x * 4];
-					dst[x * 4 + 1] = src[x * 4 + 3];
-					dst[x * 4 + 2] = src[x * 4 + 2];
-					dst[x * 4 + 3] = src[x * 4 + 1];
-				}
-			}
-			break;
+	case PSP_DISPLAY_PIXEL_FORMAT_8888:
+		// Already RGBA in memory.
+		memcpy(dst, src, count * 4);
+		break;
 
-		case PSP_DISPLAY_PIXEL_FORMAT_4444:
+	case PSP_DISPLAY_PIXEL_FORMAT_4444:
+		{
+			const u16 *src16 = (const u16 *)src;
+			for (int x = 0; x < count; x++)
 			{
-				const u16 *src = (const u16 *)framebuf + linesize * y;
-				u8 *dst = convBuf + 4 * 480 * y;
-				for (int x = 0; x < 480; x++)
-				{
-					u16 col = src[x];
-					dst[x * 4] = ((col >> 8) & 0xf) << 4;
-					dst[x * 4 + 1] = ((col >> 4) & 0xf) << 4;
-					dst[x * 4 + 2] = (col & 0xf) << 4;
-					dst[x * 4 + 3] = (col >> 12) << 4;
-				}
+				u16 col = src16[x];
+				dst[x * 4] = ((col >> 8) & 0xf) << 4;
+				dst[x * 4 + 1] = ((col >> 4) & 0xf) << 4;
+				dst[x * 4 + 2] = (col & 0xf) << 4;
+				dst[x * 4 + 3] = (col >> 12) << 4;
 			}
-			break;
 		}
+		break;
+	}
+}
+
+void FramebufferManager::DrawPixels(const u8 *framebuf, int pixelFormat, int linesize) {
+	// TODO: We can trivially do these in the shader, and there's no need to
+	// upconvert to 8888 for the 16-bit formats.
+	const int bpp = pixelFormat == PSP_DISPLAY_PIXEL_FORMAT_8888 ? 4 : 2;
+	for (int y = 0; y < 272; y++) {
+		ConvertPixelsToRGBA(convBuf + 4 * 480 * y, framebuf + linesize * bpp * y, pixelFormat, 480);
 	}
 
 	glBindTexture(GL_TEXTURE_2D,backbufTex);
@@ -154,13 +148,26 @@ void FramebufferManager::DrawPixels(const u8 *framebuf, int pixelFormat, int lin
 	DrawActiveTexture(480, 272);
 }
 
+void FramebufferManager::DrawPixelsRect(const u8 *pixels, int pixelFormat, int linesize, int x, int y, int w, int h) {
+	const int bpp = pixelFormat == PSP_DISPLAY_PIXEL_FORMAT_8888 ? 4 : 2;
+	for (int row = 0; row < h; row++) {
+		ConvertPixelsToRGBA(convBuf + 4 * w * row, pixels + linesize * bpp * row, pixelFormat, w);
+	}
+
+	glBindTexture(GL_TEXTURE_2D, backbufTex);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, w, h, GL_RGBA, GL_UNSIGNED_BYTE, convBuf);
+	DrawActiveTextureRect((float)x, (float)y, (float)w, (float)h, 0.0f, 0.0f, w / 480.0f, h / 272.0f);
+}
+
 void FramebufferManager::DrawActiveTexture(float w, float h, bool flip) {
-	float u2 = 1.0f;
 	float v1 = flip ? 1.0f : 0.0f;
 	float v2 = flip ? 0.0f : 1.0f;
+	DrawActiveTextureRect(0, 0, w, h, 0.0f, v1, 1.0f, v2);
+}
 
-	const float pos[12] = {0,0,0, w,0,0, w,h,0, 0,h,0};
-	const float texCoords[8] = {0, v1, u2, v1, u2, v2, 0, v2};
+void FramebufferManager::DrawActiveTextureRect(float x, float y, float w, float h, float u1, float v1, float u2, float v2) {
+	const float pos[12] = {x,y,0, x+w,y,0, x+w,y+h,0, x,y+h,0};
+	const float texCoords[8] = {u1, v1, u2, v1, u2, v2, u1, v2};
 
 	glsl_bind(draw2dprogram);
 	Matrix4x4 ortho;
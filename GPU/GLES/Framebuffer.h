@@ -43,11 +43,15 @@ public:
 	*/
 
 	void DrawPixels(const u8 *framebuf, int pixelFormat, int linesize);
+	// Like DrawPixels, for a w x h block at x, y. At most 480x272.
+	void DrawPixelsRect(const u8 *pixels, int pixelFormat, int linesize, int x, int y, int w, int h);
 	void DrawActiveTexture(float w, float h, bool flip = false);
+	// Draws the u1,v1 - u2,v2 part of the bound texture at x, y in 480x272 space.
+	void DrawActiveTextureRect(float x, float y, float w, float h, float u1, float v1, float u2, float v2);
 
 private:
 
-	// Used by DrawPixels
+	// Used by DrawPixels and DrawPixelsRect
 	unsigned int backbufTex;
 
 	u8 *convBuf;
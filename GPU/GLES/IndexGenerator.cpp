@@ -47,6 +47,16 @@ bool IndexGenerator::PrimCompatible(int prim) {
 	return indexedPrimitiveType[prim] == prim_;
 }
 
+bool IndexGenerator::PrimCompatible(int prim1, int prim2) {
+	if (prim1 == -1)
+		return true;
+	return indexedPrimitiveType[prim1] == indexedPrimitiveType[prim2];
+}
+
+int IndexGenerator::GeneralPrim(int prim) {
+	return indexedPrimitiveType[prim];
+}
+
 void IndexGenerator::Setup(u16 *inds) {
 	this->indsBase_ = inds;
 	Reset();
@@ -27,6 +27,9 @@ public:
 	void Setup(u16 *indexptr);
 	void Reset();
 	bool PrimCompatible(int prim);
+	static bool PrimCompatible(int prim1, int prim2);
+	// The primitive type the generated indices will draw as.
+	static int GeneralPrim(int prim);
 	int Prim() const { return prim_; }
 
 	// Points (why index these? code simplicity)
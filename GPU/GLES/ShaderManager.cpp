@@ -15,6 +15,7 @@
 // Official git repository and contact information can be found at
 // https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
 
+#include <algorithm>
 #include <map>
 
 #include "math/lin/matrix4x4.h"
@@ -314,6 +315,107 @@ void ShaderManager::ClearCache(bool deleteThem)
 	Clear();
 }
 
+class ShaderCacheReader : public LinearDiskCacheReader<ShaderManager::ShaderCacheKey, char>
+{
+public:
+	ShaderCacheReader(ShaderManager *manager) : manager_(manager) {}
+
+	void Read(const ShaderManager::ShaderCacheKey &key, const char *value, u32 value_size) {
+		// Both sources must be there and terminated, or the entry is junk.
+		const char *vsCode = value;
+		size_t vsLen = strnlen(value, value_size);
+		if (vsLen + 1 >= value_size || value[value_size - 1] != '\0') {
+			WARN_LOG(G3D, "Skipping broken shader cache entry");
+			return;
+		}
+		const char *fsCode = value + vsLen + 1;
+		manager_->QueueCachedShader(key.vsid, key.fsid, vsCode, fsCode);
+	}
+
+private:
+	ShaderManager *manager_;
+};
+
+// The cache stores generated source, so it's only good for the generators that wrote it.
+#define SHADER_CACHE_VERSION (LINEAR_DISKCACHE_VER + (VERTEX_SHADER_GEN_VERSION << 16) + (FRAGMENT_SHADER_GEN_VERSION << 24))
+
+// Compiling and linking takes a few ms each on some drivers, so cached programs are spread out.
+#define CACHED_PROGRAMS_PER_FRAME 4
+
+void ShaderManager::LoadShaderCache(const std::string &filename)
+{
+	ShaderCacheReader reader(this);
+	diskCacheKeys_.clear();
+	cachedShaders_.clear();
+	nextCachedShader_ = 0;
+	u32 count = diskCache_.OpenAndRead(filename.c_str(), reader, SHADER_CACHE_VERSION);
+	diskCacheOpen_ = true;
+	INFO_LOG(G3D, "Loaded %i programs from shader cache %s", count, filename.c_str());
+}
+
+void ShaderManager::QueueCachedShader(const VertexShaderID &VSID, const FragmentShaderID &FSID, const char *vsCode, const char *fsCode)
+{
+	diskCacheKeys_.insert(std::make_pair(VSID, FSID));
+
+	CachedShader cached;
+	cached.vsid = VSID;
+	cached.fsid = FSID;
+	cached.vsCode = vsCode;
+	cached.fsCode = fsCode;
+	cachedShaders_.push_back(cached);
+}
+
+void ShaderManager::PrecompileCachedShaders()
+{
+	if (nextCachedShader_ >= cachedShaders_.size())
+		return;
+
+	size_t end = std::min(nextCachedShader_ + CACHED_PROGRAMS_PER_FRAME, cachedShaders_.size());
+	for (; nextCachedShader_ < end; nextCachedShader_++) {
+		const CachedShader &cached = cachedShaders_[nextCachedShader_];
+		PrecompileShader(cached.vsid, cached.fsid, cached.vsCode.c_str(), cached.fsCode.c_str());
+	}
+
+	if (nextCachedShader_ >= cachedShaders_.size()) {
+		cachedShaders_.clear();
+		nextCachedShader_ = 0;
+	}
+	// Linking may have changed the current program.
+	DirtyShader();
+}
+
+void ShaderManager::PrecompileShader(const VertexShaderID &VSID, const FragmentShaderID &FSID, const char *vsCode, const char *fsCode)
+{
+	Shader *&vs = vsCache[VSID];
+	if (!vs)
+		vs = new Shader(vsCode, GL_VERTEX_SHADER);
+	Shader *&fs = fsCache[FSID];
+	if (!fs)
+		fs = new Shader(fsCode, GL_FRAGMENT_SHADER);
+
+	std::pair<Shader*, Shader*> linkedID(vs, fs);
+	if (linkedShaderCache.find(linkedID) == linkedShaderCache.end()) {
+		linkedShaderCache[linkedID] = new LinkedShader(vs, fs);
+	}
+}
+
+void ShaderManager::RecordShader(const VertexShaderID &VSID, const FragmentShaderID &FSID, const std::string &vsCode, const std::string &fsCode)
+{
+	if (!diskCacheOpen_ || !diskCacheKeys_.insert(std::make_pair(VSID, FSID)).second)
+		return;
+
+	std::string value = vsCode;
+	value.push_back('\0');
+	value += fsCode;
+	value.push_back('\0');
+
+	ShaderCacheKey key;
+	key.vsid = VSID;
+	key.fsid = FSID;
+	diskCache_.Append(key, value.data(), (u32)value.size());
+	diskCache_.Sync();
+}
+
 
 void ShaderManager::DirtyShader()
 {
@@ -382,6 +484,7 @@ LinkedShader *ShaderManager::ApplyShader(int prim)
 	if (iter == linkedShaderCache.end()) {
 		ls = new LinkedShader(vs, fs);	// This does "use" automatically
 		linkedShaderCache[linkedID] = ls;
+		RecordShader(VSID, FSID, vs->source(), fs->source());
 	} else {
 		ls = iter->second;
 		ls->use();
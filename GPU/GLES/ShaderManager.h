@@ -19,11 +19,16 @@
 
 #include "base/basictypes.h"
 #include "../../Globals.h"
+#include "../../Common/LinearDiskCache.h"
 #include <map>
+#include <set>
+#include <string>
+#include <vector>
 #include "VertexShaderGenerator.h"
 #include "FragmentShaderGenerator.h"
 
 class Shader;
+class ShaderCacheReader;
 
 class LinkedShader
 {
@@ -133,14 +138,19 @@ private:
 class ShaderManager
 {
 public:
-	ShaderManager() : lastShader(NULL), globalDirty(0xFFFFFFFF) {
+	ShaderManager() : lastShader(NULL), globalDirty(0xFFFFFFFF), diskCacheOpen_(false), nextCachedShader_(0) {
 		codeBuffer_ = new char[16384];
 	}
 	~ShaderManager() {
+		diskCache_.Close();
 		delete [] codeBuffer_;
 	}
 
 	void ClearCache(bool deleteThem);  // TODO: deleteThem currently not respected
+	// Opens a game's shader cache, queues everything in it for compiling, and records new programs to it.
+	void LoadShaderCache(const std::string &filename);
+	// Compiles a few of the queued programs. Call once a frame, so loading a big cache doesn't stall.
+	void PrecompileCachedShaders();
 	LinkedShader *ApplyShader(int prim);
 	void DirtyShader();
 	void DirtyUniform(u32 what);
@@ -150,7 +160,12 @@ public:
 	int NumPrograms() const { return (int)linkedShaderCache.size(); }
 
 private:
+	friend class ShaderCacheReader;
+
 	void Clear();
+	void QueueCachedShader(const VertexShaderID &VSID, const FragmentShaderID &FSID, const char *vsCode, const char *fsCode);
+	void PrecompileShader(const VertexShaderID &VSID, const FragmentShaderID &FSID, const char *vsCode, const char *fsCode);
+	void RecordShader(const VertexShaderID &VSID, const FragmentShaderID &FSID, const std::string &vsCode, const std::string &fsCode);
 
 	typedef std::map<std::pair<Shader *, Shader *>, LinkedShader *> LinkedShaderCache;
 
@@ -167,4 +182,22 @@ private:
 
 	typedef std::map<VertexShaderID, Shader *> VSCache;
 	VSCache vsCache;
+
+	// The value is the vertex shader source, then the fragment shader source, each null terminated.
+	struct ShaderCacheKey {
+		VertexShaderID vsid;
+		FragmentShaderID fsid;
+	};
+	LinearDiskCache<ShaderCacheKey, char> diskCache_;
+	bool diskCacheOpen_;
+	std::set<std::pair<VertexShaderID, FragmentShaderID> > diskCacheKeys_;
+
+	struct CachedShader {
+		VertexShaderID vsid;
+		FragmentShaderID fsid;
+		std::string vsCode;
+		std::string fsCode;
+	};
+	std::vector<CachedShader> cachedShaders_;
+	size_t nextCachedShader_;
 };
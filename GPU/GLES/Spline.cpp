@@ -0,0 +1,411 @@
+// Copyright (c) 2012- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(_M_IX86) || defined(_M_X64)
+#include <xmmintrin.h>
+#endif
+
+#include "../../Core/Config.h"
+#include "../GPUState.h"
+#include "../ge_constants.h"
+#include "Spline.h"
+
+// Both bezier and spline patches are piecewise cubic, so every point of the surface is
+// a weighted sum of a 4x4 block of control points.
+
+enum {
+	// One mesh has to fit the draw engine's 16-bit index buffer.
+	PATCH_MAX_INDICES = 65536,
+	PATCH_MAX_DIVISIONS = 64,
+};
+
+// A control point, with every attribute padded to four floats so they can be summed four at a time.
+struct PatchPoint {
+	float pos[4];
+	float nrm[4];
+	float uv[4];
+	float color[4];
+	float weights[8];
+};
+
+// Where a row or column of the grid lands along one direction of the patch.
+struct PatchSample {
+	int first;  // First of the four control points that affect it.
+	float weights[4];
+	float param;  // Generated texture coordinate.
+};
+
+static void BezierSamples(std::vector<PatchSample> &samples, int count, int divs) {
+	const int spans = (count - 1) / 3;
+	samples.resize(spans * divs + 1);
+	for (int s = 0; s <= spans * divs; s++) {
+		int span = std::min(s / divs, spans - 1);
+		float t = (float)(s - span * divs) / divs;
+		float it = 1.0f - t;
+
+		PatchSample &sample = samples[s];
+		sample.first = span * 3;
+		sample.weights[0] = it * it * it;
+		sample.weights[1] = 3.0f * t * it * it;
+		sample.weights[2] = 3.0f * t * t * it;
+		sample.weights[3] = t * t * t;
+		sample.param = (float)s / divs;
+	}
+}
+
+// Cubic B-spline over count control points. Knots are uniform inside, closed ends repeat
+// the first/last one so the curve ends on the control point, open ends keep going uniformly.
+static void SplineKnots(float *knots, int count, int type) {
+	for (int i = 0; i < count + 4; i++)
+		knots[i] = (float)(i - 3);
+	if ((type & 1) != 0) {
+		for (int i = 0; i < 3; i++)
+			knots[i] = 0.0f;
+	}
+	if ((type & 2) != 0) {
+		for (int i = count + 1; i < count + 4; i++)
+			knots[i] = (float)(count - 3);
+	}
+}
+
+static void SplineSamples(std::vector<PatchSample> &samples, int count, int type, int divs) {
+	const int spans = count - 3;
+	std::vector<float> knots(count + 4);
+	SplineKnots(&knots[0], count, type);
+
+	samples.resize(spans * divs + 1);
+	for (int s = 0; s <= spans * divs; s++) {
+		int span = std::min(s / divs, spans - 1);
+		float t = (float)s / divs;
+
+		// Cox-de Boor, only the four basis functions that are nonzero in this knot interval.
+		const int k = span + 3;
+		float left[4], right[4];
+		float *n = samples[s].weights;
+		n[0] = 1.0f;
+		for (int d = 1; d <= 3; d++) {
+			left[d] = t - knots[k + 1 - d];
+			right[d] = knots[k + d] - t;
+			float saved = 0.0f;
+			for (int r = 0; r < d; r++) {
+				float temp = n[r] / (right[r + 1] + left[d - r]);
+				n[r] = saved + right[r + 1] * temp;
+				saved = left[d - r] * temp;
+			}
+			n[d] = saved;
+		}
+
+		samples[s].first = span;
+		samples[s].param = t;
+	}
+}
+
+// Sums the 4x4 block of control points starting at first, weighted by wu x wv.
+static void EvaluatePatchPoint(PatchPoint &out, const PatchPoint *points, int ucount, const PatchSample &su, const PatchSample &sv) {
+	const PatchPoint *row = points + sv.first * ucount + su.first;
+#if defined(_M_IX86) || defined(_M_X64)
+	__m128 pos = _mm_setzero_ps();
+	__m128 nrm = _mm_setzero_ps();
+	__m128 uv = _mm_setzero_ps();
+	__m128 color = _mm_setzero_ps();
+	__m128 weights0 = _mm_setzero_ps();
+	__m128 weights1 = _mm_setzero_ps();
+	for (int j = 0; j < 4; j++, row += ucount) {
+		for (int i = 0; i < 4; i++) {
+			__m128 w = _mm_set1_ps(su.weights[i] * sv.weights[j]);
+			const PatchPoint &p = row[i];
+			pos = _mm_add_ps(pos, _mm_mul_ps(_mm_loadu_ps(p.pos), w));
+			nrm = _mm_add_ps(nrm, _mm_mul_ps(_mm_loadu_ps(p.nrm), w));
+			uv = _mm_add_ps(uv, _mm_mul_ps(_mm_loadu_ps(p.uv), w));
+			color = _mm_add_ps(color, _mm_mul_ps(_mm_loadu_ps(p.color), w));
+			weights0 = _mm_add_ps(weights0, _mm_mul_ps(_mm_loadu_ps(p.weights), w));
+			weights1 = _mm_add_ps(weights1, _mm_mul_ps(_mm_loadu_ps(p.weights + 4), w));
+		}
+	}
+	_mm_storeu_ps(out.pos, pos);
+	_mm_storeu_ps(out.nrm, nrm);
+	_mm_storeu_ps(out.uv, uv);
+	_mm_storeu_ps(out.color, color);
+	_mm_storeu_ps(out.weights, weights0);
+	_mm_storeu_ps(out.weights + 4, weights1);
+#else
+	float *sum = out.pos;
+	const int floats = sizeof(PatchPoint) / sizeof(float);
+	memset(&out, 0, sizeof(out));
+	for (int j = 0; j < 4; j++, row += ucount) {
+		for (int i = 0; i < 4; i++) {
+			float w = su.weights[i] * sv.weights[j];
+			const float *p = row[i].pos;
+			for (int c = 0; c < floats; c++)
+				sum[c] += p[c] * w;
+		}
+	}
+#endif
+}
+
+// How many indices GeneratePatchIndices makes for a width x height grid.
+static int PatchIndexCount(int prim, int width, int height) {
+	switch (prim) {
+	case GE_PRIM_POINTS:
+		return width * height;
+	case GE_PRIM_LINES:
+		return 2 * ((width - 1) * height + width * (height - 1));
+	default:
+		return 6 * (width - 1) * (height - 1);
+	}
+}
+
+void LimitPatchDivisions(PatchDesc &desc) {
+	int uspans = desc.spline ? desc.ucount - 3 : (desc.ucount - 1) / 3;
+	int vspans = desc.spline ? desc.vcount - 3 : (desc.vcount - 1) / 3;
+	desc.udivs = std::max(1, std::min((int)PATCH_MAX_DIVISIONS, desc.udivs));
+	desc.vdivs = std::max(1, std::min((int)PATCH_MAX_DIVISIONS, desc.vdivs));
+
+	// The vertices also have to be reachable with 16-bit indices.
+	while (PatchIndexCount(desc.prim, uspans * desc.udivs + 1, vspans * desc.vdivs + 1) > PATCH_MAX_INDICES
+		|| (uspans * desc.udivs + 1) * (vspans * desc.vdivs + 1) > PATCH_MAX_INDICES) {
+		if (desc.udivs == 1 && desc.vdivs == 1)
+			break;
+		if (desc.udivs * uspans >= desc.vdivs * vspans && desc.udivs > 1)
+			desc.udivs--;
+		else if (desc.vdivs > 1)
+			desc.vdivs--;
+		else
+			desc.udivs--;
+	}
+}
+
+bool SetupPatchDesc(PatchDesc &desc, u32 vertType) {
+	if (desc.ucount < 4 || desc.vcount < 4) {
+		ERROR_LOG(G3D, "Patch with too few control points: %ix%i", desc.ucount, desc.vcount);
+		return false;
+	}
+	if (vertType & GE_VTYPE_THROUGH_MASK) {
+		ERROR_LOG(G3D, "Patch in through mode, not supported");
+		return false;
+	}
+
+	desc.udivs = gstate.patchdivision & 0x7F;
+	desc.vdivs = (gstate.patchdivision >> 8) & 0x7F;
+	if (g_Config.iPatchQuality == 0) {
+		desc.udivs /= 2;
+		desc.vdivs /= 2;
+	} else if (g_Config.iPatchQuality == 2) {
+		desc.udivs *= 2;
+		desc.vdivs *= 2;
+	}
+	switch (gstate.patchprimitive & 3) {
+	case 1: desc.prim = GE_PRIM_LINES; break;
+	case 2: desc.prim = GE_PRIM_POINTS; break;
+	default: desc.prim = GE_PRIM_TRIANGLES; break;
+	}
+	desc.computeNormals = (vertType & GE_VTYPE_NRM_MASK) == 0 && (gstate.lightingEnable & 1) != 0;
+	desc.flipNormals = (gstate.patchfacing & 1) != 0;
+	LimitPatchDivisions(desc);
+	return true;
+}
+
+static void ReadPatchPoints(std::vector<PatchPoint> &points, int count, const u8 *decoded, const DecVtxFormat &decFmt, int indexType, const void *inds, int indexLowerBound) {
+	VertexReader reader((u8 *)decoded, decFmt);
+	points.resize(count);
+	for (int i = 0; i < count; i++) {
+		int index = i;
+		if (indexType == GE_VTYPE_IDX_8BIT)
+			index = ((const u8 *)inds)[i] - indexLowerBound;
+		else if (indexType == GE_VTYPE_IDX_16BIT)
+			index = ((const u16 *)inds)[i] - indexLowerBound;
+		reader.Goto(index);
+
+		PatchPoint &p = points[i];
+		memset(&p, 0, sizeof(p));
+		reader.ReadPos(p.pos);
+		if (reader.hasNormal())
+			reader.ReadNrm(p.nrm);
+		if (reader.hasUV())
+			reader.ReadUV(p.uv);
+		if (reader.hasColor0())
+			reader.ReadColor0(p.color);
+		if (decFmt.w0fmt != 0)
+			reader.ReadWeights(p.weights);
+	}
+}
+
+static void ComputeGridNormals(std::vector<PatchPoint> &grid, int width, int height, bool flip) {
+	for (int y = 0; y < height; y++) {
+		for (int x = 0; x < width; x++) {
+			// Central differences, one-sided at the edges.
+			const float *left = grid[y * width + std::max(x - 1, 0)].pos;
+			const float *right = grid[y * width + std::min(x + 1, width - 1)].pos;
+			const float *up = grid[std::max(y - 1, 0) * width + x].pos;
+			const float *down = grid[std::min(y + 1, height - 1) * width + x].pos;
+			float du[3], dv[3];
+			for (int i = 0; i < 3; i++) {
+				du[i] = right[i] - left[i];
+				dv[i] = down[i] - up[i];
+			}
+
+			float *n = grid[y * width + x].nrm;
+			n[0] = du[1] * dv[2] - du[2] * dv[1];
+			n[1] = du[2] * dv[0] - du[0] * dv[2];
+			n[2] = du[0] * dv[1] - du[1] * dv[0];
+			float length = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+			if (length > 0.0f) {
+				float scale = (flip ? -1.0f : 1.0f) / length;
+				for (int i = 0; i < 3; i++)
+					n[i] *= scale;
+			}
+		}
+	}
+}
+
+static void GeneratePatchIndices(std::vector<u16> &indices, int prim, int width, int height) {
+	indices.clear();
+	switch (prim) {
+	case GE_PRIM_POINTS:
+		for (int i = 0; i < width * height; i++)
+			indices.push_back(i);
+		break;
+
+	case GE_PRIM_LINES:
+		for (int y = 0; y < height; y++) {
+			for (int x = 0; x < width; x++) {
+				int i = y * width + x;
+				if (x + 1 < width) {
+					indices.push_back(i);
+					indices.push_back(i + 1);
+				}
+				if (y + 1 < height) {
+					indices.push_back(i);
+					indices.push_back(i + width);
+				}
+			}
+		}
+		break;
+
+	default:
+		for (int y = 0; y < height - 1; y++) {
+			for (int x = 0; x < width - 1; x++) {
+				int i = y * width + x;
+				indices.push_back(i);
+				indices.push_back(i + 1);
+				indices.push_back(i + width + 1);
+				indices.push_back(i + width + 1);
+				indices.push_back(i + width);
+				indices.push_back(i);
+			}
+		}
+		break;
+	}
+}
+
+static inline u8 PatchColorComponent(float f) {
+	if (f <= 0.0f)
+		return 0;
+	if (f >= 1.0f)
+		return 255;
+	return (u8)(f * 255.0f + 0.5f);
+}
+
+void TessellatePatch(PatchMesh *mesh, const PatchDesc &desc, u32 srcVertType, const u8 *decoded, const DecVtxFormat &decFmt, const void *inds, int indexLowerBound) {
+	std::vector<PatchPoint> points;
+	ReadPatchPoints(points, desc.ucount * desc.vcount, decoded, decFmt, srcVertType & GE_VTYPE_IDX_MASK, inds, indexLowerBound);
+
+	std::vector<PatchSample> usamples, vsamples;
+	if (desc.spline) {
+		SplineSamples(usamples, desc.ucount, desc.utype, desc.udivs);
+		SplineSamples(vsamples, desc.vcount, desc.vtype, desc.vdivs);
+	} else {
+		BezierSamples(usamples, desc.ucount, desc.udivs);
+		BezierSamples(vsamples, desc.vcount, desc.vdivs);
+	}
+
+	const int width = (int)usamples.size();
+	const int height = (int)vsamples.size();
+	const bool hasUV = (srcVertType & GE_VTYPE_TC_MASK) != 0;
+	std::vector<PatchPoint> grid(width * height);
+	for (int y = 0; y < height; y++) {
+		for (int x = 0; x < width; x++) {
+			PatchPoint &p = grid[y * width + x];
+			EvaluatePatchPoint(p, &points[0], desc.ucount, usamples[x], vsamples[y]);
+			// Without texture coordinates, each span gets 0 to 1.
+			if (!hasUV) {
+				p.uv[0] = usamples[x].param;
+				p.uv[1] = vsamples[y].param;
+			}
+		}
+	}
+
+	const bool hasColor = (srcVertType & GE_VTYPE_COL_MASK) != 0;
+	const bool hasNormal = (srcVertType & GE_VTYPE_NRM_MASK) != 0 || desc.computeNormals;
+	if (desc.computeNormals)
+		ComputeGridNormals(grid, width, height, desc.flipNormals);
+
+	// The decoder will reverse the normals again.
+	const float normalScale = (gstate.reversenormals & 0xFFFFFF) ? -1.0f : 1.0f;
+
+	// Skinning weights blend like everything else, and the mesh gets skinned when it's drawn.
+	const bool hasWeights = (srcVertType & GE_VTYPE_WEIGHT_MASK) != 0;
+	const int numWeights = hasWeights ? ((srcVertType & GE_VTYPE_WEIGHTCOUNT_MASK) >> GE_VTYPE_WEIGHTCOUNT_SHIFT) + 1 : 0;
+
+	// Same component order and alignment as a PSP vertex. Everything is 4 bytes, so no padding.
+	mesh->vertType = GE_VTYPE_TC_FLOAT | GE_VTYPE_POS_FLOAT | GE_VTYPE_IDX_16BIT;
+	int stride = 8 + 12;
+	if (hasWeights) {
+		mesh->vertType |= GE_VTYPE_WEIGHT_FLOAT | (srcVertType & GE_VTYPE_WEIGHTCOUNT_MASK);
+		stride += 4 * numWeights;
+	}
+	if (hasColor) {
+		mesh->vertType |= GE_VTYPE_COL_8888;
+		stride += 4;
+	}
+	if (hasNormal) {
+		mesh->vertType |= GE_VTYPE_NRM_FLOAT;
+		stride += 12;
+	}
+
+	mesh->prim = desc.prim;
+	mesh->numVerts = width * height;
+	mesh->verts.resize(mesh->numVerts * stride);
+	u8 *out = &mesh->verts[0];
+	for (int i = 0; i < mesh->numVerts; i++) {
+		const PatchPoint &p = grid[i];
+		if (hasWeights) {
+			memcpy(out, p.weights, 4 * numWeights);
+			out += 4 * numWeights;
+		}
+		memcpy(out, p.uv, 8);
+		out += 8;
+		if (hasColor) {
+			for (int c = 0; c < 4; c++)
+				out[c] = PatchColorComponent(p.color[c]);
+			out += 4;
+		}
+		if (hasNormal) {
+			float *nrm = (float *)out;
+			for (int c = 0; c < 3; c++)
+				nrm[c] = p.nrm[c] * normalScale;
+			out += 12;
+		}
+		memcpy(out, p.pos, 12);
+		out += 12;
+	}
+
+	GeneratePatchIndices(mesh->indices, desc.prim, width, height);
+}
@@ -0,0 +1,66 @@
+// Copyright (c) 2012- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#pragma once
+
+#include <vector>
+
+#include "VertexDecoder.h"
+
+// What to tessellate, taken from the BEZIER/SPLINE command and the patch registers.
+struct PatchDesc {
+	int ucount;
+	int vcount;
+	// Spline edge types, bit 0 for the start and bit 1 for the end. A set bit closes
+	// that end, so the curve reaches the last control point. A clear bit leaves it open.
+	int utype;
+	int vtype;
+	bool spline;
+
+	// Segments per span (a bezier patch or a spline knot interval.)
+	int udivs;
+	int vdivs;
+	int prim;  // GE_PRIM_TRIANGLES, GE_PRIM_LINES or GE_PRIM_POINTS.
+
+	// Without normals in the control points, lighting needs some made up from the surface.
+	bool computeNormals;
+	bool flipNormals;
+};
+
+// A tessellated patch, in a vertex format of its own with 16-bit indices, ready for SubmitPrim.
+struct PatchMesh {
+	PatchMesh() : vertType(0), prim(0), numVerts(0), lastFrame(0) {}
+
+	u32 vertType;
+	int prim;
+	int numVerts;
+	std::vector<u8> verts;
+	std::vector<u16> indices;
+
+	int lastFrame;
+};
+
+// Clamps the divisions so the mesh fits a single draw's index buffer.
+void LimitPatchDivisions(PatchDesc &desc);
+
+// Takes the tessellation settings from the patch registers and the patch quality option,
+// given the counts and edge types. Returns false for patches that can't be drawn.
+bool SetupPatchDesc(PatchDesc &desc, u32 vertType);
+
+// Evaluates the patch whose control points are the count decoded vertices referenced by inds
+// (or in order, without an index type), and fills mesh. srcVertType is the format they were decoded from.
+void TessellatePatch(PatchMesh *mesh, const PatchDesc &desc, u32 srcVertType, const u8 *decoded, const DecVtxFormat &decFmt, const void *inds, int indexLowerBound);
@@ -17,6 +17,12 @@
 
 #include <map>
 
+#if defined(_M_IX86) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+#include "../../Common/Hash.h"
+#include "../../Common/ThreadPool.h"
 #include "../../Core/MemMap.h"
 #include "../ge_constants.h"
 #include "../GPUState.h"
@@ -26,20 +32,43 @@
 // If a texture hasn't been seen for 200 frames, get rid of it.
 #define TEXTURE_KILL_AGE 200
 
-// TODO: Speed up by switching to ReadUnchecked*.
+// Textures that stayed the same this many checks are only rehashed every
+// TEXTURE_RECHECK_FRAMES frames (plus a per-texture stagger) or when written to.
+#define TEXTURE_STABLE_CHECKS 3
+#define TEXTURE_RECHECK_FRAMES 30
+
+// Bytes of scheduled rehashing per frame. Checks over budget wait for a later frame.
+#define TEXTURE_HASH_BUDGET (2 * 1024 * 1024)
+
+// Textures with at least this many pixels are decoded in stripes on the decode pool.
+#define TEXTURE_PARALLEL_MIN_PIXELS (256 * 256)
 
 struct TexCacheEntry {
+	enum Status {
+		STATUS_HASHING = 0,  // New or recently changed, rehashed every frame it's used.
+		STATUS_RELIABLE = 1,
+	};
+
 	u32 addr;
-	u32 hash;
+	u32 hash;  // First word only, a cheap first check.
+	u64 fullhash;
+	u32 sizeInRAM;
 	int frameCounter;
 	u32 format;
 	u32 clutaddr;
 	u32 clutformat;
-	u32 cluthash;
+	u32 clutsize;
+	u64 cluthash;
 	int dim;
+	int maxLevel;  // Mip levels uploaded past the first.
+	u64 miphash;  // Levels past the first, and the memory they span.
+	u32 mipaddr;
+	u32 mipsize;
 	GLuint texture;
-	int invalidHint;
-	u32 fullhash;
+	u8 status;
+	bool invalidated;  // Memory was written, rehash before the next use.
+	int numStableChecks;
+	int nextCheckFrame;
 
 	// Cache the current filter settings so we can avoid setting it again.
 	u8 magFilt;
@@ -51,6 +80,9 @@ struct TexCacheEntry {
 typedef std::map<u64, TexCacheEntry> TexCache;
 static TexCache cache;
 
+static int hashBudget;
+static int hashBudgetFrame = -1;
+
 u32 *tmpTexBuf32;
 u16 *tmpTexBuf16;
 
@@ -59,6 +91,8 @@ u32 *tmpTexBufRearrange;
 u32 *clutBuf32;
 u16 *clutBuf16;
 
+static ThreadPool *decodePool;
+
 void TextureCache_Init() {
 	// TODO: Switch to aligned allocations for alignment. AllocateMemoryPages would do the trick.
 	tmpTexBuf32 = new u32[1024 * 512];
@@ -66,6 +100,7 @@ void TextureCache_Init() {
 	tmpTexBufRearrange = new u32[1024 * 512];
 	clutBuf32 = new u32[4096];
 	clutBuf16 = new u16[4096];
+	decodePool = new ThreadPool();
 }
 
 void TextureCache_Shutdown() {
@@ -77,6 +112,13 @@ void TextureCache_Shutdown() {
 	tmpTexBufRearrange = 0;
 	delete [] clutBuf32;
 	delete [] clutBuf16;
+	delete decodePool;
+	decodePool = 0;
+}
+
+void TextureCache_SetDecodeThreads(int numThreads) {
+	delete decodePool;
+	decodePool = numThreads > 0 ? new ThreadPool(numThreads) : 0;
 }
 
 void TextureCache_Clear(bool delete_them) {
@@ -104,36 +146,68 @@ void TextureCache_Decimate() {
 	}
 }
 
+// Textures in the range get rehashed, and only reloaded if they actually changed.
+// Without force, that just happens at the next scheduled check.
 void TextureCache_Invalidate(u32 addr, int size, bool force) {
 	u32 addr_end = addr + size;
 
-	for (TexCache::iterator iter = cache.begin(); iter != cache.end(); ) {
-		// Clear if either the addr or clutaddr is in the range.
-		bool invalidate = iter->second.addr >= addr && iter->second.addr < addr_end;
-		invalidate |= iter->second.clutaddr >= addr && iter->second.clutaddr < addr_end;
+	for (TexCache::iterator iter = cache.begin(); iter != cache.end(); ++iter) {
+		TexCacheEntry &entry = iter->second;
+		// Check if either the texture or its clut overlaps the range.
+		bool invalidate = entry.addr < addr_end && entry.addr + entry.sizeInRAM > addr;
+		invalidate |= entry.clutsize != 0 && entry.clutaddr < addr_end && entry.clutaddr + entry.clutsize > addr;
+		invalidate |= entry.mipsize != 0 && entry.mipaddr < addr_end && entry.mipaddr + entry.mipsize > addr;
 
 		if (invalidate) {
 			if (force) {
 				gpuStats.numTextureInvalidations++;
-				glDeleteTextures(1, &iter->second.texture);
-				cache.erase(iter++);
+				entry.invalidated = true;
 			} else {
-				iter->second.invalidHint++;
-				++iter;
+				entry.nextCheckFrame = gpuStats.numFrames;
 			}
 		}
-		else
-			++iter;
 	}
 }
 
-void TextureCache_InvalidateAll(bool force) {
-	if (force) {
-		gpuStats.numTextureInvalidations += 1000;
-		TextureCache_Clear(true);
+// Does [start, end) overlap any of the rows of the rect?
+static inline bool RangeOverlapsRect(u32 start, u32 end, u32 addr, u32 pitch, u32 rowSize, int rows) {
+	if (end <= addr || start >= addr + (rows - 1) * pitch + rowSize)
+		return false;
+	// The row start is in, or else the last row before it.
+	u32 row = start > addr ? (start - addr) / pitch : 0;
+	if (start < addr + row * pitch + rowSize)
+		return true;
+	// Then only the next row can reach into the range.
+	return (int)row + 1 < rows && addr + (row + 1) * pitch < end;
+}
+
+void TextureCache_InvalidateRect(u32 addr, u32 pitch, u32 rowSize, int rows, bool force) {
+	if (rows <= 0)
+		return;
+	if (rows == 1 || pitch <= rowSize) {
+		TextureCache_Invalidate(addr, (rows - 1) * pitch + rowSize, force);
+		return;
 	}
-	else
-		TextureCache_Invalidate(0, 0xFFFFFFFF, force);
+
+	for (TexCache::iterator iter = cache.begin(); iter != cache.end(); ++iter) {
+		TexCacheEntry &entry = iter->second;
+		bool invalidate = RangeOverlapsRect(entry.addr, entry.addr + entry.sizeInRAM, addr, pitch, rowSize, rows);
+		invalidate |= entry.clutsize != 0 && RangeOverlapsRect(entry.clutaddr, entry.clutaddr + entry.clutsize, addr, pitch, rowSize, rows);
+		invalidate |= entry.mipsize != 0 && RangeOverlapsRect(entry.mipaddr, entry.mipaddr + entry.mipsize, addr, pitch, rowSize, rows);
+
+		if (invalidate) {
+			if (force) {
+				gpuStats.numTextureInvalidations++;
+				entry.invalidated = true;
+			} else {
+				entry.nextCheckFrame = gpuStats.numFrames;
+			}
+		}
+	}
+}
+
+void TextureCache_InvalidateAll(bool force) {
+	TextureCache_Invalidate(0, 0xFFFFFFFF, force);
 }
 
 int TextureCache_NumLoadedTextures() {
@@ -169,47 +243,67 @@ u32 *ReadClut32() {
 	return clutBuf32;
 }
 
-void *UnswizzleFromMem(u32 texaddr, u32 bytesPerPixel, u32 level) {
-	u32 addr = texaddr;
-	u32 rowWidth = (bytesPerPixel > 0) ? ((gstate.texbufwidth[level] & 0x3FF) * bytesPerPixel) : ((gstate.texbufwidth[level] & 0x3FF) / 2);
+// Swizzled textures are stored as 16 byte x 8 row blocks.
+static inline void UnswizzleBlock(u32 *dest, const u8 *src, u32 pitch) {
+	for (int n = 0; n < 8; n++) {
+#if defined(_M_IX86) || defined(_M_X64)
+		_mm_storeu_si128((__m128i *)dest, _mm_loadu_si128((const __m128i *)src));
+#else
+		memcpy(dest, src, 16);
+#endif
+		src += 16;
+		dest += pitch;
+	}
+}
+
+// Unswizzles block rows [byStart, byEnd) of a texture at least 16 bytes wide.
+static void UnswizzleBlockRows(u32 *dest, const u8 *src, u32 rowWidth, int byStart, int byEnd) {
 	u32 pitch = rowWidth / 4;
 	int bxc = rowWidth / 16;
+	src += byStart * rowWidth * 8;
+	dest += byStart * pitch * 8;
+	for (int by = byStart; by < byEnd; by++) {
+		u32 *xdest = dest;
+		for (int bx = 0; bx < bxc; bx++) {
+			UnswizzleBlock(xdest, src, pitch);
+			src += 16 * 8;
+			xdest += 4;
+		}
+		dest += pitch * 8;
+	}
+}
+
+void *UnswizzleFromMem(u32 texaddr, u32 bytesPerPixel, u32 level, u32 *dest) {
+	u32 addr = texaddr;
+	u32 rowWidth = (bytesPerPixel > 0) ? ((gstate.texbufwidth[level] & 0x3FF) * bytesPerPixel) : ((gstate.texbufwidth[level] & 0x3FF) / 2);
 	int byc = ((1 << ((gstate.texsize[level] >> 8) & 0xf)) + 7) / 8;
 	if (byc == 0)
 		byc = 1;
 
+	if (rowWidth >= 16) {
+		UnswizzleBlockRows(dest, Memory::GetPointer(texaddr), rowWidth, 0, byc);
+		return dest;
+	}
+
 	u32 ydest = 0;
+
 	for (int by = 0; by < byc; by++) {
-		if (rowWidth >= 16) {
-			u32 xdest = ydest;
-			for (int bx = 0; bx < bxc; bx++) {
-				u32 dest = xdest;
-				for (int n = 0; n < 8; n++) {
-					for (int k = 0; k < 4; k++) {
-						tmpTexBuf32[dest + k] = Memory::ReadUnchecked_U32(addr);
-						addr += 4;
-					}
-					dest += pitch;
-				}
-				xdest += 4;
-			}
-			ydest += (rowWidth * 8) / 4;
-		} else if (rowWidth == 8) {
+		if (rowWidth == 8) {
 			for (int n = 0; n < 8; n++, ydest += 2) {
-				tmpTexBuf32[ydest + 0] = Memory::ReadUnchecked_U32(addr + 0);
-				tmpTexBuf32[ydest + 1] = Memory::ReadUnchecked_U32(addr + 4);
+				dest[ydest + 0] = Memory::ReadUnchecked_U32(addr + 0);
+				dest[ydest + 1] = Memory::ReadUnchecked_U32(addr + 4);
 				addr += 16; // skip two u32
 			}
 		} else if (rowWidth == 4) {
 			for (int n = 0; n < 8; n++, ydest++) {
-				tmpTexBuf32[ydest] = Memory::ReadUnchecked_U32(addr);
+				dest[ydest] = Memory::ReadUnchecked_U32(addr);
 				addr += 16;
 			}
 		} else if (rowWidth == 2) {
 			for (int n = 0; n < 4; n++, ydest++) {
 				u16 n1 = Memory::ReadUnchecked_U16(addr +  0);
 				u16 n2 = Memory::ReadUnchecked_U16(addr + 16);
-				tmpTexBuf32[ydest] = (u32)n1 | ((u32)n2 << 16);
+				dest[ydest] = (u32)n1 | ((u32)n2 << 16);
 				addr += 32;
 			}
 		}
@@ -220,145 +314,83 @@ void *UnswizzleFromMem(u32 texaddr, u32 bytesPerPixel, u32 level) {
 				u8 n2 = Memory::ReadUnchecked_U8(addr + 16) & 0xf;
 				u8 n3 = Memory::ReadUnchecked_U8(addr + 32) & 0xf;
 				u8 n4 = Memory::ReadUnchecked_U8(addr + 48) & 0xf;
-				tmpTexBuf32[ydest] = (u32)n1 | ((u32)n2 << 8) | ((u32)n3 << 16) | ((u32)n4 << 24);
+				dest[ydest] = (u32)n1 | ((u32)n2 << 8) | ((u32)n3 << 16) | ((u32)n4 << 24);
 			}
 		}
 	}
-	return tmpTexBuf32;
+	return dest;
 }
 
-void *readIndexedTex(int level, u32 texaddr, int bytesPerIndex) {
-	int length = (gstate.texbufwidth[level] & 0x3FF) * (1 << ((gstate.texsize[level] >> 8) & 0xf));
-	void *buf = NULL;
-	switch ((gstate.clutformat & 3)) {
-	case GE_CMODE_16BIT_BGR5650:
-	case GE_CMODE_16BIT_ABGR5551:
-	case GE_CMODE_16BIT_ABGR4444:
-		{
-		u16 *clut = ReadClut16();
-		if (!(gstate.texmode & 1)) {
-			switch (bytesPerIndex) {
-			case 1:
-				for (int i = 0; i < length; i++) {
-					u8 index = Memory::ReadUnchecked_U8(texaddr + i);
-					tmpTexBuf16[i] = clut[GetClutIndex(index)];
-				}
-				break;
-
-			case 2:
-				for (int i = 0; i < length; i++) {
-					u16 index = Memory::ReadUnchecked_U16(texaddr + i * 2);
-					tmpTexBuf16[i] = clut[GetClutIndex(index)];
-				}
-				break;
+// De-indexing kernels. The palettes passed in already have GetClutIndex applied,
+// so they're indexed directly by the texel value.
 
-			case 4:
-				for (int i = 0; i < length; i++) {
-					u32 index = Memory::ReadUnchecked_U32(texaddr + i * 4);
-					tmpTexBuf16[i] = clut[GetClutIndex(index)];
-				}
-				break;
-			}
-		} else {
-			UnswizzleFromMem(texaddr, bytesPerIndex, level);
-			switch (bytesPerIndex) {
-			case 1:
-				for (int i = 0, j = 0; i < length; i += 4, j++) 	{
-					u32 n = tmpTexBuf32[j];
-					u32 k;
-					for (k = 0; k < 4; k++) {
-						u8 index = (n >> (k * 8)) & 0xff;
-						tmpTexBuf16[i + k] = clut[GetClutIndex(index)];
-					}
-				}
-				break;
+template <typename ClutT>
+static void ExpandClut(ClutT *palette, const ClutT *clut, int numIndices) {
+	for (int i = 0; i < numIndices; i++)
+		palette[i] = clut[GetClutIndex(i)];
+}
 
-			case 2:
-				for (int i = 0, j = 0; i < length; i += 2, j++) {
-					u32 n = tmpTexBuf32[j];
-					tmpTexBuf16[i + 0] = clut[GetClutIndex(n & 0xffff)];
-					tmpTexBuf16[i + 1] = clut[GetClutIndex(n >> 16)];
-				}
-				break;
+// Two texels per byte, so look up a pair of them at once.
+static void DeIndexTexture4(u16 *dest, const u8 *indexed, int length, const u16 *palette) {
+	u32 pairs[256];
+	for (int i = 0; i < 256; i++)
+		pairs[i] = (u32)palette[i & 0xF] | ((u32)palette[i >> 4] << 16);
 
-			case 4:
-				for (int i = 0; i < length; i++) {
-					u32 n = tmpTexBuf32[i];
-					tmpTexBuf16[i] = clut[GetClutIndex(n)];
-				}
-				break;
-			}
-		}
-		buf = tmpTexBuf16;
-		}
-		break;
+	u32 *dest32 = (u32 *)dest;
+	for (int i = 0; i < length / 2; i++)
+		dest32[i] = pairs[indexed[i]];
+}
 
-	case GE_CMODE_32BIT_ABGR8888:
-		{
-		u32 *clut = ReadClut32();
-		if (!(gstate.texmode & 1)) {
-			switch (bytesPerIndex) {
-			case 1:
-				for (int i = 0; i < length; i++) {
-					u8 index = Memory::ReadUnchecked_U8(texaddr + i);
-					tmpTexBuf32[i] = clut[GetClutIndex(index)];
-				}
-				break;
+static void DeIndexTexture4(u32 *dest, const u8 *indexed, int length, const u32 *palette) {
+	u64 pairs[256];
+	for (int i = 0; i < 256; i++)
+		pairs[i] = (u64)palette[i & 0xF] | ((u64)palette[i >> 4] << 32);
 
-			case 2:
-				for (int i = 0; i < length; i++) {
-					u16 index = Memory::ReadUnchecked_U16(texaddr + i * 2);
-					tmpTexBuf32[i] = clut[GetClutIndex(index)];
-				}
-				break;
+	u64 *dest64 = (u64 *)dest;
+	for (int i = 0; i < length / 2; i++)
+		dest64[i] = pairs[indexed[i]];
+}
 
-			case 4:
-				for (int i = 0; i < length; i++) {
-					u32 index = Memory::ReadUnchecked_U32(texaddr + i * 4);
-					tmpTexBuf32[i] = clut[GetClutIndex(index)];
-				}
-				break;
-			}
-		} else {
-			UnswizzleFromMem(texaddr, bytesPerIndex, level);
-			switch (bytesPerIndex) {
-			case 1:
-				for (int i = length - 4, j = (length / 4) - 1; i >= 0; i -= 4, j--) {
-					u32 n = tmpTexBuf32[j];
-					u32 k;
-					for (k = 0; k < 4; k++) {
-						u32 index = (n >> (k * 8)) & 0xff;
-						tmpTexBuf32[i + k] = clut[GetClutIndex(index)];
-					}
-				}
-				break;
+template <typename ClutT>
+static void DeIndexTexture8(ClutT *dest, const u8 *indexed, int length, const ClutT *palette) {
+	int i = 0;
+	for (; i + 4 <= length; i += 4) {
+		u32 n = *(const u32 *)(indexed + i);
+		dest[i + 0] = palette[n & 0xFF];
+		dest[i + 1] = palette[(n >> 8) & 0xFF];
+		dest[i + 2] = palette[(n >> 16) & 0xFF];
+		dest[i + 3] = palette[n >> 24];
+	}
+	for (; i < length; i++)
+		dest[i] = palette[indexed[i]];
+}
 
-			case 2:
-				for (int i = length - 2, j = (length / 2) - 1; i >= 0; i -= 2, j--) {
-					u32 n = tmpTexBuf32[j];
-					tmpTexBuf32[i + 0] = clut[GetClutIndex(n & 0xffff)];
-					tmpTexBuf32[i + 1] = clut[GetClutIndex(n >> 16)];
-				}
-				break;
+// Wide indices can reach past the palette, so these go through GetClutIndex.
+template <typename ClutT, typename IndexT>
+static void DeIndexTexture(ClutT *dest, const IndexT *indexed, int length, const ClutT *clut) {
+	for (int i = 0; i < length; i++)
+		dest[i] = clut[GetClutIndex(indexed[i])];
+}
 
-			case 4:
-				for (int i = 0; i < length; i++) {
-					u32 n = tmpTexBuf32[i];
-					tmpTexBuf32[i] = clut[GetClutIndex(n)];
-				}
-				break;
-			}
-		}
-		buf = tmpTexBuf32;
+template <typename ClutT>
+static void DeIndexTextureAny(ClutT *dest, const u8 *indexed, int length, int bytesPerIndex, const ClutT *clut) {
+	switch (bytesPerIndex) {
+	case 1:
+		{
+			ClutT palette[256];
+			ExpandClut(palette, clut, 256);
+			DeIndexTexture8(dest, indexed, length, palette);
 		}
 		break;
 
-	default:
-		ERROR_LOG(G3D, "Unhandled clut texture mode %d!!!", (gstate.clutformat & 3));
+	case 2:
+		DeIndexTexture(dest, (const u16 *)indexed, length, clut);
 		break;
-	}
 
-	return buf;
+	case 4:
+		DeIndexTexture(dest, (const u32 *)indexed, length, clut);
+		break;
+	}
 }
 
 GLenum getClutDestFormat(GEPaletteFormat format) {
@@ -401,8 +433,8 @@ void UpdateSamplingParams(TexCacheEntry &entry, bool force) {
 	bool sClamp = gstate.texwrap & 1;
 	bool tClamp = (gstate.texwrap>>8) & 1;
 
-	// TODO: remove this line when we support mipmaps
-	minFilt &= 1; // no mipmaps yet
+	if (entry.maxLevel == 0)
+		minFilt &= 1;
 
 	if (g_Config.bLinearFiltering) {
 		magFilt |= 1;
@@ -427,24 +459,6 @@ void UpdateSamplingParams(TexCacheEntry &entry, bool force) {
 	}
 }
 
-// Todo: Make versions of these that do two pixels at a time within a 32-bit register.
-
-// Convert from PSP bit order to GLES bit order
-u16 convert565(u16 c) {
-	return (c >> 11) | (c & 0x07E0) | (c << 11);
-}
-
-// Convert from PSP bit order to GLES bit order
-u16 convert4444(u16 c) {
-	return (c >> 12) | ((c >> 4) & 0xF0) | ((c << 4) & 0xF00) | (c << 12);
-}
-
-// Convert from PSP bit order to GLES bit order
-u16 convert5551(u16 c) {
-	return ((c & 0x8000) >> 15) | (c << 1);
-}
-
-
 // All these DXT structs are in the reverse order, as compared to PC.
 // On PC, alpha comes before color, and interpolants are before the tile data.
 
@@ -559,43 +573,395 @@ void decodeDXT5Block(u32 *dst, const DXT5Block *src, int pitch) {
 	}
 }
 
+// Convert from PSP bit order to GLES bit order. Without SSE2, two pixels are
+// done at a time in a 32-bit register.
+static void convert4444(u16 *p, int numPixels) {
+	int i = 0;
+#if defined(_M_IX86) || defined(_M_X64)
+	const __m128i maskF0 = _mm_set1_epi16(0x00F0);
+	const __m128i maskF00 = _mm_set1_epi16(0x0F00);
+	for (; i + 8 <= numPixels; i += 8) {
+		__m128i c = _mm_loadu_si128((const __m128i *)(p + i));
+		__m128i r = _mm_or_si128(_mm_srli_epi16(c, 12), _mm_slli_epi16(c, 12));
+		r = _mm_or_si128(r, _mm_and_si128(_mm_srli_epi16(c, 4), maskF0));
+		r = _mm_or_si128(r, _mm_and_si128(_mm_slli_epi16(c, 4), maskF00));
+		_mm_storeu_si128((__m128i *)(p + i), r);
+	}
+#else
+	u32 *p32 = (u32 *)p;
+	for (; i + 2 <= numPixels; i += 2) {
+		u32 c = p32[i / 2];
+		p32[i / 2] = ((c >> 12) & 0x000F000F) | ((c >> 4) & 0x00F000F0) | ((c << 4) & 0x0F000F00) | ((c << 12) & 0xF000F000);
+	}
+#endif
+	for (; i < numPixels; i++) {
+		u16 c = p[i];
+		p[i] = (c >> 12) | ((c >> 4) & 0xF0) | ((c << 4) & 0xF00) | (c << 12);
+	}
+}
+
+static void convert5551(u16 *p, int numPixels) {
+	int i = 0;
+#if defined(_M_IX86) || defined(_M_X64)
+	const __m128i mask3E = _mm_set1_epi16(0x003E);
+	const __m128i mask7C0 = _mm_set1_epi16(0x07C0);
+	for (; i + 8 <= numPixels; i += 8) {
+		__m128i c = _mm_loadu_si128((const __m128i *)(p + i));
+		__m128i r = _mm_or_si128(_mm_srli_epi16(c, 15), _mm_slli_epi16(c, 11));
+		r = _mm_or_si128(r, _mm_and_si128(_mm_srli_epi16(c, 9), mask3E));
+		r = _mm_or_si128(r, _mm_and_si128(_mm_slli_epi16(c, 1), mask7C0));
+		_mm_storeu_si128((__m128i *)(p + i), r);
+	}
+#else
+	u32 *p32 = (u32 *)p;
+	for (; i + 2 <= numPixels; i += 2) {
+		u32 c = p32[i / 2];
+		p32[i / 2] = ((c >> 15) & 0x00010001) | ((c >> 9) & 0x003E003E) | ((c << 1) & 0x07C007C0) | ((c << 11) & 0xF800F800);
+	}
+#endif
+	for (; i < numPixels; i++) {
+		u16 c = p[i];
+		p[i] = ((c & 0x8000) >> 15) | ((c >> 9) & 0x3E) | ((c << 1) & 0x7C0) | ((c << 11) & 0xF800);
+	}
+}
+
+static void convert565(u16 *p, int numPixels) {
+	int i = 0;
+#if defined(_M_IX86) || defined(_M_X64)
+	const __m128i mask7E0 = _mm_set1_epi16(0x07E0);
+	for (; i + 8 <= numPixels; i += 8) {
+		__m128i c = _mm_loadu_si128((const __m128i *)(p + i));
+		__m128i r = _mm_or_si128(_mm_srli_epi16(c, 11), _mm_slli_epi16(c, 11));
+		r = _mm_or_si128(r, _mm_and_si128(c, mask7E0));
+		_mm_storeu_si128((__m128i *)(p + i), r);
+	}
+#else
+	u32 *p32 = (u32 *)p;
+	for (; i + 2 <= numPixels; i += 2) {
+		u32 c = p32[i / 2];
+		p32[i / 2] = ((c >> 11) & 0x001F001F) | (c & 0x07E007E0) | ((c << 11) & 0xF800F800);
+	}
+#endif
+	for (; i < numPixels; i++) {
+		u16 c = p[i];
+		p[i] = (c >> 11) | (c & 0x07E0) | (c << 11);
+	}
+}
+
 void convertColors(u8 *finalBuf, GLuint dstFmt, int numPixels) {
-	// TODO: All these can be massively sped up with SSE, or even
-	// somewhat sped up using "manual simd" in 32 or 64-bit gprs.
 	switch (dstFmt) {
 	case GL_UNSIGNED_SHORT_4_4_4_4:
+		convert4444((u16 *)finalBuf, numPixels);
+		break;
+	case GL_UNSIGNED_SHORT_5_5_5_1:
+		convert5551((u16 *)finalBuf, numPixels);
+		break;
+	case GL_UNSIGNED_SHORT_5_6_5:
+		convert565((u16 *)finalBuf, numPixels);
+		break;
+	default:
 		{
-			u16 *p = (u16 *)finalBuf;
-			for (int i = 0; i < numPixels; i++) {
-				u16 c = p[i];
-				p[i] = (c >> 12) | ((c >> 4) & 0xF0) | ((c << 4) & 0xF00) | (c << 12);
-			}
+			// No need to convert RGBA8888, right order already
 		}
 		break;
-	case GL_UNSIGNED_SHORT_5_5_5_1:
+	}
+}
+
+static const u8 bitsPerPixel[16] = {
+	16,  // GE_TFMT_5650
+	16,  // GE_TFMT_5551
+	16,  // GE_TFMT_4444
+	32,  // GE_TFMT_8888
+	4,   // GE_TFMT_CLUT4
+	8,   // GE_TFMT_CLUT8
+	16,  // GE_TFMT_CLUT16
+	32,  // GE_TFMT_CLUT32
+	4,   // GE_TFMT_DXT1
+	8,   // GE_TFMT_DXT3
+	8,   // GE_TFMT_DXT5
+};
+
+// Hashes the full contents of a texture or clut.
+static u64 HashTextureMemory(u32 addr, u32 size) {
+	if (size == 0 || !Memory::IsValidAddress(addr + size - 1))
+		return 0;
+	return GetHash64(Memory::GetPointer(addr), size, 0);
+}
+
+// Everything a stripe of the decode needs, set up before the loop starts.
+struct TexDecodeJob {
+	u32 format;
+	u32 texaddr;
+	const u8 *texptr;
+	int level;
+	bool swizzled;
+	int bufw;
+	int w;
+	int h;
+	u32 bytesPerTexel;  // 0 for CLUT4.
+	u32 rowWidth;       // In bytes, as stored in memory.
+	const void *clut;
+	bool clut32;
+	void *dest;
+	u32 dstFmt;
+	int pixelSize;
+};
+
+// Decodes rows [lower * 8, upper * 8) of a texture level into the staging buffer.
+// Swizzled textures are stored in blocks of 8 rows, so no stripe splits a block.
+static void DecodeTextureRows(void *userdata, int lower, int upper) {
+	const TexDecodeJob &job = *(const TexDecodeJob *)userdata;
+	const int bufw = job.bufw;
+	const int y0 = lower * 8;
+	const int y1 = std::min(upper * 8, job.h);
+	const bool indexed = job.format >= GE_TFMT_CLUT4 && job.format <= GE_TFMT_CLUT32;
+
+	const u8 *src = job.texptr;
+	if (job.swizzled) {
+		// Indexed textures go through a temporary, the rest unswizzle straight to the output.
+		u32 *unswizzled = indexed ? tmpTexBufRearrange : (u32 *)job.dest;
+		if (job.rowWidth >= 16)
+			UnswizzleBlockRows(unswizzled, src, job.rowWidth, lower, upper);
+		else
+			UnswizzleFromMem(job.texaddr, job.bytesPerTexel, job.level, unswizzled);
+		src = (const u8 *)unswizzled;
+	}
+
+	switch (job.format) {
+	case GE_TFMT_CLUT4:
+		if (job.clut32) {
+			u32 palette[16];
+			ExpandClut(palette, (const u32 *)job.clut, 16);
+			DeIndexTexture4((u32 *)job.dest + y0 * bufw, src + y0 * bufw / 2, (y1 - y0) * bufw, palette);
+		} else {
+			u16 palette[16];
+			ExpandClut(palette, (const u16 *)job.clut, 16);
+			DeIndexTexture4((u16 *)job.dest + y0 * bufw, src + y0 * bufw / 2, (y1 - y0) * bufw, palette);
+		}
+		break;
+
+	case GE_TFMT_CLUT8:
+	case GE_TFMT_CLUT16:
+	case GE_TFMT_CLUT32:
+		src += y0 * bufw * job.bytesPerTexel;
+		if (job.clut32)
+			DeIndexTextureAny((u32 *)job.dest + y0 * bufw, src, (y1 - y0) * bufw, job.bytesPerTexel, (const u32 *)job.clut);
+		else
+			DeIndexTextureAny((u16 *)job.dest + y0 * bufw, src, (y1 - y0) * bufw, job.bytesPerTexel, (const u16 *)job.clut);
+		break;
+
+	case GE_TFMT_4444:
+	case GE_TFMT_5551:
+	case GE_TFMT_5650:
+	case GE_TFMT_8888:
+		if (!job.swizzled) {
+			int len = (y1 - y0) * bufw;
+			// 16-bit textures narrower than their width read a little past the end.
+			if (y1 == job.h && job.pixelSize == 2 && job.w > bufw)
+				len += (job.w - bufw) * job.h;
+			memcpy((u8 *)job.dest + y0 * bufw * job.pixelSize, src + y0 * bufw * job.pixelSize, len * job.pixelSize);
+		}
+		break;
+
+	case GE_TFMT_DXT1:
+	case GE_TFMT_DXT3:
+	case GE_TFMT_DXT5:
 		{
-			u16 *p = (u16 *)finalBuf;
-			for (int i = 0; i < numPixels; i++) {
-				u16 c = p[i];
-				p[i] = ((c & 0x8000) >> 15) | ((c >> 9) & 0x3E) | ((c << 1) & 0x7C0) | ((c << 11) & 0xF800);
+			u32 *dst = (u32 *)job.dest;
+			int minw = std::min(bufw, job.w);
+			for (int y = y0; y < y1; y += 4) {
+				u32 blockIndex = (y / 4) * (bufw / 4);
+				for (int x = 0; x < minw; x += 4) {
+					if (job.format == GE_TFMT_DXT1)
+						decodeDXT1Block(dst + bufw * y + x, (const DXT1Block *)src + blockIndex, bufw);
+					else if (job.format == GE_TFMT_DXT3)
+						decodeDXT3Block(dst + bufw * y + x, (const DXT3Block *)src + blockIndex, bufw);
+					else
+						decodeDXT5Block(dst + bufw * y + x, (const DXT5Block *)src + blockIndex, bufw);
+					blockIndex++;
+				}
 			}
 		}
 		break;
-	case GL_UNSIGNED_SHORT_5_6_5:
+	}
+
+	convertColors((u8 *)job.dest + y0 * bufw * job.pixelSize, job.dstFmt, (y1 - y0) * bufw);
+}
+
+void *TextureCache_DecodeLevel(int level, u32 &dstFmt, int &w, int &h, u32 &texByteAlign) {
+	u32 texaddr = (gstate.texaddr[level] & 0xFFFFF0) | ((gstate.texbufwidth[level] << 8) & 0xFF000000);
+	texaddr &= 0xFFFFFFF;
+	if (!Memory::IsValidAddress(texaddr))
+		return NULL;
+
+	TexDecodeJob job;
+	job.format = gstate.texformat & 0xF;
+	job.texaddr = texaddr;
+	job.texptr = Memory::GetPointer(texaddr);
+	job.level = level;
+	job.swizzled = (gstate.texmode & 1) != 0;
+	job.bufw = gstate.texbufwidth[level] & 0x3ff;
+	job.w = w = 1 << (gstate.texsize[level] & 0xf);
+	job.h = h = 1 << ((gstate.texsize[level] >> 8) & 0xf);
+	job.bytesPerTexel = bitsPerPixel[job.format] / 8;
+	job.clut = NULL;
+	job.clut32 = false;
+	texByteAlign = 1;
+
+	// TODO: Look into using BGRA for 32-bit textures when the GL_EXT_texture_format_BGRA8888 extension is available, as it's faster than RGBA on some chips.
+
+	switch (job.format) {
+	case GE_TFMT_CLUT4:
+	case GE_TFMT_CLUT8:
+	case GE_TFMT_CLUT16:
+	case GE_TFMT_CLUT32:
 		{
-			u16 *p = (u16 *)finalBuf;
-			for (int i = 0; i < numPixels; i++) {
-				u16 c = p[i];
-				p[i] = (c >> 11) | (c & 0x07E0) | (c << 11);
+			u32 clutformat = gstate.clutformat & 3;
+			dstFmt = getClutDestFormat((GEPaletteFormat)clutformat);
+			texByteAlign = texByteAlignMap[clutformat];
+			job.clut32 = clutformat == GE_CMODE_32BIT_ABGR8888;
+			// Unless the levels share a clut, each CLUT4 level uses the next 16 entries.
+			int clutOffset = job.format == GE_TFMT_CLUT4 && (gstate.texmode & 0x100) ? level * 16 : 0;
+			if (job.clut32) {
+				job.clut = ReadClut32() + clutOffset;
+				job.dest = tmpTexBuf32;
+			} else {
+				job.clut = ReadClut16() + clutOffset;
+				job.dest = tmpTexBuf16;
 			}
 		}
 		break;
+
+	case GE_TFMT_4444:
+	case GE_TFMT_5551:
+	case GE_TFMT_5650:
+		if (job.format == GE_TFMT_4444)
+			dstFmt = GL_UNSIGNED_SHORT_4_4_4_4;
+		else if (job.format == GE_TFMT_5551)
+			dstFmt = GL_UNSIGNED_SHORT_5_5_5_1;
+		else
+			dstFmt = GL_UNSIGNED_SHORT_5_6_5;
+		texByteAlign = 2;
+		job.dest = tmpTexBuf16;
+		break;
+
+	case GE_TFMT_8888:
+		dstFmt = GL_UNSIGNED_BYTE;
+		job.dest = tmpTexBuf32;
+		break;
+
+	case GE_TFMT_DXT1:
+	case GE_TFMT_DXT3:
+	case GE_TFMT_DXT5:
+		if (job.format == GE_TFMT_DXT5)
+			ERROR_LOG(G3D, "Unhandled compressed texture, format %i! swizzle=%i", job.format, gstate.texmode & 1);
+		dstFmt = GL_UNSIGNED_BYTE;
+		job.swizzled = false;
+		job.dest = tmpTexBuf32;
+		break;
+
 	default:
-		{
-			// No need to convert RGBA8888, right order already
+		ERROR_LOG(G3D, "Unknown Texture Format %d!!!", job.format);
+		return NULL;
+	}
+
+	job.dstFmt = dstFmt;
+	job.pixelSize = dstFmt == GL_UNSIGNED_BYTE ? 4 : 2;
+	job.rowWidth = job.bytesPerTexel > 0 ? job.bufw * job.bytesPerTexel : job.bufw / 2;
+
+	// Tiny swizzled textures are unswizzled in one go, and aren't worth splitting anyway.
+	int numStripes = (h + 7) / 8;
+	if (decodePool && w * h >= TEXTURE_PARALLEL_MIN_PIXELS && (!job.swizzled || job.rowWidth >= 16))
+		decodePool->ParallelLoop(&DecodeTextureRows, &job, 0, numStripes);
+	else
+		DecodeTextureRows(&job, 0, numStripes);
+
+	void *finalBuf = job.dest;
+	if (job.format >= GE_TFMT_DXT1 && job.format <= GE_TFMT_DXT5)
+		w = (w + 3) & ~3;
+
+	if (w != job.bufw) {
+		int pixelSize = job.pixelSize;
+		// Need to rearrange the buffer to simulate GL_UNPACK_ROW_LENGTH etc.
+		int inRowBytes = job.bufw * pixelSize;
+		int outRowBytes = w * pixelSize;
+		const u8 *read = (const u8 *)finalBuf;
+		u8 *write = 0;
+		if (w > job.bufw) {
+			write = (u8 *)tmpTexBufRearrange;
+			finalBuf = tmpTexBufRearrange;
+		} else {
+			write = (u8 *)finalBuf;
+		}
+		for (int y = 0; y < h; y++) {
+			memmove(write, read, outRowBytes);
+			read += inRowBytes;
+			write += outRowBytes;
 		}
-		break;
 	}
+
+	return finalBuf;
+}
+
+// GL wants each mip level to halve the previous one. Returns how many levels past
+// the first can be uploaded, 0 if the chain doesn't fit.
+int TextureCache_UsableMipLevels(u32 format) {
+	int wlog = gstate.texsize[0] & 0xf;
+	int hlog = (gstate.texsize[0] >> 8) & 0xf;
+	// Levels past 1x1 are never sampled.
+	int maxLevel = std::min((int)(gstate.texmode >> 16) & 7, std::max(wlog, hlog));
+	bool dxt = format >= GE_TFMT_DXT1 && format <= GE_TFMT_DXT5;
+
+	int level = 1;
+	for (; level <= maxLevel; level++) {
+		u32 addr = (gstate.texaddr[level] & 0xFFFFF0) | ((gstate.texbufwidth[level] << 8) & 0xFF000000);
+		if (!Memory::IsValidAddress(addr & 0xFFFFFFF))
+			break;
+		int lw = gstate.texsize[level] & 0xf;
+		int lh = (gstate.texsize[level] >> 8) & 0xf;
+		if (lw != std::max(wlog - level, 0) || lh != std::max(hlog - level, 0))
+			break;
+		// DXT levels get padded to 4x4, which would break the chain.
+		if (dxt && (lw < 2 || lh < 2))
+			break;
+	}
+
+#ifdef USING_GLES2
+	// Without GL_TEXTURE_MAX_LEVEL, the chain has to go all the way down to 1x1.
+	if (level - 1 < std::max(wlog, hlog))
+		return 0;
+#endif
+	return level - 1;
+}
+
+u64 TextureCache_HashMipLevels(u32 format, int maxLevel, u32 &mipaddr, u32 &mipsize) {
+	u64 hash = 0;
+	u32 start = 0xFFFFFFFF, end = 0;
+	for (int level = 1; level <= maxLevel; level++) {
+		u32 addr = (gstate.texaddr[level] & 0xFFFFF0) | ((gstate.texbufwidth[level] << 8) & 0xFF000000);
+		addr &= 0xFFFFFFF;
+		int bufw = gstate.texbufwidth[level] & 0x3ff;
+		int h = 1 << ((gstate.texsize[level] >> 8) & 0xf);
+		u32 size = (bitsPerPixel[format] * bufw * h) / 8;
+		// The address goes in too, so moving a level to identical data still counts.
+		hash = hash * 31 + HashTextureMemory(addr, size) + addr;
+		start = std::min(start, addr);
+		end = std::max(end, addr + size);
+	}
+	mipaddr = maxLevel > 0 ? start : 0;
+	mipsize = maxLevel > 0 ? end - start : 0;
+	return hash;
+}
+
+static void UploadLevel(int level, u32 dstFmt, int w, int h, u32 texByteAlign, void *data) {
+	// Can restore these and remove the row fixup in TextureCache_DecodeLevel on some platforms.
+	//glPixelStorei(GL_UNPACK_ROW_LENGTH, bufw);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, texByteAlign);
+	//glPixelStorei(GL_PACK_ROW_LENGTH, bufw);
+	glPixelStorei(GL_PACK_ALIGNMENT, texByteAlign);
+
+	GLuint components = dstFmt == GL_UNSIGNED_SHORT_5_6_5 ? GL_RGB : GL_RGBA;
+	glTexImage2D(GL_TEXTURE_2D, level, components, w, h, 0, components, dstFmt, data);
 }
 
 void PSPSetTexture() {
@@ -608,7 +974,6 @@ void PSPSetTexture() {
 		return;
 	}
 
-	u8 level = 0;
 	u32 format = gstate.texformat & 0xF;
 	u32 clutformat = gstate.clutformat & 3;
 	u32 clutaddr = GetClutAddr(clutformat == GE_CMODE_32BIT_ABGR8888 ? 4 : 2);
@@ -616,7 +981,15 @@ void PSPSetTexture() {
 	u8 *texptr = Memory::GetPointer(texaddr);
 	u32 texhash = texptr ? *(u32*)texptr : 0;
 
-	u64 cachekey = texaddr ^ texhash;
+	int bufw = gstate.texbufwidth[0] & 0x3ff;
+	int w = 1 << (gstate.texsize[0] & 0xf);
+	int h = 1 << ((gstate.texsize[0]>>8) & 0xf);
+	u32 sizeInRAM = (bitsPerPixel[format] * bufw * h) / 8;
+
+	bool hasClut = format >= GE_TFMT_CLUT4 && format <= GE_TFMT_CLUT32;
+	u32 clutsize = hasClut ? (gstate.loadclut & 0x3f) * 32 : 0;
+
+	u64 cachekey = texaddr;
 	cachekey |= (u64) clutaddr << 32;
 	TexCache::iterator iter = cache.find(cachekey);
 	if (iter != cache.end()) {
@@ -625,31 +998,46 @@ void PSPSetTexture() {
 
 		int dim = gstate.texsize[0] & 0xF0F;
 		bool match = true;
-		
-		//TODO: Check more texture parameters, compute real texture hash
-		if (dim != entry.dim || entry.hash != texhash || entry.format != format)
+
+		if (dim != entry.dim || entry.hash != texhash || entry.format != format || entry.sizeInRAM != sizeInRAM)
 			match = false;
 
-		//TODO: Check more clut parameters, compute clut hash
-		if (match && (format >= GE_TFMT_CLUT4 && format <= GE_TFMT_CLUT32) &&
-			 (entry.clutformat != clutformat ||
-				entry.clutaddr != clutaddr ||
-				entry.cluthash != Memory::Read_U32(entry.clutaddr))) 
+		if (match && hasClut && (entry.clutformat != clutformat || entry.clutsize != clutsize))
 			match = false;
 
-		// If it's not huge or has been invalidated many times, recheck the whole texture.
-		if (entry.invalidHint > 180 || (entry.invalidHint > 15 && dim <= 0x909)) {
-			entry.invalidHint = 0;
-			int bufw = gstate.texbufwidth[0] & 0x3ff;
-			int h = 1 << ((gstate.texsize[0]>>8) & 0xf);
+		if (match && entry.maxLevel != TextureCache_UsableMipLevels(format))
+			match = false;
 
-			u32 check = 0;
-			for (int i = 0; i < bufw * h; i += 4) {
-				check += Memory::ReadUnchecked_U32(texaddr + i);
+		// Rehash when memory was written to, and otherwise on a schedule. Scheduled
+		// checks of reliable textures share a per-frame budget.
+		if (match) {
+			bool check = entry.invalidated;
+			if (!check && gpuStats.numFrames >= entry.nextCheckFrame) {
+				if (hashBudgetFrame != gpuStats.numFrames) {
+					hashBudgetFrame = gpuStats.numFrames;
+					hashBudget = TEXTURE_HASH_BUDGET;
+				}
+				if (entry.status != TexCacheEntry::STATUS_RELIABLE || hashBudget > 0) {
+					hashBudget -= sizeInRAM + clutsize + entry.mipsize;
+					check = true;
+				}
 			}
 
-			if (check != entry.fullhash) {
-				match = false;
+			if (check) {
+				u32 mipaddr, mipsize;
+				if (HashTextureMemory(texaddr, sizeInRAM) != entry.fullhash || (hasClut && HashTextureMemory(clutaddr, clutsize) != entry.cluthash)) {
+					match = false;
+				} else if (TextureCache_HashMipLevels(format, entry.maxLevel, mipaddr, mipsize) != entry.miphash || mipaddr != entry.mipaddr || mipsize != entry.mipsize) {
+					match = false;
+				} else {
+					entry.invalidated = false;
+					if (++entry.numStableChecks >= TEXTURE_STABLE_CHECKS)
+						entry.status = TexCacheEntry::STATUS_RELIABLE;
+					if (entry.status == TexCacheEntry::STATUS_RELIABLE)
+						entry.nextCheckFrame = gpuStats.numFrames + TEXTURE_RECHECK_FRAMES + ((texaddr >> 4) & 15);
+					else
+						entry.nextCheckFrame = gpuStats.numFrames + 1;
+				}
 			}
 		}
 
@@ -676,272 +1064,55 @@ void PSPSetTexture() {
 	entry.hash = texhash;
 	entry.format = format;
 	entry.frameCounter = gpuStats.numFrames;
+	entry.status = TexCacheEntry::STATUS_HASHING;
+	entry.nextCheckFrame = gpuStats.numFrames + 1;
 
-	if (format >= GE_TFMT_CLUT4 && format <= GE_TFMT_CLUT32) {
+	if (hasClut) {
 		entry.clutformat = clutformat;
-		entry.clutaddr = GetClutAddr(clutformat == GE_CMODE_32BIT_ABGR8888 ? 4 : 2);
-		entry.cluthash = Memory::Read_U32(entry.clutaddr);
+		entry.clutaddr = clutaddr;
+		entry.clutsize = clutsize;
+		entry.cluthash = HashTextureMemory(clutaddr, clutsize);
 	} else {
 		entry.clutaddr = 0;
 	}
 
-	int bufw = gstate.texbufwidth[0] & 0x3ff;
-	
 	entry.dim = gstate.texsize[0] & 0xF0F;
-
-	int w = 1 << (gstate.texsize[0] & 0xf);
-	int h = 1 << ((gstate.texsize[0]>>8) & 0xf);
-
-	for (int i = 0; i < bufw * h; i += 4)
-		entry.fullhash += Memory::ReadUnchecked_U32(texaddr + i);
+	entry.sizeInRAM = sizeInRAM;
+	entry.fullhash = HashTextureMemory(texaddr, sizeInRAM);
 
 	gstate_c.curTextureWidth=w;
 	gstate_c.curTextureHeight=h;
-	GLenum dstFmt = 0;
-	u32 texByteAlign = 1;
-
-	void *finalBuf = NULL;
-
-	// TODO: Look into using BGRA for 32-bit textures when the GL_EXT_texture_format_BGRA8888 extension is available, as it's faster than RGBA on some chips.
-
-	// TODO: Actually decode the mipmaps.
-
-	switch (format)
-	{
-	case GE_TFMT_CLUT4:
-		dstFmt = getClutDestFormat((GEPaletteFormat)(gstate.clutformat & 3));
-
-		switch (clutformat) {
-		case GE_CMODE_16BIT_BGR5650:
-		case GE_CMODE_16BIT_ABGR5551:
-		case GE_CMODE_16BIT_ABGR4444:
-			{
-			u16 *clut = ReadClut16();
-			u32 clutSharingOff = 0;//gstate.mipmapShareClut ? 0 : level * 16;
-			texByteAlign = 2;
-			if (!(gstate.texmode & 1)) {
-				u32 addr = texaddr;
-				for (int i = 0; i < bufw * h; i += 2)
-				{
-					u8 index = Memory::ReadUnchecked_U8(addr);
-					tmpTexBuf16[i + 0] = clut[GetClutIndex((index >> 0) & 0xf) + clutSharingOff];
-					tmpTexBuf16[i + 1] = clut[GetClutIndex((index >> 4) & 0xf) + clutSharingOff];
-					addr++;
-				}
-			} else {
-				UnswizzleFromMem(texaddr, 0, level);
-				for (int i = 0, j = 0; i < bufw * h; i += 8, j++)
-				{
-					u32 n = tmpTexBuf32[j];
-					u32 k, index;
-					for (k = 0; k < 8; k++) {
-						index = (n >> (k * 4)) & 0xf;
-						tmpTexBuf16[i + k] = clut[GetClutIndex(index) + clutSharingOff];
-					}
-				}
-			}
-			finalBuf = tmpTexBuf16;
-			}
-			break;
-
-		case GE_CMODE_32BIT_ABGR8888:
-			{
-			u32 *clut = ReadClut32();
-			u32 clutSharingOff = 0;//gstate.mipmapShareClut ? 0 : level * 16;
-			if (!(gstate.texmode & 1)) {
-				u32 addr = texaddr;
-				for (int i = 0; i < bufw * h; i += 2)
-				{
-					u8 index = Memory::ReadUnchecked_U8(addr);
-					tmpTexBuf32[i + 0] = clut[GetClutIndex((index >> 0) & 0xf) + clutSharingOff];
-					tmpTexBuf32[i + 1] = clut[GetClutIndex((index >> 4) & 0xf) + clutSharingOff];
-					addr++;
-				}
-			} else {
-				u32 pixels = bufw * h;
-				UnswizzleFromMem(texaddr, 0, level);
-				for (int i = pixels - 8, j = (pixels / 8) - 1; i >= 0; i -= 8, j--) {
-					u32 n = tmpTexBuf32[j];
-					for (int k = 0; k < 8; k++) {
-						u32 index = (n >> (k * 4)) & 0xf;
-						tmpTexBuf32[i + k] = clut[GetClutIndex(index) + clutSharingOff];
-					}
-				}
-			}
-			finalBuf = tmpTexBuf32;
-			}
-			break;
-
-		default:
-			ERROR_LOG(G3D, "Unknown CLUT4 texture mode %d", (gstate.clutformat & 3));
-			return;
-		}
-		break;
-
-	case GE_TFMT_CLUT8:
-		finalBuf = readIndexedTex(level, texaddr, 1);
-		dstFmt = getClutDestFormat((GEPaletteFormat)(gstate.clutformat & 3));
-		texByteAlign = texByteAlignMap[(gstate.clutformat & 3)];
-		break;
-
-	case GE_TFMT_CLUT16:
-		finalBuf = readIndexedTex(level, texaddr, 2);
-		dstFmt = getClutDestFormat((GEPaletteFormat)(gstate.clutformat & 3));
-		texByteAlign = texByteAlignMap[(gstate.clutformat & 3)];
-		break;
-
-	case GE_TFMT_CLUT32:
-		finalBuf = readIndexedTex(level, texaddr, 4);
-		dstFmt = getClutDestFormat((GEPaletteFormat)(gstate.clutformat & 3));
-		texByteAlign = texByteAlignMap[(gstate.clutformat & 3)];
-		break;
-
-	case GE_TFMT_4444:
-	case GE_TFMT_5551:
-	case GE_TFMT_5650:
-		if (format == GE_TFMT_4444)
-			dstFmt = GL_UNSIGNED_SHORT_4_4_4_4;
-		else if (format == GE_TFMT_5551)
-			dstFmt = GL_UNSIGNED_SHORT_5_5_5_1;
-		else if (format == GE_TFMT_5650)
-			dstFmt = GL_UNSIGNED_SHORT_5_6_5;
-		texByteAlign = 2;
-
-		if (!(gstate.texmode & 1)) {
-			int len = std::max(bufw, w) * h;
-			for (int i = 0; i < len; i++)
-				tmpTexBuf16[i] = Memory::ReadUnchecked_U16(texaddr + i * 2);
-			finalBuf = tmpTexBuf16;
-		}
-		else
-			finalBuf = UnswizzleFromMem(texaddr, 2, level);
-		break;
-
-	case GE_TFMT_8888:
-		dstFmt = GL_UNSIGNED_BYTE;
-		if (!(gstate.texmode & 1)) {
-			int len = bufw * h;
-			for (int i = 0; i < len; i++)
-				tmpTexBuf32[i] = Memory::ReadUnchecked_U32(texaddr + i * 4);
-			finalBuf = tmpTexBuf32;
-		}
-		else
-			finalBuf = UnswizzleFromMem(texaddr, 4, level);
-		break;
-
-	case GE_TFMT_DXT1:
-		dstFmt = GL_UNSIGNED_BYTE;
-		{
-			u32 *dst = tmpTexBuf32;
-			DXT1Block *src = (DXT1Block*)texptr;
 
-			for (int y = 0; y < h; y += 4) {
-				u32 blockIndex = (y / 4) * (bufw / 4);
-				for (int x = 0; x < std::min(bufw, w); x += 4) {
-					decodeDXT1Block(dst + bufw * y + x, src + blockIndex, bufw);
-					blockIndex++;
-				}
-			}
-			finalBuf = tmpTexBuf32;
-			w = (w + 3) & ~3;
-		}
-		break;
-
-	case GE_TFMT_DXT3:
-		dstFmt = GL_UNSIGNED_BYTE;
-		{
-			u32 *dst = tmpTexBuf32;
-			DXT3Block *src = (DXT3Block*)texptr;
-
-			// Alpha is off
-			for (int y = 0; y < h; y += 4) {
-				u32 blockIndex = (y / 4) * (bufw / 4);
-				for (int x = 0; x < std::min(bufw, w); x += 4) {
-					decodeDXT3Block(dst + bufw * y + x, src + blockIndex, bufw);
-					blockIndex++;
-				}
-			}
-			w = (w + 3) & ~3;
-			finalBuf = tmpTexBuf32;
-		}
-		break;
-
-	case GE_TFMT_DXT5:
-		ERROR_LOG(G3D, "Unhandled compressed texture, format %i! swizzle=%i", format, gstate.texmode & 1);
-		dstFmt = GL_UNSIGNED_BYTE;
-		{
-			u32 *dst = tmpTexBuf32;
-			DXT5Block *src = (DXT5Block*)texptr;
-
-			// Alpha is almost right
-			for (int y = 0; y < h; y += 4) {
-				u32 blockIndex = (y / 4) * (bufw / 4);
-				for (int x = 0; x < std::min(bufw, w); x += 4) {
-					decodeDXT5Block(dst + bufw * y + x, src + blockIndex, bufw);
-					blockIndex++;
-				}
-			}
-			w = (w + 3) & ~3;
-			finalBuf = tmpTexBuf32;
-		}
-		break;
-
-	default:
-		ERROR_LOG(G3D, "Unknown Texture Format %d!!!", format);
-		finalBuf = tmpTexBuf32;
+	u32 dstFmt = 0;
+	u32 texByteAlign = 1;
+	void *finalBuf = TextureCache_DecodeLevel(0, dstFmt, w, h, texByteAlign);
+	if (!finalBuf)
 		return;
-	}
-
-	if (!finalBuf) {
-		ERROR_LOG(G3D, "NO finalbuf! Will crash!");
-	}
-
-	convertColors((u8*)finalBuf, dstFmt, bufw * h);
-
-	if (w != bufw) {
-		int pixelSize;
-		switch (dstFmt) {
-		case GL_UNSIGNED_SHORT_4_4_4_4:
-		case GL_UNSIGNED_SHORT_5_5_5_1:
-		case GL_UNSIGNED_SHORT_5_6_5:
-			pixelSize = 2;
-			break;
-		default:
-			pixelSize = 4;
-			break;
-		}
-		// Need to rearrange the buffer to simulate GL_UNPACK_ROW_LENGTH etc.
-		int inRowBytes = bufw * pixelSize;
-		int outRowBytes = w * pixelSize;
-		const u8 *read = (const u8 *)finalBuf;
-		u8 *write = 0;
-		if (w > bufw) {
-			write = (u8 *)tmpTexBufRearrange;
-			finalBuf = tmpTexBufRearrange;
-		} else {
-			write = (u8 *)finalBuf;
-		}
-		for (int y = 0; y < h; y++) {
-			memmove(write, read, outRowBytes);
-			read += inRowBytes;
-			write += outRowBytes;
-		}
-	}
 
 	gpuStats.numTexturesDecoded++;
-	// Can restore these and remove the above fixup on some platforms.
-	//glPixelStorei(GL_UNPACK_ROW_LENGTH, bufw);
-	glPixelStorei(GL_UNPACK_ALIGNMENT, texByteAlign);
-	//glPixelStorei(GL_PACK_ROW_LENGTH, bufw);
-	glPixelStorei(GL_PACK_ALIGNMENT, texByteAlign);
 
 	INFO_LOG(G3D, "Creating texture %i from %08x: %i x %i (stride: %i). fmt: %i", entry.texture, entry.addr, w, h, bufw, entry.format);
 
 	glGenTextures(1, &entry.texture);
 	glBindTexture(GL_TEXTURE_2D, entry.texture);
-	GLuint components = dstFmt == GL_UNSIGNED_SHORT_5_6_5 ? GL_RGB : GL_RGBA;
-	glTexImage2D(GL_TEXTURE_2D, 0, components, w, h, 0, components, dstFmt, finalBuf);
-	// glGenerateMipmap(GL_TEXTURE_2D);
+	UploadLevel(0, dstFmt, w, h, texByteAlign, finalBuf);
+
+	// The staging buffers are shared, so each level is uploaded before the next is decoded.
+	int maxLevel = TextureCache_UsableMipLevels(format);
+	for (int level = 1; level <= maxLevel; level++) {
+		int lw, lh;
+		void *levelBuf = TextureCache_DecodeLevel(level, dstFmt, lw, lh, texByteAlign);
+		if (!levelBuf) {
+			maxLevel = level - 1;
+			break;
+		}
+		UploadLevel(level, dstFmt, lw, lh, texByteAlign, levelBuf);
+	}
+	entry.maxLevel = maxLevel;
+	entry.miphash = TextureCache_HashMipLevels(format, maxLevel, entry.mipaddr, entry.mipsize);
+#ifndef USING_GLES2
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, maxLevel);
+#endif
 	UpdateSamplingParams(entry, true);
 
 	//glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
@@ -26,5 +26,19 @@ void TextureCache_Shutdown();
 void TextureCache_Clear(bool delete_them);
 void TextureCache_Decimate();  // Run this once per frame to get rid of old textures.
 void TextureCache_Invalidate(u32 addr, int size, bool force);
+// Only what overlaps the rows of the rect, each rowSize bytes long and pitch bytes apart.
+void TextureCache_InvalidateRect(u32 addr, u32 pitch, u32 rowSize, int rows, bool force);
 void TextureCache_InvalidateAll(bool force);
 int TextureCache_NumLoadedTextures();
+// Extra threads that help decode large textures. 0 decodes on the calling thread only.
+// TextureCache_Init picks a count from the number of cores.
+void TextureCache_SetDecodeThreads(int numThreads);
+
+// Decodes a level of the current texture into a staging buffer without touching GL.
+// Returns NULL for bad formats. dstFmt is the GL pixel type of the result, and w
+// and h are its size after padding.
+void *TextureCache_DecodeLevel(int level, u32 &dstFmt, int &w, int &h, u32 &texByteAlign);
+// How many mip levels past the first the current texture can upload, 0 if none.
+int TextureCache_UsableMipLevels(u32 format);
+// Hashes levels 1 to maxLevel of the current texture, and gets the memory they span.
+u64 TextureCache_HashMipLevels(u32 format, int maxLevel, u32 &mipaddr, u32 &mipsize);
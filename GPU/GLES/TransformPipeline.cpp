@@ -15,9 +15,18 @@
 // Official git repository and contact information can be found at
 // https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
 
+#include <algorithm>
+#include <cmath>
+
+#if defined(_M_IX86) || defined(_M_X64)
+#include <xmmintrin.h>
+#endif
+
+#include "../../Common/Hash.h"
 #include "../../Core/MemMap.h"
 #include "../../Core/Host.h"
 #include "../../Core/System.h"
+#include "../../Core/Config.h"
 #include "../../native/gfx_es2/gl_state.h"
 
 #include "../Math3D.h"
@@ -41,8 +50,35 @@ const GLuint glprim[8] = {
 	GL_TRIANGLES,	 // With OpenGL ES we have to expand sprites into triangles, tripling the data instead of doubling. sigh. OpenGL ES, Y U NO SUPPORT GL_QUADS?
 };
 
+// Formats seen in practice are far fewer, this just keeps a misbehaving game in check.
+#define VERTEXCACHE_MAX_DECODERS 256
+#define PATCHCACHE_MAX_MESHES 1024
+
+// Vertex array cache tuning.
+enum {
+	VAI_MIN_VERTS = 32,  // Smaller draws aren't worth a hash and a buffer.
+	VAI_STABLE_FRAMES = 2,  // Frames the data must stay unchanged before it's uploaded.
+	VAI_MAX_CHANGES = 4,  // After this many changes, stop trying.
+	VAI_HASH_SAMPLES = 1024,
+	VAI_KILL_AGE = 120,
+};
+
+VertexArrayInfo::~VertexArrayInfo() {
+	if (vbo)
+		glDeleteBuffers(1, &vbo);
+	if (ebo)
+		glDeleteBuffers(1, &ebo);
+}
+
 TransformDrawEngine::TransformDrawEngine()
 	: numVerts(0),
+		prevPrim_(-1),
+		numDrawCalls(0),
+		decodeCounter_(0),
+		lastLowerBound_(0),
+		lastUpperBound_(-1),
+		invalidations_(0),
+		dec_(0),
 		lastVType(-1),
 		shaderManager_(0) {
 	decoded = new u8[65536 * 48];
@@ -51,58 +87,282 @@ TransformDrawEngine::TransformDrawEngine()
 	transformedExpanded = new TransformedVertex[65536 * 3];
 
 	indexGen.Setup(decIndex);
+
+#if defined(_M_IX86) || defined(_M_X64)
+	decJitCache_ = new VertexDecoderJitCache();
+#else
+	decJitCache_ = 0;
+#endif
 }
 
 TransformDrawEngine::~TransformDrawEngine() {
+	ClearVertexCache(true);
+	ClearVertexDecoders();
 	delete [] decoded;
 	delete [] decIndex;
 	delete [] transformed;
 	delete [] transformedExpanded;
+#if defined(_M_IX86) || defined(_M_X64)
+	delete decJitCache_;
+#endif
 }
 
-// Just to get something on the screen, we'll just not subdivide correctly.
-void TransformDrawEngine::DrawBezier(int ucount, int vcount) {
-	u16 indices[3 * 3 * 6];
-
-	// Generate indices for a rectangular mesh.
-	int c = 0;
-	for (int y = 0; y < 3; y++) {
-		for (int x = 0; x < 3; x++) {
-			indices[c++] = y * 4 + x;
-			indices[c++] = y * 4 + x + 1;
-			indices[c++] = (y + 1) * 4 + x + 1;
-			indices[c++] = (y + 1) * 4 + x + 1;
-			indices[c++] = (y + 1) * 4 + x;
-			indices[c++] = y * 4 + x;
-		}
+void TransformDrawEngine::ClearVertexDecoders() {
+	for (std::map<u32, VertexDecoder *>::iterator iter = decoderMap_.begin(); iter != decoderMap_.end(); ++iter) {
+		delete iter->second;
 	}
+	decoderMap_.clear();
+	dec_ = 0;
+	lastVType = -1;
+
+	// Nothing refers to the jitted code anymore.
+#if defined(_M_IX86) || defined(_M_X64)
+	if (decJitCache_)
+		decJitCache_->Clear();
+#endif
+}
 
-	// We are free to use the "decoded" buffer here.
-	// Let's split it into two to get a second buffer, there's enough space.
-	u8 *decoded2 = decoded + 65536 * 24;
+VertexDecoder *TransformDrawEngine::GetVertexDecoder(u32 vtype) {
+	std::map<u32, VertexDecoder *>::iterator iter = decoderMap_.find(vtype);
+	if (iter != decoderMap_.end()) {
+		gpuStats.numVertexDecoderHits++;
+		return iter->second;
+	}
 
-	// Alright, now for the vertex data.
-	// For now, we will simply inject UVs.
+	gpuStats.numVertexDecoderMisses++;
+	bool jitFull = false;
+#if defined(_M_IX86) || defined(_M_X64)
+	jitFull = decJitCache_ && decJitCache_->IsFull();
+#endif
+	if (decoderMap_.size() >= VERTEXCACHE_MAX_DECODERS || jitFull) {
+		INFO_LOG(G3D, "Vertex decoder cache full, clearing");
+		ClearVertexDecoders();
+	}
+
+	VertexDecoder *dec = new VertexDecoder();
+	dec->SetVertexType(vtype, g_Config.bVertexDecoderJit ? decJitCache_ : 0);
+	decoderMap_[vtype] = dec;
+	return dec;
+}
 
-	float customUV[4 * 4 * 2];
-	for (int y = 0; y < 4; y++) {
-		for (int x = 0; x < 4; x++) {
-			customUV[(y * 4 + x) * 2 + 0] = (float)x/3.0f;
-			customUV[(y * 4 + x) * 2 + 1] = (float)y/3.0f;
+void TransformDrawEngine::ClearVertexCache(bool deleteThem) {
+	for (std::map<VertexArrayKey, VertexArrayInfo *>::iterator iter = vai_.begin(); iter != vai_.end(); ++iter) {
+		VertexArrayInfo *vai = iter->second;
+		if (!deleteThem) {
+			// The context is gone, and the buffers with it.
+			vai->vbo = 0;
+			vai->ebo = 0;
 		}
+		delete vai;
 	}
+	vai_.clear();
+	ClearPatchCache();
+}
 
-	if (!(gstate.vertType & GE_VTYPE_TC_MASK)) {
-		dec.SetVertexType(gstate.vertType);
-		u32 newVertType = dec.InjectUVs(decoded2, Memory::GetPointer(gstate_c.vertexAddr), customUV, 16);
-		SubmitPrim(decoded2, &indices[0], GE_PRIM_TRIANGLES, c, newVertType, GE_VTYPE_IDX_16BIT, 0);
-	} else {
-		SubmitPrim(Memory::GetPointer(gstate_c.vertexAddr), &indices[0], GE_PRIM_TRIANGLES, c, gstate.vertType, GE_VTYPE_IDX_16BIT, 0);
+// Removes vertex arrays and patch meshes that haven't been drawn in a while.
+void TransformDrawEngine::DecimateVertexCache() {
+	for (std::map<VertexArrayKey, VertexArrayInfo *>::iterator iter = vai_.begin(); iter != vai_.end(); ) {
+		if (iter->second->lastFrame + VAI_KILL_AGE < gpuStats.numFrames) {
+			delete iter->second;
+			vai_.erase(iter++);
+		}
+		else
+			++iter;
 	}
+
+	for (std::map<PatchKey, PatchMesh *>::iterator iter = patches_.begin(); iter != patches_.end(); ) {
+		if (iter->second->lastFrame + VAI_KILL_AGE < gpuStats.numFrames) {
+			delete iter->second;
+			patches_.erase(iter++);
+		}
+		else
+			++iter;
+	}
+}
+
+void TransformDrawEngine::DrawBezier(int ucount, int vcount) {
+	PatchDesc desc;
+	desc.ucount = ucount;
+	desc.vcount = vcount;
+	desc.utype = 0;
+	desc.vtype = 0;
+	desc.spline = false;
+	DrawPatch(desc);
 }
 
 void TransformDrawEngine::DrawSpline(int ucount, int vcount, int utype, int vtype) {
-	// TODO
+	PatchDesc desc;
+	desc.ucount = ucount;
+	desc.vcount = vcount;
+	desc.utype = utype;
+	desc.vtype = vtype;
+	desc.spline = true;
+	DrawPatch(desc);
+}
+
+// Tessellates the patch, unless the same control points were tessellated the same way
+// before, and submits the mesh. Patch-heavy games tend to redraw the same terrain every frame.
+void TransformDrawEngine::DrawPatch(const PatchDesc &shape) {
+	const u32 vertType = gstate.vertType;
+	PatchDesc desc = shape;
+	if (!SetupPatchDesc(desc, vertType))
+		return;
+
+	const int count = desc.ucount * desc.vcount;
+	const int indexType = vertType & GE_VTYPE_IDX_MASK;
+	if (!Memory::IsValidAddress(gstate_c.vertexAddr)) {
+		ERROR_LOG(G3D, "Bad vertex address %08x!", gstate_c.vertexAddr);
+		return;
+	}
+	const u8 *verts = Memory::GetPointer(gstate_c.vertexAddr);
+	const void *inds = 0;
+	if (indexType != GE_VTYPE_IDX_NONE) {
+		if (!Memory::IsValidAddress(gstate_c.indexAddr)) {
+			ERROR_LOG(G3D, "Bad index address %08x!", gstate_c.indexAddr);
+			return;
+		}
+		inds = Memory::GetPointer(gstate_c.indexAddr);
+	}
+
+	int lowerBound = 0;
+	int upperBound = count - 1;
+	if (indexType == GE_VTYPE_IDX_8BIT) {
+		const u8 *ind8 = (const u8 *)inds;
+		lowerBound = *std::min_element(ind8, ind8 + count);
+		upperBound = *std::max_element(ind8, ind8 + count);
+	} else if (indexType == GE_VTYPE_IDX_16BIT) {
+		const u16 *ind16 = (const u16 *)inds;
+		lowerBound = *std::min_element(ind16, ind16 + count);
+		upperBound = *std::max_element(ind16, ind16 + count);
+	}
+
+	// Setting up a new decoder may clear the ones the pending draws were submitted with.
+	if (decoderMap_.find(vertType) == decoderMap_.end())
+		Flush();
+	VertexDecoder *dec = GetVertexDecoder(vertType);
+
+	// Morphing makes the result depend on more than vertex memory.
+	PatchMesh *mesh = &patchScratch_;
+	bool tessellate = true;
+	if (g_Config.bVertexCache && (vertType & GE_VTYPE_MORPHCOUNT_MASK) == 0) {
+		const int vertexSize = dec->VertexSize();
+		PatchKey key;
+		key.hash = GetHash64(verts + lowerBound * vertexSize, (upperBound - lowerBound + 1) * vertexSize, 0);
+		if (inds) {
+			int indexSize = indexType == GE_VTYPE_IDX_16BIT ? 2 : 1;
+			key.hash ^= GetHash64((const u8 *)inds, count * indexSize, 0) * 31;
+		}
+		key.vertType = vertType;
+		key.shape = desc.ucount | (desc.vcount << 8) | (desc.utype << 16) | (desc.vtype << 18) | (desc.spline ? 1 << 20 : 0);
+		key.tess = desc.udivs | (desc.vdivs << 8) | (desc.prim << 16) | (desc.computeNormals ? 1 << 20 : 0) | (desc.flipNormals ? 1 << 21 : 0);
+		if (gstate.reversenormals & 0xFFFFFF)
+			key.tess |= 1 << 22;
+
+		std::map<PatchKey, PatchMesh *>::iterator iter = patches_.find(key);
+		if (iter != patches_.end()) {
+			mesh = iter->second;
+			tessellate = false;
+		} else {
+			// Submitted meshes are decoded right away, so nothing refers to the old ones.
+			if (patches_.size() >= PATCHCACHE_MAX_MESHES) {
+				INFO_LOG(G3D, "Patch cache full, clearing");
+				ClearPatchCache();
+			}
+			mesh = new PatchMesh();
+			patches_[key] = mesh;
+		}
+	}
+
+	if (tessellate) {
+		std::vector<u8> controlPoints((upperBound - lowerBound + 1) * dec->GetDecVtxFmt().stride);
+		int indexLowerBound, indexUpperBound;
+		dec->DecodeVerts(&controlPoints[0], verts, inds, GE_PRIM_POINTS, count, &indexLowerBound, &indexUpperBound);
+		TessellatePatch(mesh, desc, vertType, &controlPoints[0], dec->GetDecVtxFmt(), inds, indexLowerBound);
+		gpuStats.numPatchesTessellated++;
+	}
+	mesh->lastFrame = gpuStats.numFrames;
+
+	// The mesh is indexed from 0, start over if it doesn't fit behind what's collected.
+	DecodeVerts();
+	if (numVerts + mesh->numVerts > 65536 || indexGen.VertexCount() + (int)mesh->indices.size() > 65536)
+		Flush();
+
+	SubmitPrim(&mesh->verts[0], &mesh->indices[0], mesh->prim, (int)mesh->indices.size(), mesh->vertType, -1, 0);
+
+	// The scratch mesh is reused and cached meshes may be evicted, so this can't wait for Flush.
+	DecodeVerts();
+}
+
+void TransformDrawEngine::ClearPatchCache() {
+	for (std::map<PatchKey, PatchMesh *>::iterator iter = patches_.begin(); iter != patches_.end(); ++iter) {
+		delete iter->second;
+	}
+	patches_.clear();
+}
+
+// The software transform works on this many vertices at a time.
+#define TRANSFORM_BATCH_SIZE 4
+
+// One float per vertex of a transform batch. Vectors and colors are kept as one
+// Lanes per component (structure of arrays), so each operation covers the whole batch.
+struct Lanes {
+#if defined(_M_IX86) || defined(_M_X64)
+	__m128 v;
+
+	Lanes() {}
+	Lanes(__m128 _v) : v(_v) {}
+	explicit Lanes(float f) : v(_mm_set1_ps(f)) {}
+	static Lanes Load(const float p[4]) { return Lanes(_mm_loadu_ps(p)); }
+	void Store(float p[4]) const { _mm_storeu_ps(p, v); }
+
+	Lanes operator +(const Lanes &o) const { return Lanes(_mm_add_ps(v, o.v)); }
+	Lanes operator -(const Lanes &o) const { return Lanes(_mm_sub_ps(v, o.v)); }
+	Lanes operator *(const Lanes &o) const { return Lanes(_mm_mul_ps(v, o.v)); }
+	Lanes operator /(const Lanes &o) const { return Lanes(_mm_div_ps(v, o.v)); }
+	Lanes Min(const Lanes &o) const { return Lanes(_mm_min_ps(v, o.v)); }
+	Lanes Max(const Lanes &o) const { return Lanes(_mm_max_ps(v, o.v)); }
+	Lanes Sqrt() const { return Lanes(_mm_sqrt_ps(v)); }
+#else
+	float v[TRANSFORM_BATCH_SIZE];
+
+	Lanes() {}
+	explicit Lanes(float f) { for (int i = 0; i < TRANSFORM_BATCH_SIZE; i++) v[i] = f; }
+	static Lanes Load(const float p[4]) { Lanes r; memcpy(r.v, p, sizeof(r.v)); return r; }
+	void Store(float p[4]) const { memcpy(p, v, sizeof(v)); }
+
+#define LANES_OP(expr) Lanes r; for (int i = 0; i < TRANSFORM_BATCH_SIZE; i++) r.v[i] = expr; return r;
+	Lanes operator +(const Lanes &o) const { LANES_OP(v[i] + o.v[i]) }
+	Lanes operator -(const Lanes &o) const { LANES_OP(v[i] - o.v[i]) }
+	Lanes operator *(const Lanes &o) const { LANES_OP(v[i] * o.v[i]) }
+	Lanes operator /(const Lanes &o) const { LANES_OP(v[i] / o.v[i]) }
+	Lanes Min(const Lanes &o) const { LANES_OP(v[i] < o.v[i] ? v[i] : o.v[i]) }
+	Lanes Max(const Lanes &o) const { LANES_OP(v[i] > o.v[i] ? v[i] : o.v[i]) }
+	Lanes Sqrt() const { LANES_OP(sqrtf(v[i])) }
+#undef LANES_OP
+#endif
+};
+
+// There's no vector powf to lean on, so this goes lane by lane. Negative bases give 0.
+static inline Lanes PowLanes(const Lanes &base, float exponent) {
+	float b[TRANSFORM_BATCH_SIZE];
+	base.Store(b);
+	for (int i = 0; i < TRANSFORM_BATCH_SIZE; i++)
+		b[i] = b[i] >= 0.0f ? powf(b[i], exponent) : 0.0f;
+	return Lanes::Load(b);
+}
+
+static inline Lanes DotLanes(const Lanes a[3], const Lanes b[3]) {
+	return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+static inline void Vec3ByMatrix43Lanes(Lanes vecOut[3], const Lanes v[3], const float m[12]) {
+	for (int i = 0; i < 3; i++)
+		vecOut[i] = v[0] * Lanes(m[i]) + v[1] * Lanes(m[3 + i]) + v[2] * Lanes(m[6 + i]) + Lanes(m[9 + i]);
+}
+
+static inline void Norm3ByMatrix43Lanes(Lanes vecOut[3], const Lanes v[3], const float m[12]) {
+	for (int i = 0; i < 3; i++)
+		vecOut[i] = v[0] * Lanes(m[i]) + v[1] * Lanes(m[3 + i]) + v[2] * Lanes(m[6 + i]);
 }
 
 // Convenient way to do precomputation to save the parts of the lighting calculation
@@ -110,7 +370,7 @@ void TransformDrawEngine::DrawSpline(int ucount, int vcount, int utype, int vtyp
 class Lighter {
 public:
 	Lighter();
-	void Light(float colorOut0[4], float colorOut1[4], const float colorIn[4], Vec3 pos, Vec3 normal, float dots[4]);
+	void Light(Lanes colorOut0[4], Lanes colorOut1[4], const Lanes colorIn[4], const Lanes pos[3], const Lanes normal[3], Lanes dots[4]) const;
 
 private:
 	bool disabled_;
@@ -147,37 +407,34 @@ Lighter::Lighter() {
 	materialUpdate_ = gstate.materialupdate & 7;
 }
 
-void Lighter::Light(float colorOut0[4], float colorOut1[4], const float colorIn[4], Vec3 pos, Vec3 normal, float dots[4])
+void Lighter::Light(Lanes colorOut0[4], Lanes colorOut1[4], const Lanes colorIn[4], const Lanes pos[3], const Lanes normal[3], Lanes dots[4]) const
 {
+	const Lanes zero(0.0f);
+	const Lanes one(1.0f);
+
 	if (disabled_) {
-		memcpy(colorOut0, colorIn, sizeof(float) * 4);
-		memset(colorOut1, 0, sizeof(float) * 4);
+		for (int i = 0; i < 4; i++) {
+			colorOut0[i] = colorIn[i];
+			colorOut1[i] = zero;
+		}
 		return;
 	}
 
-	Vec3 norm = normal.Normalized();
-	Color4 in(colorIn);
-
-	const Color4 *ambient;
-	if (materialUpdate_ & 1)
-		ambient = &in;
-	else
-		ambient = &materialAmbient;
+	Lanes invLength = one / DotLanes(normal, normal).Sqrt();
+	Lanes norm[3] = { normal[0] * invLength, normal[1] * invLength, normal[2] * invLength };
 
-	const Color4 *diffuse;
-	if (materialUpdate_ & 2)
-		diffuse = &in;
-	else
-		diffuse = &materialDiffuse;
-
-	const Color4 *specular;
-	if (materialUpdate_ & 4)
-		specular = &in;
-	else
-		specular = &materialSpecular;
+	Lanes ambient[4], diffuse[4], specular[4];
+	for (int i = 0; i < 4; i++) {
+		ambient[i] = (materialUpdate_ & 1) ? colorIn[i] : Lanes(materialAmbient[i]);
+		diffuse[i] = (materialUpdate_ & 2) ? colorIn[i] : Lanes(materialDiffuse[i]);
+		specular[i] = (materialUpdate_ & 4) ? colorIn[i] : Lanes(materialSpecular[i]);
+	}
 
-	Color4 lightSum0 = globalAmbient * *ambient + materialEmissive;
-	Color4 lightSum1(0, 0, 0, 0);
+	Lanes lightSum0[4], lightSum1[4];
+	for (int i = 0; i < 4; i++) {
+		lightSum0[i] = Lanes(globalAmbient[i]) * ambient[i] + Lanes(materialEmissive[i]);
+		lightSum1[i] = zero;
+	}
 
 	// Try lights.elf - there's something wrong with the lighting
 
@@ -189,65 +446,60 @@ void Lighter::Light(float colorOut0[4], float colorOut1[4], const float colorIn[
 
 		GELightComputation comp = (GELightComputation)(gstate.ltype[l] & 3);
 		GELightType type = (GELightType)((gstate.ltype[l] >> 8) & 3);
-		Vec3 toLight;
-
-		if (type == GE_LIGHTTYPE_DIRECTIONAL)
-			toLight = Vec3(gstate_c.lightpos[l]);  // lightdir is for spotlights
-		else
-			toLight = Vec3(gstate_c.lightpos[l]) - pos;
+		Lanes toLight[3];
+		for (int i = 0; i < 3; i++) {
+			toLight[i] = Lanes(gstate_c.lightpos[l][i]);  // lightdir is for spotlights
+			if (type != GE_LIGHTTYPE_DIRECTIONAL)
+				toLight[i] = toLight[i] - pos[i];
+		}
 
 		bool doSpecular = (comp != GE_LIGHTCOMP_ONLYDIFFUSE);
 		bool poweredDiffuse = comp == GE_LIGHTCOMP_BOTHWITHPOWDIFFUSE;
 
-		float dot = toLight * norm;
-
 		// Clamp dot to zero.
-		if (dot < 0.0f) dot = 0.0f;
+		Lanes dot = DotLanes(toLight, norm).Max(zero);
 
 		if (poweredDiffuse)
-			dot = powf(dot, specCoef_);
+			dot = PowLanes(dot, specCoef_);
 
-		float lightScale = 1.0f;
-		float distance = toLight.Normalize();
+		Lanes lightScale = one;
+		Lanes distance = DotLanes(toLight, toLight).Sqrt();
+		Lanes invDistance = one / distance;
+		for (int i = 0; i < 3; i++)
+			toLight[i] = toLight[i] * invDistance;
 		if (type != GE_LIGHTTYPE_DIRECTIONAL)
 		{
-			lightScale = 1.0f / (gstate_c.lightatt[l][0] + gstate_c.lightatt[l][1]*distance + gstate_c.lightatt[l][2]*distance*distance);
-			if (lightScale > 1.0f) lightScale = 1.0f;
+			const float *att = gstate_c.lightatt[l];
+			lightScale = (one / (Lanes(att[0]) + Lanes(att[1]) * distance + Lanes(att[2]) * distance * distance)).Min(one);
 		}
 
-		Color4 lightDiff(gstate_c.lightColor[1][l], 0.0f);
-		Color4 diff = (lightDiff * *diffuse) * (dot * lightScale);
-
-		// Real PSP specular
-		Vec3 toViewer(0,0,1);
-		// Better specular
-		// Vec3 toViewer = (viewer - pos).Normalized();
+		Lanes diffuseScale = dot * lightScale;
 
 		if (doSpecular)
 		{
-			Vec3 halfVec = toLight;
-			halfVec += toViewer;
-			halfVec.Normalize();
-
-			dot = halfVec * norm;
-			if (dot >= 0)
-			{
-				Color4 lightSpec(gstate_c.lightColor[2][l], 0.0f);
-				lightSum1 += (lightSpec * *specular * (powf(dot, specCoef_)*lightScale));
-			}
+			// Real PSP specular, the viewer is at (0, 0, 1).
+			Lanes halfVec[3] = { toLight[0], toLight[1], toLight[2] + one };
+			Lanes invHalfLength = one / DotLanes(halfVec, halfVec).Sqrt();
+
+			dot = DotLanes(halfVec, norm) * invHalfLength;
+			Lanes specScale = PowLanes(dot, specCoef_) * lightScale;
+			// The specular light's alpha is 0, so only RGB accumulates.
+			for (int i = 0; i < 3; i++)
+				lightSum1[i] = lightSum1[i] + Lanes(gstate_c.lightColor[2][l][i]) * specular[i] * specScale;
 		}
 		dots[l] = dot;
 		if (gstate.lightEnable[l] & 1)
 		{
-			Color4 lightAmbient(gstate_c.lightColor[0][l], 1.0f);
-			lightSum0 += lightAmbient * *ambient + diff;
+			for (int i = 0; i < 3; i++)
+				lightSum0[i] = lightSum0[i] + Lanes(gstate_c.lightColor[0][l][i]) * ambient[i] + Lanes(gstate_c.lightColor[1][l][i]) * diffuse[i] * diffuseScale;
+			// Ambient light alpha is 1, diffuse alpha is 0.
+			lightSum0[3] = lightSum0[3] + ambient[3];
 		}
 	}
 
-	// 4?
 	for (int i = 0; i < 4; i++) {
-		colorOut0[i] = lightSum0[i] > 1.0f ? 1.0f : lightSum0[i];
-		colorOut1[i] = lightSum1[i] > 1.0f ? 1.0f : lightSum1[i];
+		colorOut0[i] = lightSum0[i].Min(one);
+		colorOut1[i] = lightSum1[i].Min(one);
 	}
 }
 
@@ -307,210 +559,258 @@ static void RotateUVs(TransformedVertex v[4]) {
 	}
 }
 
-// This is the software transform pipeline, which is necessary for supporting RECT
-// primitives correctly, and may be easier to use for debugging than the hardware
-// transform pipeline.
-
-// There's code here that simply expands transformed RECTANGLES into plain triangles.
-
-// We're gonna have to keep software transforming RECTANGLES, unless we use a geom shader which we can't on OpenGL ES 2.0.
-// Usually, though, these primitives don't use lighting etc so it's no biggie performance wise, but it would be nice to get rid of
-// this code.
-
-// Actually, if we find the camera-relative right and down vectors, it might even be possible to add the extra points in pre-transformed
-// space and thus make decent use of hardware transform.
-
-// Actually again, single quads could be drawn more efficiently using GL_TRIANGLE_STRIP, no need to duplicate verts as for
-// GL_TRIANGLES. Still need to sw transform to compute the extra two corners though.
-void TransformDrawEngine::SoftwareTransformAndDraw(
-		int prim, u8 *decoded, LinkedShader *program, int vertexCount, u32 vertType, void *inds, int indexType, const DecVtxFormat &decVtxFormat, int maxIndex) {
-
-	bool throughmode = (vertType & GE_VTYPE_THROUGH_MASK) != 0;
-
-	// TODO: Split up into multiple draw calls for GLES 2.0 where you can't guarantee support for more than 0x10000 verts.
+// Transforms, lights and generates texture coordinates for up to TRANSFORM_BATCH_SIZE vertices
+// starting at start. The batch is gathered into Lanes, processed together, and scattered
+// back out into transformed vertices.
+static void TransformAndLightBatch(VertexReader &reader, const Lighter &lighter, u32 vertType, int start, int count, TransformedVertex *out) {
+	float pos[3][TRANSFORM_BATCH_SIZE], nrm[3][TRANSFORM_BATCH_SIZE];
+	float color[4][TRANSFORM_BATCH_SIZE], ruv[2][TRANSFORM_BATCH_SIZE];
+	float weights[8][TRANSFORM_BATCH_SIZE];
+
+	const bool throughmode = (vertType & GE_VTYPE_THROUGH_MASK) != 0;
+	const bool skinned = (vertType & GE_VTYPE_WEIGHT_MASK) != GE_VTYPE_WEIGHT_NONE;
+	const int nweights = ((vertType & GE_VTYPE_WEIGHTCOUNT_MASK) >> GE_VTYPE_WEIGHTCOUNT_SHIFT) + 1;
+
+	float materialColor[4];
+	materialColor[0] = ((gstate.materialambient >> 16) & 0xFF) / 255.f;
+	materialColor[1] = ((gstate.materialambient >> 8)  & 0xFF) / 255.f;
+	materialColor[2] = (gstate.materialambient & 0xFF) / 255.f;
+	materialColor[3] = (gstate.materialalpha & 0xFF) / 255.f;
+
+	for (int lane = 0; lane < TRANSFORM_BATCH_SIZE; lane++) {
+		// A short batch repeats its last vertex, those results are never written out.
+		reader.Goto(start + (lane < count ? lane : count - 1));
+
+		float v[8] = {0, 0, 0, 0, 0, 0, 0, 0};
+		reader.ReadPos(v);
+		for (int i = 0; i < 3; i++)
+			pos[i][lane] = v[i];
+
+		memset(v, 0, sizeof(v));
+		if (reader.hasNormal() && !throughmode)
+			reader.ReadNrm(v);
+		for (int i = 0; i < 3; i++)
+			nrm[i][lane] = v[i];
+
+		if (reader.hasColor0())
+			reader.ReadColor0(v);
+		else
+			memcpy(v, materialColor, sizeof(materialColor));
+		for (int i = 0; i < 4; i++)
+			color[i][lane] = v[i];
+
+		memset(v, 0, sizeof(v));
+		if (reader.hasUV())
+			reader.ReadUV(v);
+		ruv[0][lane] = v[0];
+		ruv[1][lane] = v[1];
+
+		if (skinned && !throughmode) {
+			memset(v, 0, sizeof(v));
+			reader.ReadWeights(v);
+			for (int i = 0; i < nweights; i++)
+				weights[i][lane] = v[i];
+		}
+	}
 
-#if defined(USING_GLES2)
-	if (vertexCount > 0x10000/3)
-		vertexCount = 0x10000/3;
-#endif
+	if (throughmode) {
+		// Do not touch the coordinates or the colors. No lighting.
+		for (int lane = 0; lane < count; lane++) {
+			TransformedVertex &vert = out[lane];
+			vert.x = pos[0][lane];
+			vert.y = pos[1][lane];
+			vert.z = pos[2][lane];
+			vert.u = ruv[0][lane];
+			vert.v = ruv[1][lane];
+			for (int i = 0; i < 4; i++)
+				vert.color0[i] = color[i][lane];
+			for (int i = 0; i < 3; i++)
+				vert.color1[i] = 0.0f;
+		}
+		return;
+	}
 
-	Lighter lighter;
+	const Lanes zero(0.0f);
+	Lanes modelPos[3], modelNrm[3];
+	for (int i = 0; i < 3; i++) {
+		modelPos[i] = Lanes::Load(pos[i]);
+		modelNrm[i] = Lanes::Load(nrm[i]);
+	}
 
-	VertexReader reader(decoded, decVtxFormat);
-	for (int index = 0; index < maxIndex; index++) {
-		reader.Goto(index);
-
-		float v[3] = {0, 0, 0};
-		float c0[4] = {1, 1, 1, 1};
-		float c1[4] = {0, 0, 0, 0};
-		float uv[2] = {0, 0};
-
-		if (throughmode) {
-			// Do not touch the coordinates or the colors. No lighting.
-			reader.ReadPos(v);
-			if (reader.hasColor0()) {
-				reader.ReadColor0(c0);
-				for (int j = 0; j < 4; j++) {
-					c1[j] = 0.0f;
-				}
-			} else {
-				c0[0] = ((gstate.materialambient >> 16) & 0xFF) / 255.f;
-				c0[1] = ((gstate.materialambient >> 8)  & 0xFF) / 255.f;
-				c0[2] = (gstate.materialambient  & 0xFF) / 255.f;
-				c0[3] = (gstate.materialalpha & 0xFF) / 255.f;
+	Lanes worldPos[3], worldNrm[3];
+	if (!skinned) {
+		Vec3ByMatrix43Lanes(worldPos, modelPos, gstate.worldMatrix);
+		Norm3ByMatrix43Lanes(worldNrm, modelNrm, gstate.worldMatrix);
+	} else {
+		Lanes psum[3] = { zero, zero, zero };
+		Lanes nsum[3] = { zero, zero, zero };
+		for (int i = 0; i < nweights; i++) {
+			const float *bone = gstate.boneMatrix + i * 12;
+			Lanes weight = Lanes::Load(weights[i]);
+			Lanes tpos[3], tnorm[3];
+			Vec3ByMatrix43Lanes(tpos, modelPos, bone);
+			Norm3ByMatrix43Lanes(tnorm, modelNrm, bone);
+			for (int j = 0; j < 3; j++) {
+				psum[j] = psum[j] + tpos[j] * weight;
+				nsum[j] = nsum[j] + tnorm[j] * weight;
 			}
+		}
 
-			if (reader.hasUV()) {
-				reader.ReadUV(uv);
-			}
-			// Scale UV?
-		} else {
-			// We do software T&L for now
-			float out[3], norm[3];
-			float pos[3], nrm[3] = {0};
-			reader.ReadPos(pos);
-			if (reader.hasNormal())
-				reader.ReadNrm(nrm);
-
-			if ((vertType & GE_VTYPE_WEIGHT_MASK) == GE_VTYPE_WEIGHT_NONE) {
-				Vec3ByMatrix43(out, pos, gstate.worldMatrix);
-				if (reader.hasNormal()) {
-					Norm3ByMatrix43(norm, nrm, gstate.worldMatrix);
-				} else {
-					memset(norm, 0, 12);
-				}
-			} else {
-				float weights[8];
-				reader.ReadWeights(weights);
-				// Skinning
-				Vec3 psum(0,0,0);
-				Vec3 nsum(0,0,0);
-				int nweights = ((vertType & GE_VTYPE_WEIGHTCOUNT_MASK) >> GE_VTYPE_WEIGHTCOUNT_SHIFT) + 1;
-				for (int i = 0; i < nweights; i++)
-				{
-					if (weights[i] != 0.0f) {
-						Vec3ByMatrix43(out, pos, gstate.boneMatrix+i*12);
-						Vec3 tpos(out);
-						psum += tpos * weights[i];
-						if (reader.hasNormal()) {
-							Norm3ByMatrix43(norm, nrm, gstate.boneMatrix+i*12);
-							Vec3 tnorm(norm);
-							nsum += tnorm * weights[i];
-						}
-					}
-				}
+		// Yes, we really must multiply by the world matrix too.
+		Vec3ByMatrix43Lanes(worldPos, psum, gstate.worldMatrix);
+		Norm3ByMatrix43Lanes(worldNrm, nsum, gstate.worldMatrix);
+	}
 
-				// Yes, we really must multiply by the world matrix too.
-				Vec3ByMatrix43(out, psum.v, gstate.worldMatrix);
-				if (reader.hasNormal()) {
-					Norm3ByMatrix43(norm, nsum.v, gstate.worldMatrix);
-				}
-			}
+	Lanes unlitColor[4], c0[4], c1[4];
+	for (int i = 0; i < 4; i++) {
+		unlitColor[i] = Lanes::Load(color[i]);
+		c0[i] = unlitColor[i];
+		c1[i] = zero;
+	}
 
-			// Perform lighting here if enabled. don't need to check through, it's checked above.
-			float dots[4] = {0,0,0,0};
-			float unlitColor[4] = {1, 1, 1, 1};
-			if (reader.hasColor0()) {
-				reader.ReadColor0(unlitColor);
-			} else {
-				unlitColor[0] = ((gstate.materialambient  >> 16) & 0xFF) / 255.f;
-				unlitColor[1] = ((gstate.materialambient >> 8)  & 0xFF) / 255.f;
-				unlitColor[2] = (gstate.materialambient & 0xFF) / 255.f;
-				unlitColor[3] = (gstate.materialalpha & 0xFF) / 255.f;
-			}
-			float litColor0[4];
-			float litColor1[4];
-			lighter.Light(litColor0, litColor1, unlitColor, out, norm, dots);
+	// Shade mapping needs the dots even with lighting off.
+	Lanes dots[4] = { zero, zero, zero, zero };
+	if ((gstate.lightingEnable & 1) || gstate.getUVGenMode() == 2) {
+		Lanes litColor0[4], litColor1[4];
+		lighter.Light(litColor0, litColor1, unlitColor, worldPos, worldNrm, dots);
 
-			if (gstate.lightingEnable & 1) {
-				// Don't ignore gstate.lmode - we should send two colors in that case
+		if (gstate.lightingEnable & 1) {
+			// Don't ignore gstate.lmode - we should send two colors in that case
+			for (int i = 0; i < 4; i++) {
 				if (gstate.lmode & 1) {
 					// Separate colors
-					for (int j = 0; j < 4; j++) {
-						c0[j] = litColor0[j];
-						c1[j] = litColor1[j];
-					}
+					c0[i] = litColor0[i];
+					c1[i] = litColor1[i];
 				} else {
 					// Summed color into c0
-					for (int j = 0; j < 4; j++) {
-						c0[j] = litColor0[j] + litColor1[j];
-						c1[j] = 0.0f;
-					}
-				}
-			} else {
-				if (reader.hasColor0()) {
-					for (int j = 0; j < 4; j++) {
-						c0[j] = unlitColor[j];
-						c1[j] = 0.0f;
-					}
-				} else {
-					c0[0] = ((gstate.materialambient >> 16) & 0xFF) / 255.f;
-					c0[1] = ((gstate.materialambient >> 8)  & 0xFF) / 255.f;
-					c0[2] = (gstate.materialambient & 0xFF) / 255.f;
-					c0[3] = (gstate.materialalpha & 0xFF) / 255.f;
+					c0[i] = litColor0[i] + litColor1[i];
 				}
 			}
+		}
+	}
 
-			if (reader.hasUV()) {
-				float ruv[2];
-				reader.ReadUV(ruv);
-				// Perform texture coordinate generation after the transform and lighting - one style of UV depends on lights.
-				switch (gstate.getUVGenMode())
+	// Perform texture coordinate generation after the transform and lighting - one style of UV depends on lights.
+	Lanes uv[2] = { zero, zero };
+	if (reader.hasUV()) {
+		Lanes rawUV[2] = { Lanes::Load(ruv[0]), Lanes::Load(ruv[1]) };
+		switch (gstate.getUVGenMode())
+		{
+		case 0:	// UV mapping
+			// Texture scale/offset is only performed in this mode.
+			uv[0] = rawUV[0] * Lanes(gstate_c.uScale) + Lanes(gstate_c.uOff);
+			uv[1] = rawUV[1] * Lanes(gstate_c.vScale) + Lanes(gstate_c.vOff);
+			break;
+		case 1:
+			{
+				// Projection mapping
+				Lanes source[3];
+				switch (gstate.getUVProjMode())
 				{
-				case 0:	// UV mapping
-					// Texture scale/offset is only performed in this mode.
-					uv[0] = ruv[0]*gstate_c.uScale + gstate_c.uOff;
-					uv[1] = ruv[1]*gstate_c.vScale + gstate_c.vOff;
+				case 0: // Use model space XYZ as source
+					for (int i = 0; i < 3; i++)
+						source[i] = modelPos[i];
 					break;
-				case 1:
-					{
-						// Projection mapping
-						Vec3 source;
-						switch (gstate.getUVProjMode())
-						{
-						case 0: // Use model space XYZ as source
-							source = pos;
-							break;
-						case 1: // Use unscaled UV as source
-							source = Vec3(ruv[0], ruv[1], 0.0f);
-							break;
-						case 2: // Use normalized normal as source
-							source = Vec3(norm).Normalized();
-							break;
-						case 3: // Use non-normalized normal as source!
-							source = Vec3(norm);
-							break;
-						}
-
-						float uvw[3];
-						Vec3ByMatrix43(uvw, &source.x, gstate.tgenMatrix);
-						uv[0] = uvw[0];
-						uv[1] = uvw[1];
-					}
+				case 1: // Use unscaled UV as source
+					source[0] = rawUV[0];
+					source[1] = rawUV[1];
+					source[2] = zero;
 					break;
-				case 2:
-					// Shade mapping - use dot products from light sources to generate U and V.
+				case 2: // Use normalized normal as source
 					{
-						uv[0] = dots[gstate.getUVLS0()];
-						uv[1] = dots[gstate.getUVLS1()];
+						Lanes invLength = Lanes(1.0f) / DotLanes(worldNrm, worldNrm).Sqrt();
+						for (int i = 0; i < 3; i++)
+							source[i] = worldNrm[i] * invLength;
 					}
 					break;
-				case 3:
-					// Illegal
+				case 3: // Use non-normalized normal as source!
+					for (int i = 0; i < 3; i++)
+						source[i] = worldNrm[i];
 					break;
 				}
+
+				Lanes uvw[3];
+				Vec3ByMatrix43Lanes(uvw, source, gstate.tgenMatrix);
+				uv[0] = uvw[0];
+				uv[1] = uvw[1];
 			}
+			break;
+		case 2:
+			// Shade mapping - use dot products from light sources to generate U and V.
+			uv[0] = dots[gstate.getUVLS0()];
+			uv[1] = dots[gstate.getUVLS1()];
+			break;
+		case 3:
+			// Illegal
+			break;
+		}
+	}
+
+	// Transform the coord by the view matrix.
+	Lanes viewPos[3];
+	Vec3ByMatrix43Lanes(viewPos, worldPos, gstate.viewMatrix);
 
-			// Transform the coord by the view matrix.
-			Vec3ByMatrix43(v, out, gstate.viewMatrix);
+	float outPos[3][TRANSFORM_BATCH_SIZE], outUV[2][TRANSFORM_BATCH_SIZE];
+	float outColor0[4][TRANSFORM_BATCH_SIZE], outColor1[3][TRANSFORM_BATCH_SIZE];
+	for (int i = 0; i < 4; i++) {
+		if (i < 3) {
+			viewPos[i].Store(outPos[i]);
+			c1[i].Store(outColor1[i]);
 		}
+		if (i < 2)
+			uv[i].Store(outUV[i]);
+		c0[i].Store(outColor0[i]);
+	}
 
-		// TODO: Write to a flexible buffer, we don't always need all four components.
-		memcpy(&transformed[index].x, v, 3 * sizeof(float));
-		memcpy(&transformed[index].u, uv, 2 * sizeof(float));
-		memcpy(&transformed[index].color0, c0, 4 * sizeof(float));
-		memcpy(&transformed[index].color1, c1, 3 * sizeof(float));
+	for (int lane = 0; lane < count; lane++) {
+		TransformedVertex &vert = out[lane];
+		vert.x = outPos[0][lane];
+		vert.y = outPos[1][lane];
+		vert.z = outPos[2][lane];
+		vert.u = outUV[0][lane];
+		vert.v = outUV[1][lane];
+		for (int i = 0; i < 4; i++)
+			vert.color0[i] = outColor0[i][lane];
+		for (int i = 0; i < 3; i++)
+			vert.color1[i] = outColor1[i][lane];
 	}
+}
+
+void SoftwareTransformVertices(TransformedVertex *out, u8 *decoded, const DecVtxFormat &decVtxFormat, u32 vertType, int count) {
+	Lighter lighter;
+	VertexReader reader(decoded, decVtxFormat);
+	for (int index = 0; index < count; index += TRANSFORM_BATCH_SIZE) {
+		int batch = std::min(count - index, TRANSFORM_BATCH_SIZE);
+		TransformAndLightBatch(reader, lighter, vertType, index, batch, &out[index]);
+	}
+}
+
+// This is the software transform pipeline, which is necessary for supporting RECT
+// primitives correctly, and may be easier to use for debugging than the hardware
+// transform pipeline.
+
+// There's code here that simply expands transformed RECTANGLES into plain triangles.
+
+// We're gonna have to keep software transforming RECTANGLES, unless we use a geom shader which we can't on OpenGL ES 2.0.
+// Usually, though, these primitives don't use lighting etc so it's no biggie performance wise, but it would be nice to get rid of
+// this code.
+
+// Actually, if we find the camera-relative right and down vectors, it might even be possible to add the extra points in pre-transformed
+// space and thus make decent use of hardware transform.
+
+// Actually again, single quads could be drawn more efficiently using GL_TRIANGLE_STRIP, no need to duplicate verts as for
+// GL_TRIANGLES. Still need to sw transform to compute the extra two corners though.
+void TransformDrawEngine::SoftwareTransformAndDraw(
+		int prim, u8 *decoded, LinkedShader *program, int vertexCount, u32 vertType, void *inds, int indexType, const DecVtxFormat &decVtxFormat, int maxIndex) {
+
+	// TODO: Split up into multiple draw calls for GLES 2.0 where you can't guarantee support for more than 0x10000 verts.
+
+#if defined(USING_GLES2)
+	if (vertexCount > 0x10000/3)
+		vertexCount = 0x10000/3;
+#endif
+
+	// Step 1: transform and light, a batch of vertices at a time.
+	SoftwareTransformVertices(transformed, decoded, decVtxFormat, vertType, maxIndex);
 
 	// Step 2: expand rectangles.
 	const TransformedVertex *drawBuffer = transformed;
@@ -594,81 +894,145 @@ void TransformDrawEngine::SoftwareTransformAndDraw(
 }
 
 void TransformDrawEngine::SubmitPrim(void *verts, void *inds, int prim, int vertexCount, u32 vertType, int forceIndexType, int *bytesRead) {
-	// For the future
-	if (!indexGen.PrimCompatible(prim))
+	if (!IndexGenerator::PrimCompatible(prevPrim_, prim) || numDrawCalls >= MAX_DEFERRED_DRAW_CALLS)
 		Flush();
 
-	if (!indexGen.Empty()) {
+	// If vtype has changed, setup the vertex decoder.
+	if (vertType != lastVType) {
+		// The deferred draws have to be decoded with the decoder they were submitted with.
+		Flush();
+		dec_ = GetVertexDecoder(vertType);
+		lastVType = vertType;
+	}
+
+	if (numDrawCalls > 0) {
 		gpuStats.numJoins++;
 	}
 	gpuStats.numDrawCalls++;
 	gpuStats.numVertsTransformed += vertexCount;
+	prevPrim_ = prim;
 
-	indexGen.SetIndex(numVerts);
-	int indexLowerBound, indexUpperBound;
-	// If vtype has changed, setup the vertex decoder.
-	// TODO: Simply cache the setup decoders instead.
-	if (vertType != lastVType) {
-		dec.SetVertexType(vertType);
-		lastVType = vertType;
-	}
+	DeferredDrawCall &dc = drawCalls[numDrawCalls++];
+	dc.verts = verts;
+	dc.inds = inds;
+	dc.vertType = vertType;
+	dc.indexType = forceIndexType != -1 ? forceIndexType : (vertType & GE_VTYPE_IDX_MASK);
+	dc.prim = prim;
+	dc.vertexCount = vertexCount;
 
-	// Decode the verts and apply morphing
-	dec.DecodeVerts(decoded + numVerts * (int)dec.GetDecVtxFmt().stride, verts, inds, prim, vertexCount, &indexLowerBound, &indexUpperBound);
-	numVerts += indexUpperBound - indexLowerBound + 1;
 	if (bytesRead)
-		*bytesRead = vertexCount * dec.VertexSize();
-
-	int indexType = vertType & GE_VTYPE_IDX_MASK;
-	if (forceIndexType != -1) indexType = forceIndexType;
-	switch (indexType) {
-	case GE_VTYPE_IDX_NONE:
-		switch (prim) {
-		case GE_PRIM_POINTS: indexGen.AddPoints(vertexCount); break;
-		case GE_PRIM_LINES: indexGen.AddLineList(vertexCount); break;
-		case GE_PRIM_LINE_STRIP: indexGen.AddLineStrip(vertexCount); break;
-		case GE_PRIM_TRIANGLES: indexGen.AddList(vertexCount); break;
-		case GE_PRIM_TRIANGLE_STRIP: indexGen.AddStrip(vertexCount); break;
-		case GE_PRIM_TRIANGLE_FAN: indexGen.AddFan(vertexCount); break;
-		case GE_PRIM_RECTANGLES: indexGen.AddRectangles(vertexCount); break;  // Same
-		}
-		break;
-
-	case GE_VTYPE_IDX_8BIT:
-		switch (prim) {
-		case GE_PRIM_POINTS: indexGen.TranslatePoints(vertexCount, (const u8 *)inds, -indexLowerBound); break;
-		case GE_PRIM_LINES: indexGen.TranslateLineList(vertexCount, (const u8 *)inds, -indexLowerBound); break;
-		case GE_PRIM_LINE_STRIP: indexGen.TranslateLineStrip(vertexCount, (const u8 *)inds, -indexLowerBound); break;
-		case GE_PRIM_TRIANGLES: indexGen.TranslateList(vertexCount, (const u8 *)inds, -indexLowerBound); break;
-		case GE_PRIM_TRIANGLE_STRIP: indexGen.TranslateStrip(vertexCount, (const u8 *)inds, -indexLowerBound); break;
-		case GE_PRIM_TRIANGLE_FAN: indexGen.TranslateFan(vertexCount, (const u8 *)inds, -indexLowerBound); break;
-		case GE_PRIM_RECTANGLES: indexGen.TranslateRectangles(vertexCount, (const u8 *)inds, -indexLowerBound); break;  // Same
-		}
-		break;
-
-	case GE_VTYPE_IDX_16BIT:
-		switch (prim) {
-		case GE_PRIM_POINTS: indexGen.TranslatePoints(vertexCount, (const u16 *)inds, -indexLowerBound); break;
-		case GE_PRIM_LINES: indexGen.TranslateLineList(vertexCount, (const u16 *)inds, -indexLowerBound); break;
-		case GE_PRIM_LINE_STRIP: indexGen.TranslateLineStrip(vertexCount, (const u16 *)inds, -indexLowerBound); break;
-		case GE_PRIM_TRIANGLES: indexGen.TranslateList(vertexCount, (const u16 *)inds, -indexLowerBound); break;
-		case GE_PRIM_TRIANGLE_STRIP: indexGen.TranslateStrip(vertexCount, (const u16 *)inds, -indexLowerBound); break;
-		case GE_PRIM_TRIANGLE_FAN: indexGen.TranslateFan(vertexCount, (const u16 *)inds, -indexLowerBound); break;
-		case GE_PRIM_RECTANGLES: indexGen.TranslateRectangles(vertexCount, (const u16 *)inds, -indexLowerBound); break;  // Same
+		*bytesRead = vertexCount * dec_->VertexSize();
+}
+
+void TransformDrawEngine::DecodeVerts() {
+	for (; decodeCounter_ < numDrawCalls; decodeCounter_++) {
+		const DeferredDrawCall &dc = drawCalls[decodeCounter_];
+		const int prim = dc.prim;
+		const int vertexCount = dc.vertexCount;
+		const void *inds = dc.inds;
+
+		indexGen.SetIndex(numVerts);
+		int indexLowerBound, indexUpperBound;
+
+		// Decode the verts and apply morphing
+		dec_->DecodeVerts(decoded + numVerts * (int)dec_->GetDecVtxFmt().stride, dc.verts, inds, prim, vertexCount, &indexLowerBound, &indexUpperBound);
+		numVerts += indexUpperBound - indexLowerBound + 1;
+		lastLowerBound_ = indexLowerBound;
+		lastUpperBound_ = indexUpperBound;
+
+		switch (dc.indexType) {
+		case GE_VTYPE_IDX_NONE:
+			switch (prim) {
+			case GE_PRIM_POINTS: indexGen.AddPoints(vertexCount); break;
+			case GE_PRIM_LINES: indexGen.AddLineList(vertexCount); break;
+			case GE_PRIM_LINE_STRIP: indexGen.AddLineStrip(vertexCount); break;
+			case GE_PRIM_TRIANGLES: indexGen.AddList(vertexCount); break;
+			case GE_PRIM_TRIANGLE_STRIP: indexGen.AddStrip(vertexCount); break;
+			case GE_PRIM_TRIANGLE_FAN: indexGen.AddFan(vertexCount); break;
+			case GE_PRIM_RECTANGLES: indexGen.AddRectangles(vertexCount); break;  // Same
+			}
+			break;
+
+		case GE_VTYPE_IDX_8BIT:
+			switch (prim) {
+			case GE_PRIM_POINTS: indexGen.TranslatePoints(vertexCount, (const u8 *)inds, -indexLowerBound); break;
+			case GE_PRIM_LINES: indexGen.TranslateLineList(vertexCount, (const u8 *)inds, -indexLowerBound); break;
+			case GE_PRIM_LINE_STRIP: indexGen.TranslateLineStrip(vertexCount, (const u8 *)inds, -indexLowerBound); break;
+			case GE_PRIM_TRIANGLES: indexGen.TranslateList(vertexCount, (const u8 *)inds, -indexLowerBound); break;
+			case GE_PRIM_TRIANGLE_STRIP: indexGen.TranslateStrip(vertexCount, (const u8 *)inds, -indexLowerBound); break;
+			case GE_PRIM_TRIANGLE_FAN: indexGen.TranslateFan(vertexCount, (const u8 *)inds, -indexLowerBound); break;
+			case GE_PRIM_RECTANGLES: indexGen.TranslateRectangles(vertexCount, (const u8 *)inds, -indexLowerBound); break;  // Same
+			}
+			break;
+
+		case GE_VTYPE_IDX_16BIT:
+			switch (prim) {
+			case GE_PRIM_POINTS: indexGen.TranslatePoints(vertexCount, (const u16 *)inds, -indexLowerBound); break;
+			case GE_PRIM_LINES: indexGen.TranslateLineList(vertexCount, (const u16 *)inds, -indexLowerBound); break;
+			case GE_PRIM_LINE_STRIP: indexGen.TranslateLineStrip(vertexCount, (const u16 *)inds, -indexLowerBound); break;
+			case GE_PRIM_TRIANGLES: indexGen.TranslateList(vertexCount, (const u16 *)inds, -indexLowerBound); break;
+			case GE_PRIM_TRIANGLE_STRIP: indexGen.TranslateStrip(vertexCount, (const u16 *)inds, -indexLowerBound); break;
+			case GE_PRIM_TRIANGLE_FAN: indexGen.TranslateFan(vertexCount, (const u16 *)inds, -indexLowerBound); break;
+			case GE_PRIM_RECTANGLES: indexGen.TranslateRectangles(vertexCount, (const u16 *)inds, -indexLowerBound); break;  // Same
+			}
+			break;
 		}
-		break;
 	}
 }
 
-void TransformDrawEngine::Flush() {
-	if (indexGen.Empty())
-		return;
+bool TransformDrawEngine::CanCacheDrawCall(const DeferredDrawCall &dc) const {
+	if (dc.vertexCount < VAI_MIN_VERTS)
+		return false;
+	// The decoded data would also depend on state outside the vertex memory.
+	if ((dc.vertType & GE_VTYPE_MORPHCOUNT_MASK) != 0 || (gstate.reversenormals & 0xFFFFFF) != 0)
+		return false;
+	return true;
+}
 
-#if 0
-	for (int i = indexLowerBound; i <= indexUpperBound; i++) {
-		PrintDecodedVertex(decoded[i], vertType);
+u64 TransformDrawEngine::ComputeHash(const DeferredDrawCall &dc, int lowerBound, int upperBound) const {
+	const int vertexSize = dec_->VertexSize();
+	const u8 *verts = (const u8 *)dc.verts + lowerBound * vertexSize;
+	u64 hash = GetHash64(verts, (upperBound - lowerBound + 1) * vertexSize, VAI_HASH_SAMPLES);
+
+	// Changed indices may also mean a different vertex range, so those are hashed in full.
+	if (dc.indexType != GE_VTYPE_IDX_NONE) {
+		int indexSize = dc.indexType == GE_VTYPE_IDX_16BIT ? 2 : 1;
+		hash ^= GetHash64((const u8 *)dc.inds, dc.vertexCount * indexSize, 0) * 31;
 	}
-#endif
+	return hash;
+}
+
+// If there's only been one primitive type, and it's either TRIANGLES, LINES or POINTS,
+// there is no need for the index buffer we built. We can then use glDrawArrays instead
+// for a very minor speed boost.
+static bool NeedsIndexBuffer(const IndexGenerator &indexGen) {
+	int seen = indexGen.SeenPrims() | 0x83204820;
+	return !(seen == (1 << GE_PRIM_TRIANGLES) || seen == (1 << GE_PRIM_LINES) || seen == (1 << GE_PRIM_POINTS));
+}
+
+// Uploads the single draw call that was just decoded.
+void TransformDrawEngine::BuildVertexArray(VertexArrayInfo *vai) {
+	glGenBuffers(1, &vai->vbo);
+	glBindBuffer(GL_ARRAY_BUFFER, vai->vbo);
+	glBufferData(GL_ARRAY_BUFFER, numVerts * dec_->GetDecVtxFmt().stride, decoded, GL_STATIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	if (NeedsIndexBuffer(indexGen)) {
+		glGenBuffers(1, &vai->ebo);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vai->ebo);
+		glBufferData(GL_ELEMENT_ARRAY_BUFFER, indexGen.VertexCount() * sizeof(u16), decIndex, GL_STATIC_DRAW);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	}
+
+	vai->numVerts = numVerts;
+	vai->numIndices = indexGen.VertexCount();
+	vai->prim = indexGen.Prim();
+	vai->status = VertexArrayInfo::VAI_RELIABLE;
+}
+
+void TransformDrawEngine::Flush() {
+	if (!numDrawCalls)
+		return;
 
 	// Check if anything needs updating
 	if (gstate_c.textureChanged) {
@@ -679,34 +1043,105 @@ void TransformDrawEngine::Flush() {
 	}
 	gpuStats.numFlushes++;
 
-	// TODO: This should not be done on every drawcall, we should collect vertex data
-	// until critical state changes. That's when we draw (flush).
-
-	int prim = indexGen.Prim();
+	int prim = IndexGenerator::GeneralPrim(prevPrim_);
 
 	ApplyDrawState();
 	UpdateViewportAndProjection();
 
 	LinkedShader *program = shaderManager_->ApplyShader(prim);
 
-	DEBUG_LOG(G3D, "Flush prim %i! %i verts in one go", prim, numVerts);
+	DEBUG_LOG(G3D, "Flush prim %i! %i draw calls in one go", prim, numDrawCalls);
 
 	if (CanUseHardwareTransform(prim)) {
-		SetupDecFmtForDraw(program, dec.GetDecVtxFmt(), decoded);
-		// If there's only been one primitive type, and it's either TRIANGLES, LINES or POINTS,
-		// there is no need for the index buffer we built. We can then use glDrawArrays instead
-		// for a very minor speed boost.
-		int seen = indexGen.SeenPrims() | 0x83204820;
-		if (seen == (1 << GE_PRIM_TRIANGLES) || seen == (1 << GE_PRIM_LINES) || seen == (1 << GE_PRIM_POINTS)) {
-			glDrawArrays(glprim[prim], 0, indexGen.VertexCount());
+		VertexArrayInfo *vai = 0;
+		if (g_Config.bVertexCache && numDrawCalls == 1 && decodeCounter_ == 0 && CanCacheDrawCall(drawCalls[0])) {
+			const DeferredDrawCall &dc = drawCalls[0];
+			VertexArrayKey key = { dc.verts, dc.inds, dc.vertexCount, dc.vertType, dc.prim };
+			VertexArrayInfo *&entry = vai_[key];
+			if (!entry)
+				entry = new VertexArrayInfo();
+			vai = entry;
+
+			bool changed = false;
+			switch (vai->status) {
+			case VertexArrayInfo::VAI_NEW:
+				changed = true;
+				break;
+
+			case VertexArrayInfo::VAI_HASHING:
+				if (ComputeHash(dc, vai->indexLowerBound, vai->indexUpperBound) != vai->hash) {
+					changed = true;
+				} else {
+					if (vai->lastFrame != gpuStats.numFrames)
+						vai->numFrames++;
+					DecodeVerts();
+					if (vai->numFrames >= VAI_STABLE_FRAMES)
+						BuildVertexArray(vai);
+				}
+				break;
+
+			case VertexArrayInfo::VAI_RELIABLE:
+				// Recheck once per frame, and whenever the game has told us memory changed.
+				// Writes without a cache writeback in between are very unlikely to hit vertex data.
+				if ((vai->lastFrame != gpuStats.numFrames || vai->lastInvalidation != invalidations_)
+					&& ComputeHash(dc, vai->indexLowerBound, vai->indexUpperBound) != vai->hash) {
+					glDeleteBuffers(1, &vai->vbo);
+					vai->vbo = 0;
+					if (vai->ebo) {
+						glDeleteBuffers(1, &vai->ebo);
+						vai->ebo = 0;
+					}
+					changed = true;
+				}
+				break;
+
+			case VertexArrayInfo::VAI_UNRELIABLE:
+				break;
+			}
+
+			if (changed) {
+				DecodeVerts();
+				if (vai->status != VertexArrayInfo::VAI_NEW)
+					vai->numChanges++;
+				vai->status = vai->numChanges > VAI_MAX_CHANGES ? VertexArrayInfo::VAI_UNRELIABLE : VertexArrayInfo::VAI_HASHING;
+				vai->numFrames = 0;
+				vai->indexLowerBound = lastLowerBound_;
+				vai->indexUpperBound = lastUpperBound_;
+				vai->hash = ComputeHash(dc, lastLowerBound_, lastUpperBound_);
+			}
+			vai->lastFrame = gpuStats.numFrames;
+			vai->lastInvalidation = invalidations_;
+		}
+
+		if (vai && vai->vbo) {
+			glBindBuffer(GL_ARRAY_BUFFER, vai->vbo);
+			SetupDecFmtForDraw(program, dec_->GetDecVtxFmt(), 0);
+			if (vai->ebo) {
+				glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, vai->ebo);
+				glDrawElements(glprim[vai->prim], vai->numIndices, GL_UNSIGNED_SHORT, 0);
+				glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+			} else {
+				glDrawArrays(glprim[vai->prim], 0, vai->numIndices);
+			}
+			glBindBuffer(GL_ARRAY_BUFFER, 0);
 		} else {
-			glDrawElements(glprim[prim], indexGen.VertexCount(), GL_UNSIGNED_SHORT, (GLvoid *)decIndex);
+			DecodeVerts();
+			SetupDecFmtForDraw(program, dec_->GetDecVtxFmt(), decoded);
+			if (NeedsIndexBuffer(indexGen)) {
+				glDrawElements(glprim[prim], indexGen.VertexCount(), GL_UNSIGNED_SHORT, (GLvoid *)decIndex);
+			} else {
+				glDrawArrays(glprim[prim], 0, indexGen.VertexCount());
+			}
 		}
 	} else {
-		SoftwareTransformAndDraw(prim, decoded, program, indexGen.VertexCount(), dec.VertexType(), (void *)decIndex, GE_VTYPE_IDX_16BIT, dec.GetDecVtxFmt(),
+		DecodeVerts();
+		SoftwareTransformAndDraw(prim, decoded, program, indexGen.VertexCount(), dec_->VertexType(), (void *)decIndex, GE_VTYPE_IDX_16BIT, dec_->GetDecVtxFmt(),
 			indexGen.MaxIndex());
 	}
 
 	indexGen.Reset();
 	numVerts = 0;
+	numDrawCalls = 0;
+	decodeCounter_ = 0;
+	prevPrim_ = -1;
 }
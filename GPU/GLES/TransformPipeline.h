@@ -17,13 +17,109 @@
 
 #pragma once
 
+#include <map>
+
 #include "IndexGenerator.h"
+#include "Spline.h"
 #include "VertexDecoder.h"
 
 class LinkedShader;
 class ShaderManager;
 struct DecVtxFormat;
 
+// Identifies a single draw call's source data for the vertex cache.
+struct VertexArrayKey {
+	const void *verts;
+	const void *inds;
+	int vertexCount;
+	u32 vertType;
+	int prim;
+
+	bool operator <(const VertexArrayKey &other) const {
+		if (verts != other.verts) return verts < other.verts;
+		if (inds != other.inds) return inds < other.inds;
+		if (vertexCount != other.vertexCount) return vertexCount < other.vertexCount;
+		if (vertType != other.vertType) return vertType < other.vertType;
+		return prim < other.prim;
+	}
+};
+
+// Identifies a tessellated patch. The control points are only known by their hash,
+// so the same patch drawn from another address still hits.
+struct PatchKey {
+	u64 hash;
+	u32 vertType;
+	u32 shape;  // Counts and edge types, as in the BEZIER/SPLINE command.
+	u32 tess;  // Divisions, primitive and normal generation.
+
+	bool operator <(const PatchKey &other) const {
+		if (hash != other.hash) return hash < other.hash;
+		if (vertType != other.vertType) return vertType < other.vertType;
+		if (shape != other.shape) return shape < other.shape;
+		return tess < other.tess;
+	}
+};
+
+// Decoded vertices of a draw call whose source data has stayed the same for a while,
+// uploaded to GL buffers so they can be drawn again without decoding.
+class VertexArrayInfo {
+public:
+	VertexArrayInfo() {
+		status = VAI_NEW;
+		hash = 0;
+		vbo = 0;
+		ebo = 0;
+		indexLowerBound = 0;
+		indexUpperBound = -1;
+		numVerts = 0;
+		numIndices = 0;
+		prim = -1;
+		numChanges = 0;
+		numFrames = 0;
+		lastFrame = 0;
+		lastInvalidation = 0;
+	}
+	~VertexArrayInfo();
+
+	enum Status {
+		VAI_NEW,
+		VAI_HASHING,
+		VAI_RELIABLE,  // Source data is stable, drawn from vbo/ebo.
+		VAI_UNRELIABLE,  // Changes too often to be worth caching.
+	};
+
+	Status status;
+	u64 hash;
+
+	u32 vbo;
+	u32 ebo;
+
+	// Source index range the hash covers.
+	int indexLowerBound;
+	int indexUpperBound;
+
+	// Valid when the buffers are.
+	int numVerts;
+	int numIndices;
+	int prim;
+
+	int numChanges;
+	int numFrames;
+	int lastFrame;
+	// TransformDrawEngine's invalidation count when the hash was last checked.
+	u32 lastInvalidation;
+};
+
+// One SubmitPrim, recorded so decoding can be skipped if it hits the vertex cache.
+struct DeferredDrawCall {
+	void *verts;
+	void *inds;
+	u32 vertType;
+	int indexType;
+	int prim;
+	int vertexCount;
+};
+
 // Handles transform, lighting and drawing.
 class TransformDrawEngine {
 public:
@@ -36,16 +132,48 @@ public:
 	void SetShaderManager(ShaderManager *shaderManager) {
 		shaderManager_ = shaderManager;
 	}
+	int NumVertexDecoders() const { return (int)decoderMap_.size(); }
+	void ClearVertexDecoders();
+	void ClearVertexCache(bool deleteThem);
+	void DecimateVertexCache();
+	// Memory may have been written behind our back (dcache writeback etc.), recheck cached vertices.
+	void NotifyMemoryInvalidated() { invalidations_++; }
 
 private:
+	VertexDecoder *GetVertexDecoder(u32 vtype);
+	void DecodeVerts();
+	bool CanCacheDrawCall(const DeferredDrawCall &dc) const;
+	u64 ComputeHash(const DeferredDrawCall &dc, int lowerBound, int upperBound) const;
+	void BuildVertexArray(VertexArrayInfo *vai);
+	void DrawPatch(const PatchDesc &desc);
+	void ClearPatchCache();
 	void SoftwareTransformAndDraw(int prim, u8 *decoded, LinkedShader *program, int vertexCount, u32 vertexType, void *inds, int indexType, const DecVtxFormat &decVtxFormat, int maxIndex);
 
 	// Vertex collector state
 	IndexGenerator indexGen;
 	int numVerts;
+	int prevPrim_;
+
+	// Draw calls not yet decoded into the collector buffers.
+	enum { MAX_DEFERRED_DRAW_CALLS = 128 };
+	DeferredDrawCall drawCalls[MAX_DEFERRED_DRAW_CALLS];
+	int numDrawCalls;
+	int decodeCounter_;
+	int lastLowerBound_;
+	int lastUpperBound_;
+
+	std::map<VertexArrayKey, VertexArrayInfo *> vai_;
+	u32 invalidations_;
+
+	// Tessellated bezier and spline patches.
+	std::map<PatchKey, PatchMesh *> patches_;
+	// For patches that can't be cached.
+	PatchMesh patchScratch_;
 
 	// Vertex collector buffers
-	VertexDecoder dec;
+	VertexDecoder *dec_;
+	VertexDecoderJitCache *decJitCache_;
+	std::map<u32, VertexDecoder *> decoderMap_;
 	u32 lastVType;
 	u8 *decoded;
 	u16 *decIndex;
@@ -94,3 +222,7 @@ struct Color4 {
 		a = (col&0xff)/255.0f;
 	}
 };
+
+// Step 1 of the software transform: transforms, lights and generates texture coordinates
+// for decoded vertices 0 to count - 1, from gstate. Doesn't need a GL context.
+void SoftwareTransformVertices(TransformedVertex *out, u8 *decoded, const DecVtxFormat &decVtxFormat, u32 vertType, int count);
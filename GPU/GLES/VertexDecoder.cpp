@@ -22,6 +22,10 @@
 
 #include "VertexDecoder.h"
 
+#if defined(_M_IX86) || defined(_M_X64)
+#include "../../Common/ABI.h"
+#endif
+
 void PrintDecodedVertex(VertexReader &vtx) {
 	if (vtx.hasNormal())
 	{
@@ -176,7 +180,7 @@ void VertexDecoder::Step_Color565() const
 	c[0] = Convert5To8(cdata & 0x1f);
 	c[1] = Convert6To8((cdata>>5) & 0x3f);
 	c[2] = Convert5To8((cdata>>11) & 0x1f);
-	c[3] = 1.0f;
+	c[3] = 255;
 }
 
 void VertexDecoder::Step_Color5551() const
@@ -514,7 +518,7 @@ const StepFunction posstep_through[4] = {
 };
 
 
-void VertexDecoder::SetVertexType(u32 fmt) {
+void VertexDecoder::SetVertexType(u32 fmt, VertexDecoderJitCache *jitCache) {
 	fmt_ = fmt;
 	throughmode = (fmt & GE_VTYPE_THROUGH) != 0;
 	numSteps_ = 0;
@@ -643,6 +647,12 @@ void VertexDecoder::SetVertexType(u32 fmt) {
 	onesize_ = size;
 	size *= morphcount;
 	DEBUG_LOG(G3D,"SVT : size = %i, aligned to biggest %i", size, biggest);
+
+#if defined(_M_IX86) || defined(_M_X64)
+	jitted_ = jitCache ? jitCache->Compile(*this) : 0;
+#else
+	jitted_ = 0;
+#endif
 }
 
 void VertexDecoder::DecodeVerts(u8 *decodedptr, const void *verts, const void *inds, int prim, int count, int *indexLowerBound, int *indexUpperBound) const {
@@ -676,6 +686,12 @@ void VertexDecoder::DecodeVerts(u8 *decodedptr, const void *verts, const void *i
 	// Decode the vertices within the found bounds, once each
 	decoded_ = decodedptr;  // + lowerBound * decFmt.stride;
 	ptr_ = (const u8*)verts + lowerBound * size;
+	if (jitted_) {
+		if (upperBound >= lowerBound)
+			jitted_(ptr_, decoded_, upperBound - lowerBound + 1);
+		return;
+	}
+
 	for (int index = lowerBound; index <= upperBound; index++) {
 		for (int i = 0; i < numSteps_; i++) {
 			((*this).*steps_[i])();
@@ -685,23 +701,378 @@ void VertexDecoder::DecodeVerts(u8 *decodedptr, const void *verts, const void *i
 	}
 }
 
-// TODO: Does not support morphs, skinning etc.
-u32 VertexDecoder::InjectUVs(u8 *decoded, const void *verts, float *customuv, int count) const {
-	u32 customVertType = (gstate.vertType & ~GE_VTYPE_TC_MASK) | GE_VTYPE_TC_FLOAT;
-	VertexDecoder decOut;
-	decOut.SetVertexType(customVertType);
-	
-	const u8 *inp = (const u8 *)verts;
-	u8 *out = decoded;
-	for (int i = 0; i < count; i++) {
-		if (pos) memcpy(out + decOut.posoff, inp + posoff, possize[pos]);
-		if (nrm) memcpy(out + decOut.nrmoff, inp + nrmoff, nrmsize[pos]);
-		if (col) memcpy(out + decOut.coloff, inp + coloff, colsize[pos]);
-		// Ignore others for now, this is all we need for puzbob.
-		// Inject!
-		memcpy(out + decOut.tcoff, &customuv[i * 2], tcsize[decOut.tc]);
-		inp += this->onesize_;
-		out += decOut.onesize_;
+#if defined(_M_IX86) || defined(_M_X64)
+
+using namespace Gen;
+
+// The jitted loop keeps these in registers.  Only non-volatile GPRs are used for
+// pointers, they're saved in the prologue.  XMM6+ are callee-saved on Win64, so stay below.
+static const X64Reg srcReg = RSI;
+static const X64Reg dstReg = RDI;
+static const X64Reg counterReg = RBX;
+static const X64Reg tempReg1 = RAX;
+static const X64Reg tempReg2 = RCX;
+static const X64Reg tempReg3 = RDX;
+
+static const X64Reg fpScratchReg = XMM0;
+static const X64Reg fpScratchReg2 = XMM1;
+static const X64Reg fpNormalMultReg = XMM4;
+static const X64Reg fpTexSizeReg = XMM5;
+
+// Each of these matches the arithmetic of the step it replaces, so results are identical.
+static const float GC_ALIGNED16(by128[4]) = {1.0f / 128.0f, 1.0f / 128.0f, 1.0f / 128.0f, 1.0f / 128.0f};
+static const float GC_ALIGNED16(by32768[4]) = {1.0f / 32768.0f, 1.0f / 32768.0f, 1.0f / 32768.0f, 1.0f / 32768.0f};
+static const float GC_ALIGNED16(normalS8Div[4]) = {127.0f, 127.0f, 127.0f, 127.0f};
+static const float GC_ALIGNED16(normalS16Div[4]) = {32767.0f, 32767.0f, 32767.0f, 32767.0f};
+static const float GC_ALIGNED16(posS8Mult[4]) = {1.0f / 127.0f, 1.0f / 127.0f, 1.0f / 127.0f, 1.0f / 127.0f};
+static const float GC_ALIGNED16(posS16Mult[4]) = {1.0f / 32767.0f, 1.0f / 32767.0f, 1.0f / 32767.0f, 1.0f / 32767.0f};
+#ifdef _M_X64
+static const int ptrBits = 64;
+#else
+static const int ptrBits = 32;
+#endif
+
+static const float plusOne = 1.0f;
+static const float minusOne = -1.0f;
+
+typedef void (VertexDecoderJitCache::*JitStepFunction)();
+
+struct JitLookup {
+	StepFunction func;
+	JitStepFunction jitFunc;
+};
+
+static const JitLookup jitLookup[] = {
+	{&VertexDecoder::Step_WeightsU8, &VertexDecoderJitCache::Jit_WeightsU8},
+	{&VertexDecoder::Step_WeightsU16, &VertexDecoderJitCache::Jit_WeightsU16},
+	{&VertexDecoder::Step_WeightsFloat, &VertexDecoderJitCache::Jit_WeightsFloat},
+
+	{&VertexDecoder::Step_TcU8, &VertexDecoderJitCache::Jit_TcU8},
+	{&VertexDecoder::Step_TcU16, &VertexDecoderJitCache::Jit_TcU16},
+	{&VertexDecoder::Step_TcFloat, &VertexDecoderJitCache::Jit_TcFloat},
+	{&VertexDecoder::Step_TcU16Through, &VertexDecoderJitCache::Jit_TcU16Through},
+	{&VertexDecoder::Step_TcFloatThrough, &VertexDecoderJitCache::Jit_TcFloatThrough},
+
+	{&VertexDecoder::Step_Color565, &VertexDecoderJitCache::Jit_Color565},
+	{&VertexDecoder::Step_Color5551, &VertexDecoderJitCache::Jit_Color5551},
+	{&VertexDecoder::Step_Color4444, &VertexDecoderJitCache::Jit_Color4444},
+	{&VertexDecoder::Step_Color8888, &VertexDecoderJitCache::Jit_Color8888},
+
+	{&VertexDecoder::Step_NormalS8, &VertexDecoderJitCache::Jit_NormalS8},
+	{&VertexDecoder::Step_NormalS16, &VertexDecoderJitCache::Jit_NormalS16},
+	{&VertexDecoder::Step_NormalFloat, &VertexDecoderJitCache::Jit_NormalFloat},
+
+	{&VertexDecoder::Step_PosS8, &VertexDecoderJitCache::Jit_PosS8},
+	{&VertexDecoder::Step_PosS16, &VertexDecoderJitCache::Jit_PosS16},
+	{&VertexDecoder::Step_PosFloat, &VertexDecoderJitCache::Jit_PosFloat},
+	{&VertexDecoder::Step_PosS8Through, &VertexDecoderJitCache::Jit_PosS8Through},
+	{&VertexDecoder::Step_PosS16Through, &VertexDecoderJitCache::Jit_PosS16Through},
+	{&VertexDecoder::Step_PosFloatThrough, &VertexDecoderJitCache::Jit_PosFloatThrough},
+};
+
+// A decoder is a few hundred bytes at most.
+#define VERTEXJIT_CODE_SIZE (1024 * 1024)
+#define VERTEXJIT_MAX_DECODER_SIZE 4096
+
+VertexDecoderJitCache::VertexDecoderJitCache() : dec_(0) {
+	AllocCodeSpace(VERTEXJIT_CODE_SIZE);
+}
+
+bool VertexDecoderJitCache::IsFull() const {
+	return GetSpaceLeft() < VERTEXJIT_MAX_DECODER_SIZE;
+}
+
+void VertexDecoderJitCache::Clear() {
+	ClearCodeSpace();
+}
+
+JittedVertexDecoder VertexDecoderJitCache::Compile(const VertexDecoder &dec) {
+	if (IsFull()) {
+		ERROR_LOG(G3D, "Vertex decoder JIT cache full");
+		return 0;
+	}
+
+	dec_ = &dec;
+	const u8 *start = AlignCode16();
+
+	PUSH(counterReg);
+	PUSH(srcReg);
+	PUSH(dstReg);
+
+#ifdef _M_IX86
+	// Three pushes plus the return address.
+	MOV(32, R(srcReg), MDisp(ESP, 16 + 0));
+	MOV(32, R(dstReg), MDisp(ESP, 16 + 4));
+	MOV(32, R(counterReg), MDisp(ESP, 16 + 8));
+#else
+	// The params overlap srcReg / dstReg on some ABIs, so go through a temp.
+	MOV(32, R(counterReg), R(ABI_PARAM3));
+	MOV(64, R(tempReg1), R(ABI_PARAM1));
+	MOV(64, R(dstReg), R(ABI_PARAM2));
+	MOV(64, R(srcReg), R(tempReg1));
+#endif
+
+	// These are constant over a draw, so read them once rather than per vertex.
+	if (dec.nrm && dec.morphcount == 1) {
+		MOVSS(fpNormalMultReg, M((void *)&plusOne));
+		TEST(32, M(&gstate.reversenormals), Imm32(0xFFFFFF));
+		FixupBranch skip = J_CC(CC_Z);
+		MOVSS(fpNormalMultReg, M((void *)&minusOne));
+		SetJumpTarget(skip);
+		SHUFPS(fpNormalMultReg, R(fpNormalMultReg), 0x00);
+	}
+	if (dec.tc && dec.throughmode) {
+		// curTextureWidth and curTextureHeight are next to each other.
+		MOVQ_xmm(fpTexSizeReg, M(&gstate_c.curTextureWidth));
+		CVTDQ2PS(fpTexSizeReg, R(fpTexSizeReg));
+		// Repeat them so the unused lanes don't divide by zero.
+		SHUFPS(fpTexSizeReg, R(fpTexSizeReg), 0x44);
+	}
+
+	const u8 *loopStart = GetCodePtr();
+	for (int i = 0; i < dec.numSteps_; i++) {
+		if (!CompileStep(dec, i)) {
+			// Can't jit this one, throw away what we've got.
+			SetCodePtr(const_cast<u8 *>(start));
+			dec_ = 0;
+			return 0;
+		}
+	}
+
+	ADD(ptrBits, R(srcReg), Imm32(dec.VertexSize()));
+	ADD(ptrBits, R(dstReg), Imm32(dec.decFmt.stride));
+	SUB(32, R(counterReg), Imm8(1));
+	J_CC(CC_NZ, loopStart, true);
+
+	POP(dstReg);
+	POP(srcReg);
+	POP(counterReg);
+	RET();
+
+	dec_ = 0;
+	return (JittedVertexDecoder)start;
+}
+
+bool VertexDecoderJitCache::CompileStep(const VertexDecoder &dec, int step) {
+	for (size_t i = 0; i < ARRAY_SIZE(jitLookup); i++) {
+		if (dec.steps_[step] == jitLookup[i].func) {
+			((*this).*jitLookup[i].jitFunc)();
+			return true;
+		}
+	}
+	return false;
+}
+
+void VertexDecoderJitCache::Jit_WeightsU8() {
+	for (int j = 0; j < dec_->nweights; j++) {
+		MOVZX(32, 8, tempReg1, MDisp(srcReg, j));
+		MOVD_xmm(fpScratchReg, R(tempReg1));
+		CVTDQ2PS(fpScratchReg, R(fpScratchReg));
+		MULSS(fpScratchReg, M((void *)by128));
+		MOVSS(MDisp(dstReg, dec_->decFmt.w0off + j * 4), fpScratchReg);
+	}
+}
+
+void VertexDecoderJitCache::Jit_WeightsU16() {
+	for (int j = 0; j < dec_->nweights; j++) {
+		MOVZX(32, 16, tempReg1, MDisp(srcReg, j * 2));
+		MOVD_xmm(fpScratchReg, R(tempReg1));
+		CVTDQ2PS(fpScratchReg, R(fpScratchReg));
+		MULSS(fpScratchReg, M((void *)by32768));
+		MOVSS(MDisp(dstReg, dec_->decFmt.w0off + j * 4), fpScratchReg);
+	}
+}
+
+void VertexDecoderJitCache::Jit_WeightsFloat() {
+	for (int j = 0; j < dec_->nweights; j++) {
+		MOV(32, R(tempReg1), MDisp(srcReg, j * 4));
+		MOV(32, MDisp(dstReg, dec_->decFmt.w0off + j * 4), R(tempReg1));
+	}
+}
+
+void VertexDecoderJitCache::Jit_TcU8() {
+	MOVZX(32, 16, tempReg1, MDisp(srcReg, dec_->tcoff));
+	MOVD_xmm(fpScratchReg, R(tempReg1));
+	PXOR(fpScratchReg2, R(fpScratchReg2));
+	PUNPCKLBW(fpScratchReg, R(fpScratchReg2));
+	PUNPCKLWD(fpScratchReg, R(fpScratchReg2));
+	CVTDQ2PS(fpScratchReg, R(fpScratchReg));
+	MULPS(fpScratchReg, M((void *)by128));
+	MOVQ_xmm(MDisp(dstReg, dec_->decFmt.uvoff), fpScratchReg);
+}
+
+void VertexDecoderJitCache::Jit_TcU16() {
+	MOVD_xmm(fpScratchReg, MDisp(srcReg, dec_->tcoff));
+	PXOR(fpScratchReg2, R(fpScratchReg2));
+	PUNPCKLWD(fpScratchReg, R(fpScratchReg2));
+	CVTDQ2PS(fpScratchReg, R(fpScratchReg));
+	MULPS(fpScratchReg, M((void *)by32768));
+	MOVQ_xmm(MDisp(dstReg, dec_->decFmt.uvoff), fpScratchReg);
+}
+
+void VertexDecoderJitCache::Jit_TcFloat() {
+	MOV(32, R(tempReg1), MDisp(srcReg, dec_->tcoff));
+	MOV(32, R(tempReg2), MDisp(srcReg, dec_->tcoff + 4));
+	MOV(32, MDisp(dstReg, dec_->decFmt.uvoff), R(tempReg1));
+	MOV(32, MDisp(dstReg, dec_->decFmt.uvoff + 4), R(tempReg2));
+}
+
+void VertexDecoderJitCache::Jit_TcU16Through() {
+	MOVD_xmm(fpScratchReg, MDisp(srcReg, dec_->tcoff));
+	PXOR(fpScratchReg2, R(fpScratchReg2));
+	PUNPCKLWD(fpScratchReg, R(fpScratchReg2));
+	CVTDQ2PS(fpScratchReg, R(fpScratchReg));
+	DIVPS(fpScratchReg, R(fpTexSizeReg));
+	MOVQ_xmm(MDisp(dstReg, dec_->decFmt.uvoff), fpScratchReg);
+}
+
+void VertexDecoderJitCache::Jit_TcFloatThrough() {
+	MOVQ_xmm(fpScratchReg, MDisp(srcReg, dec_->tcoff));
+	DIVPS(fpScratchReg, R(fpTexSizeReg));
+	MOVQ_xmm(MDisp(dstReg, dec_->decFmt.uvoff), fpScratchReg);
+}
+
+// Takes the field at shift from the color in tempReg1, widens it to 8 bits the same
+// way as Convert4To8 / Convert5To8 / Convert6To8, and ORs it into byte outByte of tempReg3.
+void VertexDecoderJitCache::Jit_ExpandColorBits(int shift, int bits, int outByte) {
+	MOV(32, R(tempReg2), R(tempReg1));
+	if (shift != 0)
+		SHR(32, R(tempReg2), Imm8(shift));
+	AND(32, R(tempReg2), Imm32((1 << bits) - 1));
+	// The two halves of (v << (8 - bits)) | (v >> (2 * bits - 8)) don't overlap,
+	// so this is v * (2^bits + 1) >> (2 * bits - 8).
+	IMUL(32, tempReg2, R(tempReg2), Imm32((1 << bits) + 1));
+	if (2 * bits - 8 > 0)
+		SHR(32, R(tempReg2), Imm8(2 * bits - 8));
+	if (outByte != 0)
+		SHL(32, R(tempReg2), Imm8(outByte * 8));
+	OR(32, R(tempReg3), R(tempReg2));
+}
+
+void VertexDecoderJitCache::Jit_Color565() {
+	MOVZX(32, 16, tempReg1, MDisp(srcReg, dec_->coloff));
+	MOV(32, R(tempReg3), Imm32(0xFF000000));
+	Jit_ExpandColorBits(0, 5, 0);
+	Jit_ExpandColorBits(5, 6, 1);
+	Jit_ExpandColorBits(11, 5, 2);
+	MOV(32, MDisp(dstReg, dec_->decFmt.c0off), R(tempReg3));
+}
+
+void VertexDecoderJitCache::Jit_Color5551() {
+	MOVZX(32, 16, tempReg1, MDisp(srcReg, dec_->coloff));
+	// Alpha is all or nothing: 0 or -1, shifted into the top byte.
+	MOV(32, R(tempReg3), R(tempReg1));
+	SHR(32, R(tempReg3), Imm8(15));
+	NEG(32, R(tempReg3));
+	SHL(32, R(tempReg3), Imm8(24));
+	Jit_ExpandColorBits(0, 5, 0);
+	Jit_ExpandColorBits(5, 5, 1);
+	Jit_ExpandColorBits(10, 5, 2);
+	MOV(32, MDisp(dstReg, dec_->decFmt.c0off), R(tempReg3));
+}
+
+void VertexDecoderJitCache::Jit_Color4444() {
+	MOVZX(32, 16, tempReg1, MDisp(srcReg, dec_->coloff));
+	XOR(32, R(tempReg3), R(tempReg3));
+	for (int j = 0; j < 4; j++)
+		Jit_ExpandColorBits(j * 4, 4, j);
+	MOV(32, MDisp(dstReg, dec_->decFmt.c0off), R(tempReg3));
+}
+
+void VertexDecoderJitCache::Jit_Color8888() {
+	MOV(32, R(tempReg1), MDisp(srcReg, dec_->coloff));
+	MOV(32, MDisp(dstReg, dec_->decFmt.c0off), R(tempReg1));
+}
+
+// Loads three s8 as s32 into the lanes of fpScratchReg, without reading past them.
+void VertexDecoderJitCache::Jit_LoadS8x3(int off) {
+	MOVZX(32, 16, tempReg1, MDisp(srcReg, off));
+	MOVZX(32, 8, tempReg2, MDisp(srcReg, off + 2));
+	SHL(32, R(tempReg2), Imm8(16));
+	OR(32, R(tempReg1), R(tempReg2));
+	MOVD_xmm(fpScratchReg, R(tempReg1));
+	PUNPCKLBW(fpScratchReg, R(fpScratchReg));
+	PUNPCKLWD(fpScratchReg, R(fpScratchReg));
+	PSRAD(fpScratchReg, 24);
+}
+
+// Same for three s16.
+void VertexDecoderJitCache::Jit_LoadS16x3(int off) {
+	MOVD_xmm(fpScratchReg, MDisp(srcReg, off));
+	MOVZX(32, 16, tempReg1, MDisp(srcReg, off + 4));
+	MOVD_xmm(fpScratchReg2, R(tempReg1));
+	PUNPCKLDQ(fpScratchReg, R(fpScratchReg2));
+	PUNPCKLWD(fpScratchReg, R(fpScratchReg));
+	PSRAD(fpScratchReg, 16);
+}
+
+// Stores the low three floats of fpScratchReg.  Clobbers fpScratchReg.
+void VertexDecoderJitCache::Jit_StoreFloat3(int off) {
+	MOVQ_xmm(MDisp(dstReg, off), fpScratchReg);
+	// Bring lane 2 down to lane 0.
+	SHUFPS(fpScratchReg, R(fpScratchReg), 0xFE);
+	MOVSS(MDisp(dstReg, off + 8), fpScratchReg);
+}
+
+void VertexDecoderJitCache::Jit_NormalS8() {
+	Jit_LoadS8x3(dec_->nrmoff);
+	CVTDQ2PS(fpScratchReg, R(fpScratchReg));
+	DIVPS(fpScratchReg, M((void *)normalS8Div));
+	MULPS(fpScratchReg, R(fpNormalMultReg));
+	Jit_StoreFloat3(dec_->decFmt.nrmoff);
+}
+
+void VertexDecoderJitCache::Jit_NormalS16() {
+	Jit_LoadS16x3(dec_->nrmoff);
+	CVTDQ2PS(fpScratchReg, R(fpScratchReg));
+	DIVPS(fpScratchReg, M((void *)normalS16Div));
+	MULPS(fpScratchReg, R(fpNormalMultReg));
+	Jit_StoreFloat3(dec_->decFmt.nrmoff);
+}
+
+void VertexDecoderJitCache::Jit_NormalFloat() {
+	for (int j = 0; j < 3; j++) {
+		MOVSS(fpScratchReg, MDisp(srcReg, dec_->nrmoff + j * 4));
+		MULSS(fpScratchReg, R(fpNormalMultReg));
+		MOVSS(MDisp(dstReg, dec_->decFmt.nrmoff + j * 4), fpScratchReg);
+	}
+}
+
+void VertexDecoderJitCache::Jit_PosS8() {
+	Jit_LoadS8x3(dec_->posoff);
+	CVTDQ2PS(fpScratchReg, R(fpScratchReg));
+	MULPS(fpScratchReg, M((void *)posS8Mult));
+	Jit_StoreFloat3(dec_->decFmt.posoff);
+}
+
+void VertexDecoderJitCache::Jit_PosS16() {
+	Jit_LoadS16x3(dec_->posoff);
+	CVTDQ2PS(fpScratchReg, R(fpScratchReg));
+	MULPS(fpScratchReg, M((void *)posS16Mult));
+	Jit_StoreFloat3(dec_->decFmt.posoff);
+}
+
+void VertexDecoderJitCache::Jit_PosFloat() {
+	for (int j = 0; j < 3; j++) {
+		MOV(32, R(tempReg1), MDisp(srcReg, dec_->posoff + j * 4));
+		MOV(32, MDisp(dstReg, dec_->decFmt.posoff + j * 4), R(tempReg1));
 	}
-	return customVertType;
 }
+
+void VertexDecoderJitCache::Jit_PosS8Through() {
+	Jit_LoadS8x3(dec_->posoff);
+	CVTDQ2PS(fpScratchReg, R(fpScratchReg));
+	Jit_StoreFloat3(dec_->decFmt.posoff);
+}
+
+void VertexDecoderJitCache::Jit_PosS16Through() {
+	Jit_LoadS16x3(dec_->posoff);
+	CVTDQ2PS(fpScratchReg, R(fpScratchReg));
+	Jit_StoreFloat3(dec_->decFmt.posoff);
+}
+
+void VertexDecoderJitCache::Jit_PosFloatThrough() {
+	Jit_PosFloat();
+}
+
+#endif
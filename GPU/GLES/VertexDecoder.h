@@ -21,6 +21,10 @@
 #include "../Globals.h"
 #include "base/basictypes.h"
 
+#if defined(_M_IX86) || defined(_M_X64)
+#include "../../Common/x64Emitter.h"
+#endif
+
 // DecVtxFormat - vertex formats for PC
 // Kind of like a D3D VertexDeclaration.
 // Can write code to easily bind these using OpenGL, or read these manually.
@@ -62,9 +66,13 @@ struct TransformedVertex
 DecVtxFormat GetTransformedVtxFormat(const DecVtxFormat &fmt);
 
 class VertexDecoder;
+class VertexDecoderJitCache;
 
 typedef void (VertexDecoder::*StepFunction)() const;
 
+// Decodes count vertices from src to dst, same as running the steps for each one.
+typedef void (*JittedVertexDecoder)(const u8 *src, u8 *dst, int count);
+
 
 // Right now
 //   - only contains computed information
@@ -72,7 +80,7 @@ typedef void (VertexDecoder::*StepFunction)() const;
 // Future TODO
 //   - should be cached, not recreated every time
 //   - will compile into list of called functions
-//   - will compile into lighting fast specialized x86 and ARM
+//   - will compile into lighting fast specialized ARM (x86 is done, see VertexDecoderJitCache)
 //   - will not bother translating components that can be read directly
 //     by OpenGL ES. Will still have to translate 565 colors and things
 //     like that. DecodedVertex will not be a fixed struct. Will have to
@@ -80,18 +88,16 @@ typedef void (VertexDecoder::*StepFunction)() const;
 class VertexDecoder
 {
 public:
-	VertexDecoder() : coloff(0), nrmoff(0), posoff(0) {}
+	VertexDecoder() : coloff(0), nrmoff(0), posoff(0), jitted_(0) {}
 	~VertexDecoder() {}
 
-	void SetVertexType(u32 vtype);
+	// If jitCache is given, also tries to compile the steps to native code.
+	void SetVertexType(u32 vtype, VertexDecoderJitCache *jitCache = 0);
 	u32 VertexType() const { return fmt_; }
 	const DecVtxFormat &GetDecVtxFmt() { return decFmt; }
 
 	void DecodeVerts(u8 *decoded, const void *verts, const void *inds, int prim, int count, int *indexLowerBound, int *indexUpperBound) const;
 
-	// This could be easily generalized to inject any one component. Don't know another use for it though.
-	u32 InjectUVs(u8 *decoded, const void *verts, float *customuv, int count) const;
-
 	bool hasColor() const { return col != 0; }
 	int VertexSize() const { return size; }
 
@@ -170,8 +176,64 @@ public:
 	int idx;
 	int morphcount;
 	int nweights;
+
+	// Null if the steps couldn't be compiled, they are then run one by one.
+	JittedVertexDecoder jitted_;
 };
 
+#if defined(_M_IX86) || defined(_M_X64)
+
+// Compiles the decoding steps of a vertex format into a specialized loop.
+// The owner keeps the results around, see TransformDrawEngine::GetVertexDecoder.
+class VertexDecoderJitCache : public Gen::XCodeBlock
+{
+public:
+	VertexDecoderJitCache();
+
+	// Returns null if some step can't be compiled (morphing, currently.)
+	JittedVertexDecoder Compile(const VertexDecoder &dec);
+	// Must be cleared before compiling more once full.  That invalidates everything compiled.
+	bool IsFull() const;
+	void Clear();
+
+	void Jit_WeightsU8();
+	void Jit_WeightsU16();
+	void Jit_WeightsFloat();
+
+	void Jit_TcU8();
+	void Jit_TcU16();
+	void Jit_TcFloat();
+	void Jit_TcU16Through();
+	void Jit_TcFloatThrough();
+
+	void Jit_Color565();
+	void Jit_Color5551();
+	void Jit_Color4444();
+	void Jit_Color8888();
+
+	void Jit_NormalS8();
+	void Jit_NormalS16();
+	void Jit_NormalFloat();
+
+	void Jit_PosS8();
+	void Jit_PosS16();
+	void Jit_PosFloat();
+	void Jit_PosS8Through();
+	void Jit_PosS16Through();
+	void Jit_PosFloatThrough();
+
+private:
+	bool CompileStep(const VertexDecoder &dec, int i);
+	void Jit_LoadS8x3(int off);
+	void Jit_LoadS16x3(int off);
+	void Jit_StoreFloat3(int off);
+	void Jit_ExpandColorBits(int shift, int bits, int outByte);
+
+	const VertexDecoder *dec_;
+};
+
+#endif
+
 // Reads decoded vertex formats in a convenient way. For software transform and debugging.
 class VertexReader
 {
@@ -46,6 +46,9 @@ struct VertexShaderID
 	}
 };
 
+// Bump this whenever GenerateVertexShader changes, so cached shaders from older builds get dropped.
+#define VERTEX_SHADER_GEN_VERSION 1
+
 bool CanUseHardwareTransform(int prim);
 
 void ComputeVertexShaderID(VertexShaderID *id, int prim);
@@ -1,4 +1,7 @@
+#include "../Common/Atomic.h"
+#include "../Core/Config.h"
 #include "../Core/MemMap.h"
+#include "../Core/HLE/sceKernelInterrupt.h"
 #include "GeDisasm.h"
 #include "GPUCommon.h"
 #include "GPUState.h"
@@ -11,8 +14,22 @@ void init() {
 	dlIdGenerator = 1;
 }
 
+GPUCommon::~GPUCommon()
+{
+	if (thread_)
+	{
+		// The subclass is already gone, so the thread has to be idle by now (see ShutdownGfxState.)
+		threadQuit_ = true;
+		threadWork_.Set();
+		thread_->join();
+		delete thread_;
+		thread_ = NULL;
+	}
+}
+
 int GPUCommon::listStatus(int listid)
 {
+	SyncThread();
 	for(DisplayListQueue::iterator it(dlQueue.begin()); it != dlQueue.end(); ++it)
 	{
 		if(it->id == listid)
@@ -25,35 +42,141 @@ int GPUCommon::listStatus(int listid)
 
 u32 GPUCommon::EnqueueList(u32 listpc, u32 stall, int subIntrBase, bool head)
 {
-	DisplayList dl;
-	dl.id = dlIdGenerator++;
-	dl.pc = listpc & 0xFFFFFFF;
-	dl.stall = stall & 0xFFFFFFF;
-	dl.status = PSP_GE_LIST_QUEUED;
-	dl.subIntrBase = subIntrBase;
-	if(head)
-		dlQueue.push_front(dl);
-    else
-		dlQueue.push_back(dl);
-	ProcessDLQueue();
-	return dl.id;
+	if (!thread_ && g_Config.bSeparateGPUThread && SupportsThreading())
+		thread_ = new std::thread(&GPUCommon::ThreadMain, this);
+
+	GPUCommand cmd;
+	cmd.type = GPU_CMD_ENQUEUE;
+	cmd.listid = dlIdGenerator++;
+	cmd.pc = listpc;
+	cmd.stall = stall;
+	cmd.subIntrBase = subIntrBase;
+	cmd.head = head;
+	PushCommand(cmd);
+	return cmd.listid;
 }
 
 void GPUCommon::UpdateStall(int listid, u32 newstall)
 {
-	// this needs improvement....
-	for (DisplayListQueue::iterator iter = dlQueue.begin(); iter != dlQueue.end(); iter++)
+	GPUCommand cmd;
+	cmd.type = GPU_CMD_UPDATE_STALL;
+	cmd.listid = listid;
+	cmd.stall = newstall;
+	PushCommand(cmd);
+}
+
+void GPUCommon::RunCommand(const GPUCommand &cmd)
+{
+	if (cmd.type == GPU_CMD_ENQUEUE)
 	{
-		DisplayList &l = *iter;
-		if (l.id == listid)
+		DisplayList dl;
+		dl.id = cmd.listid;
+		dl.pc = cmd.pc & 0xFFFFFFF;
+		dl.stall = cmd.stall & 0xFFFFFFF;
+		dl.status = PSP_GE_LIST_QUEUED;
+		dl.subIntrBase = cmd.subIntrBase;
+		if(cmd.head)
+			dlQueue.push_front(dl);
+		else
+			dlQueue.push_back(dl);
+	}
+	else
+	{
+		// this needs improvement....
+		for (DisplayListQueue::iterator iter = dlQueue.begin(); iter != dlQueue.end(); iter++)
 		{
-			l.stall = newstall & 0xFFFFFFF;
+			DisplayList &l = *iter;
+			if (l.id == cmd.listid)
+			{
+				l.stall = cmd.stall & 0xFFFFFFF;
+			}
 		}
 	}
-	
+
 	ProcessDLQueue();
 }
 
+// Without a GPU thread the command simply runs here, as before.
+void GPUCommon::PushCommand(const GPUCommand &cmd)
+{
+	if (!thread_)
+	{
+		RunCommand(cmd);
+		return;
+	}
+
+	u32 write = ringWrite_;
+	while (write - Common::AtomicLoadAcquire(ringRead_) >= GPU_RING_SIZE)
+		threadDone_.Wait();
+
+	ring_[write & (GPU_RING_SIZE - 1)] = cmd;
+	Common::AtomicStoreRelease(ringWrite_, write + 1);
+	threadWork_.Set();
+}
+
+void GPUCommon::ThreadMain(GPUCommon *gpu)
+{
+	Common::SetCurrentThreadName("GPU");
+
+	u32 read = gpu->ringRead_;
+	while (true)
+	{
+		gpu->threadWork_.Wait();
+		if (gpu->threadQuit_)
+			break;
+
+		// The read counter only moves once a command is done, so SyncThread can watch it.
+		while (read != Common::AtomicLoadAcquire(gpu->ringWrite_))
+		{
+			gpu->RunCommand(gpu->ring_[read & (GPU_RING_SIZE - 1)]);
+			Common::AtomicStoreRelease(gpu->ringRead_, ++read);
+			gpu->threadDone_.Set();
+		}
+	}
+}
+
+void GPUCommon::SyncThread()
+{
+	if (!thread_)
+		return;
+	while (Common::AtomicLoadAcquire(ringRead_) != ringWrite_)
+		threadDone_.Wait();
+}
+
+void GPUCommon::TriggerListInterrupt(int subIntr, int arg)
+{
+	if (!thread_)
+	{
+		RaiseListInterrupt(PSP_INTR_HLE, subIntr, arg);
+		return;
+	}
+
+	QueuedInterrupt intr;
+	intr.subIntr = subIntr;
+	intr.arg = arg;
+	std::lock_guard<std::mutex> guard(interruptLock_);
+	queuedInterrupts_.push_back(intr);
+}
+
+void GPUCommon::ProcessEvents(int intrType)
+{
+	if (!thread_)
+		return;
+
+	std::vector<QueuedInterrupt> intrs;
+	{
+		std::lock_guard<std::mutex> guard(interruptLock_);
+		intrs.swap(queuedInterrupts_);
+	}
+	for (size_t i = 0; i < intrs.size(); i++)
+		RaiseListInterrupt(intrType, intrs[i].subIntr, intrs[i].arg);
+}
+
+void GPUCommon::RaiseListInterrupt(int intrType, int subIntr, int arg)
+{
+	__TriggerInterruptWithArg(intrType, PSP_GE_INTR, subIntr, arg);
+}
+
 bool GPUCommon::InterpretList(DisplayList &list)
 {
 	currentList = &list;
@@ -62,9 +185,9 @@ bool GPUCommon::InterpretList(DisplayList &list)
 	u32 op = 0;
 	prev = 0;
 	finished = false;
+	list.status = PSP_GE_LIST_DRAWING;
 	while (!finished)
 	{
-		list.status = PSP_GE_LIST_DRAWING;
 		if (!Memory::IsValidAddress(list.pc)) {
 			ERROR_LOG(G3D, "DL PC = %08x WTF!!!!", list.pc);
 			return true;
@@ -77,17 +200,20 @@ bool GPUCommon::InterpretList(DisplayList &list)
 		op = Memory::ReadUnchecked_U32(list.pc); //read from memory
 		u32 cmd = op >> 24;
 		u32 diff = op ^ gstate.cmdmem[cmd];
-		PreExecuteOp(op, diff);
 		// TODO: Add a compiler flag to remove stuff like this at very-final build time.
 		if (dumpThisFrame_) {
 			char temp[256];
 			GeDisassembleOp(list.pc, op, prev, temp);
 			NOTICE_LOG(G3D, "%s", temp);
 		}
-		gstate.cmdmem[cmd] = op;	 // crashes if I try to put the whole op there??
-		
-		ExecuteOp(op, diff);
-		
+		// Much of a typical list rewrites registers with the values they already hold.
+		if (diff != 0 || (commandFlags_[cmd] & FLAG_EXECUTE))
+		{
+			PreExecuteOp(op, diff);
+			gstate.cmdmem[cmd] = op;	 // crashes if I try to put the whole op there??
+			ExecuteOp(op, diff);
+		}
+
 		list.pc += 4;
 		prev = op;
 	}
@@ -121,6 +247,7 @@ void GPUCommon::PreExecuteOp(u32 op, u32 diff) {
 }
 
 void GPUCommon::DoState(PointerWrap &p) {
+	SyncThread();
 	p.Do(dlIdGenerator);
 	p.Do<DisplayList>(dlQueue);
 	p.DoMarker("GPUCommon");
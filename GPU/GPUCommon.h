@@ -1,7 +1,23 @@
 #pragma once
 
+#include <vector>
+
+#include "../Common/Thread.h"
 #include "GPUInterface.h"
 
+// Per-command flags in GPUCommon::commandFlags_.
+enum {
+	// Run ExecuteOp even when the command rewrites the value already in the register.
+	// Without it, InterpretList skips redundant writes entirely.
+	FLAG_EXECUTE = 1,
+	// The rest are up to the backend.
+	FLAG_FLUSHBEFORE = 2,
+	FLAG_FLUSHBEFOREONCHANGE = 4,
+	// The data goes to the matrix slot selected by the matrix number register.
+	FLAG_FLUSHBEFOREONMATRIXCHANGE = 8,
+	FLAG_DIRTYTEXTURE = 16,
+};
+
 class GPUCommon : public GPUInterface
 {
 public:
@@ -10,8 +26,16 @@ public:
 		currentList(NULL),
 		stackptr(0),
 		dumpNextFrame_(false),
-		dumpThisFrame_(false)
-	{}
+		dumpThisFrame_(false),
+		thread_(NULL),
+		threadQuit_(false),
+		ringRead_(0),
+		ringWrite_(0)
+	{
+		// Backends that don't set up their own flags see every command, as before.
+		memset(commandFlags_, FLAG_EXECUTE, sizeof(commandFlags_));
+	}
+	virtual ~GPUCommon();
 
 	virtual void PreExecuteOp(u32 op, u32 diff);
 	virtual bool InterpretList(DisplayList &list);
@@ -19,11 +43,23 @@ public:
 	virtual void UpdateStall(int listid, u32 newstall);
 	virtual u32  EnqueueList(u32 listpc, u32 stall, int subIntrBase, bool head);
 	virtual int  listStatus(int listid);
+	virtual void SyncThread();
+	virtual void ProcessEvents(int intrType);
 	virtual void DoState(PointerWrap &p);
 
 protected:
 	typedef std::deque<DisplayList> DisplayListQueue;
 
+	// Whether ExecuteOp is safe to run off the emu thread. Backends that need a graphics
+	// context don't get a GPU thread, the context belongs to the emu thread. That's GLES
+	// for now, which would first need the context handed over to the GPU thread.
+	virtual bool SupportsThreading() const { return false; }
+
+	// Raises a GE list interrupt, or queues it for ProcessEvents when on the GPU thread.
+	void TriggerListInterrupt(int subIntr, int arg);
+	// Where list interrupts end up, always on the emu thread. Virtual so tests can watch them.
+	virtual void RaiseListInterrupt(int intrType, int subIntr, int arg);
+
 	int dlIdGenerator;
 	DisplayList *currentList;
 	DisplayListQueue dlQueue;
@@ -35,4 +71,48 @@ protected:
 
 	bool dumpNextFrame_;
 	bool dumpThisFrame_;
-};
\ No newline at end of file
+
+	u8 commandFlags_[256];
+
+private:
+	enum GPUCommandType {
+		GPU_CMD_ENQUEUE,
+		GPU_CMD_UPDATE_STALL,
+	};
+
+	// A list enqueue or stall update, recorded by the emu thread for the GPU thread.
+	struct GPUCommand {
+		GPUCommandType type;
+		int listid;
+		u32 pc;
+		u32 stall;
+		int subIntrBase;
+		bool head;
+	};
+
+	struct QueuedInterrupt {
+		int subIntr;
+		int arg;
+	};
+
+	// Must be a power of two.
+	enum { GPU_RING_SIZE = 256 };
+
+	void RunCommand(const GPUCommand &cmd);
+	void PushCommand(const GPUCommand &cmd);
+	static void ThreadMain(GPUCommon *gpu);
+
+	std::thread *thread_;
+	volatile bool threadQuit_;
+	Common::Event threadWork_;
+	Common::Event threadDone_;
+
+	// Single producer (the emu thread), single consumer (the GPU thread.) The counters
+	// only ever increase, and each is written by one side only.
+	GPUCommand ring_[GPU_RING_SIZE];
+	volatile u32 ringRead_;
+	volatile u32 ringWrite_;
+
+	std::mutex interruptLock_;
+	std::vector<QueuedInterrupt> queuedInterrupts_;
+};
@@ -60,6 +60,12 @@ public:
 	virtual bool InterpretList(DisplayList& list) = 0;
 	virtual int  listStatus(int listid) = 0;
 
+	// With a separate GPU thread, waits until it has run everything enqueued so far.
+	// Call before the CPU side reads anything the GPU writes, including gstate.
+	virtual void SyncThread() = 0;
+	// Raises the list interrupts the GPU thread has queued up, with the given trigger type.
+	virtual void ProcessEvents(int intrType) = 0;
+
 	// Framebuffer management
 	virtual void SetDisplayFramebuffer(u32 framebuf, u32 stride, int format) = 0;
 	virtual void BeginFrame() = 0;  // Can be a good place to draw the "memory" framebuffer for accelerated plugins
@@ -263,9 +263,13 @@ struct GPUStatistics
 		numShaderSwitches = 0;
 		numFlushes = 0;
 		numTexturesDecoded = 0;
+		numVertexDecoderHits = 0;
+		numVertexDecoderMisses = 0;
+		numPatchesTessellated = 0;
 	}
 
-	// Per frame statistics
+	// Per frame statistics. With a separate GPU thread, that thread updates these,
+	// so only read or reset them after gpu->SyncThread().
 	int numJoins;
 	int numDrawCalls;
 	int numFlushes;
@@ -274,6 +278,9 @@ struct GPUStatistics
 	int numTextureSwitches;
 	int numShaderSwitches;
 	int numTexturesDecoded;
+	int numVertexDecoderHits;
+	int numVertexDecoderMisses;
+	int numPatchesTessellated;
 
 	// Total statistics, updated by the GPU core in UpdateStats
 	int numFrames;
@@ -281,6 +288,7 @@ struct GPUStatistics
 	int numVertexShaders;
 	int numFragmentShaders;
 	int numShaders;
+	int numVertexDecoders;
 };
 
 void InitGfxState();
@@ -138,7 +138,7 @@ void NullGPU::ExecuteOp(u32 op, u32 diff)
 
 			// TODO: Should this run while interrupts are suspended?
 			if (interruptsEnabled_)
-				__TriggerInterruptWithArg(PSP_INTR_HLE, PSP_GE_INTR, currentList->subIntrBase | PSP_GE_SUBINTR_SIGNAL, signal);
+				TriggerListInterrupt(currentList->subIntrBase | PSP_GE_SUBINTR_SIGNAL, signal);
 		}
 		break;
 
@@ -170,7 +170,7 @@ void NullGPU::ExecuteOp(u32 op, u32 diff)
 		DEBUG_LOG(G3D,"DL CMD FINISH");
 		// TODO: Should this run while interrupts are suspended?
 		if (interruptsEnabled_)
-			__TriggerInterruptWithArg(PSP_INTR_HLE, PSP_GE_INTR, currentList->subIntrBase | PSP_GE_SUBINTR_FINISH, 0);
+			TriggerListInterrupt(currentList->subIntrBase | PSP_GE_SUBINTR_FINISH, 0);
 		break;
 
 	case GE_CMD_END: 
@@ -739,6 +739,7 @@ void NullGPU::UpdateStats()
 	gpuStats.numFragmentShaders = 0;
 	gpuStats.numShaders = 0;
 	gpuStats.numTextures = 0;
+	gpuStats.numVertexDecoders = 0;
 }
 
 void NullGPU::InvalidateCache(u32 addr, int size)
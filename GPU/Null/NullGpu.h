@@ -45,6 +45,9 @@ public:
 	virtual void DeviceLost() {}
 	virtual void DumpNextFrame() {}
 
+protected:
+	virtual bool SupportsThreading() const { return true; }
+
 private:
 	bool interruptsEnabled_;
 };
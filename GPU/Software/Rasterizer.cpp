@@ -0,0 +1,1040 @@
+// Copyright (c) 2012- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+
+#include <cmath>
+#include <vector>
+
+#if defined(_M_IX86) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+
+#include "../../Common/ThreadPool.h"
+#include "../../Core/MemMap.h"
+#include "../GPUState.h"
+#include "../ge_constants.h"
+#include "Rasterizer.h"
+
+namespace Rasterizer
+{
+
+// The screen is split in bands of this many rows. A worker always gets whole
+// bands, so two threads never touch the same pixel.
+static const int BAND_HEIGHT = 16;
+
+// Flushes touching fewer pixels than this (by bounding box) are drawn on the
+// calling thread, waking up the pool costs more than it saves.
+static const int PARALLEL_MIN_PIXELS = 64 * 64;
+
+enum PrimitiveType
+{
+	PRIM_TRIANGLE,
+	PRIM_RECTANGLE,
+	PRIM_LINE,
+	PRIM_POINT,
+};
+
+struct Primitive
+{
+	int type;
+	VertexData v[3];
+	// Inclusive pixel bounds, already scissored.
+	int minX, minY, maxX, maxY;
+
+	// Triangles only. Edge i is opposite vertex i, and
+	// E_i(x, y) = a[i] * x + b[i] * y + c[i] is positive inside.
+	float a[3], b[3], c[3];
+	bool topLeft[3];
+	float invArea;
+};
+
+struct Color
+{
+	int r, g, b, a;
+};
+
+// Everything the pixel pipeline needs, decoded from gstate once per flush.
+struct DrawState
+{
+	u8 *fb;
+	int fbStride;
+	int fbFormat;
+	u16 *depth;
+	int depthStride;
+	// Rows that fit in VRAM below the framebuffer and depth buffer.
+	int rows;
+
+	int scissorX1, scissorY1, scissorX2, scissorY2;
+
+	bool clearMode;
+	bool clearColor;
+	bool clearAlphaStencil;
+	bool clearDepth;
+
+	bool textured;
+	const u8 *texData;
+	int texFormat;
+	int texWidth, texHeight;
+	int texBufWidth;
+	bool texSwizzled;
+	bool texClampS, texClampT;
+	bool texLinear;
+	int texFunc;
+	bool texAlpha;
+	bool colorDouble;
+	Color texEnv;
+	int clutFormat;
+	int clutShift;
+	int clutMask;
+	int clutBase;
+
+	bool fog;
+	Color fogColor;
+
+	bool alphaTest;
+	int alphaFunc;
+	int alphaRef;
+	int alphaMask;
+
+	bool colorTest;
+	int colorFunc;
+	u32 colorRef;
+	u32 colorMask;
+
+	bool stencilTest;
+	int stencilFunc;
+	int stencilRef;
+	int stencilMask;
+	int stencilFail, stencilZFail, stencilZPass;
+
+	bool depthTest;
+	int depthFunc;
+	bool depthWrite;
+
+	bool blend;
+	int blendEq;
+	int blendSrc, blendDst;
+	Color fixA, fixB;
+
+	// Set bits are kept from the framebuffer, in 8888 layout.
+	u32 writeMask;
+};
+
+struct FlushJob
+{
+	const DrawState *state;
+};
+
+static ThreadPool *pool;
+static std::vector<Primitive> queue;
+static u32 clut[256];
+
+void Init()
+{
+	pool = new ThreadPool();
+}
+
+void Shutdown()
+{
+	delete pool;
+	pool = NULL;
+	queue.clear();
+}
+
+void LoadClut(u32 addr, u32 bytes)
+{
+	if (bytes > sizeof(clut))
+		bytes = sizeof(clut);
+	if (bytes && Memory::IsValidAddress(addr))
+		Memory::Memcpy(clut, addr, bytes);
+}
+
+static inline Color ColorFromRGB(u32 rgb, int a)
+{
+	Color c = { (int)(rgb & 0xFF), (int)((rgb >> 8) & 0xFF), (int)((rgb >> 16) & 0xFF), a };
+	return c;
+}
+
+static inline u32 Decode565(u16 c)
+{
+	return Convert5To8(c & 0x1F) | (Convert6To8((c >> 5) & 0x3F) << 8) | (Convert5To8((c >> 11) & 0x1F) << 16) | 0xFF000000;
+}
+
+static inline u32 Decode5551(u16 c)
+{
+	return Convert5To8(c & 0x1F) | (Convert5To8((c >> 5) & 0x1F) << 8) | (Convert5To8((c >> 10) & 0x1F) << 16) | ((c >> 15) ? 0xFF000000 : 0);
+}
+
+static inline u32 Decode4444(u16 c)
+{
+	return Convert4To8(c & 0xF) | (Convert4To8((c >> 4) & 0xF) << 8) | (Convert4To8((c >> 8) & 0xF) << 16) | (Convert4To8(c >> 12) << 24);
+}
+
+static inline u16 Encode565(u32 c)
+{
+	return ((c >> 3) & 0x1F) | (((c >> 10) & 0x3F) << 5) | (((c >> 19) & 0x1F) << 11);
+}
+
+static inline u16 Encode5551(u32 c)
+{
+	return ((c >> 3) & 0x1F) | (((c >> 11) & 0x1F) << 5) | (((c >> 19) & 0x1F) << 10) | ((c >> 31) << 15);
+}
+
+static inline u16 Encode4444(u32 c)
+{
+	return ((c >> 4) & 0xF) | (((c >> 12) & 0xF) << 4) | (((c >> 20) & 0xF) << 8) | ((c >> 28) << 12);
+}
+
+static inline u32 DecodeFormat(u16 c, int format)
+{
+	switch (format) {
+	case GE_FORMAT_565: return Decode565(c);
+	case GE_FORMAT_5551: return Decode5551(c);
+	default: return Decode4444(c);
+	}
+}
+
+static void SetupDrawState(DrawState &s)
+{
+	u32 fbAddr = 0x04000000 | (((gstate.fbptr & 0xFFE000) | ((gstate.fbwidth & 0xFF0000) << 8)) & 0x1FFFFF);
+	u32 zbAddr = 0x04000000 | (((gstate.zbptr & 0xFFE000) | ((gstate.zbwidth & 0xFF0000) << 8)) & 0x1FFFFF);
+	s.fb = Memory::GetPointer(fbAddr);
+	s.fbStride = gstate.fbwidth & 0x7FC;
+	s.fbFormat = gstate.framebufpixformat & 3;
+	s.depth = (u16 *)Memory::GetPointer(zbAddr);
+	s.depthStride = gstate.zbwidth & 0x7FC;
+	s.rows = s.fbStride ? (Memory::VRAM_SIZE - (fbAddr & Memory::VRAM_MASK)) / (s.fbStride * (s.fbFormat == GE_FORMAT_8888 ? 4 : 2)) : 0;
+
+	s.scissorX1 = gstate.scissor1 & 0x3FF;
+	s.scissorY1 = (gstate.scissor1 >> 10) & 0x3FF;
+	s.scissorX2 = gstate.scissor2 & 0x3FF;
+	s.scissorY2 = (gstate.scissor2 >> 10) & 0x3FF;
+	// Don't draw past the end of the buffer whatever the scissor says.
+	if (s.scissorX2 >= s.fbStride)
+		s.scissorX2 = s.fbStride - 1;
+
+	s.clearMode = gstate.isModeClear();
+	s.clearColor = (gstate.clearmode & 0x100) != 0;
+	s.clearAlphaStencil = (gstate.clearmode & 0x200) != 0;
+	s.clearDepth = (gstate.clearmode & 0x400) != 0;
+
+	s.textured = (gstate.textureMapEnable & 1) != 0 && !s.clearMode;
+	if (s.textured) {
+		u32 texAddr = (gstate.texaddr[0] & 0xFFFFF0) | ((gstate.texbufwidth[0] << 8) & 0x0F000000);
+		s.texData = Memory::GetPointer(texAddr);
+		if (!s.texData)
+			s.textured = false;
+	}
+	s.texFormat = gstate.texformat & 0xF;
+	s.texWidth = 1 << (gstate.texsize[0] & 0xF);
+	s.texHeight = 1 << ((gstate.texsize[0] >> 8) & 0xF);
+	s.texBufWidth = gstate.texbufwidth[0] & 0x3FF;
+	s.texSwizzled = (gstate.texmode & 1) != 0;
+	s.texClampS = (gstate.texwrap & 1) != 0;
+	s.texClampT = (gstate.texwrap & 0x100) != 0;
+	// There's no LOD computation, so the magnification filter is used throughout.
+	s.texLinear = (gstate.texfilter & 0x100) != 0;
+	s.texFunc = gstate.texfunc & 7;
+	s.texAlpha = (gstate.texfunc & 0x100) != 0;
+	s.colorDouble = (gstate.texfunc & 0x10000) != 0;
+	s.texEnv = ColorFromRGB(gstate.texenvcolor, 255);
+	s.clutFormat = gstate.clutformat & 3;
+	s.clutShift = (gstate.clutformat >> 2) & 0x1F;
+	s.clutMask = (gstate.clutformat >> 8) & 0xFF;
+	s.clutBase = ((gstate.clutformat >> 16) & 0x1F) << 4;
+
+	s.fog = gstate.isFogEnabled() && !gstate.isModeThrough() && !s.clearMode;
+	s.fogColor = ColorFromRGB(gstate.fogcolor, 255);
+
+	s.alphaTest = (gstate.alphaTestEnable & 1) && !s.clearMode;
+	s.alphaFunc = gstate.alphatest & 7;
+	s.alphaRef = (gstate.alphatest >> 8) & 0xFF;
+	s.alphaMask = (gstate.alphatest >> 16) & 0xFF;
+
+	s.colorTest = (gstate.colorTestEnable & 1) && !s.clearMode;
+	s.colorFunc = gstate.colortest & 3;
+	s.colorRef = gstate.colorref & 0xFFFFFF;
+	s.colorMask = gstate.colormask & 0xFFFFFF;
+
+	// 565 has nowhere to keep the stencil.
+	s.stencilTest = (gstate.stencilTestEnable & 1) && !s.clearMode && s.fbFormat != GE_FORMAT_565;
+	s.stencilFunc = gstate.stenciltest & 7;
+	s.stencilRef = (gstate.stenciltest >> 8) & 0xFF;
+	s.stencilMask = (gstate.stenciltest >> 16) & 0xFF;
+	s.stencilFail = gstate.stencilop & 7;
+	s.stencilZFail = (gstate.stencilop >> 8) & 7;
+	s.stencilZPass = (gstate.stencilop >> 16) & 7;
+
+	s.depthTest = gstate.isDepthTestEnabled() && !s.clearMode && s.depth != NULL;
+	s.depthFunc = gstate.getDepthTestFunc();
+	s.depthWrite = s.depth != NULL && (s.clearMode ? s.clearDepth : gstate.isDepthWriteEnabled());
+
+	if ((s.depthTest || s.depthWrite) && s.depthStride) {
+		int depthRows = (Memory::VRAM_SIZE - (zbAddr & Memory::VRAM_MASK)) / (s.depthStride * 2);
+		if (depthRows < s.rows)
+			s.rows = depthRows;
+	}
+
+	s.blend = (gstate.alphaBlendEnable & 1) && !s.clearMode;
+	s.blendEq = gstate.getBlendEq();
+	s.blendSrc = gstate.getBlendFuncA();
+	s.blendDst = gstate.getBlendFuncB();
+	s.fixA = ColorFromRGB(gstate.getFixA(), 255);
+	s.fixB = ColorFromRGB(gstate.getFixB(), 255);
+
+	if (s.clearMode) {
+		s.writeMask = (s.clearColor ? 0 : 0x00FFFFFF) | (s.clearAlphaStencil ? 0 : 0xFF000000);
+	} else {
+		s.writeMask = (gstate.pmsk1 & 0xFFFFFF) | ((gstate.pmsk2 & 0xFF) << 24);
+	}
+}
+
+static inline bool Compare(int func, int a, int b)
+{
+	switch (func) {
+	case GE_COMP_NEVER: return false;
+	case GE_COMP_ALWAYS: return true;
+	case GE_COMP_EQUAL: return a == b;
+	case GE_COMP_NOTEQUAL: return a != b;
+	case GE_COMP_LESS: return a < b;
+	case GE_COMP_LEQUAL: return a <= b;
+	case GE_COMP_GREATER: return a > b;
+	case GE_COMP_GEQUAL: return a >= b;
+	}
+	return true;
+}
+
+static inline int Clamp255(int v)
+{
+	return v < 0 ? 0 : (v > 255 ? 255 : v);
+}
+
+static inline u32 LookupClut(const DrawState &s, u32 index)
+{
+	index = ((index >> s.clutShift) & s.clutMask) | s.clutBase;
+	const u16 *clut16 = (const u16 *)clut;
+	switch (s.clutFormat) {
+	case GE_CMODE_16BIT_BGR5650: return Decode565(clut16[index & 511]);
+	case GE_CMODE_16BIT_ABGR5551: return Decode5551(clut16[index & 511]);
+	case GE_CMODE_16BIT_ABGR4444: return Decode4444(clut16[index & 511]);
+	default: return clut[index & 255];
+	}
+}
+
+// Byte offset of texel x, y in a texture with the given bits per texel.
+static inline u32 TexelOffset(const DrawState &s, int x, int y, int bits)
+{
+	u32 rowBytes = (s.texBufWidth * bits) >> 3;
+	u32 xbyte = (x * bits) >> 3;
+	if (!s.texSwizzled)
+		return y * rowBytes + xbyte;
+	// Swizzled textures are stored in blocks of 16 bytes by 8 rows.
+	u32 blocksPerRow = rowBytes >> 4;
+	return ((y >> 3) * blocksPerRow + (xbyte >> 4)) * 128 + (y & 7) * 16 + (xbyte & 15);
+}
+
+struct DXT1Block
+{
+	u8 lines[4];
+	u16 color1;
+	u16 color2;
+};
+
+struct DXT3Block
+{
+	DXT1Block color;
+	u16 alphaLines[4];
+};
+
+struct DXT5Block
+{
+	DXT1Block color;
+	u32 alphadata2;
+	u16 alphadata1;
+	u8 alpha1; u8 alpha2;
+};
+
+static u32 SampleDXTColor(const DXT1Block *b, int x, int y, bool ignore1bitAlpha)
+{
+	int index = (b->lines[y] >> (x * 2)) & 3;
+	u32 c1 = Decode565(b->color1);
+	u32 c2 = Decode565(b->color2);
+	if (index < 2)
+		return index == 0 ? c1 : c2;
+
+	u32 result = 0xFF000000;
+	for (int shift = 0; shift < 24; shift += 8) {
+		int v1 = (c1 >> shift) & 0xFF;
+		int v2 = (c2 >> shift) & 0xFF;
+		int v;
+		if (b->color1 > b->color2 || ignore1bitAlpha) {
+			int d = ((v2 - v1) >> 1) - ((v2 - v1) >> 3);
+			v = index == 2 ? v1 + d : v2 - d;
+		} else {
+			v = index == 2 ? (v1 + v2 + 1) / 2 : v2;
+		}
+		result |= Clamp255(v) << shift;
+	}
+	if (index == 3 && !(b->color1 > b->color2 || ignore1bitAlpha))
+		result &= 0x00FFFFFF;
+	return result;
+}
+
+static u32 SampleDXT5Alpha(const DXT5Block *b, int x, int y)
+{
+	u64 data = ((u64)b->alphadata1 << 32) | b->alphadata2;
+	int index = (int)(data >> ((y * 4 + x) * 3)) & 7;
+	int a1 = b->alpha1, a2 = b->alpha2;
+	if (index < 2)
+		return index == 0 ? a1 : a2;
+	if (a1 > a2)
+		return (u8)(a1 + (a2 - a1) * ((8 - index) / 7.0f));
+	if (index >= 6)
+		return index == 6 ? 0 : 255;
+	return (u8)(a1 + (a2 - a1) * ((6 - index) / 5.0f));
+}
+
+// Fetches one texel as 8888, with the red channel in the low byte.
+static u32 FetchTexel(const DrawState &s, int x, int y)
+{
+	const u8 *src = s.texData;
+	switch (s.texFormat) {
+	case GE_TFMT_5650: return Decode565(*(const u16 *)(src + TexelOffset(s, x, y, 16)));
+	case GE_TFMT_5551: return Decode5551(*(const u16 *)(src + TexelOffset(s, x, y, 16)));
+	case GE_TFMT_4444: return Decode4444(*(const u16 *)(src + TexelOffset(s, x, y, 16)));
+	case GE_TFMT_8888: return *(const u32 *)(src + TexelOffset(s, x, y, 32));
+	case GE_TFMT_CLUT4:
+		{
+			u8 pair = src[TexelOffset(s, x, y, 4)];
+			return LookupClut(s, (x & 1) ? (pair >> 4) : (pair & 0xF));
+		}
+	case GE_TFMT_CLUT8: return LookupClut(s, src[TexelOffset(s, x, y, 8)]);
+	case GE_TFMT_CLUT16: return LookupClut(s, *(const u16 *)(src + TexelOffset(s, x, y, 16)));
+	case GE_TFMT_CLUT32: return LookupClut(s, *(const u32 *)(src + TexelOffset(s, x, y, 32)));
+	case GE_TFMT_DXT1:
+	case GE_TFMT_DXT3:
+	case GE_TFMT_DXT5:
+		{
+			int blockSize = s.texFormat == GE_TFMT_DXT1 ? 8 : 16;
+			int block = (y >> 2) * (s.texBufWidth >> 2) + (x >> 2);
+			const u8 *blockData = src + block * blockSize;
+			int bx = x & 3, by = y & 3;
+			if (s.texFormat == GE_TFMT_DXT1)
+				return SampleDXTColor((const DXT1Block *)blockData, bx, by, false);
+			u32 color = SampleDXTColor((const DXT1Block *)blockData, bx, by, true) & 0x00FFFFFF;
+			if (s.texFormat == GE_TFMT_DXT3) {
+				int alpha = (((const DXT3Block *)blockData)->alphaLines[by] >> (bx * 4)) & 0xF;
+				return color | (Convert4To8(alpha) << 24);
+			}
+			return color | (SampleDXT5Alpha((const DXT5Block *)blockData, bx, by) << 24);
+		}
+	default:
+		return 0xFFFFFFFF;
+	}
+}
+
+static inline int WrapCoord(int c, int size, bool clamp)
+{
+	if (clamp)
+		return c < 0 ? 0 : (c >= size ? size - 1 : c);
+	return c & (size - 1);
+}
+
+static inline Color UnpackColor(u32 c)
+{
+	Color out = { (int)(c & 0xFF), (int)((c >> 8) & 0xFF), (int)((c >> 16) & 0xFF), (int)(c >> 24) };
+	return out;
+}
+
+static Color SampleTexture(const DrawState &s, float u, float v)
+{
+	float fu = u * s.texWidth;
+	float fv = v * s.texHeight;
+	if (!s.texLinear) {
+		int x = WrapCoord((int)floorf(fu), s.texWidth, s.texClampS);
+		int y = WrapCoord((int)floorf(fv), s.texHeight, s.texClampT);
+		return UnpackColor(FetchTexel(s, x, y));
+	}
+
+	fu -= 0.5f;
+	fv -= 0.5f;
+	int x0 = (int)floorf(fu);
+	int y0 = (int)floorf(fv);
+	// 8 bit weights, good enough for 8 bit channels.
+	int fx = (int)((fu - x0) * 256.0f);
+	int fy = (int)((fv - y0) * 256.0f);
+	int x1 = WrapCoord(x0 + 1, s.texWidth, s.texClampS);
+	int y1 = WrapCoord(y0 + 1, s.texHeight, s.texClampT);
+	x0 = WrapCoord(x0, s.texWidth, s.texClampS);
+	y0 = WrapCoord(y0, s.texHeight, s.texClampT);
+
+	u32 t[4] = {
+		FetchTexel(s, x0, y0), FetchTexel(s, x1, y0),
+		FetchTexel(s, x0, y1), FetchTexel(s, x1, y1),
+	};
+	int w[4] = {
+		(256 - fx) * (256 - fy), fx * (256 - fy),
+		(256 - fx) * fy, fx * fy,
+	};
+	int sum[4] = {0, 0, 0, 0};
+	for (int i = 0; i < 4; i++) {
+		for (int c = 0; c < 4; c++)
+			sum[c] += ((t[i] >> (c * 8)) & 0xFF) * w[i];
+	}
+	Color out = { sum[0] >> 16, sum[1] >> 16, sum[2] >> 16, sum[3] >> 16 };
+	return out;
+}
+
+static Color ApplyTexFunc(const DrawState &s, const Color &p, const Color &t)
+{
+	Color out;
+	switch (s.texFunc) {
+	case GE_TEXFUNC_MODULATE:
+		out.r = p.r * t.r / 255;
+		out.g = p.g * t.g / 255;
+		out.b = p.b * t.b / 255;
+		out.a = s.texAlpha ? p.a * t.a / 255 : p.a;
+		break;
+	case GE_TEXFUNC_DECAL:
+		if (s.texAlpha) {
+			out.r = (p.r * (255 - t.a) + t.r * t.a) / 255;
+			out.g = (p.g * (255 - t.a) + t.g * t.a) / 255;
+			out.b = (p.b * (255 - t.a) + t.b * t.a) / 255;
+		} else {
+			out.r = t.r;
+			out.g = t.g;
+			out.b = t.b;
+		}
+		out.a = p.a;
+		break;
+	case GE_TEXFUNC_BLEND:
+		out.r = (p.r * (255 - t.r) + s.texEnv.r * t.r) / 255;
+		out.g = (p.g * (255 - t.g) + s.texEnv.g * t.g) / 255;
+		out.b = (p.b * (255 - t.b) + s.texEnv.b * t.b) / 255;
+		out.a = s.texAlpha ? p.a * t.a / 255 : p.a;
+		break;
+	case GE_TEXFUNC_REPLACE:
+		out.r = t.r;
+		out.g = t.g;
+		out.b = t.b;
+		out.a = s.texAlpha ? t.a : p.a;
+		break;
+	case GE_TEXFUNC_ADD:
+		out.r = p.r + t.r;
+		out.g = p.g + t.g;
+		out.b = p.b + t.b;
+		out.a = s.texAlpha ? p.a * t.a / 255 : p.a;
+		break;
+	default:
+		out = p;
+		break;
+	}
+	return out;
+}
+
+static inline int BlendFactor(int factor, int channel, const Color &src, const Color &dst, const Color &fix, bool isSrc)
+{
+	const Color &other = isSrc ? dst : src;
+	int otherChannel = channel == 0 ? other.r : (channel == 1 ? other.g : other.b);
+	switch (factor) {
+	case 0: return otherChannel;
+	case 1: return 255 - otherChannel;
+	case 2: return src.a;
+	case 3: return 255 - src.a;
+	case 4: return dst.a;
+	case 5: return 255 - dst.a;
+	case 6: return 2 * src.a;
+	case 7: return 255 - 2 * src.a;
+	case 8: return 2 * dst.a;
+	case 9: return 255 - 2 * dst.a;
+	case 10: return channel == 0 ? fix.r : (channel == 1 ? fix.g : fix.b);
+	default: return 255;
+	}
+}
+
+static inline int BlendChannel(const DrawState &s, int channel, const Color &src, const Color &dst)
+{
+	int sv = channel == 0 ? src.r : (channel == 1 ? src.g : src.b);
+	int dv = channel == 0 ? dst.r : (channel == 1 ? dst.g : dst.b);
+	int sf = BlendFactor(s.blendSrc, channel, src, dst, s.fixA, true);
+	int df = BlendFactor(s.blendDst, channel, src, dst, s.fixB, false);
+	switch (s.blendEq) {
+	case GE_BLENDMODE_MUL_AND_ADD: return Clamp255((sv * sf + dv * df) / 255);
+	case GE_BLENDMODE_MUL_AND_SUBTRACT: return Clamp255((sv * sf - dv * df) / 255);
+	case GE_BLENDMODE_MUL_AND_SUBTRACT_REVERSE: return Clamp255((dv * df - sv * sf) / 255);
+	case GE_BLENDMODE_MIN: return sv < dv ? sv : dv;
+	case GE_BLENDMODE_MAX: return sv > dv ? sv : dv;
+	case GE_BLENDMODE_ABSDIFF: return sv > dv ? sv - dv : dv - sv;
+	default: return sv;
+	}
+}
+
+static inline int ApplyStencilOp(int op, int stencil, int ref)
+{
+	switch (op) {
+	case GE_STENCILOP_ZERO: return 0;
+	case GE_STENCILOP_REPLACE: return ref;
+	case GE_STENCILOP_INVERT: return 255 - stencil;
+	case GE_STENCILOP_INCR: return stencil < 255 ? stencil + 1 : 255;
+	case GE_STENCILOP_DECR: return stencil > 0 ? stencil - 1 : 0;
+	default: return stencil;
+	}
+}
+
+static inline u32 ReadPixel(const DrawState &s, int x, int y)
+{
+	if (s.fbFormat == GE_FORMAT_8888)
+		return ((const u32 *)s.fb)[y * s.fbStride + x];
+	return DecodeFormat(((const u16 *)s.fb)[y * s.fbStride + x], s.fbFormat);
+}
+
+static inline void WritePixel(const DrawState &s, int x, int y, u32 c)
+{
+	switch (s.fbFormat) {
+	case GE_FORMAT_565: ((u16 *)s.fb)[y * s.fbStride + x] = Encode565(c); break;
+	case GE_FORMAT_5551: ((u16 *)s.fb)[y * s.fbStride + x] = Encode5551(c); break;
+	case GE_FORMAT_4444: ((u16 *)s.fb)[y * s.fbStride + x] = Encode4444(c); break;
+	default: ((u32 *)s.fb)[y * s.fbStride + x] = c; break;
+	}
+}
+
+// The stencil lives in the alpha channel, this updates only that.
+static inline void WriteStencil(const DrawState &s, int x, int y, u32 old, int stencil)
+{
+	u32 c = (old & 0x00FFFFFF) | (stencil << 24);
+	WritePixel(s, x, y, (c & ~s.writeMask) | (old & s.writeMask));
+}
+
+// The per pixel part of the pipeline, from texturing to the framebuffer write.
+// Colors are interpolated but not yet clamped.
+static void DrawPixel(const DrawState &s, int x, int y, float z, const float color0[4], const float color1[3], float u, float v, float fog)
+{
+	int depth = (int)z;
+	depth = depth < 0 ? 0 : (depth > 65535 ? 65535 : depth);
+	u16 *depthPtr = s.depth ? &s.depth[y * s.depthStride + x] : NULL;
+
+	Color prim = {
+		Clamp255((int)(color0[0] * 255.0f)), Clamp255((int)(color0[1] * 255.0f)),
+		Clamp255((int)(color0[2] * 255.0f)), Clamp255((int)(color0[3] * 255.0f)),
+	};
+
+	if (s.clearMode) {
+		u32 old = ReadPixel(s, x, y);
+		u32 c = prim.r | (prim.g << 8) | (prim.b << 16) | (prim.a << 24);
+		WritePixel(s, x, y, (c & ~s.writeMask) | (old & s.writeMask));
+		if (s.depthWrite)
+			*depthPtr = depth;
+		return;
+	}
+
+	Color c = prim;
+	if (s.textured)
+		c = ApplyTexFunc(s, prim, SampleTexture(s, u, v));
+
+	c.r += (int)(color1[0] * 255.0f);
+	c.g += (int)(color1[1] * 255.0f);
+	c.b += (int)(color1[2] * 255.0f);
+	if (s.colorDouble) {
+		c.r *= 2;
+		c.g *= 2;
+		c.b *= 2;
+	}
+	c.r = Clamp255(c.r);
+	c.g = Clamp255(c.g);
+	c.b = Clamp255(c.b);
+	c.a = Clamp255(c.a);
+
+	if (s.fog) {
+		int f = Clamp255((int)(fog * 255.0f));
+		c.r = (c.r * f + s.fogColor.r * (255 - f)) / 255;
+		c.g = (c.g * f + s.fogColor.g * (255 - f)) / 255;
+		c.b = (c.b * f + s.fogColor.b * (255 - f)) / 255;
+	}
+
+	if (s.alphaTest && !Compare(s.alphaFunc, c.a & s.alphaMask, s.alphaRef & s.alphaMask))
+		return;
+
+	if (s.colorTest) {
+		u32 rgb = (c.r | (c.g << 8) | (c.b << 16)) & s.colorMask;
+		u32 ref = s.colorRef & s.colorMask;
+		if (s.colorFunc == GE_COMP_NEVER || (s.colorFunc == GE_COMP_EQUAL && rgb != ref) || (s.colorFunc == GE_COMP_NOTEQUAL && rgb == ref))
+			return;
+	}
+
+	u32 old = ReadPixel(s, x, y);
+	int stencil = old >> 24;
+	int newAlpha = c.a;
+	if (s.stencilTest) {
+		if (!Compare(s.stencilFunc, s.stencilRef & s.stencilMask, stencil & s.stencilMask)) {
+			WriteStencil(s, x, y, old, ApplyStencilOp(s.stencilFail, stencil, s.stencilRef));
+			return;
+		}
+	}
+
+	if (s.depthTest && !Compare(s.depthFunc, depth, *depthPtr)) {
+		if (s.stencilTest)
+			WriteStencil(s, x, y, old, ApplyStencilOp(s.stencilZFail, stencil, s.stencilRef));
+		return;
+	}
+	if (s.stencilTest)
+		newAlpha = ApplyStencilOp(s.stencilZPass, stencil, s.stencilRef);
+	if (s.depthWrite)
+		*depthPtr = depth;
+
+	if (s.blend) {
+		Color dst = UnpackColor(old);
+		Color src = c;
+		c.r = BlendChannel(s, 0, src, dst);
+		c.g = BlendChannel(s, 1, src, dst);
+		c.b = BlendChannel(s, 2, src, dst);
+	}
+
+	u32 out = c.r | (c.g << 8) | (c.b << 16) | (newAlpha << 24);
+	WritePixel(s, x, y, (out & ~s.writeMask) | (old & s.writeMask));
+}
+
+static void ShadeTrianglePixel(const DrawState &s, const Primitive &p, int x, int y, float l0, float l1, float l2)
+{
+	const VertexData &v0 = p.v[0], &v1 = p.v[1], &v2 = p.v[2];
+	float z = l0 * v0.z + l1 * v1.z + l2 * v2.z;
+
+	// Everything but depth is interpolated perspective correctly.
+	float w0 = l0 * v0.invw, w1 = l1 * v1.invw, w2 = l2 * v2.invw;
+	float rw = 1.0f / (w0 + w1 + w2);
+	w0 *= rw;
+	w1 *= rw;
+	w2 *= rw;
+
+	float color0[4], color1[3];
+	for (int i = 0; i < 4; i++)
+		color0[i] = w0 * v0.color0[i] + w1 * v1.color0[i] + w2 * v2.color0[i];
+	for (int i = 0; i < 3; i++)
+		color1[i] = w0 * v0.color1[i] + w1 * v1.color1[i] + w2 * v2.color1[i];
+	float u = w0 * v0.u + w1 * v1.u + w2 * v2.u;
+	float v = w0 * v0.v + w1 * v1.v + w2 * v2.v;
+	float fog = w0 * v0.fog + w1 * v1.fog + w2 * v2.fog;
+
+	DrawPixel(s, x, y, z, color0, color1, u, v, fog);
+}
+
+// Edge functions are evaluated directly at every pixel rather than stepped,
+// so that the two triangles sharing an edge compute exactly negated values
+// and the top-left rule gives each pixel to exactly one of them.
+static void RasterizeTriangle(const DrawState &s, const Primitive &p, int bandY0, int bandY1)
+{
+	int minY = p.minY > bandY0 ? p.minY : bandY0;
+	int maxY = p.maxY < bandY1 - 1 ? p.maxY : bandY1 - 1;
+	// Pixels are tested four at a time, starting at a multiple of four.
+	int minX = p.minX & ~3;
+
+#if defined(_M_IX86) || defined(_M_X64)
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 lanes = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+	__m128 a[3], b[3], c[3], topLeft[3];
+	for (int i = 0; i < 3; i++) {
+		a[i] = _mm_set1_ps(p.a[i]);
+		b[i] = _mm_set1_ps(p.b[i]);
+		c[i] = _mm_set1_ps(p.c[i]);
+		topLeft[i] = _mm_castsi128_ps(_mm_set1_epi32(p.topLeft[i] ? -1 : 0));
+	}
+
+	for (int y = minY; y <= maxY; y++) {
+		__m128 by[3];
+		__m128 py = _mm_set1_ps(y + 0.5f);
+		for (int i = 0; i < 3; i++)
+			by[i] = _mm_mul_ps(b[i], py);
+
+		for (int x = minX; x <= p.maxX; x += 4) {
+			__m128 px = _mm_add_ps(_mm_set1_ps((float)x), lanes);
+			__m128 e[3];
+			__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+			for (int i = 0; i < 3; i++) {
+				e[i] = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a[i], px), by[i]), c[i]);
+				__m128 edgeInside = _mm_or_ps(_mm_cmpgt_ps(e[i], zero), _mm_and_ps(_mm_cmpeq_ps(e[i], zero), topLeft[i]));
+				inside = _mm_and_ps(inside, edgeInside);
+			}
+			int mask = _mm_movemask_ps(inside);
+			if (!mask)
+				continue;
+
+			float e0[4], e1[4], e2[4];
+			_mm_storeu_ps(e0, e[0]);
+			_mm_storeu_ps(e1, e[1]);
+			_mm_storeu_ps(e2, e[2]);
+			for (int lane = 0; lane < 4; lane++) {
+				int px = x + lane;
+				if ((mask & (1 << lane)) && px >= p.minX && px <= p.maxX)
+					ShadeTrianglePixel(s, p, px, y, e0[lane] * p.invArea, e1[lane] * p.invArea, e2[lane] * p.invArea);
+			}
+		}
+	}
+#else
+	for (int y = minY; y <= maxY; y++) {
+		float py = y + 0.5f;
+		for (int x = minX; x <= p.maxX; x += 4) {
+			for (int lane = 0; lane < 4; lane++) {
+				int ix = x + lane;
+				if (ix < p.minX || ix > p.maxX)
+					continue;
+				float px = ix + 0.5f;
+				float e[3];
+				bool inside = true;
+				for (int i = 0; i < 3; i++) {
+					e[i] = ((p.a[i] * px) + (p.b[i] * py)) + p.c[i];
+					inside = inside && (e[i] > 0.0f || (e[i] == 0.0f && p.topLeft[i]));
+				}
+				if (inside)
+					ShadeTrianglePixel(s, p, ix, y, e[0] * p.invArea, e[1] * p.invArea, e[2] * p.invArea);
+			}
+		}
+	}
+#endif
+}
+
+static void RasterizeRectangle(const DrawState &s, const Primitive &p, int bandY0, int bandY1)
+{
+	int minY = p.minY > bandY0 ? p.minY : bandY0;
+	int maxY = p.maxY < bandY1 - 1 ? p.maxY : bandY1 - 1;
+	const VertexData &v0 = p.v[0], &v1 = p.v[1];
+
+	// Texture coordinates go linearly from corner to corner, colors are flat.
+	float du = v1.x != v0.x ? (v1.u - v0.u) / (v1.x - v0.x) : 0.0f;
+	float dv = v1.y != v0.y ? (v1.v - v0.v) / (v1.y - v0.y) : 0.0f;
+	for (int y = minY; y <= maxY; y++) {
+		float v = v0.v + (y + 0.5f - v0.y) * dv;
+		for (int x = p.minX; x <= p.maxX; x++) {
+			float u = v0.u + (x + 0.5f - v0.x) * du;
+			DrawPixel(s, x, y, v1.z, v1.color0, v1.color1, u, v, v1.fog);
+		}
+	}
+}
+
+static void RasterizeLine(const DrawState &s, const Primitive &p, int bandY0, int bandY1)
+{
+	const VertexData &v0 = p.v[0], &v1 = p.v[1];
+	float dx = v1.x - v0.x;
+	float dy = v1.y - v0.y;
+	int steps = (int)ceilf(fabsf(dx) > fabsf(dy) ? fabsf(dx) : fabsf(dy));
+	if (steps == 0)
+		steps = 1;
+
+	// The last pixel is left out so that line strips don't draw joints twice.
+	for (int i = 0; i < steps; i++) {
+		float t = (float)i / steps;
+		int x = (int)floorf(v0.x + dx * t);
+		int y = (int)floorf(v0.y + dy * t);
+		if (y < bandY0 || y >= bandY1 || y < p.minY || y > p.maxY || x < p.minX || x > p.maxX)
+			continue;
+
+		float color0[4], color1[3];
+		for (int c = 0; c < 4; c++)
+			color0[c] = v0.color0[c] + (v1.color0[c] - v0.color0[c]) * t;
+		for (int c = 0; c < 3; c++)
+			color1[c] = v0.color1[c] + (v1.color1[c] - v0.color1[c]) * t;
+		DrawPixel(s, x, y, v0.z + (v1.z - v0.z) * t, color0, color1,
+			v0.u + (v1.u - v0.u) * t, v0.v + (v1.v - v0.v) * t, v0.fog + (v1.fog - v0.fog) * t);
+	}
+}
+
+static void RasterizeRows(void *userdata, int lower, int upper)
+{
+	const FlushJob *job = (const FlushJob *)userdata;
+	const DrawState &s = *job->state;
+	int y0 = lower * BAND_HEIGHT;
+	int y1 = upper * BAND_HEIGHT;
+	if (y1 > s.rows)
+		y1 = s.rows;
+
+	for (size_t i = 0; i < queue.size(); i++) {
+		const Primitive &p = queue[i];
+		if (p.maxY < y0 || p.minY >= y1)
+			continue;
+
+		switch (p.type) {
+		case PRIM_TRIANGLE:
+			RasterizeTriangle(s, p, y0, y1);
+			break;
+		case PRIM_RECTANGLE:
+			RasterizeRectangle(s, p, y0, y1);
+			break;
+		case PRIM_LINE:
+			RasterizeLine(s, p, y0, y1);
+			break;
+		case PRIM_POINT:
+			DrawPixel(s, p.minX, p.minY, p.v[0].z, p.v[0].color0, p.v[0].color1, p.v[0].u, p.v[0].v, p.v[0].fog);
+			break;
+		}
+	}
+}
+
+// Clips the bounds to the scissor rectangle. Returns false if nothing is left.
+static bool ScissorBounds(Primitive &p, float minX, float minY, float maxX, float maxY)
+{
+	int scissorX1 = gstate.scissor1 & 0x3FF;
+	int scissorY1 = (gstate.scissor1 >> 10) & 0x3FF;
+	int scissorX2 = gstate.scissor2 & 0x3FF;
+	int scissorY2 = (gstate.scissor2 >> 10) & 0x3FF;
+	int fbStride = gstate.fbwidth & 0x7FC;
+	if (scissorX2 >= fbStride)
+		scissorX2 = fbStride - 1;
+
+	// Guard against NaN and huge coordinates before converting to int.
+	if (!(minX <= maxX && minY <= maxY))
+		return false;
+	if (minX > scissorX2 || minY > scissorY2 || maxX < scissorX1 || maxY < scissorY1)
+		return false;
+	p.minX = minX < scissorX1 ? scissorX1 : (int)minX;
+	p.minY = minY < scissorY1 ? scissorY1 : (int)minY;
+	p.maxX = maxX > scissorX2 ? scissorX2 : (int)maxX;
+	p.maxY = maxY > scissorY2 ? scissorY2 : (int)maxY;
+	return true;
+}
+
+static inline float SnapToSubpixel(float f)
+{
+	// The GE works with 1/16 pixel precision.
+	return floorf(f * 16.0f + 0.5f) * (1.0f / 16.0f);
+}
+
+void DrawTriangle(const VertexData &v0, const VertexData &v1, const VertexData &v2)
+{
+	Primitive p;
+	p.type = PRIM_TRIANGLE;
+	p.v[0] = v0;
+	p.v[1] = v1;
+	p.v[2] = v2;
+
+	float x[3], y[3];
+	for (int i = 0; i < 3; i++) {
+		x[i] = p.v[i].x = SnapToSubpixel(p.v[i].x);
+		y[i] = p.v[i].y = SnapToSubpixel(p.v[i].y);
+	}
+
+	for (int i = 0; i < 3; i++) {
+		int j = (i + 1) % 3;
+		int k = (i + 2) % 3;
+		p.a[i] = y[j] - y[k];
+		p.b[i] = x[k] - x[j];
+		p.c[i] = x[j] * y[k] - x[k] * y[j];
+	}
+	float area = p.a[0] * x[0] + p.b[0] * y[0] + p.c[0];
+	if (area == 0.0f || area != area)
+		return;
+	if (area < 0.0f) {
+		for (int i = 0; i < 3; i++) {
+			p.a[i] = -p.a[i];
+			p.b[i] = -p.b[i];
+			p.c[i] = -p.c[i];
+		}
+		area = -area;
+	}
+	p.invArea = 1.0f / area;
+	for (int i = 0; i < 3; i++) {
+		// The gradient points inwards, so a left edge has it pointing right
+		// and a top edge has it pointing down.
+		p.topLeft[i] = p.a[i] > 0.0f || (p.a[i] == 0.0f && p.b[i] > 0.0f);
+	}
+
+	float minX = x[0], maxX = x[0], minY = y[0], maxY = y[0];
+	for (int i = 1; i < 3; i++) {
+		minX = x[i] < minX ? x[i] : minX;
+		maxX = x[i] > maxX ? x[i] : maxX;
+		minY = y[i] < minY ? y[i] : minY;
+		maxY = y[i] > maxY ? y[i] : maxY;
+	}
+	if (ScissorBounds(p, floorf(minX), floorf(minY), ceilf(maxX), ceilf(maxY)))
+		queue.push_back(p);
+}
+
+void DrawRectangle(const VertexData &v0, const VertexData &v1)
+{
+	Primitive p;
+	p.type = PRIM_RECTANGLE;
+	p.v[0] = v0;
+	p.v[1] = v1;
+
+	// A pixel is covered when its center is inside.
+	float x0 = v0.x < v1.x ? v0.x : v1.x;
+	float x1 = v0.x < v1.x ? v1.x : v0.x;
+	float y0 = v0.y < v1.y ? v0.y : v1.y;
+	float y1 = v0.y < v1.y ? v1.y : v0.y;
+	if (ScissorBounds(p, ceilf(x0 - 0.5f), ceilf(y0 - 0.5f), ceilf(x1 - 0.5f) - 1.0f, ceilf(y1 - 0.5f) - 1.0f))
+		queue.push_back(p);
+}
+
+void DrawLine(const VertexData &v0, const VertexData &v1)
+{
+	Primitive p;
+	p.type = PRIM_LINE;
+	p.v[0] = v0;
+	p.v[1] = v1;
+	float minX = v0.x < v1.x ? v0.x : v1.x;
+	float maxX = v0.x < v1.x ? v1.x : v0.x;
+	float minY = v0.y < v1.y ? v0.y : v1.y;
+	float maxY = v0.y < v1.y ? v1.y : v0.y;
+	if (ScissorBounds(p, floorf(minX), floorf(minY), floorf(maxX), floorf(maxY)))
+		queue.push_back(p);
+}
+
+void DrawPoint(const VertexData &v0)
+{
+	Primitive p;
+	p.type = PRIM_POINT;
+	p.v[0] = v0;
+	float x = floorf(v0.x);
+	float y = floorf(v0.y);
+	if (ScissorBounds(p, x, y, x, y))
+		queue.push_back(p);
+}
+
+void Flush()
+{
+	if (queue.empty())
+		return;
+
+	DrawState state;
+	SetupDrawState(state);
+	if (!state.fb || state.fbStride == 0) {
+		ERROR_LOG(G3D, "Software renderer: bad framebuffer, skipping %i primitives", (int)queue.size());
+		queue.clear();
+		return;
+	}
+
+	int minY = queue[0].minY;
+	int maxY = queue[0].maxY;
+	int pixels = 0;
+	for (size_t i = 0; i < queue.size(); i++) {
+		const Primitive &p = queue[i];
+		minY = p.minY < minY ? p.minY : minY;
+		maxY = p.maxY > maxY ? p.maxY : maxY;
+		if (pixels < PARALLEL_MIN_PIXELS)
+			pixels += (p.maxX - p.minX + 1) * (p.maxY - p.minY + 1);
+	}
+
+	FlushJob job;
+	job.state = &state;
+	int firstBand = minY / BAND_HEIGHT;
+	int lastBand = maxY / BAND_HEIGHT + 1;
+	if (pixels < PARALLEL_MIN_PIXELS)
+		RasterizeRows(&job, firstBand, lastBand);
+	else
+		pool->ParallelLoop(&RasterizeRows, &job, firstBand, lastBand);
+
+	queue.clear();
+}
+
+}  // namespace Rasterizer
@@ -0,0 +1,60 @@
+// Copyright (c) 2012- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+
+#pragma once
+
+#include "../../Globals.h"
+
+// Screen space vertex as produced by the TransformUnit. Positions are in
+// framebuffer pixels, z in depth buffer units.
+struct VertexData
+{
+	float x, y, z;
+	// 1/w of the clip space position, used for perspective correct
+	// interpolation. 1 for through mode vertices.
+	float invw;
+	// Normalized texture coordinates.
+	float u, v;
+	float color0[4];
+	float color1[3];
+	// Fog factor, 1 means no fog.
+	float fog;
+};
+
+// Draws into the framebuffer and depth buffer in PSP memory, following
+// the pixel pipeline state in gstate. Primitives are queued and drawn
+// on Flush, split in screen bands that are processed in parallel.
+namespace Rasterizer
+{
+	void Init();
+	void Shutdown();
+
+	void DrawTriangle(const VertexData &v0, const VertexData &v1, const VertexData &v2);
+	// Axis aligned sprite between two corners, attributes from v1 except
+	// for the texture coordinates.
+	void DrawRectangle(const VertexData &v0, const VertexData &v1);
+	void DrawLine(const VertexData &v0, const VertexData &v1);
+	void DrawPoint(const VertexData &v0);
+
+	// Rasterizes everything queued since the last flush. Must be called
+	// before gstate changes.
+	void Flush();
+
+	// Copies the palette out of memory, like the GE does on LOADCLUT.
+	void LoadClut(u32 addr, u32 bytes);
+}
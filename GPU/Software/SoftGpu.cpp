@@ -0,0 +1,400 @@
+// Copyright (c) 2012- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+
+#include "base/basictypes.h"
+
+#include "../../Core/MemMap.h"
+#include "../../Core/HLE/sceKernelInterrupt.h"
+#include "../GPUState.h"
+#include "../ge_constants.h"
+#include "Rasterizer.h"
+#include "SoftGpu.h"
+#include "TransformUnit.h"
+
+SoftGPU::SoftGPU()
+	: interruptsEnabled_(true),
+		displayFramebuf_(0),
+		displayStride_(0),
+		displayFormat_(0)
+{
+	TransformUnit::Init();
+	Rasterizer::Init();
+}
+
+SoftGPU::~SoftGPU()
+{
+	Rasterizer::Shutdown();
+	TransformUnit::Shutdown();
+}
+
+void SoftGPU::DrawSync(int mode)
+{
+	// Every primitive is finished before the next command runs, so there's nothing to wait for.
+	if (mode == 0)
+		__RunOnePendingInterrupt();
+}
+
+// The display reads PSP VRAM directly, which is where everything is drawn.
+void SoftGPU::SetDisplayFramebuffer(u32 framebuf, u32 stride, int format)
+{
+	displayFramebuf_ = framebuf;
+	displayStride_ = stride;
+	displayFormat_ = format;
+}
+
+void SoftGPU::UpdateStats()
+{
+	gpuStats.numVertexShaders = 0;
+	gpuStats.numFragmentShaders = 0;
+	gpuStats.numShaders = 0;
+	gpuStats.numTextures = 0;
+	gpuStats.numVertexDecoders = 0;
+}
+
+void SoftGPU::ExecuteOp(u32 op, u32 diff)
+{
+	u32 cmd = op >> 24;
+	u32 data = op & 0xFFFFFF;
+
+	switch (cmd)
+	{
+	case GE_CMD_BASE:
+		break;
+
+	case GE_CMD_VADDR:
+		gstate_c.vertexAddr = ((gstate.base & 0x00FF0000) << 8)|data;
+		break;
+
+	case GE_CMD_IADDR:
+		gstate_c.indexAddr	= ((gstate.base & 0x00FF0000) << 8)|data;
+		break;
+
+	case GE_CMD_PRIM:
+		{
+			u32 count = data & 0xFFFF;
+			u32 type = data >> 16;
+
+			if (!Memory::IsValidAddress(gstate_c.vertexAddr)) {
+				ERROR_LOG(G3D, "Bad vertex address %08x!", gstate_c.vertexAddr);
+				break;
+			}
+
+			void *verts = Memory::GetPointer(gstate_c.vertexAddr);
+			void *inds = 0;
+			if ((gstate.vertType & GE_VTYPE_IDX_MASK) != GE_VTYPE_IDX_NONE) {
+				if (!Memory::IsValidAddress(gstate_c.indexAddr)) {
+					ERROR_LOG(G3D, "Bad index address %08x!", gstate_c.indexAddr);
+					break;
+				}
+				inds = Memory::GetPointer(gstate_c.indexAddr);
+			}
+
+			int bytesRead;
+			TransformUnit::SubmitPrimitive(verts, inds, type, count, gstate.vertType, &bytesRead);
+			Rasterizer::Flush();
+			gpuStats.numDrawCalls++;
+
+			// Like the GE, advance past what was drawn.
+			if (inds) {
+				int indexSize = (gstate.vertType & GE_VTYPE_IDX_MASK) == GE_VTYPE_IDX_16BIT ? 2 : 1;
+				gstate_c.indexAddr += count * indexSize;
+			} else {
+				gstate_c.vertexAddr += bytesRead;
+			}
+		}
+		break;
+
+	case GE_CMD_BEZIER:
+	case GE_CMD_SPLINE:
+		{
+			if (!Memory::IsValidAddress(gstate_c.vertexAddr)) {
+				ERROR_LOG(G3D, "Bad vertex address %08x!", gstate_c.vertexAddr);
+				break;
+			}
+
+			void *verts = Memory::GetPointer(gstate_c.vertexAddr);
+			void *inds = 0;
+			if ((gstate.vertType & GE_VTYPE_IDX_MASK) != GE_VTYPE_IDX_NONE) {
+				if (!Memory::IsValidAddress(gstate_c.indexAddr)) {
+					ERROR_LOG(G3D, "Bad index address %08x!", gstate_c.indexAddr);
+					break;
+				}
+				inds = Memory::GetPointer(gstate_c.indexAddr);
+			}
+
+			PatchDesc shape;
+			shape.ucount = data & 0xFF;
+			shape.vcount = (data >> 8) & 0xFF;
+			shape.spline = cmd == GE_CMD_SPLINE;
+			shape.utype = shape.spline ? (data >> 16) & 0x3 : 0;
+			shape.vtype = shape.spline ? (data >> 18) & 0x3 : 0;
+			TransformUnit::SubmitPatch(verts, inds, shape, gstate.vertType);
+			Rasterizer::Flush();
+			gpuStats.numDrawCalls++;
+		}
+		break;
+
+	case GE_CMD_JUMP:
+		{
+			u32 target = (((gstate.base & 0x00FF0000) << 8) | (op & 0xFFFFFC)) & 0x0FFFFFFF;
+			if (Memory::IsValidAddress(target)) {
+				currentList->pc = target - 4; // pc will be increased after we return, counteract that
+			} else {
+				ERROR_LOG(G3D, "JUMP to illegal address %08x - ignoring??", target);
+			}
+		}
+		break;
+
+	case GE_CMD_CALL:
+		{
+			u32 retval = currentList->pc + 4;
+			if (stackptr == ARRAY_SIZE(stack)) {
+				ERROR_LOG(G3D, "CALL: Stack full!");
+			} else {
+				stack[stackptr++] = retval;
+				u32 target = (((gstate.base & 0x00FF0000) << 8) | (op & 0xFFFFFC)) & 0xFFFFFFF;
+				currentList->pc = target - 4;	// pc will be increased after we return, counteract that
+			}
+		}
+		break;
+
+	case GE_CMD_RET:
+		{
+			u32 target = (currentList->pc & 0xF0000000) | (stack[--stackptr] & 0x0FFFFFFF);
+			currentList->pc = target - 4;
+		}
+		break;
+
+	case GE_CMD_SIGNAL:
+		// Processed in GE_END.
+		break;
+
+	case GE_CMD_FINISH:
+		if (interruptsEnabled_)
+			TriggerListInterrupt(currentList->subIntrBase | PSP_GE_SUBINTR_FINISH, 0);
+		break;
+
+	case GE_CMD_END:
+		switch (prev >> 24) {
+		case GE_CMD_SIGNAL:
+			{
+				currentList->status = PSP_GE_LIST_END_REACHED;
+				int behaviour = (prev >> 16) & 0xFF;
+				int signal = prev & 0xFFFF;
+				if (behaviour != 2)
+					ERROR_LOG(G3D, "Signal behaviour %i UNIMPLEMENTED! signal/end: %04x %04x", behaviour, signal, data & 0xFFFF);
+				if (interruptsEnabled_)
+					TriggerListInterrupt(currentList->subIntrBase | PSP_GE_SUBINTR_SIGNAL, signal);
+			}
+			break;
+		case GE_CMD_FINISH:
+			currentList->status = PSP_GE_LIST_DONE;
+			finished = true;
+			break;
+		default:
+			DEBUG_LOG(G3D,"Ah, not finished: %06x", prev & 0xFFFFFF);
+			break;
+		}
+		break;
+
+	case GE_CMD_ORIGIN:
+		gstate.offsetAddr = currentList->pc & 0xFFFFFF;
+		break;
+
+	case GE_CMD_TEXSCALEU:
+		gstate_c.uScale = getFloat24(data);
+		break;
+	case GE_CMD_TEXSCALEV:
+		gstate_c.vScale = getFloat24(data);
+		break;
+	case GE_CMD_TEXOFFSETU:
+		gstate_c.uOff = getFloat24(data);
+		break;
+	case GE_CMD_TEXOFFSETV:
+		gstate_c.vOff = getFloat24(data);
+		break;
+
+	case GE_CMD_TEXSIZE0:
+		// The vertex decoder needs this for through mode texture coordinates.
+		gstate_c.curTextureWidth = 1 << (gstate.texsize[0] & 0xf);
+		gstate_c.curTextureHeight = 1 << ((gstate.texsize[0]>>8) & 0xf);
+		break;
+
+	case GE_CMD_LOADCLUT:
+		{
+			u32 clutAddr = (gstate.clutaddr & 0xFFFFFF) | ((gstate.clutaddrupper << 8) & 0x0F000000);
+			Rasterizer::LoadClut(clutAddr, (data & 0x3F) * 32);
+		}
+		break;
+
+	case GE_CMD_TRANSFERSTART:
+		DoBlockTransfer();
+		break;
+
+	case GE_CMD_LX0:case GE_CMD_LY0:case GE_CMD_LZ0:
+	case GE_CMD_LX1:case GE_CMD_LY1:case GE_CMD_LZ1:
+	case GE_CMD_LX2:case GE_CMD_LY2:case GE_CMD_LZ2:
+	case GE_CMD_LX3:case GE_CMD_LY3:case GE_CMD_LZ3:
+		{
+			int n = cmd - GE_CMD_LX0;
+			gstate_c.lightpos[n / 3][n % 3] = getFloat24(data);
+		}
+		break;
+
+	case GE_CMD_LDX0:case GE_CMD_LDY0:case GE_CMD_LDZ0:
+	case GE_CMD_LDX1:case GE_CMD_LDY1:case GE_CMD_LDZ1:
+	case GE_CMD_LDX2:case GE_CMD_LDY2:case GE_CMD_LDZ2:
+	case GE_CMD_LDX3:case GE_CMD_LDY3:case GE_CMD_LDZ3:
+		{
+			int n = cmd - GE_CMD_LDX0;
+			gstate_c.lightdir[n / 3][n % 3] = getFloat24(data);
+		}
+		break;
+
+	case GE_CMD_LKA0:case GE_CMD_LKB0:case GE_CMD_LKC0:
+	case GE_CMD_LKA1:case GE_CMD_LKB1:case GE_CMD_LKC1:
+	case GE_CMD_LKA2:case GE_CMD_LKB2:case GE_CMD_LKC2:
+	case GE_CMD_LKA3:case GE_CMD_LKB3:case GE_CMD_LKC3:
+		{
+			int n = cmd - GE_CMD_LKA0;
+			gstate_c.lightatt[n / 3][n % 3] = getFloat24(data);
+		}
+		break;
+
+	case GE_CMD_LAC0:case GE_CMD_LAC1:case GE_CMD_LAC2:case GE_CMD_LAC3:
+	case GE_CMD_LDC0:case GE_CMD_LDC1:case GE_CMD_LDC2:case GE_CMD_LDC3:
+	case GE_CMD_LSC0:case GE_CMD_LSC1:case GE_CMD_LSC2:case GE_CMD_LSC3:
+		{
+			int l = (cmd - GE_CMD_LAC0) / 3;
+			int t = (cmd - GE_CMD_LAC0) % 3;
+			gstate_c.lightColor[t][l][0] = (float)(data & 0xff)/255.0f;
+			gstate_c.lightColor[t][l][1] = (float)((data>>8) & 0xff)/255.0f;
+			gstate_c.lightColor[t][l][2] = (float)(data>>16)/255.0f;
+		}
+		break;
+
+	case GE_CMD_MORPHWEIGHT0:
+	case GE_CMD_MORPHWEIGHT1:
+	case GE_CMD_MORPHWEIGHT2:
+	case GE_CMD_MORPHWEIGHT3:
+	case GE_CMD_MORPHWEIGHT4:
+	case GE_CMD_MORPHWEIGHT5:
+	case GE_CMD_MORPHWEIGHT6:
+	case GE_CMD_MORPHWEIGHT7:
+		gstate_c.morphWeights[cmd - GE_CMD_MORPHWEIGHT0] = getFloat24(data);
+		break;
+
+	case GE_CMD_WORLDMATRIXNUMBER:
+		gstate.worldmtxnum &= 0xFF00000F;
+		break;
+
+	case GE_CMD_WORLDMATRIXDATA:
+		{
+			int num = gstate.worldmtxnum & 0xF;
+			if (num < 12)
+				gstate.worldMatrix[num++] = getFloat24(data);
+			gstate.worldmtxnum = (gstate.worldmtxnum & 0xFF000000) | (num & 0xF);
+		}
+		break;
+
+	case GE_CMD_VIEWMATRIXNUMBER:
+		gstate.viewmtxnum &= 0xFF00000F;
+		break;
+
+	case GE_CMD_VIEWMATRIXDATA:
+		{
+			int num = gstate.viewmtxnum & 0xF;
+			if (num < 12)
+				gstate.viewMatrix[num++] = getFloat24(data);
+			gstate.viewmtxnum = (gstate.viewmtxnum & 0xFF000000) | (num & 0xF);
+		}
+		break;
+
+	case GE_CMD_PROJMATRIXNUMBER:
+		gstate.projmtxnum &= 0xFF00000F;
+		break;
+
+	case GE_CMD_PROJMATRIXDATA:
+		{
+			int num = gstate.projmtxnum & 0xF;
+			gstate.projMatrix[num++] = getFloat24(data);
+			gstate.projmtxnum = (gstate.projmtxnum & 0xFF000000) | (num & 0xF);
+		}
+		break;
+
+	case GE_CMD_TGENMATRIXNUMBER:
+		gstate.texmtxnum &= 0xFF00000F;
+		break;
+
+	case GE_CMD_TGENMATRIXDATA:
+		{
+			int num = gstate.texmtxnum & 0xF;
+			if (num < 12)
+				gstate.tgenMatrix[num++] = getFloat24(data);
+			gstate.texmtxnum = (gstate.texmtxnum & 0xFF000000) | (num & 0xF);
+		}
+		break;
+
+	case GE_CMD_BONEMATRIXNUMBER:
+		gstate.boneMatrixNumber &= 0xFF00007F;
+		break;
+
+	case GE_CMD_BONEMATRIXDATA:
+		{
+			int num = gstate.boneMatrixNumber & 0x7F;
+			if (num < 96)
+				gstate.boneMatrix[num++] = getFloat24(data);
+			gstate.boneMatrixNumber = (gstate.boneMatrixNumber & 0xFF000000) | (num & 0x7F);
+		}
+		break;
+
+	default:
+		// Everything else is read straight out of gstate when drawing.
+		break;
+	}
+}
+
+void SoftGPU::DoBlockTransfer()
+{
+	u32 srcBasePtr = (gstate.transfersrc & 0xFFFFFF) | ((gstate.transfersrcw & 0xFF0000) << 8);
+	u32 srcStride = gstate.transfersrcw & 0x3FF;
+
+	u32 dstBasePtr = (gstate.transferdst & 0xFFFFFF) | ((gstate.transferdstw & 0xFF0000) << 8);
+	u32 dstStride = gstate.transferdstw & 0x3FF;
+
+	int srcX = gstate.transfersrcpos & 0x3FF;
+	int srcY = (gstate.transfersrcpos >> 10) & 0x3FF;
+
+	int dstX = gstate.transferdstpos & 0x3FF;
+	int dstY = (gstate.transferdstpos >> 10) & 0x3FF;
+
+	int width = (gstate.transfersize & 0x3FF) + 1;
+	int height = ((gstate.transfersize >> 10) & 0x3FF) + 1;
+
+	int bpp = (gstate.transferstart & 1) ? 4 : 2;
+
+	for (int y = 0; y < height; y++) {
+		u32 src = srcBasePtr + ((y + srcY) * srcStride + srcX) * bpp;
+		u32 dst = dstBasePtr + ((y + dstY) * dstStride + dstX) * bpp;
+		if (!Memory::IsValidAddress(src) || !Memory::IsValidAddress(dst + width * bpp - 1)) {
+			ERROR_LOG(G3D, "Block transfer out of range: %08x to %08x", src, dst);
+			break;
+		}
+		memmove(Memory::GetPointer(dst), Memory::GetPointer(src), width * bpp);
+	}
+}
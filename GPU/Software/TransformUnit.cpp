@@ -0,0 +1,468 @@
+// Copyright (c) 2012- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+
+#include <cmath>
+#include <vector>
+
+#include "../GPUState.h"
+#include "../ge_constants.h"
+#include "../Math3D.h"
+#include "../GLES/VertexDecoder.h"
+#include "Rasterizer.h"
+#include "TransformUnit.h"
+
+namespace TransformUnit
+{
+
+struct ClipVertex
+{
+	// Position after the projection matrix, not yet divided by w.
+	float clip[4];
+	VertexData data;
+};
+
+static VertexDecoder *decoder;
+static std::vector<u8> decoded;
+static std::vector<ClipVertex> transformed;
+// Vertex number i of the current primitive, as an index into transformed.
+static std::vector<int> order;
+static PatchMesh patchMesh;
+
+void Init()
+{
+	decoder = new VertexDecoder();
+}
+
+void Shutdown()
+{
+	delete decoder;
+	decoder = NULL;
+	decoded.clear();
+	transformed.clear();
+	order.clear();
+	patchMesh = PatchMesh();
+}
+
+static inline Vec3 ColorRGB(u32 rgb)
+{
+	return Vec3(rgb & 0xFFFFFF);
+}
+
+// Same model as the GLES backend's software lighting, so the two agree.
+static void Light(float colorOut0[4], float colorOut1[3], const float colorIn[4], const Vec3 &pos, const Vec3 &normal, float dots[4])
+{
+	Vec3 norm = normal.Normalized();
+	Vec3 in(colorIn);
+	int materialUpdate = gstate.materialupdate & 7;
+	Vec3 ambient = (materialUpdate & 1) ? in : ColorRGB(gstate.materialambient);
+	float ambientAlpha = (materialUpdate & 1) ? colorIn[3] : 1.0f;
+	Vec3 diffuse = (materialUpdate & 2) ? in : ColorRGB(gstate.materialdiffuse);
+	Vec3 specular = (materialUpdate & 4) ? in : ColorRGB(gstate.materialspecular);
+	float specCoef = getFloat24(gstate.materialspecularcoef);
+	bool doShadeMapping = gstate.getUVGenMode() == 2;
+
+	Vec3 sum0 = ColorRGB(gstate.ambientcolor).Mul(ambient) + ColorRGB(gstate.materialemissive);
+	float alpha = ((gstate.ambientalpha & 0xFF) / 255.0f) * ambientAlpha;
+	Vec3 sum1(0.0f, 0.0f, 0.0f);
+
+	for (int l = 0; l < 4; l++) {
+		bool enabled = (gstate.lightEnable[l] & 1) != 0;
+		if (!enabled && !doShadeMapping)
+			continue;
+
+		GELightComputation comp = (GELightComputation)(gstate.ltype[l] & 3);
+		GELightType type = (GELightType)((gstate.ltype[l] >> 8) & 3);
+		Vec3 toLight = type == GE_LIGHTTYPE_DIRECTIONAL ? Vec3(gstate_c.lightpos[l]) : Vec3(gstate_c.lightpos[l]) - pos;
+
+		float dot = toLight * norm;
+		if (dot < 0.0f)
+			dot = 0.0f;
+		if (comp == GE_LIGHTCOMP_BOTHWITHPOWDIFFUSE)
+			dot = powf(dot, specCoef);
+
+		float lightScale = 1.0f;
+		float distance = toLight.Normalize();
+		if (type != GE_LIGHTTYPE_DIRECTIONAL) {
+			const float *att = gstate_c.lightatt[l];
+			lightScale = 1.0f / (att[0] + att[1] * distance + att[2] * distance * distance);
+			if (lightScale > 1.0f)
+				lightScale = 1.0f;
+		}
+
+		Vec3 diff = Vec3(gstate_c.lightColor[1][l]).Mul(diffuse) * (dot * lightScale);
+
+		if (comp != GE_LIGHTCOMP_ONLYDIFFUSE) {
+			// The PSP uses a fixed viewer direction.
+			Vec3 halfVec = toLight + Vec3(0.0f, 0.0f, 1.0f);
+			halfVec.Normalize();
+			dot = halfVec * norm;
+			if (dot >= 0.0f)
+				sum1 += Vec3(gstate_c.lightColor[2][l]).Mul(specular) * (powf(dot, specCoef) * lightScale);
+		}
+		dots[l] = dot;
+
+		if (enabled)
+			sum0 += Vec3(gstate_c.lightColor[0][l]).Mul(ambient) + diff;
+	}
+
+	for (int i = 0; i < 3; i++) {
+		colorOut0[i] = sum0[i] > 1.0f ? 1.0f : sum0[i];
+		colorOut1[i] = sum1[i] > 1.0f ? 1.0f : sum1[i];
+	}
+	colorOut0[3] = alpha > 1.0f ? 1.0f : alpha;
+}
+
+static void MaterialColor(float color[4])
+{
+	Vec3 c = ColorRGB(gstate.materialambient);
+	color[0] = c.x;
+	color[1] = c.y;
+	color[2] = c.z;
+	color[3] = (gstate.materialalpha & 0xFF) / 255.0f;
+}
+
+static void TransformVertex(VertexReader &reader, u32 vertType, ClipVertex &out)
+{
+	VertexData &data = out.data;
+	float pos[3];
+	reader.ReadPos(pos);
+
+	float color[4];
+	if (reader.hasColor0())
+		reader.ReadColor0(color);
+	else
+		MaterialColor(color);
+
+	float uv[2] = {0.0f, 0.0f};
+	if (reader.hasUV())
+		reader.ReadUV(uv);
+
+	memset(data.color1, 0, sizeof(data.color1));
+	data.fog = 1.0f;
+
+	if (vertType & GE_VTYPE_THROUGH_MASK) {
+		// Already in screen space, and not lit.
+		data.x = pos[0];
+		data.y = pos[1];
+		data.z = pos[2];
+		data.invw = 1.0f;
+		data.u = uv[0];
+		data.v = uv[1];
+		memcpy(data.color0, color, sizeof(data.color0));
+		return;
+	}
+
+	float world[3], normal[3] = {0.0f, 0.0f, 0.0f};
+	float nrm[3] = {0.0f, 0.0f, 0.0f};
+	if (reader.hasNormal())
+		reader.ReadNrm(nrm);
+	if (gstate.reversenormals & 1) {
+		for (int i = 0; i < 3; i++)
+			nrm[i] = -nrm[i];
+	}
+
+	if ((vertType & GE_VTYPE_WEIGHT_MASK) == GE_VTYPE_WEIGHT_NONE) {
+		Vec3ByMatrix43(world, pos, gstate.worldMatrix);
+		Norm3ByMatrix43(normal, nrm, gstate.worldMatrix);
+	} else {
+		float weights[8];
+		reader.ReadWeights(weights);
+		Vec3 psum(0.0f, 0.0f, 0.0f);
+		Vec3 nsum(0.0f, 0.0f, 0.0f);
+		int numWeights = gstate.getNumBoneWeights();
+		for (int i = 0; i < numWeights; i++) {
+			if (weights[i] == 0.0f)
+				continue;
+			float tpos[3], tnrm[3];
+			Vec3ByMatrix43(tpos, pos, gstate.boneMatrix + i * 12);
+			Norm3ByMatrix43(tnrm, nrm, gstate.boneMatrix + i * 12);
+			psum += Vec3(tpos) * weights[i];
+			nsum += Vec3(tnrm) * weights[i];
+		}
+		Vec3ByMatrix43(world, psum.v, gstate.worldMatrix);
+		Norm3ByMatrix43(normal, nsum.v, gstate.worldMatrix);
+	}
+
+	float dots[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+	if (gstate.lightingEnable & 1) {
+		float lit0[4], lit1[3];
+		Light(lit0, lit1, color, Vec3(world), Vec3(normal), dots);
+		if (gstate.lmode & 1) {
+			memcpy(data.color0, lit0, sizeof(data.color0));
+			memcpy(data.color1, lit1, sizeof(data.color1));
+		} else {
+			for (int i = 0; i < 3; i++)
+				data.color0[i] = lit0[i] + lit1[i] > 1.0f ? 1.0f : lit0[i] + lit1[i];
+			data.color0[3] = lit0[3];
+		}
+	} else {
+		memcpy(data.color0, color, sizeof(data.color0));
+	}
+
+	switch (gstate.getUVGenMode()) {
+	case 0:
+		data.u = uv[0] * gstate_c.uScale + gstate_c.uOff;
+		data.v = uv[1] * gstate_c.vScale + gstate_c.vOff;
+		break;
+	case 1:
+		{
+			Vec3 source;
+			switch (gstate.getUVProjMode()) {
+			case 0: source = Vec3(pos); break;
+			case 1: source = Vec3(uv[0], uv[1], 0.0f); break;
+			case 2: source = Vec3(normal).Normalized(); break;
+			default: source = Vec3(normal); break;
+			}
+			float uvw[3];
+			Vec3ByMatrix43(uvw, source.v, gstate.tgenMatrix);
+			data.u = uvw[0];
+			data.v = uvw[1];
+		}
+		break;
+	case 2:
+		data.u = dots[gstate.getUVLS0()];
+		data.v = dots[gstate.getUVLS1()];
+		break;
+	default:
+		data.u = uv[0];
+		data.v = uv[1];
+		break;
+	}
+
+	float view[3];
+	Vec3ByMatrix43(view, world, gstate.viewMatrix);
+	if (gstate.isFogEnabled()) {
+		float fog = (view[2] + getFloat24(gstate.fog1)) * getFloat24(gstate.fog2);
+		data.fog = fog < 0.0f ? 0.0f : (fog > 1.0f ? 1.0f : fog);
+	}
+
+	const float *m = gstate.projMatrix;
+	for (int i = 0; i < 4; i++)
+		out.clip[i] = view[0] * m[i] + view[1] * m[4 + i] + view[2] * m[8 + i] + m[12 + i];
+}
+
+// Perspective divide and viewport transform.
+static void ToScreen(ClipVertex &v)
+{
+	float invw = 1.0f / v.clip[3];
+	float offsetX = (float)(gstate.offsetx & 0xFFFF) / 16.0f;
+	float offsetY = (float)(gstate.offsety & 0xFFFF) / 16.0f;
+	v.data.x = getFloat24(gstate.viewportx2) + getFloat24(gstate.viewportx1) * v.clip[0] * invw - offsetX;
+	v.data.y = getFloat24(gstate.viewporty2) + getFloat24(gstate.viewporty1) * v.clip[1] * invw - offsetY;
+	v.data.z = getFloat24(gstate.viewportz2) + getFloat24(gstate.viewportz1) * v.clip[2] * invw;
+	v.data.invw = invw;
+}
+
+static ClipVertex Lerp(const ClipVertex &a, const ClipVertex &b, float t)
+{
+	ClipVertex out;
+	for (int i = 0; i < 4; i++)
+		out.clip[i] = a.clip[i] + (b.clip[i] - a.clip[i]) * t;
+	for (int i = 0; i < 4; i++)
+		out.data.color0[i] = a.data.color0[i] + (b.data.color0[i] - a.data.color0[i]) * t;
+	for (int i = 0; i < 3; i++)
+		out.data.color1[i] = a.data.color1[i] + (b.data.color1[i] - a.data.color1[i]) * t;
+	out.data.u = a.data.u + (b.data.u - a.data.u) * t;
+	out.data.v = a.data.v + (b.data.v - a.data.v) * t;
+	out.data.fog = a.data.fog + (b.data.fog - a.data.fog) * t;
+	return out;
+}
+
+// Distance to the near plane, z = -w. Positive is visible.
+static inline float NearDistance(const ClipVertex &v)
+{
+	return v.clip[2] + v.clip[3];
+}
+
+static void SubmitTriangle(const ClipVertex &c0, const ClipVertex &c1, const ClipVertex &c2, bool throughMode)
+{
+	if (throughMode) {
+		Rasterizer::DrawTriangle(c0.data, c1.data, c2.data);
+		return;
+	}
+
+	// Only the near plane is clipped, the rest is left to the scissor.
+	const ClipVertex *in[3] = { &c0, &c1, &c2 };
+	ClipVertex out[4];
+	int numOut = 0;
+	for (int i = 0; i < 3; i++) {
+		const ClipVertex &a = *in[i];
+		const ClipVertex &b = *in[(i + 1) % 3];
+		float da = NearDistance(a);
+		float db = NearDistance(b);
+		if (da >= 0.0f)
+			out[numOut++] = a;
+		if ((da >= 0.0f) != (db >= 0.0f))
+			out[numOut++] = Lerp(a, b, da / (da - db));
+	}
+	if (numOut < 3)
+		return;
+	for (int i = 0; i < numOut; i++)
+		ToScreen(out[i]);
+
+	if (gstate.isCullEnabled() && !gstate.isModeClear()) {
+		// Signed area in screen space, where y points down.
+		const VertexData &v0 = out[0].data, &v1 = out[1].data, &v2 = out[2].data;
+		float area = (v1.x - v0.x) * (v2.y - v0.y) - (v2.x - v0.x) * (v1.y - v0.y);
+		if (gstate.getCullMode() == 0 ? area < 0.0f : area > 0.0f)
+			return;
+	}
+
+	Rasterizer::DrawTriangle(out[0].data, out[1].data, out[2].data);
+	if (numOut == 4)
+		Rasterizer::DrawTriangle(out[0].data, out[2].data, out[3].data);
+}
+
+static bool ToScreenIfVisible(ClipVertex &v, bool throughMode)
+{
+	if (throughMode)
+		return true;
+	if (NearDistance(v) < 0.0f || v.clip[3] <= 0.0f)
+		return false;
+	ToScreen(v);
+	return true;
+}
+
+void SubmitPrimitive(void *verts, void *inds, int prim, int vertexCount, u32 vertexType, int *bytesRead)
+{
+	decoder->SetVertexType(vertexType);
+	const DecVtxFormat &decFmt = decoder->GetDecVtxFmt();
+	*bytesRead = vertexCount * decoder->VertexSize();
+	if (vertexCount <= 0)
+		return;
+
+	int indexType = vertexType & GE_VTYPE_IDX_MASK;
+	int maxVertices = vertexCount;
+	if (indexType == GE_VTYPE_IDX_8BIT)
+		maxVertices = 0x100;
+	else if (indexType == GE_VTYPE_IDX_16BIT)
+		maxVertices = 0x10000;
+	if ((int)decoded.size() < maxVertices * decFmt.stride)
+		decoded.resize(maxVertices * decFmt.stride);
+
+	int lowerBound, upperBound;
+	decoder->DecodeVerts(&decoded[0], verts, inds, prim, vertexCount, &lowerBound, &upperBound);
+	int numVertices = upperBound - lowerBound + 1;
+	if ((int)transformed.size() < numVertices)
+		transformed.resize(numVertices);
+
+	bool throughMode = (vertexType & GE_VTYPE_THROUGH_MASK) != 0;
+	VertexReader reader(&decoded[0], decFmt);
+	for (int i = 0; i < numVertices; i++) {
+		reader.Goto(i);
+		TransformVertex(reader, vertexType, transformed[i]);
+	}
+	gpuStats.numVertsTransformed += numVertices;
+
+	const u8 *inds8 = (const u8 *)inds;
+	const u16 *inds16 = (const u16 *)inds;
+	if ((int)order.size() < vertexCount)
+		order.resize(vertexCount);
+	for (int i = 0; i < vertexCount; i++) {
+		int index = i;
+		if (indexType == GE_VTYPE_IDX_8BIT)
+			index = inds8[i];
+		else if (indexType == GE_VTYPE_IDX_16BIT)
+			index = inds16[i];
+		order[i] = index - lowerBound;
+	}
+
+	switch (prim) {
+	case GE_PRIM_POINTS:
+		for (int i = 0; i < vertexCount; i++) {
+			ClipVertex v = transformed[order[i]];
+			if (ToScreenIfVisible(v, throughMode))
+				Rasterizer::DrawPoint(v.data);
+		}
+		break;
+
+	case GE_PRIM_LINES:
+	case GE_PRIM_LINE_STRIP:
+		{
+			int step = prim == GE_PRIM_LINES ? 2 : 1;
+			for (int i = 0; i + 1 < vertexCount; i += step) {
+				ClipVertex v0 = transformed[order[i]];
+				ClipVertex v1 = transformed[order[i + 1]];
+				if (ToScreenIfVisible(v0, throughMode) && ToScreenIfVisible(v1, throughMode))
+					Rasterizer::DrawLine(v0.data, v1.data);
+			}
+		}
+		break;
+
+	case GE_PRIM_TRIANGLES:
+		for (int i = 0; i + 2 < vertexCount; i += 3)
+			SubmitTriangle(transformed[order[i]], transformed[order[i + 1]], transformed[order[i + 2]], throughMode);
+		break;
+
+	case GE_PRIM_TRIANGLE_STRIP:
+		for (int i = 0; i + 2 < vertexCount; i++) {
+			// Keep the winding consistent for culling.
+			if (i & 1)
+				SubmitTriangle(transformed[order[i + 1]], transformed[order[i]], transformed[order[i + 2]], throughMode);
+			else
+				SubmitTriangle(transformed[order[i]], transformed[order[i + 1]], transformed[order[i + 2]], throughMode);
+		}
+		break;
+
+	case GE_PRIM_TRIANGLE_FAN:
+		for (int i = 1; i + 1 < vertexCount; i++)
+			SubmitTriangle(transformed[order[0]], transformed[order[i]], transformed[order[i + 1]], throughMode);
+		break;
+
+	case GE_PRIM_RECTANGLES:
+		for (int i = 0; i + 1 < vertexCount; i += 2) {
+			ClipVertex v0 = transformed[order[i]];
+			ClipVertex v1 = transformed[order[i + 1]];
+			if (ToScreenIfVisible(v0, throughMode) && ToScreenIfVisible(v1, throughMode))
+				Rasterizer::DrawRectangle(v0.data, v1.data);
+		}
+		break;
+
+	default:
+		ERROR_LOG(G3D, "Software renderer: unknown primitive type %i", prim);
+		break;
+	}
+}
+
+void SubmitPatch(void *verts, void *inds, const PatchDesc &shape, u32 vertexType)
+{
+	PatchDesc desc = shape;
+	if (!SetupPatchDesc(desc, vertexType))
+		return;
+
+	// The control points are decoded like any other vertices, then tessellated from there.
+	decoder->SetVertexType(vertexType);
+	const DecVtxFormat &decFmt = decoder->GetDecVtxFmt();
+	const int indexType = vertexType & GE_VTYPE_IDX_MASK;
+	int maxVertices = desc.ucount * desc.vcount;
+	if (indexType == GE_VTYPE_IDX_8BIT)
+		maxVertices = 0x100;
+	else if (indexType == GE_VTYPE_IDX_16BIT)
+		maxVertices = 0x10000;
+	if ((int)decoded.size() < maxVertices * decFmt.stride)
+		decoded.resize(maxVertices * decFmt.stride);
+
+	int lowerBound, upperBound;
+	decoder->DecodeVerts(&decoded[0], verts, inds, GE_PRIM_POINTS, desc.ucount * desc.vcount, &lowerBound, &upperBound);
+	TessellatePatch(&patchMesh, desc, vertexType, &decoded[0], decFmt, inds, lowerBound);
+
+	int bytesRead;
+	SubmitPrimitive(&patchMesh.verts[0], &patchMesh.indices[0], patchMesh.prim, (int)patchMesh.indices.size(), patchMesh.vertType, &bytesRead);
+}
+
+}  // namespace TransformUnit
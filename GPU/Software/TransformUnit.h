@@ -0,0 +1,34 @@
+// Copyright (c) 2012- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+
+#pragma once
+
+#include "../../Globals.h"
+#include "../GLES/Spline.h"
+
+// Vertex decoding, transform and lighting, clipping and primitive assembly
+// for the software renderer. Finished primitives go to the Rasterizer.
+namespace TransformUnit
+{
+	void Init();
+	void Shutdown();
+
+	void SubmitPrimitive(void *verts, void *inds, int prim, int vertexCount, u32 vertexType, int *bytesRead);
+	// Tessellates a bezier or spline patch with the same code as the GLES backend, then draws the mesh.
+	void SubmitPatch(void *verts, void *inds, const PatchDesc &shape, u32 vertexType);
+}
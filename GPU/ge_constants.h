@@ -429,11 +429,11 @@ enum GETexFunc
 enum GEStencilOp
 {
 	GE_STENCILOP_KEEP=0,
-	GE_STENCILOP_ZERO=0,
-	GE_STENCILOP_REPLACE=0,
-	GE_STENCILOP_INVERT=0,
-	GE_STENCILOP_INCR=0,
-	GE_STENCILOP_DECR=0,
+	GE_STENCILOP_ZERO=1,
+	GE_STENCILOP_REPLACE=2,
+	GE_STENCILOP_INVERT=3,
+	GE_STENCILOP_INCR=4,
+	GE_STENCILOP_DECR=5,
 };
 
 
@@ -52,6 +52,7 @@ SOURCES +=		../Common/ColorUtil.cpp \
 	../Common/MsgHandler.cpp \
 	../Common/StringUtil.cpp \
 	../Common/Thread.cpp \
+	../Common/ThreadPool.cpp \
 	../Common/Timer.cpp \
 	../Common/Version.cpp
 HEADERS +=		../Common/ColorUtil.h \
@@ -70,5 +71,6 @@ HEADERS +=		../Common/ColorUtil.h \
 	../Common/MsgHandler.h \
 	../Common/StringUtil.h \
 	../Common/Thread.h \
+	../Common/ThreadPool.h \
 	../Common/Timer.h
 
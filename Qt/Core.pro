@@ -32,10 +32,12 @@ x86 {
 		../Core/MIPS/x86/CompLoadStore.cpp \
 		../Core/MIPS/x86/CompVFPU.cpp \
 		../Core/MIPS/x86/Jit.cpp \
+		../Core/MIPS/x86/JitBackpatch.cpp \
 		../Core/MIPS/x86/JitCache.cpp \
 		../Core/MIPS/x86/RegCache.cpp
 	HEADERS += ../Core/MIPS/x86/Asm.h \
 		../Core/MIPS/x86/Jit.h \
+		../Core/MIPS/x86/JitBackpatch.h \
 		../Core/MIPS/x86/JitCache.h \
 		../Core/MIPS/x86/RegCache.h
 }
@@ -114,6 +116,7 @@ SOURCES +=	../Core/CPU.cpp \ # Core
 	../Core/MIPS/MIPSDis.cpp \
 	../Core/MIPS/MIPSDisVFPU.cpp \
 	../Core/MIPS/MIPSInt.cpp \
+	../Core/MIPS/MIPSIntCache.cpp \
 	../Core/MIPS/MIPSIntVFPU.cpp \
 	../Core/MIPS/MIPSTables.cpp \
 	../Core/MIPS/MIPSVFPUUtils.cpp \
@@ -131,6 +134,7 @@ SOURCES +=	../Core/CPU.cpp \ # Core
 	../GPU/GLES/Framebuffer.cpp \
 	../GPU/GLES/IndexGenerator.cpp \
 	../GPU/GLES/ShaderManager.cpp \
+	../GPU/GLES/Spline.cpp \
 	../GPU/GLES/StateMapping.cpp \
 	../GPU/GLES/TextureCache.cpp \
 	../GPU/GLES/TransformPipeline.cpp \
@@ -140,7 +144,10 @@ SOURCES +=	../Core/CPU.cpp \ # Core
 	../GPU/GPUCommon.cpp \
 	../GPU/GPUState.cpp \
 	../GPU/Math3D.cpp \
-	../GPU/Null/NullGpu.cpp \ # Kirk
+	../GPU/Null/NullGpu.cpp \
+	../GPU/Software/Rasterizer.cpp \
+	../GPU/Software/SoftGpu.cpp \
+	../GPU/Software/TransformUnit.cpp \ # Kirk
 	../ext/libkirk/AES.c \
 	../ext/libkirk/SHA1.c \
 	../ext/libkirk/bn.c \
@@ -224,6 +231,7 @@ HEADERS +=	../Core/CPU.h \
 	../Core/MIPS/MIPSDis.h \
 	../Core/MIPS/MIPSDisVFPU.h \
 	../Core/MIPS/MIPSInt.h \
+	../Core/MIPS/MIPSIntCache.h \
 	../Core/MIPS/MIPSIntVFPU.h \
 	../Core/MIPS/MIPSTables.h \
 	../Core/MIPS/MIPSVFPUUtils.h \
@@ -241,6 +249,7 @@ HEADERS +=	../Core/CPU.h \
 	../GPU/GLES/Framebuffer.h \
 	../GPU/GLES/IndexGenerator.h \
 	../GPU/GLES/ShaderManager.h \
+	../GPU/GLES/Spline.h \
 	../GPU/GLES/StateMapping.h \
 	../GPU/GLES/TextureCache.h \
 	../GPU/GLES/TransformPipeline.h \
@@ -252,6 +261,9 @@ HEADERS +=	../Core/CPU.h \
 	../GPU/GPUState.h \
 	../GPU/Math3D.h \
 	../GPU/Null/NullGpu.h \
+	../GPU/Software/Rasterizer.h \
+	../GPU/Software/SoftGpu.h \
+	../GPU/Software/TransformUnit.h \
 	../GPU/ge_constants.h \
 	../ext/libkirk/AES.h \
 	../ext/libkirk/SHA1.h \
@@ -65,6 +65,7 @@ LOCAL_SRC_FILES := \
   $(SRC)/Common/FileUtil.cpp \
   $(SRC)/Common/StringUtil.cpp \
   $(SRC)/Common/Thread.cpp \
+  $(SRC)/Common/ThreadPool.cpp \
   $(SRC)/Common/Timer.cpp \
   $(SRC)/Common/ThunkARM.cpp \
   $(SRC)/Common/Misc.cpp \
@@ -78,12 +79,16 @@ LOCAL_SRC_FILES := \
   $(SRC)/GPU/GLES/TextureCache.cpp \
   $(SRC)/GPU/GLES/IndexGenerator.cpp \
   $(SRC)/GPU/GLES/TransformPipeline.cpp \
+  $(SRC)/GPU/GLES/Spline.cpp \
   $(SRC)/GPU/GLES/StateMapping.cpp \
   $(SRC)/GPU/GLES/VertexDecoder.cpp \
   $(SRC)/GPU/GLES/ShaderManager.cpp \
   $(SRC)/GPU/GLES/VertexShaderGenerator.cpp \
   $(SRC)/GPU/GLES/FragmentShaderGenerator.cpp \
   $(SRC)/GPU/Null/NullGpu.cpp \
+  $(SRC)/GPU/Software/Rasterizer.cpp \
+  $(SRC)/GPU/Software/SoftGpu.cpp \
+  $(SRC)/GPU/Software/TransformUnit.cpp \
   $(SRC)/Core/ELF/ElfReader.cpp \
   $(SRC)/Core/ELF/PrxDecrypter.cpp \
   $(SRC)/Core/ELF/ParamSFO.cpp \
@@ -160,6 +165,7 @@ LOCAL_SRC_FILES := \
   $(SRC)/Core/MIPS/MIPSDis.cpp \
   $(SRC)/Core/MIPS/MIPSDisVFPU.cpp \
   $(SRC)/Core/MIPS/MIPSInt.cpp.arm \
+  $(SRC)/Core/MIPS/MIPSIntCache.cpp.arm \
   $(SRC)/Core/MIPS/MIPSIntVFPU.cpp.arm \
   $(SRC)/Core/MIPS/MIPSTables.cpp.arm \
   $(SRC)/Core/MIPS/MIPSVFPUUtils.cpp \
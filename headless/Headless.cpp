@@ -60,6 +60,8 @@ void printUsage(const char *progname, const char *reason)
 	HeadlessHost h2;
 	if (typeid(h1) != typeid(h2))
 		fprintf(stderr, "  --graphics            use the full gpu backend (slower)\n");
+	fprintf(stderr, "  --software            render with the software gpu, no graphics needed\n");
+	fprintf(stderr, "  --gputhread           run display lists on a separate thread (null and software gpu)\n");
 
 	fprintf(stderr, "  -f                    use the fast interpreter\n");
 	fprintf(stderr, "  -j                    use jit (overrides -f)\n");
@@ -74,6 +76,8 @@ int main(int argc, const char* argv[])
 	bool fastInterpreter = false;
 	bool autoCompare = false;
 	bool useGraphics = false;
+	bool useSoftware = false;
+	bool gpuThread = false;
 	
 	const char *bootFilename = 0;
 	const char *mountIso = 0;
@@ -99,6 +103,10 @@ int main(int argc, const char* argv[])
 			autoCompare = true;
 		else if (!strcmp(argv[i], "--graphics"))
 			useGraphics = true;
+		else if (!strcmp(argv[i], "--software"))
+			useSoftware = true;
+		else if (!strcmp(argv[i], "--gputhread"))
+			gpuThread = true;
 		else if (bootFilename == 0)
 			bootFilename = argv[i];
 		else
@@ -147,7 +155,10 @@ int main(int argc, const char* argv[])
 	coreParameter.mountIso = mountIso ? mountIso : "";
 	coreParameter.startPaused = false;
 	coreParameter.cpuCore = useJit ? CPU_JIT : (fastInterpreter ? CPU_FASTINTERPRETER : CPU_INTERPRETER);
-	coreParameter.gpuCore = headlessHost->isGLWorking() ? GPU_GLES : GPU_NULL;
+	if (useSoftware)
+		coreParameter.gpuCore = GPU_SOFTWARE;
+	else
+		coreParameter.gpuCore = headlessHost->isGLWorking() ? GPU_GLES : GPU_NULL;
 	coreParameter.enableSound = false;
 	coreParameter.headLess = true;
 	coreParameter.printfEmuLog = true;
@@ -156,6 +167,7 @@ int main(int argc, const char* argv[])
 	g_Config.bEnableSound = false;
 	g_Config.bFirstRun = false;
 	g_Config.bIgnoreBadMemAccess = true;
+	g_Config.bSeparateGPUThread = gpuThread;
 
 	std::string error_string;
 
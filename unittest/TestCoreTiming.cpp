@@ -0,0 +1,263 @@
+// Copyright (c) 2012- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#include <vector>
+
+#include "Timer.h"
+#include "../Core/CoreTiming.h"
+#include "UnitTest.h"
+
+struct FiredEvent {
+	u64 userdata;
+	s64 time;
+};
+
+static std::vector<FiredEvent> fired;
+static int eventA, eventB, eventResched, eventRemover;
+
+static void RecordEvent(u64 userdata, int cyclesLate) {
+	FiredEvent f = {userdata, (s64)CoreTiming::GetTicks() - cyclesLate};
+	fired.push_back(f);
+}
+
+// Schedules itself again 10 cycles later, plus a second event for the same cycle.
+static void ReschedEvent(u64 userdata, int cyclesLate) {
+	RecordEvent(userdata, cyclesLate);
+	if (userdata < 3) {
+		CoreTiming::ScheduleEvent(10 - cyclesLate, eventResched, userdata + 1);
+		CoreTiming::ScheduleEvent(10 - cyclesLate, eventA, 100 + userdata);
+	}
+}
+
+// Unschedules the event with the next userdata, due on the same cycle.
+static void RemoverEvent(u64 userdata, int cyclesLate) {
+	RecordEvent(userdata, cyclesLate);
+	CoreTiming::UnscheduleEvent(eventA, userdata + 1);
+}
+
+// Runs the CPU side of the clock, like the interpreter loop does, up to the given tick.
+static void RunUntil(s64 ticks) {
+	while ((s64)CoreTiming::GetTicks() < ticks) {
+		s64 step = ticks - (s64)CoreTiming::GetTicks();
+		if (step > CoreTiming::downcount)
+			step = CoreTiming::downcount;
+		CoreTiming::downcount -= (int)step;
+		if (CoreTiming::downcount <= 0)
+			CoreTiming::Advance();
+	}
+	// Events due right at the end.
+	CoreTiming::Advance();
+}
+
+static void SetupCoreTiming() {
+	CoreTiming::Init();
+	fired.clear();
+	eventA = CoreTiming::RegisterEvent("TestA", &RecordEvent);
+	eventB = CoreTiming::RegisterEvent("TestB", &RecordEvent);
+	eventResched = CoreTiming::RegisterEvent("TestResched", &ReschedEvent);
+	eventRemover = CoreTiming::RegisterEvent("TestRemover", &RemoverEvent);
+}
+
+static void ShutdownCoreTiming() {
+	CoreTiming::ClearPendingEvents();
+	CoreTiming::UnregisterAllEvents();
+	CoreTiming::Shutdown();
+}
+
+static bool TestSameTimeOrder() {
+	CoreTiming::ScheduleEvent(100, eventA, 1);
+	CoreTiming::ScheduleEvent(100, eventB, 2);
+	CoreTiming::ScheduleEvent(50, eventA, 0);
+	CoreTiming::ScheduleEvent(100, eventA, 3);
+	CoreTiming::ScheduleEvent(200, eventB, 5);
+	CoreTiming::ScheduleEvent(100, eventB, 4);
+
+	s64 start = CoreTiming::GetTicks();
+	RunUntil(start + 300);
+
+	EXPECT_EQ_INT((int)fired.size(), 6);
+	for (int i = 0; i < 6; i++)
+		EXPECT_EQ_INT((int)fired[i].userdata, i);
+	EXPECT_EQ_INT((int)(fired[0].time - start), 50);
+	EXPECT_EQ_INT((int)(fired[4].time - start), 100);
+	EXPECT_EQ_INT((int)(fired[5].time - start), 200);
+	return true;
+}
+
+static bool TestRemoval() {
+	s64 start = CoreTiming::GetTicks();
+	CoreTiming::ScheduleEvent(100, eventA, 10);
+	CoreTiming::ScheduleEvent(100, eventA, 11);
+	CoreTiming::ScheduleEvent(150, eventA, 12);
+	CoreTiming::ScheduleEvent(120, eventB, 13);
+	CoreTiming::ScheduleEvent(130, eventB, 14);
+	// The remover takes out the event right behind it on the same cycle.
+	CoreTiming::ScheduleEvent(160, eventRemover, 20);
+	CoreTiming::ScheduleEvent(160, eventA, 21);
+	CoreTiming::ScheduleEvent(160, eventA, 22);
+
+	RunUntil(start + 40);
+	EXPECT_EQ_INT((int)CoreTiming::UnscheduleEvent(eventA, 11), 60);
+	CoreTiming::RemoveEvent(eventB);
+	EXPECT_FALSE(CoreTiming::IsScheduled(eventB));
+	EXPECT_TRUE(CoreTiming::IsScheduled(eventA));
+	// Nothing left to remove.
+	EXPECT_EQ_INT((int)CoreTiming::UnscheduleEvent(eventA, 11), 0);
+
+	RunUntil(start + 300);
+	EXPECT_EQ_INT((int)fired.size(), 4);
+	EXPECT_EQ_INT((int)fired[0].userdata, 10);
+	EXPECT_EQ_INT((int)fired[1].userdata, 12);
+	EXPECT_EQ_INT((int)fired[2].userdata, 20);
+	EXPECT_EQ_INT((int)fired[3].userdata, 22);
+	EXPECT_FALSE(CoreTiming::IsScheduled(eventA));
+	return true;
+}
+
+static bool TestRescheduleFromCallback() {
+	s64 start = CoreTiming::GetTicks();
+	CoreTiming::ScheduleEvent(100, eventResched, 0);
+	// Was scheduled first, so runs before the callback's event for the same cycle.
+	CoreTiming::ScheduleEvent(110, eventB, 50);
+
+	RunUntil(start + 300);
+	// Resched 0, B 50, resched 1, A 100, resched 2, A 101, resched 3, A 102.
+	static const int expected[] = {0, 50, 1, 100, 2, 101, 3, 102};
+	static const int expectedTime[] = {100, 110, 110, 110, 120, 120, 130, 130};
+	EXPECT_EQ_INT((int)fired.size(), 8);
+	for (int i = 0; i < 8; i++) {
+		EXPECT_EQ_INT((int)fired[i].userdata, expected[i]);
+		EXPECT_EQ_INT((int)(fired[i].time - start), expectedTime[i]);
+	}
+	return true;
+}
+
+bool TestCoreTiming() {
+	bool (*tests[])() = {&TestSameTimeOrder, &TestRemoval, &TestRescheduleFromCallback};
+	for (size_t i = 0; i < sizeof(tests) / sizeof(tests[0]); i++) {
+		SetupCoreTiming();
+		bool passed = tests[i]();
+		ShutdownCoreTiming();
+		if (!passed)
+			return false;
+	}
+	return true;
+}
+
+// The sorted linked list CoreTiming used before the heap, to compare against.
+class OldEventList {
+public:
+	OldEventList() : first(0) {}
+	~OldEventList() {
+		while (first) {
+			Event *next = first->next;
+			delete first;
+			first = next;
+		}
+	}
+
+	void Schedule(s64 time, int type, u64 userdata) {
+		Event *ne = new Event;
+		ne->time = time;
+		ne->type = type;
+		ne->userdata = userdata;
+		Event **pNext = &first;
+		while (*pNext && (*pNext)->time <= ne->time)
+			pNext = &(*pNext)->next;
+		ne->next = *pNext;
+		*pNext = ne;
+	}
+
+	s64 Unschedule(int type, u64 userdata) {
+		s64 result = 0;
+		Event **pNext = &first;
+		while (*pNext) {
+			Event *ptr = *pNext;
+			if (ptr->type == type && ptr->userdata == userdata) {
+				result = ptr->time;
+				*pNext = ptr->next;
+				delete ptr;
+			} else {
+				pNext = &ptr->next;
+			}
+		}
+		return result;
+	}
+
+private:
+	struct Event {
+		s64 time;
+		u64 userdata;
+		int type;
+		Event *next;
+	};
+	Event *first;
+};
+
+static const int SCHEDULE_OPS = 100000;
+
+// Pseudo random times, the same for both queues.
+static s64 EventTime(u32 &seed) {
+	seed = seed * 1103515245 + 12345;
+	return (seed >> 8) % 100000;
+}
+
+// Schedules SCHEDULE_OPS events, and cancels the oldest one whenever more than pending are queued.
+static void ScheduleCancelNew(int pending) {
+	u32 seed = 1;
+	for (int i = 0; i < SCHEDULE_OPS; i++) {
+		CoreTiming::ScheduleEvent(EventTime(seed), eventA, i);
+		if (i >= pending)
+			CoreTiming::UnscheduleEvent(eventA, i - pending);
+	}
+	CoreTiming::ClearPendingEvents();
+}
+
+static void ScheduleCancelOld(int pending) {
+	OldEventList list;
+	u32 seed = 1;
+	for (int i = 0; i < SCHEDULE_OPS; i++) {
+		list.Schedule(EventTime(seed), eventA, i);
+		if (i >= pending)
+			list.Unschedule(eventA, i - pending);
+	}
+}
+
+bool BenchCoreTimingSchedule() {
+	static const int pendingCounts[] = {16, 128, 1024};
+	const int rounds = 5;
+
+	SetupCoreTiming();
+	printf("  %d schedules and cancels per round, %d rounds\n", SCHEDULE_OPS, rounds);
+	for (size_t p = 0; p < sizeof(pendingCounts) / sizeof(pendingCounts[0]); p++) {
+		u32 start = Common::Timer::GetTimeMs();
+		for (int r = 0; r < rounds; r++)
+			ScheduleCancelNew(pendingCounts[p]);
+		u32 heapMs = Common::Timer::GetTimeMs() - start;
+
+		start = Common::Timer::GetTimeMs();
+		for (int r = 0; r < rounds; r++)
+			ScheduleCancelOld(pendingCounts[p]);
+		u32 listMs = Common::Timer::GetTimeMs() - start;
+
+		double ops = (double)SCHEDULE_OPS * rounds;
+		printf("  %4d pending  heap: %5u ms (%.1f ns/op)  sorted list: %5u ms (%.1f ns/op)\n", pendingCounts[p],
+			heapMs, heapMs * 1000000.0 / ops, listMs, listMs * 1000000.0 / ops);
+	}
+	ShutdownCoreTiming();
+	return true;
+}
@@ -0,0 +1,146 @@
+// Copyright (c) 2012- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#include <vector>
+
+#include "../Core/Config.h"
+#include "../Core/MemMap.h"
+#include "../Core/HLE/sceGe.h"
+#include "../Core/HLE/sceKernelInterrupt.h"
+#include "../GPU/GPUState.h"
+#include "../GPU/ge_constants.h"
+#include "../GPU/Null/NullGpu.h"
+#include "UnitTest.h"
+
+static const u32 LIST_ADDR = 0x08810000;
+static const u32 LIST_SIZE = 16;
+static const int NUM_LISTS = 300;
+
+// Records list interrupts instead of raising them, and which thread ran the lists.
+class ThreadTestGPU : public NullGPU {
+public:
+	struct Raised {
+		int subIntr;
+		int arg;
+		bool onEmuThread;
+	};
+
+	ThreadTestGPU() : emuThread(std::this_thread::get_id()), ranOnOtherThread(false) {}
+
+	// NullGPU's would run the kernel's pending interrupts, there are none here.
+	virtual void DrawSync(int mode) {}
+
+	virtual void ExecuteOp(u32 op, u32 diff) {
+		if (std::this_thread::get_id() != emuThread)
+			ranOnOtherThread = true;
+		NullGPU::ExecuteOp(op, diff);
+	}
+
+	std::thread::id emuThread;
+	volatile bool ranOnOtherThread;
+	std::vector<Raised> raised;
+
+protected:
+	virtual void RaiseListInterrupt(int intrType, int subIntr, int arg) {
+		Raised r = {subIntr, arg, std::this_thread::get_id() == emuThread};
+		raised.push_back(r);
+	}
+};
+
+// SIGNAL with the list's number, then FINISH and END.
+static u32 WriteList(int i) {
+	u32 addr = LIST_ADDR + i * LIST_SIZE;
+	Memory::Write_U32((GE_CMD_SIGNAL << 24) | (i & 0xFFFF), addr);
+	Memory::Write_U32(GE_CMD_END << 24, addr + 4);
+	Memory::Write_U32(GE_CMD_FINISH << 24, addr + 8);
+	Memory::Write_U32(GE_CMD_END << 24, addr + 12);
+	return addr;
+}
+
+// Each list raises its signal, then its finish, in list order.
+static bool CheckRaised(const ThreadTestGPU &test, int count) {
+	EXPECT_EQ_INT((int)test.raised.size(), count * 2);
+	for (int i = 0; i < count; i++) {
+		const ThreadTestGPU::Raised &signal = test.raised[i * 2];
+		const ThreadTestGPU::Raised &finish = test.raised[i * 2 + 1];
+		EXPECT_EQ_INT(signal.subIntr, PSP_GE_SUBINTR_SIGNAL);
+		EXPECT_EQ_INT(signal.arg, i);
+		EXPECT_EQ_INT(finish.subIntr, PSP_GE_SUBINTR_FINISH);
+		EXPECT_TRUE(signal.onEmuThread && finish.onEmuThread);
+	}
+	return true;
+}
+
+// A list that starts stalled only runs once the stall moves, and raises nothing before that.
+static bool TestStalledList(ThreadTestGPU &test) {
+	u32 addr = WriteList(0);
+	int id = sceGeListEnQueue(addr, addr, -1, 0);
+	EXPECT_EQ_INT(sceGeListSync(id, 1), PSP_GE_LIST_STALL_REACHED);
+	EXPECT_EQ_INT((int)test.raised.size(), 0);
+
+	sceGeListUpdateStallAddr(id, addr + LIST_SIZE);
+	// Done lists leave the queue.
+	EXPECT_EQ_HEX(sceGeListSync(id, 1), 0x80000100);
+	EXPECT_TRUE(CheckRaised(test, 1));
+	test.raised.clear();
+	return true;
+}
+
+// More lists than the GPU thread's command ring holds, then a DrawSync.
+static bool TestManyLists(ThreadTestGPU &test) {
+	std::vector<int> ids;
+	for (int i = 0; i < NUM_LISTS; i++)
+		ids.push_back(sceGeListEnQueue(WriteList(i), 0, -1, 0));
+	sceGeDrawSync(0);
+	EXPECT_TRUE(CheckRaised(test, NUM_LISTS));
+
+	for (int i = 0; i < NUM_LISTS; i++)
+		EXPECT_EQ_HEX(sceGeListSync(ids[i], 1), 0x80000100);
+	EXPECT_EQ_INT((int)test.raised.size(), NUM_LISTS * 2);
+	test.raised.clear();
+	return true;
+}
+
+static bool RunLists(bool separateThread) {
+	bool oldSeparate = g_Config.bSeparateGPUThread;
+	GPUInterface *oldGpu = gpu;
+	g_Config.bSeparateGPUThread = separateThread;
+
+	bool passed;
+	{
+		ThreadTestGPU test;
+		gpu = &test;
+		passed = TestStalledList(test) && TestManyLists(test);
+		if (passed && test.ranOnOtherThread != separateThread) {
+			printf("Lists %s on the GPU thread\n", separateThread ? "didn't run" : "ran");
+			passed = false;
+		}
+		test.SyncThread();
+	}
+
+	gpu = oldGpu;
+	g_Config.bSeparateGPUThread = oldSeparate;
+	return passed;
+}
+
+// Display lists give the same interrupts and statuses with or without the GPU thread.
+bool TestGPUThread() {
+	Memory::Init();
+	bool passed = RunLists(false) && RunLists(true);
+	Memory::Shutdown();
+	return passed;
+}
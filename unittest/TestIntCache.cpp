@@ -0,0 +1,149 @@
+// Copyright (c) 2012- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#include "base/basictypes.h"
+#include "Timer.h"
+#include "../Core/Core.h"
+#include "../Core/CoreTiming.h"
+#include "../Core/MemMap.h"
+#include "../Core/System.h"
+#include "../Core/MIPS/MIPS.h"
+#include "../Core/MIPS/MIPSIntCache.h"
+#include "../Core/MIPS/MIPSTables.h"
+#include "UnitTest.h"
+
+static const u32 LOOP_ADDR = 0x08804000;
+
+// Common ALU and load/store ops, plus a mult and mflo that go through the generic handler.
+// The interpreters only count cycles for delay slots, so each pass takes one cycle.
+static const u32 loopCode[] = {
+	0x3C090890, // lui t1, 0x0890
+	0x25080001, // addiu t0, t0, 1
+	0x01095021, // addu t2, t0, t1
+	0x000A5880, // sll t3, t2, 2
+	0x016A6026, // xor t4, t3, t2
+	0xAD2C0000, // sw t4, 0(t1)
+	0x8D2D0000, // lw t5, 0(t1)
+	0x010D0018, // mult t0, t5
+	0x00007012, // mflo t6
+	0x0A201000, // j LOOP_ADDR
+	0x00000000, // nop
+};
+
+static void StopCore(u64 userdata, int cyclesLate) {
+	coreState = CORE_POWERDOWN;
+}
+
+static void WriteLoop() {
+	for (size_t i = 0; i < ARRAY_SIZE(loopCode); i++)
+		Memory::Write_U32(loopCode[i], LOOP_ADDR + (u32)i * 4);
+	mipsr4k.InvalidateICache(LOOP_ADDR, sizeof(loopCode));
+}
+
+// Runs from pc until the given number of cycles have passed.
+static void RunFor(bool fast, int cycles) {
+	int stopEvent = CoreTiming::RegisterEvent("StopCore", &StopCore);
+	CoreTiming::ScheduleEvent(cycles, stopEvent);
+	coreState = CORE_RUNNING;
+	// Only the event stops them, the plain interpreter also returns when passing globalTicks.
+	if (fast)
+		MIPSInterpret_RunFastUntil(0xFFFFFFFFFFFFFFFFULL);
+	else
+		MIPSInterpret_RunUntil(0xFFFFFFFFFFFFFFFFULL);
+	CoreTiming::ClearPendingEvents();
+	CoreTiming::UnregisterAllEvents();
+}
+
+static void StartInterpreter() {
+	Memory::Init();
+	CoreTiming::Init();
+	mipsr4k.Reset();
+	mipsr4k.pc = LOOP_ADDR;
+}
+
+static void StopInterpreter() {
+	MIPSIntCache_Shutdown();
+	CoreTiming::Shutdown();
+	Memory::Shutdown();
+	coreState = CORE_POWERDOWN;
+}
+
+static void SaveRegs(u32 regs[32]) {
+	for (int i = 0; i < 32; i++)
+		regs[i] = mipsr4k.r[i];
+}
+
+// Runs the loop on the given interpreter, then changes the loop's addiu to add 2 instead,
+// and runs it again. Returns all GPRs.
+static void RunChangingLoop(bool fast, u32 regs[32], u32 changedRegs[32]) {
+	StartInterpreter();
+	WriteLoop();
+	RunFor(fast, 1000);
+	SaveRegs(regs);
+
+	Memory::Write_U32(0x25080002, LOOP_ADDR + 4);
+	mipsr4k.InvalidateICache(LOOP_ADDR + 4, 4);
+	RunFor(fast, 1000);
+	SaveRegs(changedRegs);
+	StopInterpreter();
+}
+
+// The predecoded interpreter must agree with the plain one, also after the code changes.
+bool TestFastInterpreter() {
+	CPUCore oldCore = PSP_CoreParameter().cpuCore;
+	PSP_CoreParameter().cpuCore = CPU_FASTINTERPRETER;
+
+	u32 fast[32], fastChanged[32], slow[32], slowChanged[32];
+	RunChangingLoop(true, fast, fastChanged);
+	RunChangingLoop(false, slow, slowChanged);
+	PSP_CoreParameter().cpuCore = oldCore;
+
+	EXPECT_TRUE(slow[8] > 900);
+	EXPECT_TRUE(slowChanged[8] - slow[8] > 2 * 900);
+	for (int i = 0; i < 32; i++) {
+		EXPECT_EQ_HEX(fast[i], slow[i]);
+		EXPECT_EQ_HEX(fastChanged[i], slowChanged[i]);
+	}
+	return true;
+}
+
+static u32 TimeLoop(bool fast, int cycles) {
+	StartInterpreter();
+	WriteLoop();
+	u32 start = Common::Timer::GetTimeMs();
+	RunFor(fast, cycles);
+	u32 ms = Common::Timer::GetTimeMs() - start;
+	StopInterpreter();
+	return ms;
+}
+
+// Times the predecoded interpreter against the plain one on the same loop.
+bool BenchFastInterpreter() {
+	CPUCore oldCore = PSP_CoreParameter().cpuCore;
+	PSP_CoreParameter().cpuCore = CPU_FASTINTERPRETER;
+
+	const int passes = 5000000;
+	const double ops = (double)passes * ARRAY_SIZE(loopCode);
+	u32 fastMs = TimeLoop(true, passes);
+	u32 slowMs = TimeLoop(false, passes);
+	PSP_CoreParameter().cpuCore = oldCore;
+
+	printf("  %d loop passes, %d ops each\n", passes, (int)ARRAY_SIZE(loopCode));
+	printf("  predecoded: %5u ms (%.2f ns/op)\n", fastMs, fastMs * 1000000.0 / ops);
+	printf("  plain:      %5u ms (%.2f ns/op)\n", slowMs, slowMs * 1000000.0 / ops);
+	return true;
+}
@@ -0,0 +1,290 @@
+// Copyright (c) 2012- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#include <map>
+
+#include "MemoryUtil.h"
+#include "Timer.h"
+#include "../Core/Core.h"
+#include "../Core/MemMap.h"
+#include "../Core/System.h"
+#include "../Core/MIPS/MIPS.h"
+#include "../Core/MIPS/MIPSCodeUtils.h"
+#include "../Core/MIPS/JitCommon/JitCommon.h"
+#if defined(_M_IX86) || defined(_M_X64)
+#include "x64Emitter.h"
+#include "../Core/MIPS/x86/Jit.h"
+#include "../Core/MIPS/x86/JitCache.h"
+#endif
+#include "UnitTest.h"
+
+#if defined(_M_IX86) || defined(_M_X64)
+
+// The lookup before the tables: read the emuhack back out of RAM.
+static int EmuhackBlockLookup(JitBlockCache &cache, u32 addr) {
+	u32 inst = Memory::Read_U32(addr);
+	if (!MIPS_IS_EMUHACK(inst))
+		return -1;
+	int bl = inst & MIPS_EMUHACK_VALUE_MASK;
+	if (bl >= cache.GetNumBlocks() || cache.GetBlock(bl)->originalAddress != addr)
+		return -1;
+	return bl;
+}
+
+// The invalidation before the range buckets, over a map of (end, start) ranges.
+typedef std::map<std::pair<u32, u32>, u32> OldBlockMap;
+static int OldInvalidateICache(JitBlockCache &cache, OldBlockMap &blockMap, u32 address, u32 length) {
+	u32 pAddr = address & 0x1FFFFFFF;
+	int hits = 0;
+	OldBlockMap::iterator it = blockMap.lower_bound(std::make_pair(pAddr, 0));
+	for (; it != blockMap.end() && it->first.second < pAddr + length; ++it) {
+		if (!cache.GetBlock(it->second)->invalid)
+			hits++;
+	}
+	return hits;
+}
+
+// Times the dispatcher's block lookup: hits spread over RAM, and misses between them.
+bool BenchJitBlockLookup() {
+	const int NUM_BLOCKS = 30000;
+	const u32 BLOCK_SPACING = 64;
+	const u32 START = 0x08804000;
+	const int ROUNDS = 200;
+
+	Memory::Init();
+	JitBlockCache cache(&mipsr4k);
+	cache.Init();
+	OldBlockMap blockMap;
+
+	// Nothing runs these, so there's no real code behind them.
+	static u8 fakeCode[16];
+	for (int i = 0; i < NUM_BLOCKS; i++) {
+		u32 addr = START + i * BLOCK_SPACING;
+		Memory::Write_U32(0, addr);
+		int num = cache.AllocateBlock(addr);
+		JitBlock *b = cache.GetBlock(num);
+		b->checkedEntry = fakeCode;
+		b->normalEntry = fakeCode;
+		// Half the spacing, so invalidating the gaps in between finds nothing.
+		b->originalSize = BLOCK_SPACING / 8;
+		b->codeSize = 0;
+		cache.FinalizeBlock(num, false, fakeCode);
+		blockMap[std::make_pair(addr + BLOCK_SPACING / 2 - 1, addr)] = num;
+	}
+
+	int found = 0;
+	u32 start = Common::Timer::GetTimeMs();
+	for (int round = 0; round < ROUNDS; round++) {
+		for (int i = 0; i < NUM_BLOCKS; i++)
+			found += cache.GetBlockNumberFromStartAddress(START + i * BLOCK_SPACING) >= 0;
+	}
+	u32 hitMs = Common::Timer::GetTimeMs() - start;
+
+	int missed = 0;
+	start = Common::Timer::GetTimeMs();
+	for (int round = 0; round < ROUNDS; round++) {
+		for (int i = 0; i < NUM_BLOCKS; i++)
+			missed += cache.GetBlockNumberFromStartAddress(START + i * BLOCK_SPACING + 4) < 0;
+	}
+	u32 missMs = Common::Timer::GetTimeMs() - start;
+
+	int oldFound = 0;
+	start = Common::Timer::GetTimeMs();
+	for (int round = 0; round < ROUNDS; round++) {
+		for (int i = 0; i < NUM_BLOCKS; i++)
+			oldFound += EmuhackBlockLookup(cache, START + i * BLOCK_SPACING) >= 0;
+	}
+	u32 oldHitMs = Common::Timer::GetTimeMs() - start;
+
+	// Small invalidations that miss, like most icache invalidations of data.
+	start = Common::Timer::GetTimeMs();
+	for (int round = 0; round < ROUNDS; round++) {
+		for (int i = 0; i < NUM_BLOCKS; i++)
+			cache.InvalidateICache(START + i * BLOCK_SPACING + BLOCK_SPACING / 2, BLOCK_SPACING / 2);
+	}
+	u32 invalidateMs = Common::Timer::GetTimeMs() - start;
+
+	int oldHits = 0;
+	start = Common::Timer::GetTimeMs();
+	for (int round = 0; round < ROUNDS; round++) {
+		for (int i = 0; i < NUM_BLOCKS; i++)
+			oldHits += OldInvalidateICache(cache, blockMap, START + i * BLOCK_SPACING + BLOCK_SPACING / 2, BLOCK_SPACING / 2);
+	}
+	u32 oldInvalidateMs = Common::Timer::GetTimeMs() - start;
+
+	const double lookups = (double)NUM_BLOCKS * ROUNDS;
+	printf("%d blocks, %.0f lookups each way\n", NUM_BLOCKS, lookups);
+	printf("  hits:   %u ms, %.1f ns/lookup (emuhack lookup: %u ms, %.1f ns)\n", hitMs, hitMs * 1000000.0 / lookups,
+		oldHitMs, oldHitMs * 1000000.0 / lookups);
+	printf("  misses: %u ms, %.1f ns/lookup\n", missMs, missMs * 1000000.0 / lookups);
+	printf("  invalidations: %u ms, %.1f ns each (block map: %u ms, %.1f ns)\n", invalidateMs, invalidateMs * 1000000.0 / lookups,
+		oldInvalidateMs, oldInvalidateMs * 1000000.0 / lookups);
+
+	const bool intact = cache.GetBlockNumberFromStartAddress(START) == 0;
+	cache.Shutdown();
+	Memory::Shutdown();
+	return found == NUM_BLOCKS * ROUNDS && missed == NUM_BLOCKS * ROUNDS && oldFound == found && oldHits == 0 && intact;
+}
+
+// A fake compiled block: a checked entry and a few exits, each a slot that fits
+// an unlinked exit (MOV to pc, JMP to the dispatcher) or a linked one (JMP).
+static const int FAKE_SLOT_SIZE = 32;
+static const int FAKE_BLOCK_SIZE = FAKE_SLOT_SIZE * (1 + MAX_JIT_BLOCK_EXITS);
+
+static int AddFakeBlock(JitBlockCache &cache, u8 *code, u32 addr, const u32 *exits, int numExits) {
+	const u8 *dispatcher = MIPSComp::jit->Asm().dispatcher;
+	int num = cache.AllocateBlock(addr);
+	JitBlock *b = cache.GetBlock(num);
+	u8 *base = code + num * FAKE_BLOCK_SIZE;
+	b->checkedEntry = base;
+	b->normalEntry = base;
+	b->originalSize = 2;
+	b->codeSize = FAKE_BLOCK_SIZE;
+	for (int e = 0; e < numExits; e++) {
+		u8 *exitPtr = base + FAKE_SLOT_SIZE * (1 + e);
+		b->exitAddress[e] = exits[e];
+		b->exitPtrs[e] = exitPtr;
+		Gen::XEmitter emit(exitPtr);
+		emit.MOV(32, Gen::M(&mipsr4k.pc), Gen::Imm32(exits[e]));
+		emit.JMP(dispatcher, true);
+	}
+	cache.FinalizeBlock(num, true, base);
+	return num;
+}
+
+// True if the exit is patched into a jump straight to the block's checked entry.
+static bool ExitJumpsTo(JitBlockCache &cache, int from, int e, int to) {
+	const u8 *p = cache.GetBlock(from)->exitPtrs[e];
+	if (p[0] != 0xE9)
+		return false;
+	s32 rel;
+	memcpy(&rel, p + 1, 4);
+	return p + 5 + rel == cache.GetBlock(to)->checkedEntry;
+}
+
+static bool ExitLinked(JitBlockCache &cache, int from, int e, int to) {
+	return cache.GetBlock(from)->linkStatus[e] && ExitJumpsTo(cache, from, e, to);
+}
+
+static bool ExitUnlinked(JitBlockCache &cache, int from, int e, int to) {
+	return !cache.GetBlock(from)->linkStatus[e] && !ExitJumpsTo(cache, from, e, to);
+}
+
+static bool TestBlockLinks(JitBlockCache &cache, u8 *code) {
+	const u32 A = 0x08804000, B = 0x08805000, C = 0x08806000;
+	Memory::Write_U32(0x24020001, A);
+	Memory::Write_U32(0x24020002, B);
+	Memory::Write_U32(0x24020003, C);
+
+	// A jumps to B and C, B to C, C back to A.
+	const u32 exitsA[] = {B, C};
+	const u32 exitsB[] = {C};
+	const u32 exitsC[] = {A};
+	int a = AddFakeBlock(cache, code, A, exitsA, 2);
+	EXPECT_TRUE(ExitUnlinked(cache, a, 0, a) && !cache.GetBlock(a)->linkStatus[1]);
+
+	// New blocks get linked from the exits already waiting for them.
+	int b = AddFakeBlock(cache, code, B, exitsB, 1);
+	EXPECT_TRUE(ExitLinked(cache, a, 0, b));
+	EXPECT_FALSE(cache.GetBlock(a)->linkStatus[1]);
+	int c = AddFakeBlock(cache, code, C, exitsC, 1);
+	EXPECT_TRUE(ExitLinked(cache, a, 1, c));
+	EXPECT_TRUE(ExitLinked(cache, b, 0, c));
+	EXPECT_TRUE(ExitLinked(cache, c, 0, a));
+	EXPECT_EQ_INT(cache.GetBlockNumberFromStartAddress(B), b);
+
+	// Invalidating B puts its first op back and unlinks A's jump to it, nothing else.
+	cache.InvalidateICache(B, 8);
+	EXPECT_TRUE(cache.GetBlock(b)->invalid);
+	EXPECT_EQ_INT(cache.GetBlockNumberFromStartAddress(B), -1);
+	EXPECT_EQ_INT((int)Memory::Read_U32(B), 0x24020002);
+	EXPECT_TRUE(ExitUnlinked(cache, a, 0, b));
+	EXPECT_TRUE(ExitLinked(cache, a, 1, c));
+	EXPECT_TRUE(ExitLinked(cache, c, 0, a));
+	EXPECT_EQ_INT(cache.GetBlockNumberFromStartAddress(A), a);
+	EXPECT_EQ_INT(cache.GetBlockNumberFromStartAddress(C), c);
+
+	// Compiled again, A links to the new block.
+	int b2 = AddFakeBlock(cache, code, B, exitsB, 1);
+	EXPECT_EQ_INT(cache.GetBlockNumberFromStartAddress(B), b2);
+	EXPECT_TRUE(ExitLinked(cache, a, 0, b2));
+	EXPECT_TRUE(ExitLinked(cache, b2, 0, c));
+
+	// Invalidating C unlinks both live blocks jumping there. The dead B is off C's list.
+	cache.InvalidateICache(C - 4, 12);
+	EXPECT_EQ_INT(cache.GetBlockNumberFromStartAddress(C), -1);
+	EXPECT_TRUE(ExitUnlinked(cache, a, 1, c));
+	EXPECT_TRUE(ExitUnlinked(cache, b2, 0, c));
+	EXPECT_TRUE(ExitLinked(cache, a, 0, b2));
+	EXPECT_TRUE(cache.GetBlock(b)->linkStatus[0]);
+
+	// A range covering everything takes out the rest.
+	cache.InvalidateICache(A, C - A);
+	EXPECT_EQ_INT(cache.GetBlockNumberFromStartAddress(A), -1);
+	EXPECT_EQ_INT(cache.GetBlockNumberFromStartAddress(B), -1);
+	EXPECT_EQ_INT((int)Memory::Read_U32(A), 0x24020001);
+
+	// After a clear, a block at the same address starts out with nothing linked.
+	cache.Clear();
+	EXPECT_EQ_INT(cache.GetNumBlocks(), 0);
+	int c2 = AddFakeBlock(cache, code, C, exitsC, 1);
+	EXPECT_EQ_INT(cache.GetBlockNumberFromStartAddress(C), c2);
+	EXPECT_FALSE(cache.GetBlock(c2)->linkStatus[0]);
+	int a2 = AddFakeBlock(cache, code, A, exitsA, 2);
+	EXPECT_TRUE(ExitLinked(cache, a2, 1, c2));
+	EXPECT_TRUE(ExitLinked(cache, c2, 0, a2));
+	EXPECT_FALSE(cache.GetBlock(a2)->linkStatus[0]);
+	return true;
+}
+
+// Links, unlinks and invalidates fake blocks, and checks the lookups and the patched exits.
+bool TestJitBlockLinks() {
+	Memory::Init();
+	CPUCore oldCore = PSP_CoreParameter().cpuCore;
+	PSP_CoreParameter().cpuCore = CPU_JIT;
+	mipsr4k.Reset();
+
+	// Unlinking writes a MOV to mips->pc, so this has to be allocated like JIT code.
+	const size_t codeSize = FAKE_BLOCK_SIZE * 16;
+	u8 *code = (u8 *)AllocateExecutableMemory(codeSize);
+	JitBlockCache cache(&mipsr4k);
+	cache.Init();
+
+	bool passed = TestBlockLinks(cache, code);
+
+	cache.Shutdown();
+	FreeMemoryPages(code, codeSize);
+	delete MIPSComp::jit;
+	MIPSComp::jit = 0;
+	PSP_CoreParameter().cpuCore = oldCore;
+	Memory::Shutdown();
+	return passed;
+}
+
+#else
+
+bool TestJitBlockLinks() {
+	printf("Only the x86 JIT uses the lookup tables.\n");
+	return true;
+}
+
+bool BenchJitBlockLookup() {
+	printf("Only the x86 JIT uses the lookup tables.\n");
+	return true;
+}
+
+#endif
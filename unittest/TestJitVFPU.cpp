@@ -0,0 +1,258 @@
+// Copyright (c) 2012- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#include <math.h>
+#include <string.h>
+
+#include "base/basictypes.h"
+#include "../Core/Core.h"
+#include "../Core/CoreTiming.h"
+#include "../Core/MemMap.h"
+#include "../Core/System.h"
+#include "../Core/MIPS/MIPS.h"
+#include "../Core/MIPS/MIPSTables.h"
+#include "../Core/MIPS/JitCommon/JitCommon.h"
+#if defined(_M_IX86) || defined(_M_X64)
+#include "../Core/MIPS/x86/Jit.h"
+#endif
+#include "UnitTest.h"
+
+#if defined(_M_IX86) || defined(_M_X64)
+
+// Runs single VFPU ops through the JIT and the interpreter from the same state, and compares.
+// Each case sets all three prefixes first, since the JIT only compiles natively when it knows them.
+
+enum {
+	OP_VADD = 0x60000000,
+	OP_VSUB = 0x60800000,
+	OP_VDIV = 0x63800000,
+	OP_VMUL = 0x64000000,
+	OP_VDOT = 0x64800000,
+	OP_VSCL = 0x65000000,
+	OP_VPFXS = 0xDC000000,
+	OP_VPFXT = 0xDD000000,
+	OP_VPFXD = 0xDE000000,
+	OP_VMMUL = 0xF0000000,
+	OP_VTFM2 = 0xF0800000,
+	OP_VTFM3 = 0xF1000000,
+	OP_VTFM4 = 0xF1800000,
+	OP_VCRSP = 0xF2800000,
+	OP_JR_RA = 0x03E00008,
+	OP_NOP = 0x00000000,
+};
+
+enum {
+	SZ_S = 0x0000,
+	SZ_P = 0x0080,
+	SZ_T = 0x8000,
+	SZ_Q = 0x8080,
+};
+
+// Register numbers: matrix in bits 2-4, column in 0-1, row in 5-6 (bit 5 transposes vectors).
+enum {
+	C000 = 0x00, C100 = 0x04, C200 = 0x08,
+	R000 = 0x20, R100 = 0x24, R200 = 0x28,
+	S000 = 0x00, S001 = 0x20, S100 = 0x04, S200 = 0x08,
+	M000 = 0x00, M100 = 0x04, M200 = 0x08, E000 = 0x20,
+};
+
+static u32 VOp(u32 op, u32 size, int vd, int vs, int vt) {
+	return op | size | (vt << 16) | (vs << 8) | vd;
+}
+
+const u32 PFX_NONE = 0xE4;
+const u32 PFX_D_NONE = 0;
+// Not a prefix, just leaves them out so the JIT can't know them.
+const u32 PFX_SKIP = 0xFFFFFFFF;
+
+struct VFPUCase {
+	const char *name;
+	u32 op;
+	u32 prefixS;
+	u32 prefixT;
+	u32 prefixD;
+};
+
+static const VFPUCase cases[] = {
+	{"vadd.q", VOp(OP_VADD, SZ_Q, C200, C000, C100), PFX_NONE, PFX_NONE, PFX_D_NONE},
+	{"vsub.t", VOp(OP_VSUB, SZ_T, C200, C000, C100), PFX_NONE, PFX_NONE, PFX_D_NONE},
+	{"vmul.p", VOp(OP_VMUL, SZ_P, C200, C000, C100), PFX_NONE, PFX_NONE, PFX_D_NONE},
+	{"vdiv.s", VOp(OP_VDIV, SZ_S, S200, S000, S100), PFX_NONE, PFX_NONE, PFX_D_NONE},
+	{"vmul.q rows", VOp(OP_VMUL, SZ_Q, R200, R000, R100), PFX_NONE, PFX_NONE, PFX_D_NONE},
+	{"vadd.q in place", VOp(OP_VADD, SZ_Q, C000, C000, C100), PFX_NONE, PFX_NONE, PFX_D_NONE},
+	// Reversed S swizzle, negated T lanes 0 and 2, saturated D lanes 0 and 1.
+	{"vadd.q swizzle/neg/sat", VOp(OP_VADD, SZ_Q, C200, C000, C100), 0x1B, 0x500E4, 0x0D},
+	// Reversed swizzle in place, so later lanes read what earlier lanes write.
+	{"vadd.q swizzle in place", VOp(OP_VADD, SZ_Q, C000, C000, C100), 0x1B, PFX_NONE, PFX_D_NONE},
+	// Abs on S, constants 0 and 1 in T lanes 0 and 1, D masks lanes 1 and 3.
+	{"vsub.q abs/const/mask", VOp(OP_VSUB, SZ_Q, C200, C000, C100), 0xFE4, 0x30E4, 0xA00},
+	{"vmul.q broadcast", VOp(OP_VMUL, SZ_Q, C200, C000, C100), 0x00, PFX_NONE, PFX_D_NONE},
+	// Swizzles past the end of a pair, left to the interpreter.
+	{"vadd.p out of size", VOp(OP_VADD, SZ_P, C200, C000, C100), 0xE6, PFX_NONE, PFX_D_NONE},
+	{"vadd.q unknown prefixes", VOp(OP_VADD, SZ_Q, C200, C000, C100), PFX_SKIP, PFX_SKIP, PFX_SKIP},
+	{"vdot.q", VOp(OP_VDOT, SZ_Q, S200, C000, C100), PFX_NONE, PFX_NONE, PFX_D_NONE},
+	{"vdot.t neg/sat", VOp(OP_VDOT, SZ_T, S200, C000, C100), 0x100E4, PFX_NONE, 0x03},
+	{"vdot.p in place", VOp(OP_VDOT, SZ_P, S000, C000, C100), PFX_NONE, PFX_NONE, PFX_D_NONE},
+	{"vscl.q", VOp(OP_VSCL, SZ_Q, C200, C000, S100), PFX_NONE, PFX_NONE, PFX_D_NONE},
+	{"vscl.t abs/mask", VOp(OP_VSCL, SZ_T, C200, C000, S100), 0xFE4, PFX_NONE, 0x200},
+	// The scale is lane 1 of the destination.
+	{"vscl.q scale in place", VOp(OP_VSCL, SZ_Q, C000, C000, S001), PFX_NONE, PFX_NONE, PFX_D_NONE},
+	{"vmmul.q", VOp(OP_VMMUL, SZ_Q, M200, M000, M100), PFX_NONE, PFX_NONE, PFX_D_NONE},
+	{"vmmul.t", VOp(OP_VMMUL, SZ_T, M200, M000, M100), PFX_NONE, PFX_NONE, PFX_D_NONE},
+	{"vmmul.p transposed", VOp(OP_VMMUL, SZ_P, M200, E000, M100), PFX_NONE, PFX_NONE, PFX_D_NONE},
+	{"vmmul.q in place", VOp(OP_VMMUL, SZ_Q, M000, M000, M100), PFX_NONE, PFX_NONE, PFX_D_NONE},
+	{"vtfm4.q", VOp(OP_VTFM4, SZ_Q, C200, M000, C100), PFX_NONE, PFX_NONE, PFX_D_NONE},
+	{"vtfm3.t", VOp(OP_VTFM3, SZ_T, C200, M000, C100), PFX_NONE, PFX_NONE, PFX_D_NONE},
+	{"vtfm2.p", VOp(OP_VTFM2, SZ_P, C200, M000, C100), PFX_NONE, PFX_NONE, PFX_D_NONE},
+	{"vhtfm4.t", VOp(OP_VTFM4, SZ_T, C200, M000, C100), PFX_NONE, PFX_NONE, PFX_D_NONE},
+	{"vtfm4.q in place", VOp(OP_VTFM4, SZ_Q, C100, M000, C100), PFX_NONE, PFX_NONE, PFX_D_NONE},
+	{"vcrsp.t", VOp(OP_VCRSP, SZ_T, C200, C000, C100), PFX_NONE, PFX_NONE, PFX_D_NONE},
+	{"vcrsp.t in place", VOp(OP_VCRSP, SZ_T, C000, C000, C100), PFX_NONE, PFX_NONE, PFX_D_NONE},
+	// vqmul.q, left to the interpreter.
+	{"vqmul.q", VOp(OP_VCRSP, SZ_Q, C200, C000, C100), PFX_NONE, PFX_NONE, PFX_D_NONE},
+};
+
+struct VFPURegs {
+	float v[128];
+	u32 vfpuCtrl[16];
+};
+
+const u32 TEST_CODE_START = 0x08804000;
+const u32 TEST_CODE_SPACING = 0x40;
+const u32 TEST_RETURN_ADDR = 0x08800000;
+
+static void StopTestEvent(u64 userdata, int cyclesLate) {
+}
+
+static int WriteCase(const VFPUCase &c, u32 addr, u32 *ops) {
+	int n = 0;
+	if (c.prefixS != PFX_SKIP) {
+		ops[n++] = OP_VPFXS | c.prefixS;
+		ops[n++] = OP_VPFXT | c.prefixT;
+		ops[n++] = OP_VPFXD | c.prefixD;
+	}
+	ops[n++] = c.op;
+	for (int i = 0; i < n; i++)
+		Memory::Write_U32(ops[i], addr + i * 4);
+	Memory::Write_U32(OP_JR_RA, addr + n * 4);
+	Memory::Write_U32(OP_NOP, addr + n * 4 + 4);
+	return n;
+}
+
+// Small exact values, none of them zero so vdiv stays finite.
+static void ResetRegs() {
+	for (int i = 0; i < 128; i++)
+		mipsr4k.v[i] = (float)((i * 37) % 61 - 30) / 8.0f + 0.0625f;
+	mipsr4k.vfpuCtrl[VFPU_CTRL_SPREFIX] = 0xE4;
+	mipsr4k.vfpuCtrl[VFPU_CTRL_TPREFIX] = 0xE4;
+	mipsr4k.vfpuCtrl[VFPU_CTRL_DPREFIX] = 0;
+	mipsr4k.r[MIPS_REG_RA] = TEST_RETURN_ADDR;
+}
+
+static void SaveRegs(VFPURegs &regs) {
+	memcpy(regs.v, mipsr4k.v, sizeof(regs.v));
+	memcpy(regs.vfpuCtrl, mipsr4k.vfpuCtrl, sizeof(regs.vfpuCtrl));
+}
+
+static bool SameFloat(float a, float b) {
+	u32 abits, bbits;
+	memcpy(&abits, &a, 4);
+	memcpy(&bbits, &b, 4);
+	if (abits == bbits || (a != a && b != b))
+		return true;
+	// Only the summing ops could round differently.
+	return fabsf(a - b) <= 1e-6f * (fabsf(a) > 1.0f ? fabsf(a) : 1.0f);
+}
+
+static bool CompareRegs(const VFPUCase &c, const VFPURegs &interp, const VFPURegs &jit) {
+	bool same = true;
+	for (int i = 0; i < 128; i++) {
+		if (!SameFloat(interp.v[i], jit.v[i])) {
+			printf("%s: v[%d] interp %f jit %f\n", c.name, i, interp.v[i], jit.v[i]);
+			same = false;
+		}
+	}
+	for (int i = 0; i < 16; i++) {
+		if (interp.vfpuCtrl[i] != jit.vfpuCtrl[i]) {
+			printf("%s: vfpuCtrl[%d] interp %08x jit %08x\n", c.name, i, interp.vfpuCtrl[i], jit.vfpuCtrl[i]);
+			same = false;
+		}
+	}
+	return same;
+}
+
+bool TestJitVFPU() {
+	Memory::Init();
+	CoreTiming::Init();
+	CPUCore oldCore = PSP_CoreParameter().cpuCore;
+	PSP_CoreParameter().cpuCore = CPU_JIT;
+	mipsr4k.Reset();
+	int stopEvent = CoreTiming::RegisterEvent("VFPUTestStop", &StopTestEvent);
+
+	int failed = 0;
+	for (size_t i = 0; i < ARRAY_SIZE(cases); i++) {
+		const VFPUCase &c = cases[i];
+		u32 addr = TEST_CODE_START + (u32)i * TEST_CODE_SPACING;
+		u32 ops[4];
+		int n = WriteCase(c, addr, ops);
+
+		VFPURegs interp, jit;
+		ResetRegs();
+		for (int j = 0; j < n; j++) {
+			mipsr4k.pc = addr + j * 4;
+			MIPSInterpret(ops[j]);
+		}
+		SaveRegs(interp);
+
+		// With the next event a cycle away, the block's exit bails out of the dispatcher.
+		ResetRegs();
+		mipsr4k.pc = addr;
+		CoreTiming::ClearPendingEvents();
+		CoreTiming::ScheduleEvent(1, stopEvent);
+		coreState = CORE_STEPPING;
+		MIPSComp::jit->RunLoopUntil(0);
+		SaveRegs(jit);
+
+		if (mipsr4k.pc != TEST_RETURN_ADDR) {
+			printf("%s: jit stopped at %08x\n", c.name, mipsr4k.pc);
+			failed++;
+		} else if (!CompareRegs(c, interp, jit)) {
+			failed++;
+		}
+	}
+
+	CoreTiming::ClearPendingEvents();
+	CoreTiming::UnregisterAllEvents();
+	CoreTiming::Shutdown();
+	delete MIPSComp::jit;
+	MIPSComp::jit = 0;
+	PSP_CoreParameter().cpuCore = oldCore;
+	coreState = CORE_RUNNING;
+	Memory::Shutdown();
+
+	EXPECT_EQ_INT(failed, 0);
+	return true;
+}
+
+#else
+
+bool TestJitVFPU() {
+	printf("Only the x86 JIT compiles VFPU ops natively.\n");
+	return true;
+}
+
+#endif
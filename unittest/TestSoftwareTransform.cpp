@@ -0,0 +1,424 @@
+// Copyright (c) 2012- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+#include <vector>
+
+#include "base/basictypes.h"
+#include "Timer.h"
+#include "../GPU/GPUState.h"
+#include "../GPU/ge_constants.h"
+#include "../GPU/GLES/TransformPipeline.h"
+#include "../GPU/GLES/VertexDecoder.h"
+#include "UnitTest.h"
+
+// Not a multiple of the batch size, so the last batch is a short one.
+static const int TEST_VERTS = 37;
+
+static u32 seed;
+
+static float RandomFloat(float lo, float hi) {
+	seed = seed * 1103515245 + 12345;
+	return lo + (hi - lo) * ((seed >> 8) & 0xFFFF) / 65535.0f;
+}
+
+static u32 Float24(float f) {
+	u32 bits;
+	memcpy(&bits, &f, 4);
+	return bits >> 8;
+}
+
+static void RandomMatrix(float *m, int size) {
+	for (int i = 0; i < size; i++)
+		m[i] = RandomFloat(-1.0f, 1.0f);
+	// Keep it well away from singular.
+	m[0] += 2.0f;
+	m[4] += 2.0f;
+	m[8] += 2.0f;
+}
+
+// Decodes random vertices in the given format, all float except the color.
+static void MakeDecodedVertices(VertexDecoder &dec, std::vector<u8> &decoded, u32 vtype) {
+	dec.SetVertexType(vtype);
+	std::vector<float> raw(TEST_VERTS * dec.VertexSize() / 4 + 1);
+	for (size_t i = 0; i < raw.size(); i++)
+		raw[i] = RandomFloat(-1.0f, 1.0f);
+	// Colors are the only bytes, any pattern is a valid color.
+
+	decoded.resize(TEST_VERTS * 64);
+	int lower, upper;
+	dec.DecodeVerts(&decoded[0], &raw[0], 0, GE_PRIM_TRIANGLES, TEST_VERTS, &lower, &upper);
+}
+
+static void SetupLights(int lightsOn, int comps, int types) {
+	for (int l = 0; l < 4; l++) {
+		gstate.lightEnable[l] = (lightsOn >> l) & 1;
+		gstate.ltype[l] = ((comps >> (l * 2)) & 3) | (((types >> (l * 2)) & 3) << 8);
+		for (int i = 0; i < 3; i++) {
+			gstate_c.lightpos[l][i] = RandomFloat(-3.0f, 3.0f);
+			gstate_c.lightColor[0][l][i] = RandomFloat(0.0f, 0.3f);
+			gstate_c.lightColor[1][l][i] = RandomFloat(0.0f, 1.0f);
+			gstate_c.lightColor[2][l][i] = RandomFloat(0.0f, 1.0f);
+		}
+		gstate_c.lightatt[l][0] = 1.0f;
+		gstate_c.lightatt[l][1] = RandomFloat(0.0f, 0.5f);
+		gstate_c.lightatt[l][2] = RandomFloat(0.0f, 0.1f);
+	}
+}
+
+static void SetupTransformState() {
+	RandomMatrix(gstate.worldMatrix, 12);
+	RandomMatrix(gstate.viewMatrix, 12);
+	RandomMatrix(gstate.tgenMatrix, 12);
+	for (int i = 0; i < 8; i++)
+		RandomMatrix(gstate.boneMatrix + i * 12, 12);
+
+	gstate.materialambient = 0x8040C0;
+	gstate.materialalpha = 0xA0;
+	gstate.materialdiffuse = 0xC0C0C0;
+	gstate.materialspecular = 0x808080;
+	gstate.materialemissive = 0x101010;
+	gstate.ambientcolor = 0x202020;
+	gstate.ambientalpha = 0xFF;
+	gstate.materialspecularcoef = Float24(8.0f);
+
+	gstate_c.uScale = 1.5f;
+	gstate_c.vScale = 0.5f;
+	gstate_c.uOff = 0.25f;
+	gstate_c.vOff = -0.125f;
+	gstate_c.curTextureWidth = 256;
+	gstate_c.curTextureHeight = 256;
+}
+
+// The per-vertex scalar transform that the batched one replaced.
+
+static void Vec3ByMatrix43(float out[3], const float v[3], const float m[12]) {
+	for (int i = 0; i < 3; i++)
+		out[i] = v[0] * m[i] + v[1] * m[3 + i] + v[2] * m[6 + i] + m[9 + i];
+}
+
+static void Norm3ByMatrix43(float out[3], const float v[3], const float m[12]) {
+	for (int i = 0; i < 3; i++)
+		out[i] = v[0] * m[i] + v[1] * m[3 + i] + v[2] * m[6 + i];
+}
+
+static float Dot3(const float a[3], const float b[3]) {
+	return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+}
+
+static void Normalize3(float v[3]) {
+	float scale = 1.0f / sqrtf(Dot3(v, v));
+	for (int i = 0; i < 3; i++)
+		v[i] *= scale;
+}
+
+static void ReferenceLight(float colorOut0[4], float colorOut1[4], const float colorIn[4], const float pos[3], const float normal[3], float dots[4]) {
+	const bool doShadeMapping = (gstate.texmapmode & 0x3) == 2;
+	if (!doShadeMapping && !(gstate.lightEnable[0] & 1) && !(gstate.lightEnable[1] & 1) && !(gstate.lightEnable[2] & 1) && !(gstate.lightEnable[3] & 1)) {
+		memcpy(colorOut0, colorIn, sizeof(float) * 4);
+		memset(colorOut1, 0, sizeof(float) * 4);
+		return;
+	}
+
+	Color4 materialEmissive, globalAmbient, materialAmbient, materialDiffuse, materialSpecular;
+	materialEmissive.GetFromRGB(gstate.materialemissive);
+	materialEmissive.a = 0.0f;
+	globalAmbient.GetFromRGB(gstate.ambientcolor);
+	globalAmbient.GetFromA(gstate.ambientalpha);
+	materialAmbient.GetFromRGB(gstate.materialambient);
+	materialAmbient.a = 1.0f;
+	materialDiffuse.GetFromRGB(gstate.materialdiffuse);
+	materialDiffuse.a = 1.0f;
+	materialSpecular.GetFromRGB(gstate.materialspecular);
+	materialSpecular.a = 1.0f;
+	const float specCoef = getFloat24(gstate.materialspecularcoef);
+	const int materialUpdate = gstate.materialupdate & 7;
+
+	float norm[3] = {normal[0], normal[1], normal[2]};
+	Normalize3(norm);
+	Color4 in(colorIn);
+	const Color4 &ambient = (materialUpdate & 1) ? in : materialAmbient;
+	const Color4 &diffuse = (materialUpdate & 2) ? in : materialDiffuse;
+	const Color4 &specular = (materialUpdate & 4) ? in : materialSpecular;
+
+	Color4 lightSum0 = globalAmbient * ambient + materialEmissive;
+	Color4 lightSum1(0, 0, 0, 0);
+	for (int l = 0; l < 4; l++) {
+		if ((gstate.lightEnable[l] & 1) == 0 && !doShadeMapping)
+			continue;
+
+		GELightComputation comp = (GELightComputation)(gstate.ltype[l] & 3);
+		GELightType type = (GELightType)((gstate.ltype[l] >> 8) & 3);
+		float toLight[3];
+		for (int i = 0; i < 3; i++)
+			toLight[i] = gstate_c.lightpos[l][i] - (type == GE_LIGHTTYPE_DIRECTIONAL ? 0.0f : pos[i]);
+
+		float dot = Dot3(toLight, norm);
+		if (dot < 0.0f)
+			dot = 0.0f;
+		if (comp == GE_LIGHTCOMP_BOTHWITHPOWDIFFUSE)
+			dot = powf(dot, specCoef);
+
+		float lightScale = 1.0f;
+		float distance = sqrtf(Dot3(toLight, toLight));
+		Normalize3(toLight);
+		if (type != GE_LIGHTTYPE_DIRECTIONAL) {
+			const float *att = gstate_c.lightatt[l];
+			lightScale = 1.0f / (att[0] + att[1] * distance + att[2] * distance * distance);
+			if (lightScale > 1.0f)
+				lightScale = 1.0f;
+		}
+
+		Color4 diff = (Color4(gstate_c.lightColor[1][l], 0.0f) * diffuse) * (dot * lightScale);
+		if (comp != GE_LIGHTCOMP_ONLYDIFFUSE) {
+			float halfVec[3] = {toLight[0], toLight[1], toLight[2] + 1.0f};
+			Normalize3(halfVec);
+			dot = Dot3(halfVec, norm);
+			if (dot >= 0.0f)
+				lightSum1 += Color4(gstate_c.lightColor[2][l], 0.0f) * specular * (powf(dot, specCoef) * lightScale);
+		}
+		dots[l] = dot;
+		if (gstate.lightEnable[l] & 1)
+			lightSum0 += Color4(gstate_c.lightColor[0][l], 1.0f) * ambient + diff;
+	}
+
+	for (int i = 0; i < 4; i++) {
+		colorOut0[i] = lightSum0[i] > 1.0f ? 1.0f : lightSum0[i];
+		colorOut1[i] = lightSum1[i] > 1.0f ? 1.0f : lightSum1[i];
+	}
+}
+
+static void ReferenceTransform(TransformedVertex *out, u8 *decoded, const DecVtxFormat &decFmt, u32 vertType, int count) {
+	const bool throughmode = (vertType & GE_VTYPE_THROUGH_MASK) != 0;
+	VertexReader reader(decoded, decFmt);
+	for (int index = 0; index < count; index++) {
+		reader.Goto(index);
+		TransformedVertex &vert = out[index];
+		float c0[4], c1[4] = {0, 0, 0, 0}, uv[2] = {0, 0};
+
+		float unlitColor[4];
+		if (reader.hasColor0()) {
+			reader.ReadColor0(unlitColor);
+		} else {
+			unlitColor[0] = ((gstate.materialambient >> 16) & 0xFF) / 255.f;
+			unlitColor[1] = ((gstate.materialambient >> 8) & 0xFF) / 255.f;
+			unlitColor[2] = (gstate.materialambient & 0xFF) / 255.f;
+			unlitColor[3] = (gstate.materialalpha & 0xFF) / 255.f;
+		}
+		memcpy(c0, unlitColor, sizeof(c0));
+
+		float pos[3], nrm[3] = {0, 0, 0};
+		reader.ReadPos(pos);
+		if (throughmode) {
+			memcpy(&vert.x, pos, sizeof(pos));
+			if (reader.hasUV())
+				reader.ReadUV(uv);
+		} else {
+			if (reader.hasNormal())
+				reader.ReadNrm(nrm);
+
+			float world[3], norm[3];
+			if ((vertType & GE_VTYPE_WEIGHT_MASK) == GE_VTYPE_WEIGHT_NONE) {
+				Vec3ByMatrix43(world, pos, gstate.worldMatrix);
+				Norm3ByMatrix43(norm, nrm, gstate.worldMatrix);
+			} else {
+				float weights[8];
+				reader.ReadWeights(weights);
+				float psum[3] = {0, 0, 0}, nsum[3] = {0, 0, 0};
+				int nweights = ((vertType & GE_VTYPE_WEIGHTCOUNT_MASK) >> GE_VTYPE_WEIGHTCOUNT_SHIFT) + 1;
+				for (int i = 0; i < nweights; i++) {
+					float tpos[3], tnorm[3];
+					Vec3ByMatrix43(tpos, pos, gstate.boneMatrix + i * 12);
+					Norm3ByMatrix43(tnorm, nrm, gstate.boneMatrix + i * 12);
+					for (int j = 0; j < 3; j++) {
+						psum[j] += tpos[j] * weights[i];
+						nsum[j] += tnorm[j] * weights[i];
+					}
+				}
+				Vec3ByMatrix43(world, psum, gstate.worldMatrix);
+				Norm3ByMatrix43(norm, nsum, gstate.worldMatrix);
+			}
+
+			float dots[4] = {0, 0, 0, 0};
+			float litColor0[4], litColor1[4];
+			ReferenceLight(litColor0, litColor1, unlitColor, world, norm, dots);
+			if (gstate.lightingEnable & 1) {
+				for (int j = 0; j < 4; j++) {
+					if (gstate.lmode & 1) {
+						c0[j] = litColor0[j];
+						c1[j] = litColor1[j];
+					} else {
+						c0[j] = litColor0[j] + litColor1[j];
+					}
+				}
+			}
+
+			if (reader.hasUV()) {
+				float ruv[2];
+				reader.ReadUV(ruv);
+				switch (gstate.getUVGenMode()) {
+				case 0:
+					uv[0] = ruv[0] * gstate_c.uScale + gstate_c.uOff;
+					uv[1] = ruv[1] * gstate_c.vScale + gstate_c.vOff;
+					break;
+				case 1:
+					{
+						float source[3] = {0, 0, 0}, uvw[3];
+						switch (gstate.getUVProjMode()) {
+						case 0: memcpy(source, pos, sizeof(source)); break;
+						case 1: source[0] = ruv[0]; source[1] = ruv[1]; break;
+						case 2: memcpy(source, norm, sizeof(source)); Normalize3(source); break;
+						case 3: memcpy(source, norm, sizeof(source)); break;
+						}
+						Vec3ByMatrix43(uvw, source, gstate.tgenMatrix);
+						uv[0] = uvw[0];
+						uv[1] = uvw[1];
+					}
+					break;
+				case 2:
+					uv[0] = dots[gstate.getUVLS0()];
+					uv[1] = dots[gstate.getUVLS1()];
+					break;
+				}
+			}
+
+			Vec3ByMatrix43(&vert.x, world, gstate.viewMatrix);
+		}
+
+		vert.u = uv[0];
+		vert.v = uv[1];
+		memcpy(vert.color0, c0, sizeof(vert.color0));
+		memcpy(vert.color1, c1, sizeof(vert.color1));
+	}
+}
+
+static bool Close(float a, float b) {
+	if (a != a || b != b)
+		return a != a && b != b;
+	float scale = std::max(1.0f, std::max(fabsf(a), fabsf(b)));
+	return fabsf(a - b) <= 1e-4f * scale;
+}
+
+static bool CompareTransformed(const char *what, const TransformedVertex *batched, const TransformedVertex *reference) {
+	static const char *fields[12] = {"x", "y", "z", "u", "v", "r0", "g0", "b0", "a0", "r1", "g1", "b1"};
+	for (int i = 0; i < TEST_VERTS; i++) {
+		const float *a = &batched[i].x;
+		const float *b = &reference[i].x;
+		for (int f = 0; f < 12; f++) {
+			if (!Close(a[f], b[f])) {
+				printf("%s: vertex %d %s is %f, expected %f\n", what, i, fields[f], a[f], b[f]);
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+struct TransformCase {
+	const char *name;
+	u32 vtype;
+	int lighting;
+	int lightsOn;
+	int comps;  // Two bits per light.
+	int types;
+	int lmode;
+	int materialUpdate;
+	u32 texmapmode;
+	u32 texshade;
+};
+
+static const u32 VTYPE_LIT = GE_VTYPE_TC_FLOAT | GE_VTYPE_COL_8888 | GE_VTYPE_NRM_FLOAT | GE_VTYPE_POS_FLOAT;
+static const u32 VTYPE_SKINNED = GE_VTYPE_WEIGHT_FLOAT | (2 << GE_VTYPE_WEIGHTCOUNT_SHIFT) | GE_VTYPE_TC_FLOAT | GE_VTYPE_NRM_FLOAT | GE_VTYPE_POS_FLOAT;
+static const u32 VTYPE_THROUGH = GE_VTYPE_THROUGH | GE_VTYPE_TC_FLOAT | GE_VTYPE_COL_8888 | GE_VTYPE_POS_FLOAT;
+
+static const TransformCase transformCases[] = {
+	{"unlit", VTYPE_LIT, 0, 0, 0, 0, 0, 0, 0, 0},
+	{"four lights", VTYPE_LIT, 1, 0xF, 0xE4, 0x24, 0, 0, 0, 0},
+	{"separate specular", VTYPE_LIT, 1, 0xF, 0xE4, 0x24, 1, 7, 0, 0},
+	{"some lights off", VTYPE_LIT, 1, 0x5, 0x99, 0x11, 1, 2, 0, 0},
+	{"skinned", VTYPE_SKINNED, 1, 0xF, 0x66, 0x24, 0, 5, 0, 0},
+	{"uv projection 0", VTYPE_LIT, 1, 0x3, 0x55, 0x00, 0, 0, 0x001, 0},
+	{"uv projection 1", VTYPE_LIT, 1, 0x3, 0x55, 0x00, 0, 0, 0x101, 0},
+	{"uv projection 2", VTYPE_SKINNED, 1, 0x3, 0x55, 0x00, 0, 0, 0x201, 0},
+	{"uv projection 3", VTYPE_LIT, 1, 0x3, 0x55, 0x00, 0, 0, 0x301, 0},
+	{"shade mapping", VTYPE_LIT, 0, 0x0, 0xE4, 0x24, 0, 0, 0x002, 0x0301},
+	{"lit shade mapping", VTYPE_LIT, 1, 0x6, 0xE4, 0x24, 1, 1, 0x002, 0x0102},
+	{"through", VTYPE_THROUGH, 1, 0xF, 0xE4, 0x24, 0, 0, 0, 0},
+};
+
+static void SetupCase(const TransformCase &c) {
+	SetupTransformState();
+	SetupLights(c.lightsOn, c.comps, c.types);
+	gstate.lightingEnable = c.lighting;
+	gstate.lmode = c.lmode;
+	gstate.materialupdate = c.materialUpdate;
+	gstate.texmapmode = c.texmapmode;
+	gstate.texshade = c.texshade;
+}
+
+// Runs the batched software transform and the per-vertex one over the same vertices and state.
+bool TestSoftwareTransform() {
+	VertexDecoder dec;
+	std::vector<u8> decoded;
+	TransformedVertex batched[TEST_VERTS], reference[TEST_VERTS];
+
+	seed = 1;
+	for (int i = 0; i < (int)ARRAY_SIZE(transformCases); i++) {
+		const TransformCase &c = transformCases[i];
+		SetupCase(c);
+		MakeDecodedVertices(dec, decoded, c.vtype);
+
+		SoftwareTransformVertices(batched, &decoded[0], dec.GetDecVtxFmt(), c.vtype, TEST_VERTS);
+		ReferenceTransform(reference, &decoded[0], dec.GetDecVtxFmt(), c.vtype, TEST_VERTS);
+		if (!CompareTransformed(c.name, batched, reference))
+			return false;
+	}
+	return true;
+}
+
+// Times the batched software transform against the per-vertex one, with four lights.
+bool BenchSoftwareTransform() {
+	const int reps = 20000;
+	VertexDecoder dec;
+	std::vector<u8> decoded;
+	TransformedVertex out[TEST_VERTS];
+
+	static const int benchCases[] = {0, 2, 4};
+	seed = 1;
+	for (int i = 0; i < (int)ARRAY_SIZE(benchCases); i++) {
+		const TransformCase &c = transformCases[benchCases[i]];
+		SetupCase(c);
+		MakeDecodedVertices(dec, decoded, c.vtype);
+
+		u32 start = Common::Timer::GetTimeMs();
+		for (int r = 0; r < reps; r++)
+			SoftwareTransformVertices(out, &decoded[0], dec.GetDecVtxFmt(), c.vtype, TEST_VERTS);
+		u32 batchedMs = Common::Timer::GetTimeMs() - start;
+
+		start = Common::Timer::GetTimeMs();
+		for (int r = 0; r < reps; r++)
+			ReferenceTransform(out, &decoded[0], dec.GetDecVtxFmt(), c.vtype, TEST_VERTS);
+		u32 scalarMs = Common::Timer::GetTimeMs() - start;
+
+		double verts = (double)reps * TEST_VERTS;
+		printf("  %-18s batched: %4u ms (%.1f ns/vertex)  per vertex: %4u ms (%.1f ns/vertex)\n", c.name,
+			batchedMs, batchedMs * 1000000.0 / verts, scalarMs, scalarMs * 1000000.0 / verts);
+	}
+	return true;
+}
@@ -0,0 +1,241 @@
+// Copyright (c) 2012- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+#include <vector>
+
+#include "../GPU/GPUState.h"
+#include "../GPU/ge_constants.h"
+#include "../GPU/GLES/Spline.h"
+#include "../GPU/GLES/VertexDecoder.h"
+#include "UnitTest.h"
+
+// Control point x only depends on the column and y only on the row. The basis functions
+// sum to one, so the tessellated x then only depends on u and y only on v.
+static float ControlX(int i) {
+	return (float)(i * i);
+}
+
+static float ControlY(int j) {
+	return (float)(j * j * j) * 0.5f - (float)j;
+}
+
+static void TessellateTestPatch(PatchMesh &mesh, const PatchDesc &desc) {
+	const u32 vtype = GE_VTYPE_POS_FLOAT;
+	std::vector<float> points(desc.ucount * desc.vcount * 3);
+	for (int j = 0; j < desc.vcount; j++) {
+		for (int i = 0; i < desc.ucount; i++) {
+			float *p = &points[(j * desc.ucount + i) * 3];
+			p[0] = ControlX(i);
+			p[1] = ControlY(j);
+			p[2] = 1.0f;
+		}
+	}
+
+	VertexDecoder dec;
+	dec.SetVertexType(vtype);
+	std::vector<u8> decoded(desc.ucount * desc.vcount * dec.GetDecVtxFmt().stride);
+	int lower, upper;
+	dec.DecodeVerts(&decoded[0], &points[0], 0, GE_PRIM_TRIANGLES, desc.ucount * desc.vcount, &lower, &upper);
+	TessellatePatch(&mesh, desc, vtype, &decoded[0], dec.GetDecVtxFmt(), 0, 0);
+}
+
+// Without color or normal, each tessellated vertex is a float uv and a float position.
+static const float *MeshPos(const PatchMesh &mesh, int i) {
+	return (const float *)&mesh.verts[i * 20 + 8];
+}
+
+static bool Close(float a, float b) {
+	return fabsf(a - b) <= 1e-4f * std::max(1.0f, fabsf(b));
+}
+
+// De Casteljau, a different way to the same cubic.
+static float BezierReference(const float p[4], float t) {
+	float a[4] = {p[0], p[1], p[2], p[3]};
+	for (int n = 3; n > 0; n--) {
+		for (int i = 0; i < n; i++)
+			a[i] = a[i] + (a[i + 1] - a[i]) * t;
+	}
+	return a[0];
+}
+
+static bool TestBezierPoints() {
+	PatchDesc desc;
+	memset(&desc, 0, sizeof(desc));
+	// Two spans across, one down.
+	desc.ucount = 7;
+	desc.vcount = 4;
+	desc.udivs = 5;
+	desc.vdivs = 3;
+	desc.prim = GE_PRIM_TRIANGLES;
+
+	PatchMesh mesh;
+	TessellateTestPatch(mesh, desc);
+	const int width = 2 * desc.udivs + 1;
+	const int height = desc.vdivs + 1;
+	EXPECT_EQ_INT(mesh.numVerts, width * height);
+	EXPECT_EQ_INT((int)mesh.indices.size(), 6 * (width - 1) * (height - 1));
+
+	for (int y = 0; y < height; y++) {
+		float py[4] = {ControlY(0), ControlY(1), ControlY(2), ControlY(3)};
+		float expectY = BezierReference(py, (float)y / desc.vdivs);
+		for (int x = 0; x < width; x++) {
+			int span = x == width - 1 ? 1 : x / desc.udivs;
+			float px[4];
+			for (int i = 0; i < 4; i++)
+				px[i] = ControlX(span * 3 + i);
+			float expectX = BezierReference(px, (float)(x - span * desc.udivs) / desc.udivs);
+
+			const float *pos = MeshPos(mesh, y * width + x);
+			if (!Close(pos[0], expectX) || !Close(pos[1], expectY) || !Close(pos[2], 1.0f)) {
+				printf("bezier point %d,%d is %f %f %f, expected %f %f 1\n", x, y, pos[0], pos[1], pos[2], expectX, expectY);
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+// A uniform cubic B-spline starts at (p0 + 4 p1 + p2) / 6. A closed end is on the control point.
+static float SplineStart(float p0, float p1, float p2, bool closed) {
+	return closed ? p0 : (p0 + 4.0f * p1 + p2) / 6.0f;
+}
+
+static bool TestSplineEnds() {
+	for (int type = 0; type < 16; type++) {
+		PatchDesc desc;
+		memset(&desc, 0, sizeof(desc));
+		desc.ucount = 6;
+		desc.vcount = 5;
+		desc.utype = type & 3;
+		desc.vtype = type >> 2;
+		desc.spline = true;
+		desc.udivs = 4;
+		desc.vdivs = 2;
+		desc.prim = GE_PRIM_TRIANGLES;
+
+		PatchMesh mesh;
+		TessellateTestPatch(mesh, desc);
+		const int width = (desc.ucount - 3) * desc.udivs + 1;
+		const int height = (desc.vcount - 3) * desc.vdivs + 1;
+		EXPECT_EQ_INT(mesh.numVerts, width * height);
+
+		const int u = desc.ucount - 1, v = desc.vcount - 1;
+		const float startX = SplineStart(ControlX(0), ControlX(1), ControlX(2), (desc.utype & 1) != 0);
+		const float endX = SplineStart(ControlX(u), ControlX(u - 1), ControlX(u - 2), (desc.utype & 2) != 0);
+		const float startY = SplineStart(ControlY(0), ControlY(1), ControlY(2), (desc.vtype & 1) != 0);
+		const float endY = SplineStart(ControlY(v), ControlY(v - 1), ControlY(v - 2), (desc.vtype & 2) != 0);
+
+		const float *first = MeshPos(mesh, 0);
+		const float *last = MeshPos(mesh, width * height - 1);
+		if (!Close(first[0], startX) || !Close(first[1], startY) || !Close(last[0], endX) || !Close(last[1], endY)) {
+			printf("spline types %d,%d: ends are %f %f and %f %f, expected %f %f and %f %f\n", desc.utype, desc.vtype,
+				first[0], first[1], last[0], last[1], startX, startY, endX, endY);
+			return false;
+		}
+
+		// Open at both ends, the knots are uniform, so every knot lands at (p0 + 4 p1 + p2) / 6.
+		if (desc.utype == 0) {
+			for (int k = 0; k < desc.ucount - 2; k++) {
+				float expect = SplineStart(ControlX(k), ControlX(k + 1), ControlX(k + 2), false);
+				float got = MeshPos(mesh, k * desc.udivs)[0];
+				if (!Close(got, expect)) {
+					printf("open spline knot %d is at %f, expected %f\n", k, got, expect);
+					return false;
+				}
+			}
+		}
+	}
+	return true;
+}
+
+static bool TestPatchIndexLimit() {
+	static const int prims[] = {GE_PRIM_TRIANGLES, GE_PRIM_LINES, GE_PRIM_POINTS};
+	for (int p = 0; p < 3; p++) {
+		PatchDesc desc;
+		memset(&desc, 0, sizeof(desc));
+		// Three spans each way, so 64 divisions make a 193x193 grid.
+		desc.ucount = 10;
+		desc.vcount = 10;
+		desc.udivs = 64;
+		desc.vdivs = 64;
+		desc.prim = prims[p];
+		LimitPatchDivisions(desc);
+
+		PatchMesh mesh;
+		TessellateTestPatch(mesh, desc);
+		EXPECT_TRUE(mesh.indices.size() <= 65536);
+		EXPECT_TRUE(mesh.numVerts <= 65536);
+		if (desc.prim == GE_PRIM_POINTS) {
+			// 37249 points fit, nothing to cut.
+			EXPECT_EQ_INT(desc.udivs, 64);
+			EXPECT_EQ_INT(desc.vdivs, 64);
+		} else {
+			// But not much less than fits.
+			EXPECT_TRUE(mesh.indices.size() > 65536 / 2);
+		}
+	}
+	return true;
+}
+
+// Weights blend like positions. With two weights equal to x and y, they have to match them.
+static bool TestPatchWeights() {
+	PatchDesc desc;
+	memset(&desc, 0, sizeof(desc));
+	desc.ucount = 4;
+	desc.vcount = 5;
+	desc.spline = true;
+	desc.udivs = 3;
+	desc.vdivs = 4;
+	desc.prim = GE_PRIM_TRIANGLES;
+
+	const u32 vtype = GE_VTYPE_POS_FLOAT | GE_VTYPE_WEIGHT_FLOAT | (1 << GE_VTYPE_WEIGHTCOUNT_SHIFT);
+	std::vector<float> points(desc.ucount * desc.vcount * 5);
+	for (int j = 0; j < desc.vcount; j++) {
+		for (int i = 0; i < desc.ucount; i++) {
+			float *p = &points[(j * desc.ucount + i) * 5];
+			p[0] = p[2] = ControlX(i);
+			p[1] = p[3] = ControlY(j);
+			p[4] = 1.0f;
+		}
+	}
+
+	VertexDecoder dec;
+	dec.SetVertexType(vtype);
+	std::vector<u8> decoded(desc.ucount * desc.vcount * dec.GetDecVtxFmt().stride);
+	int lower, upper;
+	dec.DecodeVerts(&decoded[0], &points[0], 0, GE_PRIM_TRIANGLES, desc.ucount * desc.vcount, &lower, &upper);
+	PatchMesh mesh;
+	TessellatePatch(&mesh, desc, vtype, &decoded[0], dec.GetDecVtxFmt(), 0, 0);
+
+	EXPECT_EQ_HEX(mesh.vertType & (GE_VTYPE_WEIGHT_MASK | GE_VTYPE_WEIGHTCOUNT_MASK), vtype & (GE_VTYPE_WEIGHT_MASK | GE_VTYPE_WEIGHTCOUNT_MASK));
+	EXPECT_EQ_INT((int)mesh.verts.size(), mesh.numVerts * (8 + 8 + 12));
+	for (int i = 0; i < mesh.numVerts; i++) {
+		const float *v = (const float *)&mesh.verts[i * 28];
+		if (!Close(v[0], v[4]) || !Close(v[1], v[5])) {
+			printf("patch vertex %d has weights %f %f at %f %f\n", i, v[0], v[1], v[4], v[5]);
+			return false;
+		}
+	}
+	return true;
+}
+
+bool TestSpline() {
+	return TestBezierPoints() && TestSplineEnds() && TestPatchIndexLimit() && TestPatchWeights();
+}
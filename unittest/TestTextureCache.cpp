@@ -0,0 +1,406 @@
+// Copyright (c) 2012- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+#include "base/basictypes.h"
+#include "Timer.h"
+#include "../Core/MemMap.h"
+#include "../GPU/GPUState.h"
+#include "../GPU/ge_constants.h"
+#include "../GPU/GLES/TextureCache.h"
+#include "UnitTest.h"
+
+static const u32 TEST_TEX_ADDR = 0x08800000;
+static const u32 TEST_CLUT_ADDR = 0x08700000;
+
+static const int bitsPerTexel[8] = {16, 16, 16, 32, 4, 8, 16, 32};
+
+static void FillMemory(u32 addr, u32 size, u32 seed) {
+	u8 *p = Memory::GetPointer(addr);
+	for (u32 i = 0; i < size; i++) {
+		seed = seed * 1103515245 + 12345;
+		p[i] = (u8)(seed >> 16);
+	}
+}
+
+static void SetupTexture(u32 format, bool swizzled, int wlog, int hlog, int bufw, u32 clutformat) {
+	gstate.texaddr[0] = TEST_TEX_ADDR & 0xFFFFF0;
+	gstate.texbufwidth[0] = ((TEST_TEX_ADDR >> 8) & 0xFF0000) | bufw;
+	gstate.texsize[0] = wlog | (hlog << 8);
+	gstate.texformat = format;
+	gstate.texmode = swizzled ? 1 : 0;
+	gstate.clutaddr = TEST_CLUT_ADDR & 0xFFFFFF;
+	gstate.clutaddrupper = (TEST_CLUT_ADDR >> 8) & 0xFF0000;
+	gstate.clutformat = clutformat;
+	// 512 entries for 16-bit cluts, 256 for 32-bit ones.
+	gstate.loadclut = 32;
+}
+
+// Reads one texel the slow way, following the swizzle pattern one texel at a time.
+static u32 ReadTexel(u32 format, bool swizzled, int bufw, int x, int y) {
+	const int bits = bitsPerTexel[format];
+	const u32 rowBytes = bufw * bits / 8;
+	const u32 xb = x * bits / 8;
+	u32 offset;
+	if (swizzled) {
+		// 16 byte x 8 row blocks. Rows narrower than a block still take up all 16 bytes.
+		u32 blocksPerRow = rowBytes < 16 ? 1 : rowBytes / 16;
+		offset = ((y / 8) * blocksPerRow + xb / 16) * 128 + (y % 8) * 16 + xb % 16;
+	} else {
+		offset = y * rowBytes + xb;
+	}
+
+	const u32 addr = TEST_TEX_ADDR + offset;
+	switch (bits) {
+	case 4:
+		return (x & 1) ? Memory::Read_U8(addr) >> 4 : Memory::Read_U8(addr) & 0xF;
+	case 8:
+		return Memory::Read_U8(addr);
+	case 16:
+		return Memory::Read_U16(addr);
+	default:
+		return Memory::Read_U32(addr);
+	}
+}
+
+// PSP colors have red in the low bits, GL packed formats have it in the high bits.
+static u32 ConvertColor(u32 c, u32 pspFormat) {
+	switch (pspFormat) {
+	case GE_CMODE_16BIT_BGR5650:
+		return ((c & 0x1F) << 11) | (c & 0x7E0) | ((c >> 11) & 0x1F);
+	case GE_CMODE_16BIT_ABGR5551:
+		return ((c & 0x1F) << 11) | (((c >> 5) & 0x1F) << 6) | (((c >> 10) & 0x1F) << 1) | ((c >> 15) & 1);
+	case GE_CMODE_16BIT_ABGR4444:
+		return ((c & 0xF) << 12) | (((c >> 4) & 0xF) << 8) | (((c >> 8) & 0xF) << 4) | ((c >> 12) & 0xF);
+	default:
+		return c;
+	}
+}
+
+// Decodes texel by texel, the way the texture cache did before it had block and SIMD kernels.
+static void ReferenceDecode(std::vector<u32> &out, u32 format, bool swizzled, int w, int h, int bufw, u32 clutformat) {
+	const bool indexed = format >= GE_TFMT_CLUT4;
+	const u32 clutFmt = clutformat & 3;
+	const u32 clutShift = (clutformat >> 2) & 0x1F;
+	const u32 clutMask = (clutformat >> 8) & 0xFF;
+
+	out.resize(w * h);
+	for (int y = 0; y < h; y++) {
+		for (int x = 0; x < w; x++) {
+			u32 texel = ReadTexel(format, swizzled, bufw, x, y);
+			u32 color;
+			if (indexed) {
+				u32 entry = (texel >> clutShift) & clutMask;
+				if (clutFmt == GE_CMODE_32BIT_ABGR8888)
+					color = Memory::Read_U32(TEST_CLUT_ADDR + entry * 4);
+				else
+					color = ConvertColor(Memory::Read_U16(TEST_CLUT_ADDR + entry * 2), clutFmt);
+			} else {
+				// The direct 16-bit formats are numbered like the palette formats.
+				color = ConvertColor(texel, format);
+			}
+			out[y * w + x] = color;
+		}
+	}
+}
+
+static int DecodedPixelSize(u32 format, u32 clutformat) {
+	if (format >= GE_TFMT_CLUT4)
+		return (clutformat & 3) == GE_CMODE_32BIT_ABGR8888 ? 4 : 2;
+	return format == GE_TFMT_8888 ? 4 : 2;
+}
+
+static bool CheckDecode(u32 format, bool swizzled, int wlog, int hlog, int bufw, u32 clutformat) {
+	SetupTexture(format, swizzled, wlog, hlog, bufw, clutformat);
+
+	u32 dstFmt, texByteAlign;
+	int w, h;
+	const u8 *decoded = (const u8 *)TextureCache_DecodeLevel(0, dstFmt, w, h, texByteAlign);
+	EXPECT_TRUE(decoded != NULL);
+	EXPECT_EQ_INT(w, 1 << wlog);
+	EXPECT_EQ_INT(h, 1 << hlog);
+
+	std::vector<u32> expected;
+	ReferenceDecode(expected, format, swizzled, w, h, bufw, clutformat);
+	const int pixelSize = DecodedPixelSize(format, clutformat);
+	for (int i = 0; i < w * h; i++) {
+		u32 actual = pixelSize == 4 ? ((const u32 *)decoded)[i] : ((const u16 *)decoded)[i];
+		if (actual != expected[i]) {
+			printf("format %d clut %08x swizzle %d %dx%d bufw %d: texel %d,%d is %08x, expected %08x\n",
+				format, clutformat, swizzled, w, h, bufw, i % w, i / w, actual, expected[i]);
+			return false;
+		}
+	}
+	return true;
+}
+
+// Runs every non-DXT format through the texture cache's decoder and checks it texel by texel.
+bool TestTextureDecode() {
+	Memory::Init();
+	TextureCache_Init();
+	FillMemory(TEST_TEX_ADDR, 0x100000, 1);
+	FillMemory(TEST_CLUT_ADDR, 0x1000, 2);
+
+	struct Size {
+		int wlog, hlog, bufw;
+	};
+	// Square, narrower than the buffer, and a swizzled row narrower than a block for 16-bit.
+	static const Size sizes[] = {{6, 5, 64}, {5, 4, 64}, {3, 3, 16}, {2, 4, 4}};
+	// Shift and mask combinations, the palette format is or'd in.
+	static const u32 clutModes[] = {0x0000FF00, 0x00003F04, 0x00000F08, 0x00007F00};
+
+	bool passed = true;
+	for (int s = 0; s < (int)ARRAY_SIZE(sizes) && passed; s++) {
+		const Size &size = sizes[s];
+		for (int swizzled = 0; swizzled < 2 && passed; swizzled++) {
+			for (u32 format = GE_TFMT_5650; format <= GE_TFMT_8888 && passed; format++)
+				passed = CheckDecode(format, swizzled != 0, size.wlog, size.hlog, size.bufw, 0);
+			for (u32 format = GE_TFMT_CLUT4; format <= GE_TFMT_CLUT32 && passed; format++) {
+				for (u32 clutFmt = 0; clutFmt < 4 && passed; clutFmt++) {
+					for (int m = 0; m < (int)ARRAY_SIZE(clutModes) && passed; m++)
+						passed = CheckDecode(format, swizzled != 0, size.wlog, size.hlog, size.bufw, clutModes[m] | clutFmt);
+				}
+			}
+		}
+	}
+
+	TextureCache_Shutdown();
+	Memory::Shutdown();
+	return passed;
+}
+
+// Decodes with the given number of helper threads, and keeps a copy of the result.
+static bool DecodeCopy(std::vector<u8> &out, int numThreads, u32 format, u32 clutformat) {
+	TextureCache_SetDecodeThreads(numThreads);
+	u32 dstFmt, texByteAlign;
+	int w, h;
+	const u8 *decoded = (const u8 *)TextureCache_DecodeLevel(0, dstFmt, w, h, texByteAlign);
+	EXPECT_TRUE(decoded != NULL);
+	out.assign(decoded, decoded + w * h * DecodedPixelSize(format, clutformat));
+	return true;
+}
+
+// Large textures are decoded in stripes on several threads. The result must match
+// decoding the whole texture on one thread, byte for byte.
+bool TestTextureDecodeThreaded() {
+	Memory::Init();
+	TextureCache_Init();
+	FillMemory(TEST_TEX_ADDR, 0x200000, 3);
+	FillMemory(TEST_CLUT_ADDR, 0x1000, 4);
+
+	struct Case {
+		u32 format, clutformat;
+		int wlog, hlog, bufw;
+	};
+	// Stripe counts that the threads can't share evenly, and a texture narrower than its buffer.
+	static const Case cases[] = {
+		{GE_TFMT_8888, 0, 9, 9, 512},
+		{GE_TFMT_4444, 0, 9, 9, 512},
+		{GE_TFMT_5650, 0, 8, 9, 512},
+		{GE_TFMT_CLUT4, 0x0000FF00 | GE_CMODE_16BIT_ABGR5551, 9, 9, 512},
+		{GE_TFMT_CLUT8, 0x0000FF00 | GE_CMODE_32BIT_ABGR8888, 9, 8, 512},
+		{GE_TFMT_CLUT16, 0x00003F04 | GE_CMODE_16BIT_BGR5650, 8, 9, 256},
+		{GE_TFMT_CLUT32, 0x0000FF00 | GE_CMODE_16BIT_ABGR4444, 9, 8, 512},
+	};
+	static const int threadCounts[] = {1, 2, 3, 7};
+
+	bool passed = true;
+	std::vector<u8> serial, threaded;
+	for (int i = 0; i < (int)ARRAY_SIZE(cases) && passed; i++) {
+		const Case &c = cases[i];
+		for (int swizzled = 0; swizzled < 2 && passed; swizzled++) {
+			SetupTexture(c.format, swizzled != 0, c.wlog, c.hlog, c.bufw, c.clutformat);
+			passed = DecodeCopy(serial, 0, c.format, c.clutformat);
+			for (int t = 0; t < (int)ARRAY_SIZE(threadCounts) && passed; t++) {
+				passed = DecodeCopy(threaded, threadCounts[t], c.format, c.clutformat);
+				if (passed && threaded != serial) {
+					printf("format %d swizzle %d with %d threads differs from the serial decode\n", c.format, swizzled, threadCounts[t]);
+					passed = false;
+				}
+			}
+		}
+	}
+
+	TextureCache_Shutdown();
+	Memory::Shutdown();
+	return passed;
+}
+
+// Sets up levels 1-7 after the level 0 SetupTexture made, each halving the last.
+static void SetupMipChain(int maxLevel) {
+	const int wlog = gstate.texsize[0] & 0xf;
+	const int hlog = (gstate.texsize[0] >> 8) & 0xf;
+	gstate.texmode = (gstate.texmode & ~0x70000) | (maxLevel << 16);
+	for (int level = 1; level < 8; level++) {
+		u32 addr = TEST_TEX_ADDR + level * 0x40000;
+		int lw = std::max(wlog - level, 0);
+		int lh = std::max(hlog - level, 0);
+		gstate.texaddr[level] = addr & 0xFFFFF0;
+		gstate.texbufwidth[level] = ((addr >> 8) & 0xFF0000) | std::max(1 << lw, 4);
+		gstate.texsize[level] = lw | (lh << 8);
+	}
+}
+
+#ifdef USING_GLES2
+// Without GL_TEXTURE_MAX_LEVEL, only chains that reach 1x1 can be used.
+#define EXPECT_MIP_LEVELS(format, full, partial) EXPECT_EQ_INT(TextureCache_UsableMipLevels(format), full ? partial : 0)
+#else
+#define EXPECT_MIP_LEVELS(format, full, partial) EXPECT_EQ_INT(TextureCache_UsableMipLevels(format), partial)
+#endif
+
+static bool TestMipLevelCounts() {
+	// A chain that stops before 1x1.
+	SetupTexture(GE_TFMT_8888, false, 6, 5, 64, 0);
+	SetupMipChain(0);
+	EXPECT_MIP_LEVELS(GE_TFMT_8888, false, 0);
+	SetupMipChain(3);
+	EXPECT_MIP_LEVELS(GE_TFMT_8888, false, 3);
+
+	// Each level must halve the last, down to a minimum of 1.
+	SetupTexture(GE_TFMT_5551, false, 3, 2, 8, 0);
+	SetupMipChain(3);
+	EXPECT_MIP_LEVELS(GE_TFMT_5551, true, 3);
+	// Levels past 1x1 are dropped.
+	SetupMipChain(7);
+	EXPECT_MIP_LEVELS(GE_TFMT_5551, true, 3);
+
+	SetupTexture(GE_TFMT_8888, false, 8, 8, 256, 0);
+	SetupMipChain(7);
+	EXPECT_MIP_LEVELS(GE_TFMT_8888, false, 7);
+
+	// The chain ends at the first level with the wrong size, or a bad address.
+	SetupTexture(GE_TFMT_8888, false, 6, 5, 64, 0);
+	SetupMipChain(3);
+	gstate.texsize[2] = 4 | (4 << 8);
+	EXPECT_MIP_LEVELS(GE_TFMT_8888, false, 1);
+	SetupMipChain(3);
+	gstate.texaddr[2] = 0;
+	gstate.texbufwidth[2] = 16;
+	EXPECT_MIP_LEVELS(GE_TFMT_8888, false, 1);
+
+	// DXT levels below 4x4 would be padded, so they end the chain.
+	SetupTexture(GE_TFMT_DXT1, false, 4, 4, 16, 0);
+	SetupMipChain(4);
+	EXPECT_MIP_LEVELS(GE_TFMT_DXT1, false, 2);
+	return true;
+}
+
+// Each level decodes from its own address at its own size.
+static bool TestMipLevelDecode() {
+	SetupTexture(GE_TFMT_CLUT8, true, 6, 5, 64, 0x0000FF00 | GE_CMODE_16BIT_ABGR4444);
+	SetupMipChain(3);
+	for (int level = 0; level <= 3; level++) {
+		u32 dstFmt, texByteAlign;
+		int w, h;
+		EXPECT_TRUE(TextureCache_DecodeLevel(level, dstFmt, w, h, texByteAlign) != NULL);
+		EXPECT_EQ_INT(w, 64 >> level);
+		EXPECT_EQ_INT(h, 32 >> level);
+	}
+	return true;
+}
+
+// Changes to any used level change the hash, and the range covers all of them.
+static bool TestMipLevelHash() {
+	SetupTexture(GE_TFMT_8888, false, 6, 6, 64, 0);
+	SetupMipChain(3);
+	u32 mipaddr, mipsize;
+	u64 hash = TextureCache_HashMipLevels(GE_TFMT_8888, 3, mipaddr, mipsize);
+	EXPECT_EQ_HEX(mipaddr, TEST_TEX_ADDR + 0x40000);
+	// Level 3 is 8x8 at 32 bits.
+	EXPECT_EQ_HEX(mipsize, 2 * 0x40000 + 8 * 8 * 4);
+
+	u32 mipaddr2, mipsize2;
+	EXPECT_TRUE(TextureCache_HashMipLevels(GE_TFMT_8888, 0, mipaddr2, mipsize2) != hash);
+	EXPECT_EQ_INT(mipsize2, 0);
+
+	// Past the end of level 3, so not part of the texture.
+	u32 unused = TEST_TEX_ADDR + 3 * 0x40000 + 8 * 8 * 4;
+	Memory::Write_U32(Memory::Read_U32(unused) ^ 1, unused);
+	EXPECT_TRUE(TextureCache_HashMipLevels(GE_TFMT_8888, 3, mipaddr2, mipsize2) == hash);
+
+	u32 lastTexel = unused - 4;
+	Memory::Write_U32(Memory::Read_U32(lastTexel) ^ 1, lastTexel);
+	EXPECT_TRUE(TextureCache_HashMipLevels(GE_TFMT_8888, 3, mipaddr2, mipsize2) != hash);
+	Memory::Write_U32(Memory::Read_U32(lastTexel) ^ 1, lastTexel);
+	EXPECT_TRUE(TextureCache_HashMipLevels(GE_TFMT_8888, 3, mipaddr2, mipsize2) == hash);
+
+	// Same contents, somewhere else.
+	u32 level1 = TEST_TEX_ADDR + 0x40000;
+	memcpy(Memory::GetPointer(level1 + 0x20000), Memory::GetPointer(level1), 32 * 32 * 4);
+	gstate.texaddr[1] = (level1 + 0x20000) & 0xFFFFF0;
+	EXPECT_TRUE(TextureCache_HashMipLevels(GE_TFMT_8888, 3, mipaddr2, mipsize2) != hash);
+	return true;
+}
+
+bool TestTextureMipLevels() {
+	Memory::Init();
+	TextureCache_Init();
+	FillMemory(TEST_TEX_ADDR, 0x200000, 5);
+	FillMemory(TEST_CLUT_ADDR, 0x1000, 6);
+
+	bool passed = TestMipLevelCounts() && TestMipLevelDecode() && TestMipLevelHash();
+
+	TextureCache_Shutdown();
+	Memory::Shutdown();
+	return passed;
+}
+
+static void TimeDecode(const char *name, u32 format, bool swizzled, u32 clutformat) {
+	// Below the size that gets split across threads, so this is the kernels alone.
+	const int wlog = 8, hlog = 7, bufw = 256;
+	const int reps = 200;
+	SetupTexture(format, swizzled, wlog, hlog, bufw, clutformat);
+
+	u32 dstFmt, texByteAlign;
+	int w, h;
+	u32 start = Common::Timer::GetTimeMs();
+	for (int i = 0; i < reps; i++)
+		TextureCache_DecodeLevel(0, dstFmt, w, h, texByteAlign);
+	u32 fastMs = Common::Timer::GetTimeMs() - start;
+
+	std::vector<u32> out;
+	start = Common::Timer::GetTimeMs();
+	for (int i = 0; i < reps; i++)
+		ReferenceDecode(out, format, swizzled, 1 << wlog, 1 << hlog, bufw, clutformat);
+	u32 slowMs = Common::Timer::GetTimeMs() - start;
+
+	double pixels = (double)reps * (1 << wlog) * (1 << hlog);
+	printf("  %-16s decoder: %4u ms (%.1f ns/texel)  per texel: %4u ms (%.1f ns/texel)\n", name,
+		fastMs, fastMs * 1000000.0 / pixels, slowMs, slowMs * 1000000.0 / pixels);
+}
+
+// Times the texture cache's decoder against texel by texel decoding.
+bool BenchTextureDecode() {
+	Memory::Init();
+	TextureCache_Init();
+	FillMemory(TEST_TEX_ADDR, 0x100000, 1);
+	FillMemory(TEST_CLUT_ADDR, 0x1000, 2);
+
+	TimeDecode("5650", GE_TFMT_5650, false, 0);
+	TimeDecode("4444 swizzled", GE_TFMT_4444, true, 0);
+	TimeDecode("8888 swizzled", GE_TFMT_8888, true, 0);
+	TimeDecode("CLUT4 5551", GE_TFMT_CLUT4, true, 0x0000FF00 | GE_CMODE_16BIT_ABGR5551);
+	TimeDecode("CLUT8 8888", GE_TFMT_CLUT8, true, 0x0000FF00 | GE_CMODE_32BIT_ABGR8888);
+	TimeDecode("CLUT16 565", GE_TFMT_CLUT16, false, 0x0000FF00 | GE_CMODE_16BIT_BGR5650);
+
+	TextureCache_Shutdown();
+	Memory::Shutdown();
+	return true;
+}
@@ -0,0 +1,134 @@
+// Copyright (c) 2012- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#include <string.h>
+
+#include "../GPU/GPUState.h"
+#include "../GPU/ge_constants.h"
+#include "../GPU/GLES/VertexDecoder.h"
+#include "UnitTest.h"
+
+#if defined(_M_IX86) || defined(_M_X64)
+
+static const int TEST_VERTS = 37;
+// Big enough for the largest vertex: 8 float weights, float uv, color, normal and position.
+static const int MAX_VERTEX_SIZE = 8 * 4 + 8 + 4 + 12 + 12;
+static const int MAX_DECODED_SIZE = 8 * 4 + 8 + 4 + 12 + 12;
+
+// Random, but never NaN or infinity when read as a float, so both decoders copy them alike.
+static void FillVertexData(u8 *data, int size, u32 seed) {
+	u32 *words = (u32 *)data;
+	for (int i = 0; i < size / 4; i++) {
+		seed = seed * 1103515245 + 12345;
+		words[i] = (seed >> 1) & ~0x40000000;
+		seed = seed * 1103515245 + 12345;
+		words[i] ^= seed << 16;
+		words[i] &= ~0x40000000;
+	}
+}
+
+static bool SameField(const VertexDecoder &dec, const char *what, u8 fmt, u8 off, const u8 *interp, const u8 *jit) {
+	if (fmt == DEC_NONE)
+		return true;
+	for (int v = 0; v < TEST_VERTS; v++) {
+		const int pos = v * dec.decFmt.stride + off;
+		if (memcmp(interp + pos, jit + pos, DecFmtSize(fmt)) != 0) {
+			printf("vtype %06x: %s of vertex %d differs\n", dec.VertexType(), what, v);
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool CompareDecoded(const VertexDecoder &dec, const u8 *interp, const u8 *jit) {
+	const DecVtxFormat &fmt = dec.decFmt;
+	return SameField(dec, "weights 0-3", fmt.w0fmt, fmt.w0off, interp, jit)
+		&& SameField(dec, "weights 4-7", fmt.w1fmt, fmt.w1off, interp, jit)
+		&& SameField(dec, "uv", fmt.uvfmt, fmt.uvoff, interp, jit)
+		&& SameField(dec, "color", fmt.c0fmt, fmt.c0off, interp, jit)
+		&& SameField(dec, "normal", fmt.nrmfmt, fmt.nrmoff, interp, jit)
+		&& SameField(dec, "position", fmt.posfmt, fmt.posoff, interp, jit);
+}
+
+// Decodes every unmorphed, unindexed vertex format with both decoders and compares the output.
+bool TestVertexDecoderJit() {
+	static const int colorFormats[] = {0, 4, 5, 6, 7};
+
+	VertexDecoderJitCache jitCache;
+	u8 *src = new u8[TEST_VERTS * MAX_VERTEX_SIZE];
+	u8 *interpOut = new u8[TEST_VERTS * MAX_DECODED_SIZE];
+	u8 *jitOut = new u8[TEST_VERTS * MAX_DECODED_SIZE];
+	FillVertexData(src, TEST_VERTS * MAX_VERTEX_SIZE, 1);
+
+	gstate_c.curTextureWidth = 256;
+	gstate_c.curTextureHeight = 64;
+
+	int tested = 0;
+	int notJitted = 0;
+	int failed = 0;
+	for (int reverse = 0; reverse < 2; reverse++) {
+		gstate.reversenormals = reverse;
+		for (u32 through = 0; through < 2; through++)
+		for (u32 weight = 0; weight < 4; weight++)
+		for (u32 nweights = 0; nweights < (weight ? 8u : 1u); nweights++)
+		for (u32 tc = 0; tc < 4; tc++)
+		for (int c = 0; c < (int)ARRAY_SIZE(colorFormats); c++)
+		for (u32 nrm = 0; nrm < 4; nrm++)
+		for (u32 pos = 1; pos < 4; pos++) {
+			u32 vtype = (through ? GE_VTYPE_THROUGH : 0) | (weight << 9) | (nweights << 14)
+				| tc | (colorFormats[c] << 2) | (nrm << 5) | (pos << 7);
+
+			if (jitCache.IsFull())
+				jitCache.Clear();
+			VertexDecoder interpDec, jitDec;
+			interpDec.SetVertexType(vtype);
+			jitDec.SetVertexType(vtype, &jitCache);
+			tested++;
+			if (!jitDec.jitted_) {
+				notJitted++;
+				continue;
+			}
+
+			// Same fill in both, so untouched padding can't make a difference.
+			memset(interpOut, 0xCD, TEST_VERTS * MAX_DECODED_SIZE);
+			memset(jitOut, 0xCD, TEST_VERTS * MAX_DECODED_SIZE);
+			int lower, upper;
+			interpDec.DecodeVerts(interpOut, src, 0, GE_PRIM_TRIANGLES, TEST_VERTS, &lower, &upper);
+			jitDec.DecodeVerts(jitOut, src, 0, GE_PRIM_TRIANGLES, TEST_VERTS, &lower, &upper);
+			if (!CompareDecoded(interpDec, interpOut, jitOut))
+				failed++;
+		}
+	}
+
+	delete [] src;
+	delete [] interpOut;
+	delete [] jitOut;
+
+	printf("%d vertex formats, %d not jitted, %d differ\n", tested, notJitted, failed);
+	EXPECT_EQ_INT(notJitted, 0);
+	EXPECT_EQ_INT(failed, 0);
+	return true;
+}
+
+#else
+
+bool TestVertexDecoderJit() {
+	printf("Only x86 has a vertex decoder JIT.\n");
+	return true;
+}
+
+#endif
@@ -0,0 +1,93 @@
+// Copyright (c) 2012- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+// Unit tests and microbenchmarks for pieces of the core that can run without a game.
+// With no arguments, runs all the tests. Otherwise runs the named tests and benchmarks.
+
+#include <string.h>
+
+#include "base/basictypes.h"
+#include "../Core/Config.h"
+#include "../Core/Host.h"
+#include "../headless/StubHost.h"
+#include "LogManager.h"
+#include "UnitTest.h"
+
+struct TestItem {
+	const char *name;
+	bool (*func)();
+	bool benchmark;
+};
+
+static const TestItem availableTests[] = {
+	{"CoreTiming", &TestCoreTiming, false},
+	{"FastInterpreter", &TestFastInterpreter, false},
+	{"GPUThread", &TestGPUThread, false},
+	{"JitBlockLinks", &TestJitBlockLinks, false},
+	{"JitVFPU", &TestJitVFPU, false},
+	{"VertexDecoderJit", &TestVertexDecoderJit, false},
+	{"TextureDecode", &TestTextureDecode, false},
+	{"TextureDecodeThreaded", &TestTextureDecodeThreaded, false},
+	{"TextureMipLevels", &TestTextureMipLevels, false},
+	{"SoftwareTransform", &TestSoftwareTransform, false},
+	{"Spline", &TestSpline, false},
+	{"CoreTimingSchedule", &BenchCoreTimingSchedule, true},
+	{"FastInterpreterSpeed", &BenchFastInterpreter, true},
+	{"JitBlockLookup", &BenchJitBlockLookup, true},
+	{"TextureDecodeSpeed", &BenchTextureDecode, true},
+	{"SoftwareTransformSpeed", &BenchSoftwareTransform, true},
+};
+
+static bool RunTest(const TestItem &test) {
+	printf("%s %s...\n", test.benchmark ? "Timing" : "Testing", test.name);
+	bool passed = test.func();
+	printf("%s: %s\n", test.name, passed ? "OK" : "FAILED");
+	return passed;
+}
+
+int main(int argc, const char *argv[]) {
+	host = new HeadlessHost();
+	LogManager::Init();
+
+	int failed = 0;
+	if (argc <= 1) {
+		for (size_t i = 0; i < ARRAY_SIZE(availableTests); i++) {
+			if (!availableTests[i].benchmark && !RunTest(availableTests[i]))
+				failed++;
+		}
+	} else {
+		for (int arg = 1; arg < argc; arg++) {
+			bool found = false;
+			for (size_t i = 0; i < ARRAY_SIZE(availableTests); i++) {
+				if (!strcmp(argv[arg], availableTests[i].name)) {
+					found = true;
+					if (!RunTest(availableTests[i]))
+						failed++;
+				}
+			}
+			if (!found) {
+				printf("Unknown test %s\n", argv[arg]);
+				failed++;
+			}
+		}
+	}
+
+	LogManager::Shutdown();
+	delete host;
+	host = NULL;
+	return failed == 0 ? 0 : 1;
+}
@@ -0,0 +1,45 @@
+// Copyright (c) 2012- PPSSPP Project.
+
+// This program is free software: you can redistribute it and/or modify
+// it under the terms of the GNU General Public License as published by
+// the Free Software Foundation, version 2.0 or later versions.
+
+// This program is distributed in the hope that it will be useful,
+// but WITHOUT ANY WARRANTY; without even the implied warranty of
+// MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+// GNU General Public License 2.0 for more details.
+
+// A copy of the GPL 2.0 should have been included with the program.
+// If not, see http://www.gnu.org/licenses/
+
+// Official git repository and contact information can be found at
+// https://github.com/hrydgard/ppsspp and http://www.ppsspp.org/.
+
+#pragma once
+
+#include <stdio.h>
+
+#define EXPECT_TRUE(a) if (!(a)) { printf("%s:%i: Test fail: %s\n", __FUNCTION__, __LINE__, #a); return false; }
+#define EXPECT_FALSE(a) if ((a)) { printf("%s:%i: Test fail: not %s\n", __FUNCTION__, __LINE__, #a); return false; }
+#define EXPECT_EQ_INT(a, b) if ((a) != (b)) { printf("%s:%i: Test fail: %s (%d) == %s (%d)\n", __FUNCTION__, __LINE__, #a, (int)(a), #b, (int)(b)); return false; }
+#define EXPECT_EQ_HEX(a, b) if ((a) != (b)) { printf("%s:%i: Test fail: %s (%08x) == %s (%08x)\n", __FUNCTION__, __LINE__, #a, (unsigned)(a), #b, (unsigned)(b)); return false; }
+#define EXPECT_APPROX(a, b, eps) if (fabsf((float)(a) - (float)(b)) > (eps)) { printf("%s:%i: Test fail: %s (%f) ~= %s (%f)\n", __FUNCTION__, __LINE__, #a, (float)(a), #b, (float)(b)); return false; }
+
+bool TestCoreTiming();
+bool TestFastInterpreter();
+bool TestGPUThread();
+bool TestJitBlockLinks();
+bool TestJitVFPU();
+bool TestVertexDecoderJit();
+bool TestTextureDecode();
+bool TestTextureDecodeThreaded();
+bool TestTextureMipLevels();
+bool TestSoftwareTransform();
+bool TestSpline();
+
+// Benchmarks only print timings, they don't fail. Run them by name.
+bool BenchCoreTimingSchedule();
+bool BenchFastInterpreter();
+bool BenchJitBlockLookup();
+bool BenchTextureDecode();
+bool BenchSoftwareTransform();